@@ -0,0 +1,570 @@
+// ========================================
+// psblend_bench: 每种混合模式的吞吐量测试.
+// 行宽 (HD / 4K / 8K) x 数据分布 x 线程数 x 指令集, 输出 Mpix/s 和 ns/pixel,
+// --json 写出机器可读的结果, 方便不同版本之间对比.
+//
+//   psblend_bench [--modes multiply,softLight] [--widths 1920,3840,7680]
+//                 [--dists uniform,zero,one,edges,solid] [--threads 1,8]
+//                 [--simd active|all|scalar,avx2] [--rows 256] [--min-time 0.2]
+//                 [--const-b on|off] [--api rows|image] [--pin on|off]
+//                 [--math legacy|clamped|hdr] [--soft-light exact|accurate] [--expr <formula>]
+//                 [--json out.json]
+// 一个像素 = R/G/B 三个通道, 可分离模式对每个通道各调用一次行内核.
+// solid: B 每个通道是一个常数 (纯色层), 默认用常数 B 内核, --const-b off 改用普通内核对比.
+// --api image: 整帧 (宽 x 宽*9/16) 交给 blend_image, 用 --threads 个线程的任务窃取池,
+// 看 tile 调度随线程数的扩展; 这时 --simd 不起作用, 总是用检测到的指令集.
+// --math clamped / hdr 测 0..1 域的内核, 与默认的 legacy (0..255) 对比缩放的开销.
+// --soft-light accurate 测柔光的 accurate 内核 (psSoftLight.inl), 其它模式不受影响.
+// custom 模式求值 --expr 的公式, 默认是写成公式的叠加 (clamped), 可以和内置的 overlay 直接对比.
+// ========================================
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <ctime>
+#include <random>
+#include <string>
+#include <thread>
+#include <vector>
+#include "psBlend.h"
+#include "psExpr.h"
+#include "psImage.h"
+#include "psThreadPool.h"
+
+using namespace photoshopMergeTool;
+
+namespace {
+
+	struct Options {
+		std::vector<int> modes;
+		std::vector<int> widths;
+		std::vector<std::string> dists;
+		std::vector<int> threads;
+		std::vector<SimdLevel> levels;
+		int rows;
+		double min_time;
+		bool const_b;
+		bool image_api;
+		bool pin;
+		BlendMath math;
+		SoftLightPrecision soft_light;
+		// custom 模式的公式, parse_args 里编译
+		BlendExpr expr;
+		std::string json;
+	};
+
+	struct Result {
+		std::string mode;
+		std::string dist;
+		std::string simd;
+		int width;
+		int threads;
+		double mpix_per_s;
+		double ns_per_pixel;
+	};
+
+	std::vector<std::string> split(const char* s)
+	{
+		std::vector<std::string> out;
+		std::string cur;
+		for (; *s; s++) {
+			if (*s == ',') {
+				if (!cur.empty())
+					out.push_back(cur);
+				cur.clear();
+			}
+			else
+				cur += *s;
+		}
+		if (!cur.empty())
+			out.push_back(cur);
+		return out;
+	}
+
+	int mode_from_name(const std::string& name)
+	{
+		for (int m = 0; blendModeNames[m]; m++) {
+			if (name == blendModeNames[m])
+				return m;
+		}
+		return -1;
+	}
+
+	int math_from_name(const std::string& name)
+	{
+		for (int m = 0; blendMathNames[m]; m++) {
+			if (name == blendMathNames[m])
+				return m;
+		}
+		return -1;
+	}
+
+	int soft_light_from_name(const std::string& name)
+	{
+		for (int p = 0; softLightPrecisionNames[p]; p++) {
+			if (name == softLightPrecisionNames[p])
+				return p;
+		}
+		return -1;
+	}
+
+	bool level_from_name(const std::string& name, SimdLevel* level)
+	{
+		for (int l = SimdScalar; l <= SimdAVX512; l++) {
+			if (name == simd_level_name((SimdLevel)l)) {
+				*level = (SimdLevel)l;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	void usage()
+	{
+		fprintf(stderr,
+			"usage: psblend_bench [--modes m1,m2] [--widths 1920,3840,7680] [--dists uniform,zero,one,edges,solid]\n"
+			"                     [--threads 1,N] [--simd active|all|scalar,sse41,avx2,avx512]\n"
+			"                     [--rows 256] [--min-time 0.2] [--const-b on|off] [--api rows|image]\n"
+			"                     [--pin on|off] [--math legacy|clamped|hdr] [--soft-light exact|accurate]\n"
+			"                     [--expr <formula>] [--json out.json]\n");
+	}
+
+	bool parse_args(int argc, char** argv, Options* opt)
+	{
+		int hw = (int)std::thread::hardware_concurrency();
+		opt->widths = { 1920, 3840, 7680 };
+		opt->dists = { "uniform", "zero", "one", "edges" };
+		opt->threads = { 1 };
+		if (hw > 1)
+			opt->threads.push_back(hw);
+		opt->levels = { simd_level() };
+		opt->rows = 256;
+		opt->min_time = 0.2;
+		opt->const_b = true;
+		opt->image_api = false;
+		opt->pin = false;
+		opt->math = MathLegacy;
+		opt->soft_light = SoftLightExact;
+		std::string expr = "clamp(a <= 0.5 ? 2*a*b : 1 - 2*(1-a)*(1-b))";
+		for (int m = 0; blendModeNames[m]; m++)
+			opt->modes.push_back(m);
+
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			if (i + 1 >= argc) {
+				usage();
+				return false;
+			}
+			const char* val = argv[++i];
+			if (arg == "--modes") {
+				opt->modes.clear();
+				for (const std::string& s : split(val)) {
+					int m = mode_from_name(s);
+					if (m < 0) {
+						fprintf(stderr, "unknown mode '%s'\n", s.c_str());
+						return false;
+					}
+					opt->modes.push_back(m);
+				}
+			}
+			else if (arg == "--widths") {
+				opt->widths.clear();
+				for (const std::string& s : split(val))
+					opt->widths.push_back(std::max(1, atoi(s.c_str())));
+			}
+			else if (arg == "--dists") {
+				opt->dists = split(val);
+			}
+			else if (arg == "--threads") {
+				opt->threads.clear();
+				for (const std::string& s : split(val))
+					opt->threads.push_back(std::max(1, atoi(s.c_str())));
+			}
+			else if (arg == "--simd") {
+				opt->levels.clear();
+				std::string v = val;
+				if (v == "active")
+					opt->levels.push_back(simd_level());
+				else if (v == "all") {
+					for (int l = SimdScalar; l <= simd_level(); l++)
+						opt->levels.push_back((SimdLevel)l);
+				}
+				else {
+					for (const std::string& s : split(val)) {
+						SimdLevel level;
+						if (!level_from_name(s, &level)) {
+							fprintf(stderr, "unknown simd level '%s'\n", s.c_str());
+							return false;
+						}
+						if (level > simd_level()) {
+							fprintf(stderr, "simd level '%s' is not supported on this CPU, skipped\n", s.c_str());
+							continue;
+						}
+						opt->levels.push_back(level);
+					}
+				}
+			}
+			else if (arg == "--rows") {
+				opt->rows = std::max(1, atoi(val));
+			}
+			else if (arg == "--min-time") {
+				opt->min_time = atof(val);
+			}
+			else if (arg == "--const-b") {
+				opt->const_b = strcmp(val, "off") != 0;
+			}
+			else if (arg == "--api") {
+				opt->image_api = strcmp(val, "image") == 0;
+			}
+			else if (arg == "--pin") {
+				opt->pin = strcmp(val, "on") == 0;
+			}
+			else if (arg == "--math") {
+				int m = math_from_name(val);
+				if (m < 0) {
+					fprintf(stderr, "unknown math '%s'\n", val);
+					return false;
+				}
+				opt->math = (BlendMath)m;
+			}
+			else if (arg == "--soft-light") {
+				int p = soft_light_from_name(val);
+				if (p < 0) {
+					fprintf(stderr, "unknown soft light precision '%s'\n", val);
+					return false;
+				}
+				opt->soft_light = (SoftLightPrecision)p;
+			}
+			else if (arg == "--expr")
+				expr = val;
+			else if (arg == "--json") {
+				opt->json = val;
+			}
+			else {
+				usage();
+				return false;
+			}
+		}
+		std::string err;
+		if (!opt->expr.compile(expr, &err)) {
+			fprintf(stderr, "--expr: %s\n", err.c_str());
+			return false;
+		}
+		return true;
+	}
+
+	// 每个线程自己的一块数据: kBufferRows 行循环使用, R/G/B 三个平面
+	const int kBufferRows = 16;
+
+	struct RowBuffers {
+		std::vector<float> a[3];
+		std::vector<float> b[3];
+		std::vector<float> out[3];
+	};
+
+	void fill(std::vector<float>& v, const std::string& dist, std::mt19937& rng)
+	{
+		static const float edges[] = { 0.0f, 128.0f / 255.0f, 1.0f };
+		std::uniform_real_distribution<float> uniform(0.0f, 1.0f);
+		std::uniform_int_distribution<int> pick(0, 2);
+		for (size_t i = 0; i < v.size(); i++) {
+			if (dist == "zero")
+				v[i] = 0.0f;
+			else if (dist == "one")
+				v[i] = 1.0f;
+			else if (dist == "edges")
+				v[i] = edges[pick(rng)];
+			else
+				v[i] = uniform(rng);
+		}
+	}
+
+	// solid 分布的 B 颜色, 落在分段模式的两段里
+	const float kSolid[3] = { 0.35f, 0.6f, 0.8f };
+
+	void make_buffers(RowBuffers* buf, int width, const std::string& dist, unsigned seed)
+	{
+		std::mt19937 rng(seed);
+		size_t n = (size_t)width * kBufferRows;
+		for (int c = 0; c < 3; c++) {
+			buf->a[c].resize(n);
+			buf->b[c].resize(n);
+			buf->out[c].assign(n, 0.0f);
+			fill(buf->a[c], dist, rng);
+			if (dist == "solid")
+				buf->b[c].assign(n, kSolid[c]);
+			else
+				fill(buf->b[c], dist, rng);
+		}
+	}
+
+	void run_rows(int mode, SimdLevel level, BlendMath math, SoftLightPrecision soft_light, const BlendExpr* expr,
+		RowBuffers* buf, int width, int rows, bool const_b)
+	{
+		if (mode == Custom) {
+			for (int y = 0; y < rows; y++) {
+				size_t off = (size_t)(y % kBufferRows) * width;
+				for (int c = 0; c < 3; c++)
+					expr->run(&buf->a[c][off], &buf->b[c][off], &buf->out[c][off], width, level);
+			}
+		}
+		else if (const_b && blend_mode_kind(mode) == asColorBlend) {
+			ConstColorRowKernel kernel = const_color_row_kernel(mode, math, level);
+			for (int y = 0; y < rows; y++) {
+				size_t off = (size_t)(y % kBufferRows) * width;
+				const float* pa[3] = { &buf->a[0][off], &buf->a[1][off], &buf->a[2][off] };
+				float* po[3] = { &buf->out[0][off], &buf->out[1][off], &buf->out[2][off] };
+				(*kernel)(pa, kSolid, po, width);
+			}
+		}
+		else if (const_b && blend_mode_kind(mode) == asValueBlend) {
+			// 与节点里一样, 每行按 B 的值取一次内核
+			for (int y = 0; y < rows; y++) {
+				size_t off = (size_t)(y % kBufferRows) * width;
+				for (int c = 0; c < 3; c++) {
+					ConstRowKernel kernel = mode == SoftLight ? soft_light_const_row_kernel(kSolid[c], math, soft_light, level) :
+						const_row_kernel(mode, kSolid[c], math, level);
+					(*kernel)(&buf->a[c][off], kSolid[c], &buf->out[c][off], width);
+				}
+			}
+		}
+		else if (blend_mode_kind(mode) == asColorBlend) {
+			ColorRowKernel kernel = color_row_kernel(mode, math, level);
+			for (int y = 0; y < rows; y++) {
+				size_t off = (size_t)(y % kBufferRows) * width;
+				const float* pa[3] = { &buf->a[0][off], &buf->a[1][off], &buf->a[2][off] };
+				const float* pb[3] = { &buf->b[0][off], &buf->b[1][off], &buf->b[2][off] };
+				float* po[3] = { &buf->out[0][off], &buf->out[1][off], &buf->out[2][off] };
+				(*kernel)(pa, pb, po, width);
+			}
+		}
+		else if (blend_mode_kind(mode) == asDissolveBlend) {
+			DissolveRowKernel kernel = dissolve_row_kernel(level);
+			DissolveKey key = { 1, 0, 0.5f };
+			for (int y = 0; y < rows; y++) {
+				size_t off = (size_t)(y % kBufferRows) * width;
+				for (int c = 0; c < 3; c++)
+					(*kernel)(&buf->a[c][off], &buf->b[c][off], &buf->out[c][off], width, 0, y, key);
+			}
+		}
+		else {
+			RowKernel kernel = mode == SoftLight ? soft_light_row_kernel(math, soft_light, level) : value_row_kernel(mode, math, level);
+			for (int y = 0; y < rows; y++) {
+				size_t off = (size_t)(y % kBufferRows) * width;
+				for (int c = 0; c < 3; c++)
+					(*kernel)(&buf->a[c][off], &buf->b[c][off], &buf->out[c][off], width);
+			}
+		}
+	}
+
+	// 多线程: 每个线程处理 rows / threads 行, 计时从同时开始到全部结束
+	double time_once(int mode, SimdLevel level, BlendMath math, SoftLightPrecision soft_light, const BlendExpr* expr,
+		std::vector<RowBuffers>& bufs, int width, int rows, bool const_b)
+	{
+		int threads = (int)bufs.size();
+		int per_thread = (rows + threads - 1) / threads;
+		std::atomic<int> ready(0);
+		std::atomic<bool> go(false);
+		std::vector<std::thread> pool;
+		for (int t = 1; t < threads; t++) {
+			pool.emplace_back([&, t]() {
+				ready++;
+				while (!go.load(std::memory_order_acquire))
+					std::this_thread::yield();
+				run_rows(mode, level, math, soft_light, expr, &bufs[t], width, per_thread, const_b);
+			});
+		}
+		while (ready.load() < threads - 1)
+			std::this_thread::yield();
+		auto start = std::chrono::steady_clock::now();
+		go.store(true, std::memory_order_release);
+		run_rows(mode, level, math, soft_light, expr, &bufs[0], width, per_thread, const_b);
+		for (std::thread& th : pool)
+			th.join();
+		auto end = std::chrono::steady_clock::now();
+		return std::chrono::duration<double>(end - start).count();
+	}
+
+	Result measure(int mode, SimdLevel level, const std::string& dist, int width, int threads, const Options& opt)
+	{
+		std::vector<RowBuffers> bufs(threads);
+		for (int t = 0; t < threads; t++)
+			make_buffers(&bufs[t], width, dist, 1234u + (unsigned)t);
+
+		int rows = std::max(opt.rows, threads);
+		int per_thread = (rows + threads - 1) / threads;
+		double pixels = (double)per_thread * threads * width;
+		bool const_b = opt.const_b && dist == "solid";
+
+		// 预热一次, 然后重复直到超过 min_time, 取最快的一次
+		time_once(mode, level, opt.math, opt.soft_light, &opt.expr, bufs, width, rows, const_b);
+		double best = 1e30, total = 0.0;
+		int runs = 0;
+		while (runs < 3 || total < opt.min_time) {
+			double t = time_once(mode, level, opt.math, opt.soft_light, &opt.expr, bufs, width, rows, const_b);
+			best = std::min(best, t);
+			total += t;
+			runs++;
+		}
+
+		Result r;
+		r.mode = blendModeNames[mode];
+		r.dist = dist;
+		r.simd = simd_level_name(level);
+		r.width = width;
+		r.threads = threads;
+		r.mpix_per_s = pixels / best / 1e6;
+		r.ns_per_pixel = best * 1e9 / pixels;
+		return r;
+	}
+
+	// 整帧走 blend_image: 三张图都按池的 tile 分配首次写入, 再单线程填数据
+	Result measure_image(int mode, const std::string& dist, int width, int threads, const Options& opt)
+	{
+		ThreadPool pool(threads, opt.pin);
+		BlendImageOptions bo;
+		bo.pool = &pool;
+		bo.math = opt.math;
+		bo.soft_light = opt.soft_light;
+		bo.expr = &opt.expr;
+		int height = std::max(1, width * 9 / 16);
+		ImageBuffer a, b, out;
+		a.allocate(width, height, 3, bo);
+		b.allocate(width, height, 3, bo);
+		out.allocate(width, height, 3, bo);
+		std::mt19937 rng(1234u);
+		std::vector<float> row(width);
+		for (int c = 0; c < 3; c++) {
+			for (int y = 0; y < height; y++) {
+				fill(row, dist, rng);
+				std::copy(row.begin(), row.end(), a.view().row(c, y));
+				if (dist == "solid")
+					std::fill(b.view().row(c, y), b.view().row(c, y) + width, kSolid[c]);
+				else {
+					fill(row, dist, rng);
+					std::copy(row.begin(), row.end(), b.view().row(c, y));
+				}
+			}
+		}
+
+		auto once = [&]() {
+			auto start = std::chrono::steady_clock::now();
+			blend_image(out.view(), a.view(), b.view(), mode, bo);
+			return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		};
+		once();
+		double best = 1e30, total = 0.0;
+		int runs = 0;
+		while (runs < 3 || total < opt.min_time) {
+			double t = once();
+			best = std::min(best, t);
+			total += t;
+			runs++;
+		}
+
+		double pixels = (double)width * height;
+		Result r;
+		r.mode = blendModeNames[mode];
+		r.dist = dist;
+		r.simd = simd_level_name(simd_level());
+		r.width = width;
+		r.threads = pool.size();
+		r.mpix_per_s = pixels / best / 1e6;
+		r.ns_per_pixel = best * 1e9 / pixels;
+		return r;
+	}
+
+	std::string compiler_name()
+	{
+#if defined(__clang__)
+		return std::string("clang ") + __clang_version__;
+#elif defined(__GNUC__)
+		return std::string("gcc ") + __VERSION__;
+#elif defined(_MSC_VER)
+		return "msvc " + std::to_string(_MSC_VER);
+#else
+		return "unknown";
+#endif
+	}
+
+	std::string json_escape(const std::string& s)
+	{
+		std::string out;
+		for (char c : s) {
+			if (c == '"' || c == '\\')
+				out += '\\';
+			out += c;
+		}
+		return out;
+	}
+
+	bool write_json(const std::string& path, const Options& opt, const std::vector<Result>& results)
+	{
+		FILE* f = fopen(path.c_str(), "w");
+		if (!f)
+			return false;
+		char when[64];
+		time_t now = time(NULL);
+		strftime(when, sizeof(when), "%Y-%m-%dT%H:%M:%SZ", gmtime(&now));
+		fprintf(f, "{\n");
+		fprintf(f, "  \"timestamp\": \"%s\",\n", when);
+		fprintf(f, "  \"compiler\": \"%s\",\n", json_escape(compiler_name()).c_str());
+		fprintf(f, "  \"detected_simd\": \"%s\",\n", simd_level_name(simd_level()));
+		fprintf(f, "  \"hardware_threads\": %u,\n", std::thread::hardware_concurrency());
+		fprintf(f, "  \"rows\": %d,\n", opt.rows);
+		fprintf(f, "  \"math\": \"%s\",\n", blendMathNames[opt.math]);
+		fprintf(f, "  \"soft_light\": \"%s\",\n", softLightPrecisionNames[opt.soft_light]);
+		fprintf(f, "  \"expr\": \"%s\",\n", json_escape(opt.expr.text()).c_str());
+		fprintf(f, "  \"results\": [\n");
+		for (size_t i = 0; i < results.size(); i++) {
+			const Result& r = results[i];
+			fprintf(f, "    {\"mode\": \"%s\", \"dist\": \"%s\", \"simd\": \"%s\", \"width\": %d, \"threads\": %d, "
+				"\"mpix_per_s\": %.3f, \"ns_per_pixel\": %.4f}%s\n",
+				r.mode.c_str(), r.dist.c_str(), r.simd.c_str(), r.width, r.threads,
+				r.mpix_per_s, r.ns_per_pixel, i + 1 < results.size() ? "," : "");
+		}
+		fprintf(f, "  ]\n}\n");
+		fclose(f);
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options opt;
+	if (!parse_args(argc, argv, &opt))
+		return 1;
+
+	printf("psblend_bench  detected simd: %s  rows per run: %d  math: %s  soft light: %s\n", simd_level_name(simd_level()),
+		opt.rows, blendMathNames[opt.math], softLightPrecisionNames[opt.soft_light]);
+	printf("%-14s %-8s %-7s %6s %4s %12s %10s\n", "mode", "dist", "simd", "width", "thr", "Mpix/s", "ns/pix");
+
+	std::vector<Result> results;
+	for (int mode : opt.modes) {
+		for (SimdLevel level : opt.levels) {
+			for (const std::string& dist : opt.dists) {
+				for (int width : opt.widths) {
+					for (int threads : opt.threads) {
+						Result r = opt.image_api ? measure_image(mode, dist, width, threads, opt) :
+							measure(mode, level, dist, width, threads, opt);
+						printf("%-14s %-8s %-7s %6d %4d %12.2f %10.3f\n", r.mode.c_str(), r.dist.c_str(),
+							r.simd.c_str(), r.width, r.threads, r.mpix_per_s, r.ns_per_pixel);
+						fflush(stdout);
+						results.push_back(r);
+					}
+				}
+			}
+		}
+	}
+
+	if (!opt.json.empty()) {
+		if (!write_json(opt.json, opt, results)) {
+			fprintf(stderr, "cannot write %s\n", opt.json.c_str());
+			return 1;
+		}
+		printf("wrote %s\n", opt.json.c_str());
+	}
+	return 0;
+}
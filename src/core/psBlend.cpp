@@ -0,0 +1,911 @@
+// ========================================
+// Author: wuxiaomeng
+// Date: 2021-10
+// Photoshop 图层混合模式: 标量实现与内核选择.
+// ========================================
+#include <cmath>
+#include <cstdlib>
+#include <cstring>
+#if defined(_MSC_VER)
+#include <intrin.h>
+#endif
+#include "psBlend.h"
+#include "psBlendSimd.h"
+
+#define max(a,b)  (((a) > (b)) ? (a) : (b))
+#define min(a,b)  (((a) < (b)) ? (a) : (b))
+
+namespace photoshopMergeTool {
+/*
+正常      Normal
+溶解     Dissolve
+-------------------------
+变暗       Darken
+正片叠底   Multiply
+颜色加深   ColorBurn
+线性加深    LinearBurn
+深色       DarkerColor
+-----------------------------
+变亮      Lighten
+滤色       Screen
+颜色减淡    ColorDodge
+线性减淡    LinearDodge
+浅色       LighterColor
+----------------------------
+叠加      Overlay
+柔光     SoftLight
+强光    HardLight
+亮光    VividLight
+线性光   LinearLight
+点光    PinLight
+实色混合  HardMix
+----------------------------
+差值     Diference
+排除     Exclusion
+---------------------------
+色相     Hue
+饱和度    Saturation
+颜色      Color
+亮度      Luminosity
+----------------------------
+自定义公式  Custom
+*/
+
+	const char* const blendModeNames[] = { "normal", "darken", "multiply",
+	"colorBurn", "linearBurn", "darkerColor", "lighten", "screen", "colorDodge", "linearDodge", "lighterColor",
+	"overlay", "softLight", "hardLight", "vividLight", "linearLight", "pinLight", "hardMix",
+	"diference", "exclusion", "hue", "saturation", "color", "luminosity", "dissolve", "custom", NULL };
+
+	float PhotoshopComput::clump_to_ps_argb(float a)
+	{
+		argb r = (argb)(a * ARGB_LEVER);
+		return r;
+	}
+
+	float PhotoshopComput::convert_from_argb(argb a)
+	{
+		float r = float(a) / ARGB_LEVER;
+		return r;
+	}
+
+	argb PhotoshopComput::inverted(argb a)
+	{
+		argb r = (argb)(ARGB_LEVER - a);
+		return r;
+	}
+
+	float PhotoshopComput::normal(float a, float b)
+	{
+		// 正常
+		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
+		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
+		float r = PhotoshopComput::convert_from_argb(r_b);
+		return b;
+	}
+
+	float PhotoshopComput::darken(float a, float b)
+	{
+		// 变暗   B<=A 则 C=B B>=A 则 C=A
+		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
+		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
+		argb r_1 = 0;
+		if (r_a >= r_b)
+			r_1 = r_b;
+		else
+			r_1 = r_a;
+		float r = PhotoshopComput::convert_from_argb(r_1);
+		return r;
+	}
+
+	float PhotoshopComput::multiply(float a, float b)
+	{
+		// 正片叠底    C = (A*B)/255
+		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
+		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
+		argb r_1 = r_a * r_b / ARGB_LEVER;
+		if (r_1 > ARGB_LEVER)
+			r_1 = ARGB_LEVER;
+		if (r_1 < 0)
+			r_1 = 0;
+		float r = PhotoshopComput::convert_from_argb(r_1);
+		return r;
+	}
+
+	float PhotoshopComput::color_burn(float a, float b)
+	{
+		// 颜色加深    C = A - ( (255 - A) * (255 - B) ) / B
+		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
+		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
+		if (r_b == 0)
+			return 0.0;
+		argb r_1 = r_a - PhotoshopComput::inverted(r_a) * PhotoshopComput::inverted(r_b) / r_b;
+		if (r_1 > ARGB_LEVER)
+			r_1 = ARGB_LEVER;
+		if (r_1 < 0)
+			r_1 = 0;
+		float r = PhotoshopComput::convert_from_argb(r_1);
+		return r;
+	}
+
+	float PhotoshopComput::linear_burn(float a, float b)
+	{
+		// 线性加深   C=A+B-255
+		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
+		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
+		argb r_1 = r_a + r_b - ARGB_LEVER;
+		if (r_1 > ARGB_LEVER)
+			r_1 = ARGB_LEVER;
+		if (r_1 < 0)
+			r_1 = 0;
+		float r = PhotoshopComput::convert_from_argb(r_1);
+		return r;
+	}
+
+	float PhotoshopComput::lighten(float a, float b)
+	{
+		// 变亮 B<=A 则 C=A B>A 则 C=B
+		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
+		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
+		argb r_1 = 0;
+		if (r_a >= r_b)
+			r_1 = r_a;
+		else
+			r_1 = r_b;
+		float r = PhotoshopComput::convert_from_argb(r_1);
+		return r;
+	}
+
+	float PhotoshopComput::screen(float a, float b)
+	{
+		// 滤色 C = 255 - ( (255 - A) * (255 - B) ) / 255
+		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
+		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
+		argb r_1 = 0;
+		r_1 = ARGB_LEVER - PhotoshopComput::inverted(r_a) * PhotoshopComput::inverted(r_b) / ARGB_LEVER;
+		if (r_1 > ARGB_LEVER)
+			r_1 = ARGB_LEVER;
+		if (r_1 < 0)
+			r_1 = 0;
+		float r = PhotoshopComput::convert_from_argb(r_1);
+		return r;
+	}
+
+	float PhotoshopComput::color_dodge(float a, float b)
+	{
+		// 颜色减淡   C = A + (A * B) / (255 - B)
+		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
+		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
+		if (PhotoshopComput::inverted(r_b) == 0)
+			return 1.0;
+		argb r_1 = r_a + r_a * r_b / PhotoshopComput::inverted(r_b);
+		if (r_1 > ARGB_LEVER)
+			r_1 = ARGB_LEVER;
+		if (r_1 < 0)
+			r_1 = 0;
+		float r = PhotoshopComput::convert_from_argb(r_1);
+		return r;
+	}
+
+	float PhotoshopComput::linear_dodge(float a, float b)
+	{
+		// 线性减淡（添加）   C=A+B
+		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
+		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
+		argb r_1 = r_a + r_b;
+		if (r_1 > ARGB_LEVER)
+			r_1 = ARGB_LEVER;
+		if (r_1 < 0)
+			r_1 = 0;
+		float r = PhotoshopComput::convert_from_argb(r_1);
+		return r;
+	}
+
+	float PhotoshopComput::overlay(float a, float b)
+	{
+		// 叠加  if A <= 128 则 C = ( A × B ) / 255, if A > 128 则 C = 255 - ( (255 - A) * (255 - B)) / 128
+		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
+		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
+		argb r_1 = 0;
+		if (r_a <= 128)
+			r_1 = r_a * r_b / 128;
+		else
+			r_1 = 255 - PhotoshopComput::inverted(r_a) * PhotoshopComput::inverted(r_b) / 128;
+		if (r_1 > ARGB_LEVER)
+			r_1 = ARGB_LEVER;
+		if (r_1 < 0)
+			r_1 = 0;
+		float r = PhotoshopComput::convert_from_argb(r_1);
+		return r;
+	}
+
+	float PhotoshopComput::soft_light(float a, float b)
+	{
+		// 柔光    if B <= 128 则 C= (A * B) / 128 + (A / 255) ^ 2＊(255 - 2B) , if B>128 则 C = ( A * ( 255 - _B ) ) / 128 + sqrt(A / 255) * (2B - 255)
+		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
+		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
+		// argb 是 float, 所以不需要 double 的 pow / sqrt: 平方在 float 里算, 开方用 float 的 sqrt,
+		// 两者都与 double 算完再转回 float 逐位相同, 也与向量版本的 vmul / vsqrt 相同
+		argb r_1 = 0;
+		argb n_a = r_a / 255;
+		if (r_b <= 128)
+			r_1 = r_a * r_b / 128 + n_a * n_a * (255 - 2 * r_b);
+		else  // A < 0 (超出 0..1 的输入) 时开方取 0, 不产生 NaN
+			r_1 = r_a * PhotoshopComput::inverted(r_b) / 128 + std::sqrt(n_a > 0 ? n_a : 0) * (2 * r_b - 255);
+		if (r_1 > ARGB_LEVER)
+			r_1 = ARGB_LEVER;
+		if (r_1 < 0)
+			r_1 = 0;
+		float r = PhotoshopComput::convert_from_argb(r_1);
+		return r;
+	}
+
+	float PhotoshopComput::hard_light(float a, float b)
+	{
+		// 强光  if B<=128 则 C=(A * B)/128 , if B>128 则 C = 255 - ( (255 - A) * (255 - B) ) / 128
+		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
+		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
+		argb r_1 = 0;
+		if (r_b <= 128)
+			r_1 = r_a * r_b / 128;
+		else
+			r_1 = 255 - PhotoshopComput::inverted(r_a) * PhotoshopComput::inverted(r_b) / 128;
+		if (r_1 > ARGB_LEVER)
+			r_1 = ARGB_LEVER;
+		if (r_1 < 0)
+			r_1 = 0;
+		float r = PhotoshopComput::convert_from_argb(r_1);
+		return r;
+	}
+
+	float PhotoshopComput::vivid_light(float a, float b)
+	{
+		// 亮光   if B <= 128 则 C = A - (255 - A) * (255-2B) / (2B), if  B>128 则 C = A + A * (2B - 255) / (2 * (255 - B) )
+		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
+		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
+		argb r_1 = 0;
+		if (r_b == 0)
+			return 0.0;
+		if (PhotoshopComput::inverted(r_b) == 0)
+			return 0.0;
+		if (r_b <= 128)
+			r_1 = r_a - PhotoshopComput::inverted(r_a) * (255 - 2 * r_b) / (2 * r_b);
+		else
+			r_1 = r_a + r_a * (2 * r_b - 255) / (2 * PhotoshopComput::inverted(r_b));
+		if (r_1 > ARGB_LEVER)
+			r_1 = ARGB_LEVER;
+		if (r_1 < 0)
+			r_1 = 0;
+		float r = PhotoshopComput::convert_from_argb(r_1);
+		return r;
+	}
+
+	float PhotoshopComput::linear_light(float a, float b)
+	{
+		// 线性光  C = A + 2 * B - 255
+		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
+		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
+		argb r_1 = 0;
+		r_1 = r_a + 2 * r_b - 255;
+		if (r_1 > ARGB_LEVER)
+			r_1 = ARGB_LEVER;
+		if (r_1 < 0)
+			r_1 = 0;
+		float r = PhotoshopComput::convert_from_argb(r_1);
+		return r;
+	}
+
+	float PhotoshopComput::pin_light(float a, float b)
+	{
+		// 点光  if B <= 128 则 C = Min(A, 2B),  if B>128 则 C = MAX(A, 2B - 255)
+		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
+		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
+		argb r_1 = 0;
+		if (r_b <= 128)
+			r_1 = min(r_a, 2 * r_b);
+		else
+			r_1 = max(r_a, 2 * r_b - 255);
+		if (r_1 > ARGB_LEVER)
+			r_1 = ARGB_LEVER;
+		if (r_1 < 0)
+			r_1 = 0;
+		float r = PhotoshopComput::convert_from_argb(r_1);
+		return r;
+	}
+
+	float PhotoshopComput::hard_mix(float a, float b)
+	{
+		// 实色混合   A + B >= 255 则 C=255, else C = A + B
+		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
+		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
+		argb r_1 = 0;
+		if (r_a + r_b > ARGB_LEVER)
+			r_1 = ARGB_LEVER;
+		else
+			r_1 = 0;
+		if (r_1 > ARGB_LEVER)
+			r_1 = ARGB_LEVER;
+		if (r_1 < 0)
+			r_1 = 0;
+		float r = PhotoshopComput::convert_from_argb(r_1);
+		return r;
+	}
+
+	float PhotoshopComput::diference(float a, float b)
+	{
+		// 差值   C = | A - B |
+		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
+		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
+		argb r_1 = 0;
+		r_1 = fabsf(r_a - r_b);
+		if (r_1 > ARGB_LEVER)
+			r_1 = ARGB_LEVER;
+		if (r_1 < 0)
+			r_1 = 0;
+		float r = PhotoshopComput::convert_from_argb(r_1);
+		return r;
+	}
+
+	float PhotoshopComput::exclusion(float a, float b)
+	{
+		// 排除   C = A + B - (A * B) / 128
+		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
+		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
+		argb r_1 = 0;
+		r_1 = r_a + r_b - r_a * r_b / 128;
+		if (r_1 > ARGB_LEVER)
+			r_1 = ARGB_LEVER;
+		if (r_1 < 0)
+			r_1 = 0;
+		float r = PhotoshopComput::convert_from_argb(r_1);
+		return r;
+	}
+
+	// 颜色混合模式：a, b, r 都是 {R, G, B} 三个值
+	void PhotoshopComput::darker_color(const float* a, const float* b, float* r)
+	{
+		// 深色   Br+Bg+Bb >= Ar+Ag+Ab 则 C=A
+		argb r_a_r = PhotoshopComput::clump_to_ps_argb(a[0]);
+		argb r_a_g = PhotoshopComput::clump_to_ps_argb(a[1]);
+		argb r_a_b = PhotoshopComput::clump_to_ps_argb(a[2]);
+		argb r_b_r = PhotoshopComput::clump_to_ps_argb(b[0]);
+		argb r_b_g = PhotoshopComput::clump_to_ps_argb(b[1]);
+		argb r_b_b = PhotoshopComput::clump_to_ps_argb(b[2]);
+		argb r_1_r = 0; argb r_1_g = 0; argb r_1_b = 0;
+		argb aline = r_a_r + r_a_g + r_a_b;
+		argb bline = r_b_r + r_b_g + r_b_b;
+		if (bline >= aline) {
+			r_1_r = r_a_r;
+			r_1_g = r_a_g;
+			r_1_b = r_a_b;
+		}
+		else {
+			r_1_r = r_b_r;
+			r_1_g = r_b_g;
+			r_1_b = r_b_b;
+		}
+		if (r_1_r > ARGB_LEVER)
+			r_1_r = ARGB_LEVER;
+		if (r_1_g > ARGB_LEVER)
+			r_1_g = ARGB_LEVER;
+		if (r_1_b > ARGB_LEVER)
+			r_1_b = ARGB_LEVER;
+		if (r_1_r < 0)
+			r_1_r = 0;
+		if (r_1_g < 0)
+			r_1_g = 0;
+		if (r_1_b < 0)
+			r_1_b = 0;
+		r[0] = PhotoshopComput::convert_from_argb(r_1_r);
+		r[1] = PhotoshopComput::convert_from_argb(r_1_g);
+		r[2] = PhotoshopComput::convert_from_argb(r_1_b);
+	}
+
+	void PhotoshopComput::lighter_color(const float* a, const float* b, float* r)
+	{
+		// 浅色  Br+Bg+Bb >= Ar+Ag+Ab 则 C=B
+		argb r_a_r = PhotoshopComput::clump_to_ps_argb(a[0]);
+		argb r_a_g = PhotoshopComput::clump_to_ps_argb(a[1]);
+		argb r_a_b = PhotoshopComput::clump_to_ps_argb(a[2]);
+		argb r_b_r = PhotoshopComput::clump_to_ps_argb(b[0]);
+		argb r_b_g = PhotoshopComput::clump_to_ps_argb(b[1]);
+		argb r_b_b = PhotoshopComput::clump_to_ps_argb(b[2]);
+		argb r_1_r = 0; argb r_1_g = 0; argb r_1_b = 0;
+		argb aline = r_a_r + r_a_g + r_a_b;
+		argb bline = r_b_r + r_b_g + r_b_b;
+		if (bline >= aline) {
+			r_1_r = r_b_r;
+			r_1_g = r_b_g;
+			r_1_b = r_b_b;
+		}
+		else {
+			r_1_r = r_a_r;
+			r_1_g = r_a_g;
+			r_1_b = r_a_b;
+		}
+		if (r_1_r > ARGB_LEVER)
+			r_1_r = ARGB_LEVER;
+		if (r_1_g > ARGB_LEVER)
+			r_1_g = ARGB_LEVER;
+		if (r_1_b > ARGB_LEVER)
+			r_1_b = ARGB_LEVER;
+		if (r_1_r < 0)
+			r_1_r = 0;
+		if (r_1_g < 0)
+			r_1_g = 0;
+		if (r_1_b < 0)
+			r_1_b = 0;
+		r[0] = PhotoshopComput::convert_from_argb(r_1_r);
+		r[1] = PhotoshopComput::convert_from_argb(r_1_g);
+		r[2] = PhotoshopComput::convert_from_argb(r_1_b);
+	}
+
+	// 色相 / 饱和度 / 颜色 / 亮度: 按 W3C compositing 规范的 Lum / Sat / ClipColor 计算,
+	// 全部在 0..255 上进行. 向量版本 (psBlendSimd.inl) 的运算顺序与这里一致
+	static inline argb hsl_lum(const argb* c)
+	{
+		return 0.3f * c[0] + 0.59f * c[1] + 0.11f * c[2];
+	}
+
+	static inline argb hsl_sat(const argb* c)
+	{
+		return max(max(c[0], c[1]), c[2]) - min(min(c[0], c[1]), c[2]);
+	}
+
+	// 最小值 -> 0, 最大值 -> s, 中间值按比例; 三个值相等时全为 0
+	static inline void hsl_set_sat(argb* c, argb s)
+	{
+		argb n = min(min(c[0], c[1]), c[2]);
+		argb x = max(max(c[0], c[1]), c[2]);
+		argb d = x - n;
+		for (int i = 0; i < 3; i++)
+			c[i] = d > 0 ? (c[i] - n) * s / d : 0;
+	}
+
+	// 平移到亮度 l, 再把超出 0..255 的颜色沿亮度方向拉回.
+	// 灰色 (三个分量相等) 超出范围时 cl - n 或 x - cl 为 0, 没有方向可拉, 留给 hsl_result 截断
+	static inline void hsl_set_lum(argb* c, argb l)
+	{
+		argb d = l - hsl_lum(c);
+		for (int i = 0; i < 3; i++)
+			c[i] = c[i] + d;
+		argb cl = hsl_lum(c);
+		argb n = min(min(c[0], c[1]), c[2]);
+		argb x = max(max(c[0], c[1]), c[2]);
+		if (n < 0 && cl > n) {
+			for (int i = 0; i < 3; i++)
+				c[i] = (c[i] - cl) * cl / (cl - n) + cl;
+		}
+		if (x > ARGB_LEVER && x > cl) {
+			for (int i = 0; i < 3; i++)
+				c[i] = (c[i] - cl) * (ARGB_LEVER - cl) / (x - cl) + cl;
+		}
+	}
+
+	static inline void hsl_result(const argb* c, float* r)
+	{
+		for (int i = 0; i < 3; i++) {
+			argb r_1 = c[i];
+			if (r_1 > ARGB_LEVER)
+				r_1 = ARGB_LEVER;
+			if (r_1 < 0)
+				r_1 = 0;
+			r[i] = PhotoshopComput::convert_from_argb(r_1);
+		}
+	}
+
+	void PhotoshopComput::hue(const float* a, const float* b, float* r)
+	{
+		// 色相   B 的色相, A 的饱和度和亮度
+		argb r_a[3] = { clump_to_ps_argb(a[0]), clump_to_ps_argb(a[1]), clump_to_ps_argb(a[2]) };
+		argb r_1[3] = { clump_to_ps_argb(b[0]), clump_to_ps_argb(b[1]), clump_to_ps_argb(b[2]) };
+		hsl_set_sat(r_1, hsl_sat(r_a));
+		hsl_set_lum(r_1, hsl_lum(r_a));
+		hsl_result(r_1, r);
+	}
+
+	void PhotoshopComput::saturation(const float* a, const float* b, float* r)
+	{
+		// 饱和度   B 的饱和度, A 的色相和亮度
+		argb r_b[3] = { clump_to_ps_argb(b[0]), clump_to_ps_argb(b[1]), clump_to_ps_argb(b[2]) };
+		argb r_1[3] = { clump_to_ps_argb(a[0]), clump_to_ps_argb(a[1]), clump_to_ps_argb(a[2]) };
+		argb l = hsl_lum(r_1);
+		hsl_set_sat(r_1, hsl_sat(r_b));
+		hsl_set_lum(r_1, l);
+		hsl_result(r_1, r);
+	}
+
+	void PhotoshopComput::color(const float* a, const float* b, float* r)
+	{
+		// 颜色   B 的色相和饱和度, A 的亮度
+		argb r_a[3] = { clump_to_ps_argb(a[0]), clump_to_ps_argb(a[1]), clump_to_ps_argb(a[2]) };
+		argb r_1[3] = { clump_to_ps_argb(b[0]), clump_to_ps_argb(b[1]), clump_to_ps_argb(b[2]) };
+		hsl_set_lum(r_1, hsl_lum(r_a));
+		hsl_result(r_1, r);
+	}
+
+	void PhotoshopComput::luminosity(const float* a, const float* b, float* r)
+	{
+		// 亮度   B 的亮度, A 的色相和饱和度
+		argb r_b[3] = { clump_to_ps_argb(b[0]), clump_to_ps_argb(b[1]), clump_to_ps_argb(b[2]) };
+		argb r_1[3] = { clump_to_ps_argb(a[0]), clump_to_ps_argb(a[1]), clump_to_ps_argb(a[2]) };
+		hsl_set_lum(r_1, hsl_lum(r_b));
+		hsl_result(r_1, r);
+	}
+
+	// 标量行内核: 每种混合模式在编译期实例化一个独立的循环, 像素函数可以内联.
+	template <float (*Func)(float, float)>
+	void blend_row(const float* a, const float* b, float* out, int n)
+	{
+		for (int i = 0; i < n; i++)
+			out[i] = Func(a[i], b[i]);
+	}
+
+	// 颜色模式按平面 R/G/B 指针整行处理, 循环内不分配内存
+	template <void (*Func)(const float*, const float*, float*)>
+	void blend_row_rgb(const float* const* a, const float* const* b, float* const* out, int n)
+	{
+		for (int i = 0; i < n; i++) {
+			float pa[3] = { a[0][i], a[1][i], a[2][i] };
+			float pb[3] = { b[0][i], b[1][i], b[2][i] };
+			float pr[3];
+			Func(pa, pb, pr);
+			out[0][i] = pr[0];
+			out[1][i] = pr[1];
+			out[2][i] = pr[2];
+		}
+	}
+
+	PsMode blend_mode_kind(int mode)
+	{
+		switch (mode)
+		{
+		case DarkerColor:
+		case LighterColor:
+		case Hue:
+		case Saturation:
+		case Color:
+		case Luminosity:
+			return asColorBlend;
+		case Dissolve:
+			return asDissolveBlend;
+		default:
+			return asValueBlend;
+		}
+	}
+
+	static RowKernel scalar_row_kernel(int mode)
+	{
+		switch (mode)
+		{
+		case Normal:       return &blend_row<PhotoshopComput::normal>;
+		case Darken:       return &blend_row<PhotoshopComput::darken>;
+		case Multiply:     return &blend_row<PhotoshopComput::multiply>;
+		case ColorBurn:    return &blend_row<PhotoshopComput::color_burn>;
+		case LinearBurn:   return &blend_row<PhotoshopComput::linear_burn>;
+		case Lighten:      return &blend_row<PhotoshopComput::lighten>;
+		case Screen:       return &blend_row<PhotoshopComput::screen>;
+		case ColorDodge:   return &blend_row<PhotoshopComput::color_dodge>;
+		case LinearDodge:  return &blend_row<PhotoshopComput::linear_dodge>;
+		case Overlay:      return &blend_row<PhotoshopComput::overlay>;
+		case SoftLight:    return &blend_row<PhotoshopComput::soft_light>;
+		case HardLight:    return &blend_row<PhotoshopComput::hard_light>;
+		case VividLight:   return &blend_row<PhotoshopComput::vivid_light>;
+		case LinearLight:  return &blend_row<PhotoshopComput::linear_light>;
+		case PinLight:     return &blend_row<PhotoshopComput::pin_light>;
+		case HardMix:      return &blend_row<PhotoshopComput::hard_mix>;
+		case Diference:    return &blend_row<PhotoshopComput::diference>;
+		case Exclusion:    return &blend_row<PhotoshopComput::exclusion>;
+		default:           return &blend_row<PhotoshopComput::normal>;
+		}
+	}
+
+	static SimdLevel detect_simd_level()
+	{
+#if PS_X86_SIMD && defined(_MSC_VER)
+		int info[4];
+		__cpuid(info, 0);
+		int nids = info[0];
+		__cpuid(info, 1);
+		bool sse41 = (info[2] & (1 << 19)) != 0;
+		bool osxsave = (info[2] & (1 << 27)) != 0;
+		bool avx = (info[2] & (1 << 28)) != 0;
+		bool avx2 = false, avx512 = false;
+		if (nids >= 7) {
+			__cpuidex(info, 7, 0);
+			avx2 = (info[1] & (1 << 5)) != 0;
+			avx512 = (info[1] & (1 << 16)) != 0;
+		}
+		unsigned long long xcr0 = osxsave ? _xgetbv(0) : 0;
+		if (avx512 && (xcr0 & 0xe6) == 0xe6)
+			return SimdAVX512;
+		if (avx && avx2 && (xcr0 & 0x6) == 0x6)
+			return SimdAVX2;
+		if (sse41)
+			return SimdSSE41;
+		return SimdScalar;
+#elif PS_X86_SIMD
+		__builtin_cpu_init();
+		if (__builtin_cpu_supports("avx512f"))
+			return SimdAVX512;
+		if (__builtin_cpu_supports("avx2"))
+			return SimdAVX2;
+		if (__builtin_cpu_supports("sse4.1"))
+			return SimdSSE41;
+		return SimdScalar;
+#else
+		return SimdScalar;
+#endif
+	}
+
+	// PSMERGE_SIMD=scalar|sse41|avx2|avx512 可以把级别往下压, 方便对比
+	static SimdLevel select_simd_level()
+	{
+		SimdLevel level = detect_simd_level();
+		const char* env = getenv("PSMERGE_SIMD");
+		if (env) {
+			SimdLevel want = level;
+			if (strcmp(env, "scalar") == 0)
+				want = SimdScalar;
+			else if (strcmp(env, "sse41") == 0)
+				want = SimdSSE41;
+			else if (strcmp(env, "avx2") == 0)
+				want = SimdAVX2;
+			else if (strcmp(env, "avx512") == 0)
+				want = SimdAVX512;
+			if (want < level)
+				level = want;
+		}
+		return level;
+	}
+
+	static const SimdLevel g_simd_level = select_simd_level();
+
+	SimdLevel simd_level()
+	{
+		return g_simd_level;
+	}
+
+	const char* simd_level_name(SimdLevel level)
+	{
+		switch (level)
+		{
+		case SimdSSE41:  return "sse41";
+		case SimdAVX2:   return "avx2";
+		case SimdAVX512: return "avx512";
+		default:         return "scalar";
+		}
+	}
+
+	static ColorRowKernel scalar_color_row_kernel(int mode)
+	{
+		switch (mode)
+		{
+		case DarkerColor:  return &blend_row_rgb<PhotoshopComput::darker_color>;
+		case LighterColor: return &blend_row_rgb<PhotoshopComput::lighter_color>;
+		case Saturation:   return &blend_row_rgb<PhotoshopComput::saturation>;
+		case Color:        return &blend_row_rgb<PhotoshopComput::color>;
+		case Luminosity:   return &blend_row_rgb<PhotoshopComput::luminosity>;
+		default:           return &blend_row_rgb<PhotoshopComput::hue>;
+		}
+	}
+
+	RowKernel value_row_kernel(int mode, SimdLevel level)
+	{
+		RowKernel k = NULL;
+#if PS_X86_SIMD
+		switch (level)
+		{
+		case SimdAVX512: k = avx512::row_kernel(mode); break;
+		case SimdAVX2:   k = avx2::row_kernel(mode); break;
+		case SimdSSE41:  k = sse41::row_kernel(mode); break;
+		default: break;
+		}
+#endif
+		return k ? k : scalar_row_kernel(mode);
+	}
+
+	RowKernel value_row_kernel(int mode)
+	{
+		return value_row_kernel(mode, g_simd_level);
+	}
+
+	ColorRowKernel color_row_kernel(int mode, SimdLevel level)
+	{
+		ColorRowKernel k = NULL;
+#if PS_X86_SIMD
+		switch (level)
+		{
+		case SimdAVX512: k = avx512::color_row_kernel(mode); break;
+		case SimdAVX2:   k = avx2::color_row_kernel(mode); break;
+		case SimdSSE41:  k = sse41::color_row_kernel(mode); break;
+		default: break;
+		}
+#endif
+		return k ? k : scalar_color_row_kernel(mode);
+	}
+
+	ColorRowKernel color_row_kernel(int mode)
+	{
+		return color_row_kernel(mode, g_simd_level);
+	}
+
+	template <float (*Func)(float, float)>
+	void blend_row_const(const float* a, float b, float* out, int n)
+	{
+		for (int i = 0; i < n; i++)
+			out[i] = Func(a[i], b);
+	}
+
+	template <void (*Func)(const float*, const float*, float*)>
+	void blend_row_rgb_const(const float* const* a, const float* b, float* const* out, int n)
+	{
+		for (int i = 0; i < n; i++) {
+			float pa[3] = { a[0][i], a[1][i], a[2][i] };
+			float pr[3];
+			Func(pa, b, pr);
+			out[0][i] = pr[0];
+			out[1][i] = pr[1];
+			out[2][i] = pr[2];
+		}
+	}
+
+	static ConstRowKernel scalar_const_row_kernel(int mode)
+	{
+		switch (mode)
+		{
+		case Darken:       return &blend_row_const<PhotoshopComput::darken>;
+		case Multiply:     return &blend_row_const<PhotoshopComput::multiply>;
+		case ColorBurn:    return &blend_row_const<PhotoshopComput::color_burn>;
+		case LinearBurn:   return &blend_row_const<PhotoshopComput::linear_burn>;
+		case Lighten:      return &blend_row_const<PhotoshopComput::lighten>;
+		case Screen:       return &blend_row_const<PhotoshopComput::screen>;
+		case ColorDodge:   return &blend_row_const<PhotoshopComput::color_dodge>;
+		case LinearDodge:  return &blend_row_const<PhotoshopComput::linear_dodge>;
+		case Overlay:      return &blend_row_const<PhotoshopComput::overlay>;
+		case SoftLight:    return &blend_row_const<PhotoshopComput::soft_light>;
+		case HardLight:    return &blend_row_const<PhotoshopComput::hard_light>;
+		case VividLight:   return &blend_row_const<PhotoshopComput::vivid_light>;
+		case LinearLight:  return &blend_row_const<PhotoshopComput::linear_light>;
+		case PinLight:     return &blend_row_const<PhotoshopComput::pin_light>;
+		case HardMix:      return &blend_row_const<PhotoshopComput::hard_mix>;
+		case Diference:    return &blend_row_const<PhotoshopComput::diference>;
+		case Exclusion:    return &blend_row_const<PhotoshopComput::exclusion>;
+		default:           return &blend_row_const<PhotoshopComput::normal>;
+		}
+	}
+
+	static ConstColorRowKernel scalar_const_color_row_kernel(int mode)
+	{
+		switch (mode)
+		{
+		case DarkerColor:  return &blend_row_rgb_const<PhotoshopComput::darker_color>;
+		case LighterColor: return &blend_row_rgb_const<PhotoshopComput::lighter_color>;
+		case Saturation:   return &blend_row_rgb_const<PhotoshopComput::saturation>;
+		case Color:        return &blend_row_rgb_const<PhotoshopComput::color>;
+		case Luminosity:   return &blend_row_rgb_const<PhotoshopComput::luminosity>;
+		default:           return &blend_row_rgb_const<PhotoshopComput::hue>;
+		}
+	}
+
+	ConstRowKernel const_row_kernel(int mode, float b, SimdLevel level)
+	{
+		ConstRowKernel k = NULL;
+#if PS_X86_SIMD
+		switch (level)
+		{
+		case SimdAVX512: k = avx512::const_row_kernel(mode, b); break;
+		case SimdAVX2:   k = avx2::const_row_kernel(mode, b); break;
+		case SimdSSE41:  k = sse41::const_row_kernel(mode, b); break;
+		default: break;
+		}
+#endif
+		return k ? k : scalar_const_row_kernel(mode);
+	}
+
+	ConstRowKernel const_row_kernel(int mode, float b)
+	{
+		return const_row_kernel(mode, b, g_simd_level);
+	}
+
+	ConstColorRowKernel const_color_row_kernel(int mode, SimdLevel level)
+	{
+		ConstColorRowKernel k = NULL;
+#if PS_X86_SIMD
+		switch (level)
+		{
+		case SimdAVX512: k = avx512::const_color_row_kernel(mode); break;
+		case SimdAVX2:   k = avx2::const_color_row_kernel(mode); break;
+		case SimdSSE41:  k = sse41::const_color_row_kernel(mode); break;
+		default: break;
+		}
+#endif
+		return k ? k : scalar_const_color_row_kernel(mode);
+	}
+
+	ConstColorRowKernel const_color_row_kernel(int mode)
+	{
+		return const_color_row_kernel(mode, g_simd_level);
+	}
+
+	bool span_is_uniform(const float* p, int n)
+	{
+		if (n <= 0)
+			return false;
+		unsigned int first;
+		memcpy(&first, p, sizeof(first));
+		for (int i = 1; i < n; i++) {
+			unsigned int v;
+			memcpy(&v, p + i, sizeof(v));
+			if (v != first)
+				return false;
+		}
+		return true;
+	}
+
+	// murmur3 的 32 位收尾混合, 每一位输入都会影响所有输出位
+	static inline unsigned int dissolve_mix(unsigned int h)
+	{
+		h ^= h >> 16;
+		h *= 0x85EBCA6Bu;
+		h ^= h >> 13;
+		h *= 0xC2B2AE35u;
+		h ^= h >> 16;
+		return h;
+	}
+
+	// 一行内不变的部分 (seed, frame, y) 先混合好, 每个像素只剩 x 的一次乘加和一次混合
+	unsigned int dissolve_row_key(int y, const DissolveKey& key)
+	{
+		unsigned int h = dissolve_mix(key.seed * 0x9E3779B9u + 0x7F4A7C15u);
+		h = dissolve_mix(h ^ ((unsigned int)key.frame * 0x85EBCA77u));
+		return dissolve_mix(h ^ ((unsigned int)y * 0xC2B2AE3Du));
+	}
+
+	// 哈希的高 24 位换成 [0, 1) 的浮点数, 与 amount 比较
+	static inline bool dissolve_pick(unsigned int row, int x, float amount)
+	{
+		unsigned int h = dissolve_mix(row + (unsigned int)x * kDissolveStepX);
+		return (float)(int)(h >> 8) * (1.0f / 16777216.0f) < amount;
+	}
+
+	bool dissolve_pick_b(int x, int y, const DissolveKey& key)
+	{
+		return dissolve_pick(dissolve_row_key(y, key), x, key.amount);
+	}
+
+	static void scalar_dissolve_row(const float* a, const float* b, float* out, int n, int x, int y, const DissolveKey& key)
+	{
+		unsigned int row = dissolve_row_key(y, key);
+		for (int i = 0; i < n; i++)
+			out[i] = dissolve_pick(row, x + i, key.amount) ? b[i] : a[i];
+	}
+
+	DissolveRowKernel dissolve_row_kernel(SimdLevel level)
+	{
+#if PS_X86_SIMD
+		switch (level)
+		{
+		case SimdAVX512: return &avx512::dissolve_row;
+		case SimdAVX2:   return &avx2::dissolve_row;
+		case SimdSSE41:  return &sse41::dissolve_row;
+		default: break;
+		}
+#endif
+		return &scalar_dissolve_row;
+	}
+
+	DissolveRowKernel dissolve_row_kernel()
+	{
+		return dissolve_row_kernel(g_simd_level);
+	}
+
+	void blend_span(int mode, const float* a, const float* b, float* out, int n)
+	{
+		(*value_row_kernel(mode))(a, b, out, n);
+	}
+
+	void blend_span_rgb(int mode, const float* const* a, const float* const* b, float* const* out, int n)
+	{
+		(*color_row_kernel(mode))(a, b, out, n);
+	}
+}
@@ -0,0 +1,147 @@
+// ========================================
+// Photoshop 图层混合模式计算核心, 不依赖 DDImage.
+// 所有接口都在普通 float 数组上工作: 单通道行, 或者 R/G/B 三个平面.
+// ========================================
+#pragma once
+
+#define ARGB_LEVER 255.0f
+typedef float argb;
+
+namespace photoshopMergeTool {
+	enum PsBlend {
+		Normal, Darken, Multiply, ColorBurn, LinearBurn, DarkerColor, Lighten, Screen, ColorDodge, LinearDodge, LighterColor,
+		Overlay, SoftLight, HardLight, VividLight, LinearLight, PinLight, HardMix, Diference, Exclusion,
+		Hue, Saturation, Color, Luminosity, Dissolve,
+		// 自定义公式 (psExpr.h), 按可分离模式处理; 没有公式时与正常相同
+		Custom
+	};
+
+	enum PsMode {
+		asValueBlend, asColorBlend, asDissolveBlend
+	};
+
+	class PhotoshopComput
+	{
+	public:
+		PhotoshopComput() = default;
+		~PhotoshopComput() = default;
+		static float clump_to_ps_argb(float);
+		static float convert_from_argb(argb);
+		static argb inverted(argb);  // 反相
+		static float normal(float, float);  // 正常
+		static float darken(float, float);    // 变暗
+		static float multiply(float, float);  // 正片叠底
+		static float color_burn(float, float); // 颜色加深
+		static float linear_burn(float, float); // 线性加深
+		static void darker_color(const float* a, const float* b, float* r); // 深色
+		static float lighten(float, float);    // 变亮
+		static float screen(float, float); // 滤色
+		static float color_dodge(float, float); // 颜色减淡
+		static float linear_dodge(float, float); // 线性减淡
+		static void lighter_color(const float* a, const float* b, float* r); // 浅色
+		static float overlay(float, float); // 叠加
+		static float soft_light(float, float); // 柔光
+		static float hard_light(float, float); // 强光
+		static float vivid_light(float, float); // 亮光
+		static float linear_light(float, float); // 线性光
+		static float pin_light(float, float); // 点光
+		static float hard_mix(float, float); // 实色混合
+		static float diference(float, float); // 排除
+		static float exclusion(float, float); // 差值
+		static void hue(const float* a, const float* b, float* r); // 色相
+		static void saturation(const float* a, const float* b, float* r); // 饱和度
+		static void color(const float* a, const float* b, float* r); // 颜色
+		static void luminosity(const float* a, const float* b, float* r); // 亮度
+	};
+
+	// 行内核: out[i] = mode(a[i], b[i]), 颜色模式的 a, b, out 各是 {R, G, B} 三个平面指针
+	typedef void (*RowKernel)(const float* a, const float* b, float* out, int n);
+	typedef void (*ColorRowKernel)(const float* const* a, const float* const* b, float* const* out, int n);
+
+	// 溶解: 每个像素按 (x, y, frame, seed) 算一个哈希, 落在 amount 以内取 B, 否则取 A.
+	// 结果只由这几个数决定, 与线程 / 分块的处理顺序无关, 重复渲染也完全一致
+	struct DissolveKey {
+		int frame;
+		unsigned int seed;
+		float amount;
+	};
+	// B 为常数 (纯色层) 的行内核: 不读 B 的内存, 只与 B 有关的部分每行只算一次,
+	// 结果与普通内核逐位相同. 颜色模式的 b 是 {R, G, B} 三个值
+	typedef void (*ConstRowKernel)(const float* a, float b, float* out, int n);
+	typedef void (*ConstColorRowKernel)(const float* const* a, const float* b, float* const* out, int n);
+
+	typedef void (*DissolveRowKernel)(const float* a, const float* b, float* out, int n, int x, int y, const DissolveKey& key);
+
+	enum SimdLevel {
+		SimdScalar, SimdSSE41, SimdAVX2, SimdAVX512
+	};
+
+	// 计算用的数值域 (溶解只取 A 或 B, 与它无关):
+	// MathLegacy  原来的 0..255 公式, 结果与以前的版本逐位相同 (默认)
+	// MathClamped 直接在 0..1 上算, 不做缩放, 结果截到 [0, 1], 即 Photoshop 8 / 16 位文档的行为
+	// MathHdr     直接在 0..1 上算, 不截断, 场景线性的高光 (> 1) 穿过混合保留下来,
+	//             超出 0..1 时每种模式的延伸方式见 psBlendFloat.inl
+	enum BlendMath {
+		MathLegacy, MathClamped, MathHdr
+	};
+
+	// 柔光的算法, 只影响柔光 (细节和误差的测法见 psSoftLight.inl):
+	// SoftLightExact    与其它模式一样的公式 (默认)
+	// SoftLightAccurate 除以常数改成乘法, 与精确版本最多差约 7e-7
+	enum SoftLightPrecision {
+		SoftLightExact, SoftLightAccurate
+	};
+
+	// 菜单名字, 顺序与 PsBlend 一致, 以 NULL 结尾
+	extern const char* const blendModeNames[];
+	// 顺序与 BlendMath 一致, 以 NULL 结尾
+	extern const char* const blendMathNames[];
+	// 顺序与 SoftLightPrecision 一致, 以 NULL 结尾
+	extern const char* const softLightPrecisionNames[];
+
+	PsMode blend_mode_kind(int mode);
+
+	// 程序加载时按 CPUID 选好的指令集, PSMERGE_SIMD 环境变量可以往下压
+	SimdLevel simd_level();
+	const char* simd_level_name(SimdLevel level);
+
+	// 按模式取行内核, 不带 level 时使用 simd_level()
+	RowKernel value_row_kernel(int mode);
+	RowKernel value_row_kernel(int mode, SimdLevel level);
+	ColorRowKernel color_row_kernel(int mode);
+	ColorRowKernel color_row_kernel(int mode, SimdLevel level);
+	// 常数 B 的内核. 分段模式按 b 选好用到的那一段, 所以 b 变了要重新取
+	ConstRowKernel const_row_kernel(int mode, float b);
+	ConstRowKernel const_row_kernel(int mode, float b, SimdLevel level);
+	ConstColorRowKernel const_color_row_kernel(int mode);
+	ConstColorRowKernel const_color_row_kernel(int mode, SimdLevel level);
+
+	// 按数值域取内核 (psBlendFloat.cpp). MathLegacy 与上面不带 math 的版本相同
+	RowKernel value_row_kernel(int mode, BlendMath math);
+	RowKernel value_row_kernel(int mode, BlendMath math, SimdLevel level);
+	ColorRowKernel color_row_kernel(int mode, BlendMath math);
+	ColorRowKernel color_row_kernel(int mode, BlendMath math, SimdLevel level);
+	ConstRowKernel const_row_kernel(int mode, float b, BlendMath math);
+	ConstRowKernel const_row_kernel(int mode, float b, BlendMath math, SimdLevel level);
+	ConstColorRowKernel const_color_row_kernel(int mode, BlendMath math);
+	ConstColorRowKernel const_color_row_kernel(int mode, BlendMath math, SimdLevel level);
+
+	// 按 sqrt 的算法取柔光内核 (psBlendFloat.cpp). SoftLightExact 与上面 mode 为 SoftLight 的版本相同
+	RowKernel soft_light_row_kernel(BlendMath math, SoftLightPrecision precision);
+	RowKernel soft_light_row_kernel(BlendMath math, SoftLightPrecision precision, SimdLevel level);
+	ConstRowKernel soft_light_const_row_kernel(float b, BlendMath math, SoftLightPrecision precision);
+	ConstRowKernel soft_light_const_row_kernel(float b, BlendMath math, SoftLightPrecision precision, SimdLevel level);
+
+	// 整段的每个值 (按位) 都相同时返回 true, 用来发现纯色的 B 行
+	bool span_is_uniform(const float* p, int n);
+
+	DissolveRowKernel dissolve_row_kernel();
+	DissolveRowKernel dissolve_row_kernel(SimdLevel level);
+
+	// 像素 (x, y) 取 B 的判定, 与 dissolve_row_kernel 的结果一致
+	bool dissolve_pick_b(int x, int y, const DissolveKey& key);
+
+	// 一次性调用, 每次都会查表选内核; 热循环里应先取内核再反复调用
+	void blend_span(int mode, const float* a, const float* b, float* out, int n);
+	void blend_span_rgb(int mode, const float* const* a, const float* const* b, float* const* out, int n);
+}
@@ -0,0 +1,254 @@
+// ========================================
+// 0..1 浮点域的混合内核 (MathClamped / MathHdr)、柔光 accurate 版本和自定义公式求值的标量版本与内核选择.
+// 公式在 psBlendFloat.inl / psSoftLight.inl / psExpr.inl, 这里把它们实例化在 float 上; 向量版本在 psBlendSimd.cpp.
+// 标量的 vmin / vmax / vsel 与 SSE 指令在 NaN 上的取法一致, 所以各指令集结果逐位相同.
+// ========================================
+#include <cmath>
+#include <cstddef>
+#include <cstring>
+#include "psBlend.h"
+#include "psBlendSimd.h"
+
+namespace photoshopMergeTool {
+	const char* const blendMathNames[] = { "legacy", "clamped", "hdr", NULL };
+	const char* const softLightPrecisionNames[] = { "exact", "accurate", NULL };
+
+	namespace scalar {
+		typedef float vfloat;
+		typedef bool vmask;
+		static const int kWidth = 1;
+		static inline vfloat vset1(float a) { return a; }
+		static inline vfloat vloadu(const float* p) { return *p; }
+		static inline void vstoreu(float* p, vfloat a) { *p = a; }
+		static inline vfloat vadd(vfloat a, vfloat b) { return a + b; }
+		static inline vfloat vsub(vfloat a, vfloat b) { return a - b; }
+		static inline vfloat vmul(vfloat a, vfloat b) { return a * b; }
+		static inline vfloat vdiv(vfloat a, vfloat b) { return a / b; }
+		static inline vfloat vmin(vfloat a, vfloat b) { return a < b ? a : b; }
+		static inline vfloat vmax(vfloat a, vfloat b) { return a > b ? a : b; }
+		static inline vfloat vsqrt(vfloat a) { return std::sqrt(a); }
+		static inline vfloat vabs(vfloat a) { return std::fabs(a); }
+		static inline vmask veq(vfloat a, vfloat b) { return a == b; }
+		static inline vmask vlt(vfloat a, vfloat b) { return a < b; }
+		static inline vmask vle(vfloat a, vfloat b) { return a <= b; }
+		static inline vmask vgt(vfloat a, vfloat b) { return a > b; }
+		static inline vmask vge(vfloat a, vfloat b) { return a >= b; }
+		static inline vmask vor(vmask a, vmask b) { return a || b; }
+		static inline vmask vand(vmask a, vmask b) { return a && b; }
+		static inline vfloat vsel(vmask m, vfloat t, vfloat f) { return m ? t : f; }
+
+		template <vfloat (*Op)(vfloat, vfloat)>
+		void blend_row(const float* a, const float* b, float* out, int n)
+		{
+			for (int i = 0; i < n; i++)
+				out[i] = Op(a[i], b[i]);
+		}
+
+		template <void (*Op)(const vfloat*, const vfloat*, vfloat*)>
+		void blend_row_rgb(const float* const* a, const float* const* b, float* const* out, int n)
+		{
+			for (int i = 0; i < n; i++) {
+				float pa[3] = { a[0][i], a[1][i], a[2][i] };
+				float pb[3] = { b[0][i], b[1][i], b[2][i] };
+				float pr[3];
+				Op(pa, pb, pr);
+				out[0][i] = pr[0];
+				out[1][i] = pr[1];
+				out[2][i] = pr[2];
+			}
+		}
+
+		template <vfloat (*Op)(vfloat, vfloat)>
+		void blend_row_const(const float* a, float b, float* out, int n)
+		{
+			for (int i = 0; i < n; i++)
+				out[i] = Op(a[i], b);
+		}
+
+		template <void (*Op)(const vfloat*, const vfloat*, vfloat*)>
+		void blend_row_rgb_const(const float* const* a, const float* b, float* const* out, int n)
+		{
+			for (int i = 0; i < n; i++) {
+				float pa[3] = { a[0][i], a[1][i], a[2][i] };
+				float pr[3];
+				Op(pa, b, pr);
+				out[0][i] = pr[0];
+				out[1][i] = pr[1];
+				out[2][i] = pr[2];
+			}
+		}
+
+		namespace unit {
+#include "psBlendFloat.inl"
+		}
+		namespace soft {
+#include "psSoftLight.inl"
+		}
+		namespace expr {
+#include "psExpr.inl"
+		}
+	}
+
+	// 没有对应内核的模式 (溶解) 与 legacy 的标量版本一样退回正常 / 色相
+	RowKernel value_row_kernel(int mode, BlendMath math, SimdLevel level)
+	{
+		if (math == MathLegacy)
+			return value_row_kernel(mode, level);
+		bool hdr = math == MathHdr;
+		RowKernel k = NULL;
+#if PS_X86_SIMD
+		switch (level)
+		{
+		case SimdAVX512: k = avx512::unit::row_kernel(mode, hdr); break;
+		case SimdAVX2:   k = avx2::unit::row_kernel(mode, hdr); break;
+		case SimdSSE41:  k = sse41::unit::row_kernel(mode, hdr); break;
+		default: break;
+		}
+#endif
+		if (!k)
+			k = scalar::unit::row_kernel(mode, hdr);
+		return k ? k : scalar::unit::row_kernel(Normal, hdr);
+	}
+
+	RowKernel value_row_kernel(int mode, BlendMath math)
+	{
+		return value_row_kernel(mode, math, simd_level());
+	}
+
+	ColorRowKernel color_row_kernel(int mode, BlendMath math, SimdLevel level)
+	{
+		if (math == MathLegacy)
+			return color_row_kernel(mode, level);
+		bool hdr = math == MathHdr;
+		ColorRowKernel k = NULL;
+#if PS_X86_SIMD
+		switch (level)
+		{
+		case SimdAVX512: k = avx512::unit::color_row_kernel(mode, hdr); break;
+		case SimdAVX2:   k = avx2::unit::color_row_kernel(mode, hdr); break;
+		case SimdSSE41:  k = sse41::unit::color_row_kernel(mode, hdr); break;
+		default: break;
+		}
+#endif
+		if (!k)
+			k = scalar::unit::color_row_kernel(mode, hdr);
+		return k ? k : scalar::unit::color_row_kernel(Hue, hdr);
+	}
+
+	ColorRowKernel color_row_kernel(int mode, BlendMath math)
+	{
+		return color_row_kernel(mode, math, simd_level());
+	}
+
+	ConstRowKernel const_row_kernel(int mode, float b, BlendMath math, SimdLevel level)
+	{
+		if (math == MathLegacy)
+			return const_row_kernel(mode, b, level);
+		bool hdr = math == MathHdr;
+		ConstRowKernel k = NULL;
+#if PS_X86_SIMD
+		switch (level)
+		{
+		case SimdAVX512: k = avx512::unit::const_row_kernel(mode, hdr, b); break;
+		case SimdAVX2:   k = avx2::unit::const_row_kernel(mode, hdr, b); break;
+		case SimdSSE41:  k = sse41::unit::const_row_kernel(mode, hdr, b); break;
+		default: break;
+		}
+#endif
+		if (!k)
+			k = scalar::unit::const_row_kernel(mode, hdr, b);
+		return k ? k : scalar::unit::const_row_kernel(Normal, hdr, b);
+	}
+
+	ConstRowKernel const_row_kernel(int mode, float b, BlendMath math)
+	{
+		return const_row_kernel(mode, b, math, simd_level());
+	}
+
+	ConstColorRowKernel const_color_row_kernel(int mode, BlendMath math, SimdLevel level)
+	{
+		if (math == MathLegacy)
+			return const_color_row_kernel(mode, level);
+		bool hdr = math == MathHdr;
+		ConstColorRowKernel k = NULL;
+#if PS_X86_SIMD
+		switch (level)
+		{
+		case SimdAVX512: k = avx512::unit::const_color_row_kernel(mode, hdr); break;
+		case SimdAVX2:   k = avx2::unit::const_color_row_kernel(mode, hdr); break;
+		case SimdSSE41:  k = sse41::unit::const_color_row_kernel(mode, hdr); break;
+		default: break;
+		}
+#endif
+		if (!k)
+			k = scalar::unit::const_color_row_kernel(mode, hdr);
+		return k ? k : scalar::unit::const_color_row_kernel(Hue, hdr);
+	}
+
+	ConstColorRowKernel const_color_row_kernel(int mode, BlendMath math)
+	{
+		return const_color_row_kernel(mode, math, simd_level());
+	}
+
+	// 精确版本就是普通的柔光内核; accurate 每个指令集都有, 不会为空
+	RowKernel soft_light_row_kernel(BlendMath math, SoftLightPrecision precision, SimdLevel level)
+	{
+		if (precision == SoftLightExact)
+			return value_row_kernel(SoftLight, math, level);
+#if PS_X86_SIMD
+		switch (level)
+		{
+		case SimdAVX512: return avx512::soft::row_kernel(math);
+		case SimdAVX2:   return avx2::soft::row_kernel(math);
+		case SimdSSE41:  return sse41::soft::row_kernel(math);
+		default: break;
+		}
+#endif
+		return scalar::soft::row_kernel(math);
+	}
+
+	RowKernel soft_light_row_kernel(BlendMath math, SoftLightPrecision precision)
+	{
+		return soft_light_row_kernel(math, precision, simd_level());
+	}
+
+	ConstRowKernel soft_light_const_row_kernel(float b, BlendMath math, SoftLightPrecision precision, SimdLevel level)
+	{
+		if (precision == SoftLightExact)
+			return const_row_kernel(SoftLight, b, math, level);
+#if PS_X86_SIMD
+		switch (level)
+		{
+		case SimdAVX512: return avx512::soft::const_row_kernel(math, b);
+		case SimdAVX2:   return avx2::soft::const_row_kernel(math, b);
+		case SimdSSE41:  return sse41::soft::const_row_kernel(math, b);
+		default: break;
+		}
+#endif
+		return scalar::soft::const_row_kernel(math, b);
+	}
+
+	ConstRowKernel soft_light_const_row_kernel(float b, BlendMath math, SoftLightPrecision precision)
+	{
+		return soft_light_const_row_kernel(b, math, precision, simd_level());
+	}
+
+	ExprRowKernel expr_row_kernel(SimdLevel level)
+	{
+#if PS_X86_SIMD
+		switch (level)
+		{
+		case SimdAVX512: return &avx512::expr::run;
+		case SimdAVX2:   return &avx2::expr::run;
+		case SimdSSE41:  return &sse41::expr::run;
+		default: break;
+		}
+#endif
+		return &scalar::expr::run;
+	}
+
+	ExprRowKernel expr_row_kernel()
+	{
+		return expr_row_kernel(simd_level());
+	}
+}
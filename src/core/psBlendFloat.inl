@@ -0,0 +1,424 @@
+// ========================================
+// 0..1 浮点域的混合公式 (MathClamped / MathHdr), 不经过 0..255.
+// 由 psBlendFloat.cpp (标量, vfloat 就是 float) 和 psBlendSimd.cpp (每个指令集一次)
+// 在各自的 unit 命名空间里包含, 包含前需要定义 v* 基本运算和 blend_row /
+// blend_row_rgb / blend_row_const / blend_row_rgb_const 四个循环模板.
+//
+// 公式用 Photoshop 的标准形式 (叠加 / 强光的分界是 0.5, 系数是 2),
+// 所以 MathClamped 与 MathLegacy 里 128 / 255 这样的常数有差别 (叠加 / 柔光 / 强光最多约 0.004,
+// 排除约 0.008), 其它模式只差浮点舍入.
+// Hdr 为 false 时结果截到 [0, 1]; 为 true 时不截断, 超出 0..1 的输入按下面的规则延伸:
+//   滤色类 (滤色, 叠加 / 强光的亮部): 任一边大于 1 时取 max(a, b), 高光不会被反转
+//   除法类 (颜色加深 / 减淡, 亮光): 分母 <= 0 时加深取 0, 减淡取 max(a, 1), 不会出现 inf
+//   柔光: sqrt 的参数先截到 >= 0
+//   色相 / 饱和度 / 颜色 / 亮度: 只把低于 0 的分量收回来, 不再压到 1 以下
+// ========================================
+
+static inline vfloat one_minus(vfloat a) { return vsub(vset1(1.0f), a); }
+
+// NaN 原样传递, 与 clamp_argb 相同
+static inline vfloat clamp01(vfloat r) { return vmax(vset1(0.0f), vmin(vset1(1.0f), r)); }
+
+template <bool Hdr>
+static inline vfloat finish(vfloat r) { return Hdr ? r : clamp01(r); }
+
+// a + b - ab; Hdr 时任一边超过 1 取较大的一个
+template <bool Hdr>
+static inline vfloat screen_of(vfloat a, vfloat b)
+{
+	vfloat r = vsub(vadd(a, b), vmul(a, b));
+	if (!Hdr)
+		return r;
+	return vsel(vor(vgt(a, vset1(1.0f)), vgt(b, vset1(1.0f))), vmax(a, b), r);
+}
+
+template <bool Hdr>
+static inline vfloat normal(vfloat, vfloat b)
+{
+	return b;
+}
+
+template <bool Hdr>
+static inline vfloat darken(vfloat a, vfloat b)
+{
+	return finish<Hdr>(vsel(vge(a, b), b, a));
+}
+
+template <bool Hdr>
+static inline vfloat multiply(vfloat a, vfloat b)
+{
+	return finish<Hdr>(vmul(a, b));
+}
+
+// 与 legacy 相同的形状: a - (1 - a)(1 - b) / b, b <= 0 时为 0
+template <bool Hdr>
+static inline vfloat color_burn(vfloat a, vfloat b)
+{
+	vfloat r = vsub(a, vdiv(vmul(one_minus(a), one_minus(b)), b));
+	return vsel(vle(b, vset1(0.0f)), vset1(0.0f), finish<Hdr>(r));
+}
+
+template <bool Hdr>
+static inline vfloat linear_burn(vfloat a, vfloat b)
+{
+	return finish<Hdr>(vsub(vadd(a, b), vset1(1.0f)));
+}
+
+template <bool Hdr>
+static inline vfloat lighten(vfloat a, vfloat b)
+{
+	return finish<Hdr>(vsel(vge(a, b), a, b));
+}
+
+template <bool Hdr>
+static inline vfloat screen(vfloat a, vfloat b)
+{
+	return finish<Hdr>(screen_of<Hdr>(a, b));
+}
+
+// a + ab / (1 - b), b >= 1 时为白 (Hdr 时保留大于 1 的 a)
+template <bool Hdr>
+static inline vfloat color_dodge(vfloat a, vfloat b)
+{
+	vfloat inv_b = one_minus(b);
+	vfloat r = vadd(a, vdiv(vmul(a, b), inv_b));
+	vfloat white = Hdr ? vmax(a, vset1(1.0f)) : vset1(1.0f);
+	return vsel(vle(inv_b, vset1(0.0f)), white, finish<Hdr>(r));
+}
+
+template <bool Hdr>
+static inline vfloat linear_dodge(vfloat a, vfloat b)
+{
+	return finish<Hdr>(vadd(a, b));
+}
+
+template <bool Hdr>
+static inline vfloat overlay(vfloat a, vfloat b)
+{
+	vfloat lo = vmul(vmul(vset1(2.0f), a), b);
+	vfloat hi = screen_of<Hdr>(vsub(vmul(vset1(2.0f), a), vset1(1.0f)), b);
+	return finish<Hdr>(vsel(vle(a, vset1(0.5f)), lo, hi));
+}
+
+// 按 B <= 0.5 分两段的模式, 两段各一个函数, B 为常数时只算用到的那一段
+template <bool Hdr>
+static inline vfloat soft_light_lo(vfloat a, vfloat b)
+{
+	// 2ab + a^2 (1 - 2b)
+	return vadd(vmul(vmul(vset1(2.0f), a), b), vmul(vmul(a, a), vsub(vset1(1.0f), vmul(vset1(2.0f), b))));
+}
+
+template <bool Hdr>
+static inline vfloat soft_light_hi(vfloat a, vfloat b)
+{
+	// 2a (1 - b) + sqrt(a) (2b - 1)
+	// 截断的数值域也不截输入, A < 0 时 sqrt 取 0
+	vfloat root = vsqrt(vmax(a, vset1(0.0f)));
+	return vadd(vmul(vmul(vset1(2.0f), a), one_minus(b)), vmul(root, vsub(vmul(vset1(2.0f), b), vset1(1.0f))));
+}
+
+template <bool Hdr>
+static inline vfloat soft_light(vfloat a, vfloat b)
+{
+	return finish<Hdr>(vsel(vle(b, vset1(0.5f)), soft_light_lo<Hdr>(a, b), soft_light_hi<Hdr>(a, b)));
+}
+
+template <bool Hdr>
+static inline vfloat hard_light_lo(vfloat a, vfloat b)
+{
+	return vmul(vmul(vset1(2.0f), a), b);
+}
+
+template <bool Hdr>
+static inline vfloat hard_light_hi(vfloat a, vfloat b)
+{
+	return screen_of<Hdr>(a, vsub(vmul(vset1(2.0f), b), vset1(1.0f)));
+}
+
+template <bool Hdr>
+static inline vfloat hard_light(vfloat a, vfloat b)
+{
+	return finish<Hdr>(vsel(vle(b, vset1(0.5f)), hard_light_lo<Hdr>(a, b), hard_light_hi<Hdr>(a, b)));
+}
+
+// 暗部是 2b 的颜色加深, 亮部是 2b - 1 的颜色减淡, 分母为 0 的两端同样处理
+template <bool Hdr>
+static inline vfloat vivid_light_lo(vfloat a, vfloat b)
+{
+	vfloat two_b = vmul(vset1(2.0f), b);
+	vfloat r = vsub(a, vdiv(vmul(one_minus(a), one_minus(two_b)), two_b));
+	return vsel(vle(b, vset1(0.0f)), vset1(0.0f), finish<Hdr>(r));
+}
+
+template <bool Hdr>
+static inline vfloat vivid_light_hi(vfloat a, vfloat b)
+{
+	vfloat inv_b = one_minus(b);
+	vfloat r = vadd(a, vdiv(vmul(a, vsub(vmul(vset1(2.0f), b), vset1(1.0f))), vmul(vset1(2.0f), inv_b)));
+	vfloat white = Hdr ? vmax(a, vset1(1.0f)) : vset1(1.0f);
+	return vsel(vle(inv_b, vset1(0.0f)), white, finish<Hdr>(r));
+}
+
+template <bool Hdr>
+static inline vfloat vivid_light(vfloat a, vfloat b)
+{
+	return vsel(vle(b, vset1(0.5f)), vivid_light_lo<Hdr>(a, b), vivid_light_hi<Hdr>(a, b));
+}
+
+template <bool Hdr>
+static inline vfloat linear_light(vfloat a, vfloat b)
+{
+	return finish<Hdr>(vsub(vadd(a, vmul(vset1(2.0f), b)), vset1(1.0f)));
+}
+
+template <bool Hdr>
+static inline vfloat pin_light_lo(vfloat a, vfloat b)
+{
+	return vmin(a, vmul(vset1(2.0f), b));
+}
+
+template <bool Hdr>
+static inline vfloat pin_light_hi(vfloat a, vfloat b)
+{
+	return vmax(a, vsub(vmul(vset1(2.0f), b), vset1(1.0f)));
+}
+
+template <bool Hdr>
+static inline vfloat pin_light(vfloat a, vfloat b)
+{
+	return finish<Hdr>(vsel(vle(b, vset1(0.5f)), pin_light_lo<Hdr>(a, b), pin_light_hi<Hdr>(a, b)));
+}
+
+// 实色混合本来就只有 0 和 1 两个结果
+template <bool Hdr>
+static inline vfloat hard_mix(vfloat a, vfloat b)
+{
+	return vsel(vgt(vadd(a, b), vset1(1.0f)), vset1(1.0f), vset1(0.0f));
+}
+
+template <bool Hdr>
+static inline vfloat diference(vfloat a, vfloat b)
+{
+	return finish<Hdr>(vabs(vsub(a, b)));
+}
+
+template <bool Hdr>
+static inline vfloat exclusion(vfloat a, vfloat b)
+{
+	return finish<Hdr>(vsub(vadd(a, b), vmul(vmul(vset1(2.0f), a), b)));
+}
+
+// B 为常数时已经确定走哪一段
+template <vfloat (*Side)(vfloat, vfloat), bool Hdr>
+static inline vfloat one_side(vfloat a, vfloat b)
+{
+	return finish<Hdr>(Side(a, b));
+}
+
+// 颜色模式: a, b, r 都是 {R, G, B}
+template <bool Hdr>
+static inline void darker_color(const vfloat* a, const vfloat* b, vfloat* r)
+{
+	vmask m = vge(vadd(vadd(b[0], b[1]), b[2]), vadd(vadd(a[0], a[1]), a[2]));
+	for (int i = 0; i < 3; i++)
+		r[i] = finish<Hdr>(vsel(m, a[i], b[i]));
+}
+
+template <bool Hdr>
+static inline void lighter_color(const vfloat* a, const vfloat* b, vfloat* r)
+{
+	vmask m = vge(vadd(vadd(b[0], b[1]), b[2]), vadd(vadd(a[0], a[1]), a[2]));
+	for (int i = 0; i < 3; i++)
+		r[i] = finish<Hdr>(vsel(m, b[i], a[i]));
+}
+
+static inline vfloat hsl_lum(const vfloat* c)
+{
+	return vadd(vadd(vmul(vset1(0.3f), c[0]), vmul(vset1(0.59f), c[1])), vmul(vset1(0.11f), c[2]));
+}
+
+static inline vfloat hsl_min(const vfloat* c) { return vmin(vmin(c[0], c[1]), c[2]); }
+static inline vfloat hsl_max(const vfloat* c) { return vmax(vmax(c[0], c[1]), c[2]); }
+
+static inline vfloat hsl_sat(const vfloat* c)
+{
+	return vsub(hsl_max(c), hsl_min(c));
+}
+
+static inline void hsl_set_sat(vfloat* c, vfloat s)
+{
+	vfloat n = hsl_min(c);
+	vfloat d = vsub(hsl_max(c), n);
+	vmask has_sat = vgt(d, vset1(0.0f));
+	for (int i = 0; i < 3; i++)
+		c[i] = vsel(has_sat, vdiv(vmul(vsub(c[i], n), s), d), vset1(0.0f));
+}
+
+// 截色: 低于 0 的分量按亮度收回 (亮度本身 <= 0 时没有可保持的亮度, 不动);
+// 只有 Hdr 为 false 时才把高于 1 的分量压回来. 灰色超出范围时分母为 0, 也不动, 由 finish 截断
+template <bool Hdr>
+static inline void hsl_set_lum(vfloat* c, vfloat l)
+{
+	vfloat d = vsub(l, hsl_lum(c));
+	for (int i = 0; i < 3; i++)
+		c[i] = vadd(c[i], d);
+	vfloat cl = hsl_lum(c);
+	vfloat n = hsl_min(c);
+	vfloat x = hsl_max(c);
+	vmask under = vand(vlt(n, vset1(0.0f)), vgt(cl, Hdr ? vset1(0.0f) : n));
+	for (int i = 0; i < 3; i++)
+		c[i] = vsel(under, vadd(vdiv(vmul(vsub(c[i], cl), cl), vsub(cl, n)), cl), c[i]);
+	if (Hdr)
+		return;
+	vmask over = vand(vgt(x, vset1(1.0f)), vgt(x, cl));
+	for (int i = 0; i < 3; i++)
+		c[i] = vsel(over, vadd(vdiv(vmul(vsub(c[i], cl), one_minus(cl)), vsub(x, cl)), cl), c[i]);
+}
+
+template <bool Hdr>
+static inline void hsl_result(const vfloat* c, vfloat* r)
+{
+	for (int i = 0; i < 3; i++)
+		r[i] = finish<Hdr>(c[i]);
+}
+
+template <bool Hdr>
+static inline void hue(const vfloat* a, const vfloat* b, vfloat* r)
+{
+	vfloat r_1[3] = { b[0], b[1], b[2] };
+	hsl_set_sat(r_1, hsl_sat(a));
+	hsl_set_lum<Hdr>(r_1, hsl_lum(a));
+	hsl_result<Hdr>(r_1, r);
+}
+
+template <bool Hdr>
+static inline void saturation(const vfloat* a, const vfloat* b, vfloat* r)
+{
+	vfloat r_1[3] = { a[0], a[1], a[2] };
+	vfloat l = hsl_lum(r_1);
+	hsl_set_sat(r_1, hsl_sat(b));
+	hsl_set_lum<Hdr>(r_1, l);
+	hsl_result<Hdr>(r_1, r);
+}
+
+template <bool Hdr>
+static inline void color(const vfloat* a, const vfloat* b, vfloat* r)
+{
+	vfloat r_1[3] = { b[0], b[1], b[2] };
+	hsl_set_lum<Hdr>(r_1, hsl_lum(a));
+	hsl_result<Hdr>(r_1, r);
+}
+
+template <bool Hdr>
+static inline void luminosity(const vfloat* a, const vfloat* b, vfloat* r)
+{
+	vfloat r_1[3] = { a[0], a[1], a[2] };
+	hsl_set_lum<Hdr>(r_1, hsl_lum(b));
+	hsl_result<Hdr>(r_1, r);
+}
+
+template <bool Hdr>
+RowKernel row_kernel_of(int mode)
+{
+	switch (mode)
+	{
+	case Normal:       return &blend_row<normal<Hdr> >;
+	case Darken:       return &blend_row<darken<Hdr> >;
+	case Multiply:     return &blend_row<multiply<Hdr> >;
+	case ColorBurn:    return &blend_row<color_burn<Hdr> >;
+	case LinearBurn:   return &blend_row<linear_burn<Hdr> >;
+	case Lighten:      return &blend_row<lighten<Hdr> >;
+	case Screen:       return &blend_row<screen<Hdr> >;
+	case ColorDodge:   return &blend_row<color_dodge<Hdr> >;
+	case LinearDodge:  return &blend_row<linear_dodge<Hdr> >;
+	case Overlay:      return &blend_row<overlay<Hdr> >;
+	case SoftLight:    return &blend_row<soft_light<Hdr> >;
+	case HardLight:    return &blend_row<hard_light<Hdr> >;
+	case VividLight:   return &blend_row<vivid_light<Hdr> >;
+	case LinearLight:  return &blend_row<linear_light<Hdr> >;
+	case PinLight:     return &blend_row<pin_light<Hdr> >;
+	case HardMix:      return &blend_row<hard_mix<Hdr> >;
+	case Diference:    return &blend_row<diference<Hdr> >;
+	case Exclusion:    return &blend_row<exclusion<Hdr> >;
+	default:           return NULL;
+	}
+}
+
+template <bool Hdr>
+ColorRowKernel color_row_kernel_of(int mode)
+{
+	switch (mode)
+	{
+	case DarkerColor:  return &blend_row_rgb<darker_color<Hdr> >;
+	case LighterColor: return &blend_row_rgb<lighter_color<Hdr> >;
+	case Hue:          return &blend_row_rgb<hue<Hdr> >;
+	case Saturation:   return &blend_row_rgb<saturation<Hdr> >;
+	case Color:        return &blend_row_rgb<color<Hdr> >;
+	case Luminosity:   return &blend_row_rgb<luminosity<Hdr> >;
+	default:           return NULL;
+	}
+}
+
+template <bool Hdr>
+ConstRowKernel const_row_kernel_of(int mode, float b)
+{
+	// 与 vle(b, 0.5) 相同的判断, NaN 走第二段
+	bool lo = b <= 0.5f;
+	switch (mode)
+	{
+	case SoftLight:    return lo ? &blend_row_const<one_side<soft_light_lo<Hdr>, Hdr> > : &blend_row_const<one_side<soft_light_hi<Hdr>, Hdr> >;
+	case HardLight:    return lo ? &blend_row_const<one_side<hard_light_lo<Hdr>, Hdr> > : &blend_row_const<one_side<hard_light_hi<Hdr>, Hdr> >;
+	case VividLight:   return lo ? &blend_row_const<vivid_light_lo<Hdr> > : &blend_row_const<vivid_light_hi<Hdr> >;
+	case PinLight:     return lo ? &blend_row_const<one_side<pin_light_lo<Hdr>, Hdr> > : &blend_row_const<one_side<pin_light_hi<Hdr>, Hdr> >;
+	case Normal:       return &blend_row_const<normal<Hdr> >;
+	case Darken:       return &blend_row_const<darken<Hdr> >;
+	case Multiply:     return &blend_row_const<multiply<Hdr> >;
+	case ColorBurn:    return &blend_row_const<color_burn<Hdr> >;
+	case LinearBurn:   return &blend_row_const<linear_burn<Hdr> >;
+	case Lighten:      return &blend_row_const<lighten<Hdr> >;
+	case Screen:       return &blend_row_const<screen<Hdr> >;
+	case ColorDodge:   return &blend_row_const<color_dodge<Hdr> >;
+	case LinearDodge:  return &blend_row_const<linear_dodge<Hdr> >;
+	case Overlay:      return &blend_row_const<overlay<Hdr> >;
+	case LinearLight:  return &blend_row_const<linear_light<Hdr> >;
+	case HardMix:      return &blend_row_const<hard_mix<Hdr> >;
+	case Diference:    return &blend_row_const<diference<Hdr> >;
+	case Exclusion:    return &blend_row_const<exclusion<Hdr> >;
+	default:           return NULL;
+	}
+}
+
+template <bool Hdr>
+ConstColorRowKernel const_color_row_kernel_of(int mode)
+{
+	switch (mode)
+	{
+	case DarkerColor:  return &blend_row_rgb_const<darker_color<Hdr> >;
+	case LighterColor: return &blend_row_rgb_const<lighter_color<Hdr> >;
+	case Hue:          return &blend_row_rgb_const<hue<Hdr> >;
+	case Saturation:   return &blend_row_rgb_const<saturation<Hdr> >;
+	case Color:        return &blend_row_rgb_const<color<Hdr> >;
+	case Luminosity:   return &blend_row_rgb_const<luminosity<Hdr> >;
+	default:           return NULL;
+	}
+}
+
+RowKernel row_kernel(int mode, bool hdr)
+{
+	return hdr ? row_kernel_of<true>(mode) : row_kernel_of<false>(mode);
+}
+
+ColorRowKernel color_row_kernel(int mode, bool hdr)
+{
+	return hdr ? color_row_kernel_of<true>(mode) : color_row_kernel_of<false>(mode);
+}
+
+ConstRowKernel const_row_kernel(int mode, bool hdr, float b)
+{
+	return hdr ? const_row_kernel_of<true>(mode, b) : const_row_kernel_of<false>(mode, b);
+}
+
+ConstColorRowKernel const_color_row_kernel(int mode, bool hdr)
+{
+	return hdr ? const_color_row_kernel_of<true>(mode) : const_color_row_kernel_of<false>(mode);
+}
@@ -0,0 +1,169 @@
+// ========================================
+// 混合模式的 SSE4.1 / AVX2 / AVX-512 内核.
+// 每个指令集在自己的 target 区域里包含一次 psBlendSimd.inl (0..255 公式),
+// psBlendFloat.inl (0..1 公式, 放在 unit 子命名空间)、psSoftLight.inl (柔光 accurate, soft 子命名空间)
+// 和 psExpr.inl (自定义公式, expr 子命名空间),
+// 所以整个文件用默认编译选项即可, 由 psBlend.cpp 在运行时选择.
+// ========================================
+#include "psBlendSimd.h"
+
+#if PS_X86_SIMD
+#include <cstring>
+#include <immintrin.h>
+
+// 为一段代码打开指定指令集 (MSVC 不需要, 内置函数总是可用).
+// avx512f 同时带有 FMA, 关闭乘加合并以保持与标量版本逐位相同.
+#if defined(__clang__)
+#define PS_TARGET_SSE41  _Pragma("clang attribute push (__attribute__((target(\"sse4.1\"))), apply_to = function)")
+#define PS_TARGET_AVX2   _Pragma("clang attribute push (__attribute__((target(\"avx2\"))), apply_to = function)")
+#define PS_TARGET_AVX512 _Pragma("clang attribute push (__attribute__((target(\"avx512f\"))), apply_to = function)")
+#define PS_TARGET_END    _Pragma("clang attribute pop")
+#elif defined(__GNUC__)
+#define PS_TARGET_SSE41  _Pragma("GCC push_options") _Pragma("GCC target(\"sse4.1\")")
+#define PS_TARGET_AVX2   _Pragma("GCC push_options") _Pragma("GCC target(\"avx2\")")
+#define PS_TARGET_AVX512 _Pragma("GCC push_options") _Pragma("GCC target(\"avx512f\")") _Pragma("GCC optimize(\"fp-contract=off\")")
+#define PS_TARGET_END    _Pragma("GCC pop_options")
+#else
+#define PS_TARGET_SSE41
+#define PS_TARGET_AVX2
+#define PS_TARGET_AVX512
+#define PS_TARGET_END
+#endif
+
+namespace photoshopMergeTool {
+PS_TARGET_SSE41
+	namespace sse41 {
+		typedef __m128 vfloat;
+		typedef __m128 vmask;
+		static const int kWidth = 4;
+		static inline vfloat vset1(float a) { return _mm_set1_ps(a); }
+		static inline vfloat vloadu(const float* p) { return _mm_loadu_ps(p); }
+		static inline void vstoreu(float* p, vfloat a) { _mm_storeu_ps(p, a); }
+		static inline vfloat vadd(vfloat a, vfloat b) { return _mm_add_ps(a, b); }
+		static inline vfloat vsub(vfloat a, vfloat b) { return _mm_sub_ps(a, b); }
+		static inline vfloat vmul(vfloat a, vfloat b) { return _mm_mul_ps(a, b); }
+		static inline vfloat vdiv(vfloat a, vfloat b) { return _mm_div_ps(a, b); }
+		static inline vfloat vmin(vfloat a, vfloat b) { return _mm_min_ps(a, b); }
+		static inline vfloat vmax(vfloat a, vfloat b) { return _mm_max_ps(a, b); }
+		static inline vfloat vsqrt(vfloat a) { return _mm_sqrt_ps(a); }
+		static inline vfloat vabs(vfloat a) { return _mm_andnot_ps(_mm_set1_ps(-0.0f), a); }
+		static inline vmask veq(vfloat a, vfloat b) { return _mm_cmpeq_ps(a, b); }
+		static inline vmask vlt(vfloat a, vfloat b) { return _mm_cmplt_ps(a, b); }
+		static inline vmask vle(vfloat a, vfloat b) { return _mm_cmple_ps(a, b); }
+		static inline vmask vgt(vfloat a, vfloat b) { return _mm_cmpgt_ps(a, b); }
+		static inline vmask vge(vfloat a, vfloat b) { return _mm_cmpge_ps(a, b); }
+		static inline vmask vor(vmask a, vmask b) { return _mm_or_ps(a, b); }
+		static inline vmask vand(vmask a, vmask b) { return _mm_and_ps(a, b); }
+		static inline vfloat vsel(vmask m, vfloat t, vfloat f) { return _mm_blendv_ps(f, t, m); }
+		typedef __m128i vint;
+		static inline vint viset1(unsigned int a) { return _mm_set1_epi32((int)a); }
+		static inline vint viota() { return _mm_setr_epi32(0, 1, 2, 3); }
+		static inline vint viadd(vint a, vint b) { return _mm_add_epi32(a, b); }
+		static inline vint vimul(vint a, vint b) { return _mm_mullo_epi32(a, b); }
+		static inline vint vixor(vint a, vint b) { return _mm_xor_si128(a, b); }
+		template <int N> static inline vint visrl(vint a) { return _mm_srli_epi32(a, N); }
+		static inline vfloat vcvt(vint a) { return _mm_cvtepi32_ps(a); }
+#include "psBlendSimd.inl"
+		namespace unit {
+#include "psBlendFloat.inl"
+		}
+		namespace soft {
+#include "psSoftLight.inl"
+		}
+		namespace expr {
+#include "psExpr.inl"
+		}
+	}
+PS_TARGET_END
+
+PS_TARGET_AVX2
+	namespace avx2 {
+		typedef __m256 vfloat;
+		typedef __m256 vmask;
+		static const int kWidth = 8;
+		static inline vfloat vset1(float a) { return _mm256_set1_ps(a); }
+		static inline vfloat vloadu(const float* p) { return _mm256_loadu_ps(p); }
+		static inline void vstoreu(float* p, vfloat a) { _mm256_storeu_ps(p, a); }
+		static inline vfloat vadd(vfloat a, vfloat b) { return _mm256_add_ps(a, b); }
+		static inline vfloat vsub(vfloat a, vfloat b) { return _mm256_sub_ps(a, b); }
+		static inline vfloat vmul(vfloat a, vfloat b) { return _mm256_mul_ps(a, b); }
+		static inline vfloat vdiv(vfloat a, vfloat b) { return _mm256_div_ps(a, b); }
+		static inline vfloat vmin(vfloat a, vfloat b) { return _mm256_min_ps(a, b); }
+		static inline vfloat vmax(vfloat a, vfloat b) { return _mm256_max_ps(a, b); }
+		static inline vfloat vsqrt(vfloat a) { return _mm256_sqrt_ps(a); }
+		static inline vfloat vabs(vfloat a) { return _mm256_andnot_ps(_mm256_set1_ps(-0.0f), a); }
+		static inline vmask veq(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_EQ_OQ); }
+		static inline vmask vlt(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_LT_OQ); }
+		static inline vmask vle(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_LE_OQ); }
+		static inline vmask vgt(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_GT_OQ); }
+		static inline vmask vge(vfloat a, vfloat b) { return _mm256_cmp_ps(a, b, _CMP_GE_OQ); }
+		static inline vmask vor(vmask a, vmask b) { return _mm256_or_ps(a, b); }
+		static inline vmask vand(vmask a, vmask b) { return _mm256_and_ps(a, b); }
+		static inline vfloat vsel(vmask m, vfloat t, vfloat f) { return _mm256_blendv_ps(f, t, m); }
+		typedef __m256i vint;
+		static inline vint viset1(unsigned int a) { return _mm256_set1_epi32((int)a); }
+		static inline vint viota() { return _mm256_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7); }
+		static inline vint viadd(vint a, vint b) { return _mm256_add_epi32(a, b); }
+		static inline vint vimul(vint a, vint b) { return _mm256_mullo_epi32(a, b); }
+		static inline vint vixor(vint a, vint b) { return _mm256_xor_si256(a, b); }
+		template <int N> static inline vint visrl(vint a) { return _mm256_srli_epi32(a, N); }
+		static inline vfloat vcvt(vint a) { return _mm256_cvtepi32_ps(a); }
+#include "psBlendSimd.inl"
+		namespace unit {
+#include "psBlendFloat.inl"
+		}
+		namespace soft {
+#include "psSoftLight.inl"
+		}
+		namespace expr {
+#include "psExpr.inl"
+		}
+	}
+PS_TARGET_END
+
+PS_TARGET_AVX512
+	namespace avx512 {
+		typedef __m512 vfloat;
+		typedef __mmask16 vmask;
+		static const int kWidth = 16;
+		static inline vfloat vset1(float a) { return _mm512_set1_ps(a); }
+		static inline vfloat vloadu(const float* p) { return _mm512_loadu_ps(p); }
+		static inline void vstoreu(float* p, vfloat a) { _mm512_storeu_ps(p, a); }
+		static inline vfloat vadd(vfloat a, vfloat b) { return _mm512_add_ps(a, b); }
+		static inline vfloat vsub(vfloat a, vfloat b) { return _mm512_sub_ps(a, b); }
+		static inline vfloat vmul(vfloat a, vfloat b) { return _mm512_mul_ps(a, b); }
+		static inline vfloat vdiv(vfloat a, vfloat b) { return _mm512_div_ps(a, b); }
+		static inline vfloat vmin(vfloat a, vfloat b) { return _mm512_min_ps(a, b); }
+		static inline vfloat vmax(vfloat a, vfloat b) { return _mm512_max_ps(a, b); }
+		static inline vfloat vsqrt(vfloat a) { return _mm512_sqrt_ps(a); }
+		static inline vfloat vabs(vfloat a) { return _mm512_castsi512_ps(_mm512_and_si512(_mm512_castps_si512(a), _mm512_set1_epi32(0x7fffffff))); }
+		static inline vmask veq(vfloat a, vfloat b) { return _mm512_cmp_ps_mask(a, b, _CMP_EQ_OQ); }
+		static inline vmask vlt(vfloat a, vfloat b) { return _mm512_cmp_ps_mask(a, b, _CMP_LT_OQ); }
+		static inline vmask vle(vfloat a, vfloat b) { return _mm512_cmp_ps_mask(a, b, _CMP_LE_OQ); }
+		static inline vmask vgt(vfloat a, vfloat b) { return _mm512_cmp_ps_mask(a, b, _CMP_GT_OQ); }
+		static inline vmask vge(vfloat a, vfloat b) { return _mm512_cmp_ps_mask(a, b, _CMP_GE_OQ); }
+		static inline vmask vor(vmask a, vmask b) { return (vmask)(a | b); }
+		static inline vmask vand(vmask a, vmask b) { return (vmask)(a & b); }
+		static inline vfloat vsel(vmask m, vfloat t, vfloat f) { return _mm512_mask_blend_ps(m, f, t); }
+		typedef __m512i vint;
+		static inline vint viset1(unsigned int a) { return _mm512_set1_epi32((int)a); }
+		static inline vint viota() { return _mm512_setr_epi32(0, 1, 2, 3, 4, 5, 6, 7, 8, 9, 10, 11, 12, 13, 14, 15); }
+		static inline vint viadd(vint a, vint b) { return _mm512_add_epi32(a, b); }
+		static inline vint vimul(vint a, vint b) { return _mm512_mullo_epi32(a, b); }
+		static inline vint vixor(vint a, vint b) { return _mm512_xor_si512(a, b); }
+		template <int N> static inline vint visrl(vint a) { return _mm512_srli_epi32(a, N); }
+		static inline vfloat vcvt(vint a) { return _mm512_cvtepi32_ps(a); }
+#include "psBlendSimd.inl"
+		namespace unit {
+#include "psBlendFloat.inl"
+		}
+		namespace soft {
+#include "psSoftLight.inl"
+		}
+		namespace expr {
+#include "psExpr.inl"
+		}
+	}
+PS_TARGET_END
+}
+#endif
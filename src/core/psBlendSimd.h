@@ -0,0 +1,83 @@
+// ========================================
+// psBlend 内部使用: 各指令集版本的内核表, 定义在 psBlendSimd.cpp.
+// ========================================
+#pragma once
+#include "psBlend.h"
+#include "psExpr.h"
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define PS_X86_SIMD 1
+#else
+#define PS_X86_SIMD 0
+#endif
+
+namespace photoshopMergeTool {
+	// 溶解哈希的公共部分, 标量和向量版本都用它们 (定义在 psBlend.cpp)
+	static const unsigned int kDissolveStepX = 0x9E3779B1u;
+	unsigned int dissolve_row_key(int y, const DissolveKey& key);
+}
+
+#if PS_X86_SIMD
+namespace photoshopMergeTool {
+	namespace sse41 {
+		RowKernel row_kernel(int mode);
+		ColorRowKernel color_row_kernel(int mode);
+		void dissolve_row(const float* a, const float* b, float* out, int n, int x, int y, const DissolveKey& key);
+		ConstRowKernel const_row_kernel(int mode, float b);
+		ConstColorRowKernel const_color_row_kernel(int mode);
+		namespace unit {
+			RowKernel row_kernel(int mode, bool hdr);
+			ColorRowKernel color_row_kernel(int mode, bool hdr);
+			ConstRowKernel const_row_kernel(int mode, bool hdr, float b);
+			ConstColorRowKernel const_color_row_kernel(int mode, bool hdr);
+		}
+		namespace soft {
+			RowKernel row_kernel(BlendMath math);
+			ConstRowKernel const_row_kernel(BlendMath math, float b);
+		}
+		namespace expr {
+			void run(const ExprOp* code, int count, const float* consts, const float* a, const float* b, float* out, int n);
+		}
+	}
+	namespace avx2 {
+		RowKernel row_kernel(int mode);
+		ColorRowKernel color_row_kernel(int mode);
+		void dissolve_row(const float* a, const float* b, float* out, int n, int x, int y, const DissolveKey& key);
+		ConstRowKernel const_row_kernel(int mode, float b);
+		ConstColorRowKernel const_color_row_kernel(int mode);
+		namespace unit {
+			RowKernel row_kernel(int mode, bool hdr);
+			ColorRowKernel color_row_kernel(int mode, bool hdr);
+			ConstRowKernel const_row_kernel(int mode, bool hdr, float b);
+			ConstColorRowKernel const_color_row_kernel(int mode, bool hdr);
+		}
+		namespace soft {
+			RowKernel row_kernel(BlendMath math);
+			ConstRowKernel const_row_kernel(BlendMath math, float b);
+		}
+		namespace expr {
+			void run(const ExprOp* code, int count, const float* consts, const float* a, const float* b, float* out, int n);
+		}
+	}
+	namespace avx512 {
+		RowKernel row_kernel(int mode);
+		ColorRowKernel color_row_kernel(int mode);
+		void dissolve_row(const float* a, const float* b, float* out, int n, int x, int y, const DissolveKey& key);
+		ConstRowKernel const_row_kernel(int mode, float b);
+		ConstColorRowKernel const_color_row_kernel(int mode);
+		namespace unit {
+			RowKernel row_kernel(int mode, bool hdr);
+			ColorRowKernel color_row_kernel(int mode, bool hdr);
+			ConstRowKernel const_row_kernel(int mode, bool hdr, float b);
+			ConstColorRowKernel const_color_row_kernel(int mode, bool hdr);
+		}
+		namespace soft {
+			RowKernel row_kernel(BlendMath math);
+			ConstRowKernel const_row_kernel(BlendMath math, float b);
+		}
+		namespace expr {
+			void run(const ExprOp* code, int count, const float* consts, const float* a, const float* b, float* out, int n);
+		}
+	}
+}
+#endif
@@ -0,0 +1,561 @@
+// ========================================
+// 混合模式的向量版本 (可分离模式 + 颜色模式).
+// 由 psBlendSimd.cpp 在 sse41 / avx2 / avx512 命名空间内各包含一次,
+// 包含前需要定义: vfloat, vmask, vint, kWidth 以及 v* / vi* 基本运算.
+// 每个函数与 PhotoshopComput 中的同名函数运算顺序一致, 结果逐位相同;
+// if 分支改为 vsel 选择, 除零保护改为最后用掩码覆盖.
+// ========================================
+
+static inline vfloat to_argb(vfloat a) { return vmul(a, vset1(ARGB_LEVER)); }
+static inline vfloat from_argb(vfloat a) { return vdiv(a, vset1(ARGB_LEVER)); }
+static inline vfloat inverted(vfloat a) { return vsub(vset1(ARGB_LEVER), a); }
+
+// if (r > 255) r = 255; if (r < 0) r = 0;  常量放在第一个参数, NaN 原样传递
+static inline vfloat clamp_argb(vfloat r) { return vmax(vset1(0.0f), vmin(vset1(ARGB_LEVER), r)); }
+
+static inline vfloat normal(vfloat, vfloat b)
+{
+	return b;
+}
+
+static inline vfloat darken(vfloat a, vfloat b)
+{
+	vfloat r_a = to_argb(a);
+	vfloat r_b = to_argb(b);
+	return from_argb(vsel(vge(r_a, r_b), r_b, r_a));
+}
+
+static inline vfloat multiply(vfloat a, vfloat b)
+{
+	vfloat r_a = to_argb(a);
+	vfloat r_b = to_argb(b);
+	vfloat r_1 = vdiv(vmul(r_a, r_b), vset1(ARGB_LEVER));
+	return from_argb(clamp_argb(r_1));
+}
+
+static inline vfloat color_burn(vfloat a, vfloat b)
+{
+	vfloat r_a = to_argb(a);
+	vfloat r_b = to_argb(b);
+	vfloat r_1 = vsub(r_a, vdiv(vmul(inverted(r_a), inverted(r_b)), r_b));
+	vfloat r = from_argb(clamp_argb(r_1));
+	return vsel(veq(r_b, vset1(0.0f)), vset1(0.0f), r);
+}
+
+static inline vfloat linear_burn(vfloat a, vfloat b)
+{
+	vfloat r_a = to_argb(a);
+	vfloat r_b = to_argb(b);
+	vfloat r_1 = vsub(vadd(r_a, r_b), vset1(ARGB_LEVER));
+	return from_argb(clamp_argb(r_1));
+}
+
+static inline vfloat lighten(vfloat a, vfloat b)
+{
+	vfloat r_a = to_argb(a);
+	vfloat r_b = to_argb(b);
+	return from_argb(vsel(vge(r_a, r_b), r_a, r_b));
+}
+
+static inline vfloat screen(vfloat a, vfloat b)
+{
+	vfloat r_a = to_argb(a);
+	vfloat r_b = to_argb(b);
+	vfloat r_1 = vsub(vset1(ARGB_LEVER), vdiv(vmul(inverted(r_a), inverted(r_b)), vset1(ARGB_LEVER)));
+	return from_argb(clamp_argb(r_1));
+}
+
+static inline vfloat color_dodge(vfloat a, vfloat b)
+{
+	vfloat r_a = to_argb(a);
+	vfloat r_b = to_argb(b);
+	vfloat inv_b = inverted(r_b);
+	vfloat r_1 = vadd(r_a, vdiv(vmul(r_a, r_b), inv_b));
+	vfloat r = from_argb(clamp_argb(r_1));
+	return vsel(veq(inv_b, vset1(0.0f)), vset1(1.0f), r);
+}
+
+static inline vfloat linear_dodge(vfloat a, vfloat b)
+{
+	vfloat r_a = to_argb(a);
+	vfloat r_b = to_argb(b);
+	return from_argb(clamp_argb(vadd(r_a, r_b)));
+}
+
+static inline vfloat overlay(vfloat a, vfloat b)
+{
+	vfloat r_a = to_argb(a);
+	vfloat r_b = to_argb(b);
+	vfloat lo = vdiv(vmul(r_a, r_b), vset1(128.0f));
+	vfloat hi = vsub(vset1(255.0f), vdiv(vmul(inverted(r_a), inverted(r_b)), vset1(128.0f)));
+	return from_argb(clamp_argb(vsel(vle(r_a, vset1(128.0f)), lo, hi)));
+}
+
+// 按 B <= 128 分两段的模式, 两段各自拆成一个函数 (0..255 上, 未截断),
+// B 为常数时只算用到的那一段
+static inline vfloat soft_light_lo(vfloat r_a, vfloat r_b)
+{
+	vfloat n_a = vdiv(r_a, vset1(255.0f));
+	return vadd(vdiv(vmul(r_a, r_b), vset1(128.0f)), vmul(vmul(n_a, n_a), vsub(vset1(255.0f), vmul(vset1(2.0f), r_b))));
+}
+
+static inline vfloat soft_light_hi(vfloat r_a, vfloat r_b)
+{
+	vfloat n_a = vdiv(r_a, vset1(255.0f));
+	return vadd(vdiv(vmul(r_a, inverted(r_b)), vset1(128.0f)), vmul(vsqrt(vmax(n_a, vset1(0.0f))), vsub(vmul(vset1(2.0f), r_b), vset1(255.0f))));
+}
+
+static inline vfloat soft_light(vfloat a, vfloat b)
+{
+	vfloat r_a = to_argb(a);
+	vfloat r_b = to_argb(b);
+	vfloat r_1 = vsel(vle(r_b, vset1(128.0f)), soft_light_lo(r_a, r_b), soft_light_hi(r_a, r_b));
+	return from_argb(clamp_argb(r_1));
+}
+
+static inline vfloat hard_light_lo(vfloat r_a, vfloat r_b)
+{
+	return vdiv(vmul(r_a, r_b), vset1(128.0f));
+}
+
+static inline vfloat hard_light_hi(vfloat r_a, vfloat r_b)
+{
+	return vsub(vset1(255.0f), vdiv(vmul(inverted(r_a), inverted(r_b)), vset1(128.0f)));
+}
+
+static inline vfloat hard_light(vfloat a, vfloat b)
+{
+	vfloat r_a = to_argb(a);
+	vfloat r_b = to_argb(b);
+	vfloat r_1 = vsel(vle(r_b, vset1(128.0f)), hard_light_lo(r_a, r_b), hard_light_hi(r_a, r_b));
+	return from_argb(clamp_argb(r_1));
+}
+
+static inline vfloat vivid_light_lo(vfloat r_a, vfloat r_b)
+{
+	vfloat two_b = vmul(vset1(2.0f), r_b);
+	return vsub(r_a, vdiv(vmul(inverted(r_a), vsub(vset1(255.0f), two_b)), two_b));
+}
+
+static inline vfloat vivid_light_hi(vfloat r_a, vfloat r_b)
+{
+	vfloat two_b = vmul(vset1(2.0f), r_b);
+	return vadd(r_a, vdiv(vmul(r_a, vsub(two_b, vset1(255.0f))), vmul(vset1(2.0f), inverted(r_b))));
+}
+
+static inline vmask vivid_light_zero(vfloat r_b)
+{
+	return vor(veq(r_b, vset1(0.0f)), veq(inverted(r_b), vset1(0.0f)));
+}
+
+static inline vfloat vivid_light(vfloat a, vfloat b)
+{
+	vfloat r_a = to_argb(a);
+	vfloat r_b = to_argb(b);
+	vfloat r_1 = vsel(vle(r_b, vset1(128.0f)), vivid_light_lo(r_a, r_b), vivid_light_hi(r_a, r_b));
+	return vsel(vivid_light_zero(r_b), vset1(0.0f), from_argb(clamp_argb(r_1)));
+}
+
+static inline vfloat linear_light(vfloat a, vfloat b)
+{
+	vfloat r_a = to_argb(a);
+	vfloat r_b = to_argb(b);
+	vfloat r_1 = vsub(vadd(r_a, vmul(vset1(2.0f), r_b)), vset1(255.0f));
+	return from_argb(clamp_argb(r_1));
+}
+
+static inline vfloat pin_light_lo(vfloat r_a, vfloat r_b)
+{
+	vfloat two_b = vmul(vset1(2.0f), r_b);
+	return vsel(vlt(r_a, two_b), r_a, two_b);
+}
+
+static inline vfloat pin_light_hi(vfloat r_a, vfloat r_b)
+{
+	vfloat two_b_255 = vsub(vmul(vset1(2.0f), r_b), vset1(255.0f));
+	return vsel(vgt(r_a, two_b_255), r_a, two_b_255);
+}
+
+static inline vfloat pin_light(vfloat a, vfloat b)
+{
+	vfloat r_a = to_argb(a);
+	vfloat r_b = to_argb(b);
+	vfloat r_1 = vsel(vle(r_b, vset1(128.0f)), pin_light_lo(r_a, r_b), pin_light_hi(r_a, r_b));
+	return from_argb(clamp_argb(r_1));
+}
+
+// B 为常数时已经确定走哪一段, 截断方式与完整函数相同
+template <vfloat (*Side)(vfloat, vfloat)>
+static inline vfloat one_side(vfloat a, vfloat b)
+{
+	return from_argb(clamp_argb(Side(to_argb(a), to_argb(b))));
+}
+
+template <vfloat (*Side)(vfloat, vfloat)>
+static inline vfloat vivid_light_side(vfloat a, vfloat b)
+{
+	vfloat r_b = to_argb(b);
+	return vsel(vivid_light_zero(r_b), vset1(0.0f), from_argb(clamp_argb(Side(to_argb(a), r_b))));
+}
+
+static inline vfloat hard_mix(vfloat a, vfloat b)
+{
+	vfloat r_a = to_argb(a);
+	vfloat r_b = to_argb(b);
+	vfloat r_1 = vsel(vgt(vadd(r_a, r_b), vset1(ARGB_LEVER)), vset1(ARGB_LEVER), vset1(0.0f));
+	return from_argb(r_1);
+}
+
+static inline vfloat diference(vfloat a, vfloat b)
+{
+	vfloat r_a = to_argb(a);
+	vfloat r_b = to_argb(b);
+	return from_argb(clamp_argb(vabs(vsub(r_a, r_b))));
+}
+
+static inline vfloat exclusion(vfloat a, vfloat b)
+{
+	vfloat r_a = to_argb(a);
+	vfloat r_b = to_argb(b);
+	vfloat r_1 = vsub(vadd(r_a, r_b), vdiv(vmul(r_a, r_b), vset1(128.0f)));
+	return from_argb(clamp_argb(r_1));
+}
+
+// 颜色模式: a, b, r 都是 {R, G, B} 三个向量
+static inline void darker_color(const vfloat* a, const vfloat* b, vfloat* r)
+{
+	vfloat r_a_r = to_argb(a[0]);
+	vfloat r_a_g = to_argb(a[1]);
+	vfloat r_a_b = to_argb(a[2]);
+	vfloat r_b_r = to_argb(b[0]);
+	vfloat r_b_g = to_argb(b[1]);
+	vfloat r_b_b = to_argb(b[2]);
+	vmask m = vge(vadd(vadd(r_b_r, r_b_g), r_b_b), vadd(vadd(r_a_r, r_a_g), r_a_b));
+	r[0] = from_argb(clamp_argb(vsel(m, r_a_r, r_b_r)));
+	r[1] = from_argb(clamp_argb(vsel(m, r_a_g, r_b_g)));
+	r[2] = from_argb(clamp_argb(vsel(m, r_a_b, r_b_b)));
+}
+
+static inline void lighter_color(const vfloat* a, const vfloat* b, vfloat* r)
+{
+	vfloat r_a_r = to_argb(a[0]);
+	vfloat r_a_g = to_argb(a[1]);
+	vfloat r_a_b = to_argb(a[2]);
+	vfloat r_b_r = to_argb(b[0]);
+	vfloat r_b_g = to_argb(b[1]);
+	vfloat r_b_b = to_argb(b[2]);
+	vmask m = vge(vadd(vadd(r_b_r, r_b_g), r_b_b), vadd(vadd(r_a_r, r_a_g), r_a_b));
+	r[0] = from_argb(clamp_argb(vsel(m, r_b_r, r_a_r)));
+	r[1] = from_argb(clamp_argb(vsel(m, r_b_g, r_a_g)));
+	r[2] = from_argb(clamp_argb(vsel(m, r_b_b, r_a_b)));
+}
+
+// 色相 / 饱和度 / 颜色 / 亮度: 与 psBlend.cpp 的 hsl_* 一一对应, 所有分支都换成 vsel,
+// 一次处理 kWidth 个像素的 R/G/B 三个平面
+static inline vfloat hsl_lum(const vfloat* c)
+{
+	return vadd(vadd(vmul(vset1(0.3f), c[0]), vmul(vset1(0.59f), c[1])), vmul(vset1(0.11f), c[2]));
+}
+
+static inline vfloat hsl_min(const vfloat* c) { return vmin(vmin(c[0], c[1]), c[2]); }
+static inline vfloat hsl_max(const vfloat* c) { return vmax(vmax(c[0], c[1]), c[2]); }
+
+static inline vfloat hsl_sat(const vfloat* c)
+{
+	return vsub(hsl_max(c), hsl_min(c));
+}
+
+static inline void hsl_set_sat(vfloat* c, vfloat s)
+{
+	vfloat n = hsl_min(c);
+	vfloat d = vsub(hsl_max(c), n);
+	vmask has_sat = vgt(d, vset1(0.0f));
+	for (int i = 0; i < 3; i++)
+		c[i] = vsel(has_sat, vdiv(vmul(vsub(c[i], n), s), d), vset1(0.0f));
+}
+
+static inline void hsl_set_lum(vfloat* c, vfloat l)
+{
+	vfloat d = vsub(l, hsl_lum(c));
+	for (int i = 0; i < 3; i++)
+		c[i] = vadd(c[i], d);
+	vfloat cl = hsl_lum(c);
+	vfloat n = hsl_min(c);
+	vfloat x = hsl_max(c);
+	// 与标量版本相同, 灰色超出范围时不拉回 (分母为 0)
+	vmask under = vand(vlt(n, vset1(0.0f)), vgt(cl, n));
+	vmask over = vand(vgt(x, vset1(ARGB_LEVER)), vgt(x, cl));
+	for (int i = 0; i < 3; i++) {
+		vfloat t = vsel(under, vadd(vdiv(vmul(vsub(c[i], cl), cl), vsub(cl, n)), cl), c[i]);
+		c[i] = vsel(over, vadd(vdiv(vmul(vsub(t, cl), vsub(vset1(ARGB_LEVER), cl)), vsub(x, cl)), cl), t);
+	}
+}
+
+static inline void hsl_result(const vfloat* c, vfloat* r)
+{
+	for (int i = 0; i < 3; i++)
+		r[i] = from_argb(clamp_argb(c[i]));
+}
+
+static inline void hue(const vfloat* a, const vfloat* b, vfloat* r)
+{
+	vfloat r_a[3] = { to_argb(a[0]), to_argb(a[1]), to_argb(a[2]) };
+	vfloat r_1[3] = { to_argb(b[0]), to_argb(b[1]), to_argb(b[2]) };
+	hsl_set_sat(r_1, hsl_sat(r_a));
+	hsl_set_lum(r_1, hsl_lum(r_a));
+	hsl_result(r_1, r);
+}
+
+static inline void saturation(const vfloat* a, const vfloat* b, vfloat* r)
+{
+	vfloat r_b[3] = { to_argb(b[0]), to_argb(b[1]), to_argb(b[2]) };
+	vfloat r_1[3] = { to_argb(a[0]), to_argb(a[1]), to_argb(a[2]) };
+	vfloat l = hsl_lum(r_1);
+	hsl_set_sat(r_1, hsl_sat(r_b));
+	hsl_set_lum(r_1, l);
+	hsl_result(r_1, r);
+}
+
+static inline void color(const vfloat* a, const vfloat* b, vfloat* r)
+{
+	vfloat r_a[3] = { to_argb(a[0]), to_argb(a[1]), to_argb(a[2]) };
+	vfloat r_1[3] = { to_argb(b[0]), to_argb(b[1]), to_argb(b[2]) };
+	hsl_set_lum(r_1, hsl_lum(r_a));
+	hsl_result(r_1, r);
+}
+
+static inline void luminosity(const vfloat* a, const vfloat* b, vfloat* r)
+{
+	vfloat r_b[3] = { to_argb(b[0]), to_argb(b[1]), to_argb(b[2]) };
+	vfloat r_1[3] = { to_argb(a[0]), to_argb(a[1]), to_argb(a[2]) };
+	hsl_set_lum(r_1, hsl_lum(r_b));
+	hsl_result(r_1, r);
+}
+
+// 整行循环, 不足一个向量宽度的尾部补零后走同一条向量路径
+template <vfloat (*Op)(vfloat, vfloat)>
+void blend_row(const float* a, const float* b, float* out, int n)
+{
+	int i = 0;
+	for (; i + kWidth <= n; i += kWidth)
+		vstoreu(out + i, Op(vloadu(a + i), vloadu(b + i)));
+	if (i < n) {
+		float ta[kWidth] = { 0 };
+		float tb[kWidth] = { 0 };
+		float to[kWidth];
+		for (int j = 0; j < n - i; j++) {
+			ta[j] = a[i + j];
+			tb[j] = b[i + j];
+		}
+		vstoreu(to, Op(vloadu(ta), vloadu(tb)));
+		for (int j = 0; j < n - i; j++)
+			out[i + j] = to[j];
+	}
+}
+
+RowKernel row_kernel(int mode)
+{
+	switch (mode)
+	{
+	case Normal:       return &blend_row<normal>;
+	case Darken:       return &blend_row<darken>;
+	case Multiply:     return &blend_row<multiply>;
+	case ColorBurn:    return &blend_row<color_burn>;
+	case LinearBurn:   return &blend_row<linear_burn>;
+	case Lighten:      return &blend_row<lighten>;
+	case Screen:       return &blend_row<screen>;
+	case ColorDodge:   return &blend_row<color_dodge>;
+	case LinearDodge:  return &blend_row<linear_dodge>;
+	case Overlay:      return &blend_row<overlay>;
+	case SoftLight:    return &blend_row<soft_light>;
+	case HardLight:    return &blend_row<hard_light>;
+	case VividLight:   return &blend_row<vivid_light>;
+	case LinearLight:  return &blend_row<linear_light>;
+	case PinLight:     return &blend_row<pin_light>;
+	case HardMix:      return &blend_row<hard_mix>;
+	case Diference:    return &blend_row<diference>;
+	case Exclusion:    return &blend_row<exclusion>;
+	default:           return NULL;
+	}
+}
+
+template <void (*Op)(const vfloat*, const vfloat*, vfloat*)>
+void blend_row_rgb(const float* const* a, const float* const* b, float* const* out, int n)
+{
+	int i = 0;
+	for (; i + kWidth <= n; i += kWidth) {
+		vfloat va[3] = { vloadu(a[0] + i), vloadu(a[1] + i), vloadu(a[2] + i) };
+		vfloat vb[3] = { vloadu(b[0] + i), vloadu(b[1] + i), vloadu(b[2] + i) };
+		vfloat vr[3];
+		Op(va, vb, vr);
+		vstoreu(out[0] + i, vr[0]);
+		vstoreu(out[1] + i, vr[1]);
+		vstoreu(out[2] + i, vr[2]);
+	}
+	if (i < n) {
+		float ta[3][kWidth] = { { 0 } };
+		float tb[3][kWidth] = { { 0 } };
+		float to[3][kWidth];
+		for (int c = 0; c < 3; c++) {
+			for (int j = 0; j < n - i; j++) {
+				ta[c][j] = a[c][i + j];
+				tb[c][j] = b[c][i + j];
+			}
+		}
+		vfloat va[3] = { vloadu(ta[0]), vloadu(ta[1]), vloadu(ta[2]) };
+		vfloat vb[3] = { vloadu(tb[0]), vloadu(tb[1]), vloadu(tb[2]) };
+		vfloat vr[3];
+		Op(va, vb, vr);
+		for (int c = 0; c < 3; c++) {
+			vstoreu(to[c], vr[c]);
+			for (int j = 0; j < n - i; j++)
+				out[c][i + j] = to[c][j];
+		}
+	}
+}
+
+ColorRowKernel color_row_kernel(int mode)
+{
+	switch (mode)
+	{
+	case DarkerColor:  return &blend_row_rgb<darker_color>;
+	case LighterColor: return &blend_row_rgb<lighter_color>;
+	case Hue:          return &blend_row_rgb<hue>;
+	case Saturation:   return &blend_row_rgb<saturation>;
+	case Color:        return &blend_row_rgb<color>;
+	case Luminosity:   return &blend_row_rgb<luminosity>;
+	default:           return NULL;
+	}
+}
+
+// 溶解: 与 psBlend.cpp 的 dissolve_pick 相同的哈希, 一次算 kWidth 个像素
+static inline vint dissolve_mix(vint h)
+{
+	h = vixor(h, visrl<16>(h));
+	h = vimul(h, viset1(0x85EBCA6Bu));
+	h = vixor(h, visrl<13>(h));
+	h = vimul(h, viset1(0xC2B2AE35u));
+	h = vixor(h, visrl<16>(h));
+	return h;
+}
+
+static inline vmask dissolve_pick(vint row, int x, vfloat amount)
+{
+	vint vx = viadd(viset1((unsigned int)x), viota());
+	vint h = dissolve_mix(viadd(row, vimul(vx, viset1(kDissolveStepX))));
+	return vlt(vmul(vcvt(visrl<8>(h)), vset1(1.0f / 16777216.0f)), amount);
+}
+
+void dissolve_row(const float* a, const float* b, float* out, int n, int x, int y, const DissolveKey& key)
+{
+	vint row = viset1(dissolve_row_key(y, key));
+	vfloat amount = vset1(key.amount);
+	int i = 0;
+	for (; i + kWidth <= n; i += kWidth)
+		vstoreu(out + i, vsel(dissolve_pick(row, x + i, amount), vloadu(b + i), vloadu(a + i)));
+	if (i < n) {
+		float ta[kWidth] = { 0 };
+		float tb[kWidth] = { 0 };
+		float to[kWidth];
+		for (int j = 0; j < n - i; j++) {
+			ta[j] = a[i + j];
+			tb[j] = b[i + j];
+		}
+		vstoreu(to, vsel(dissolve_pick(row, x + i, amount), vloadu(tb), vloadu(ta)));
+		for (int j = 0; j < n - i; j++)
+			out[i + j] = to[j];
+	}
+}
+
+// B 为常数 (纯色层): 与 blend_row 相同的 Op, B 换成广播的常数向量, 不再读 B 的内存;
+// Op 内联后只与 B 有关的运算是循环不变量, 由编译器提到循环外
+template <vfloat (*Op)(vfloat, vfloat)>
+void blend_row_const(const float* a, float b, float* out, int n)
+{
+	vfloat vb = vset1(b);
+	int i = 0;
+	for (; i + kWidth <= n; i += kWidth)
+		vstoreu(out + i, Op(vloadu(a + i), vb));
+	if (i < n) {
+		float ta[kWidth] = { 0 };
+		float to[kWidth];
+		for (int j = 0; j < n - i; j++)
+			ta[j] = a[i + j];
+		vstoreu(to, Op(vloadu(ta), vb));
+		for (int j = 0; j < n - i; j++)
+			out[i + j] = to[j];
+	}
+}
+
+ConstRowKernel const_row_kernel(int mode, float b)
+{
+	// 与 vle(r_b, 128) 相同的判断, NaN 走第二段
+	bool lo = b * ARGB_LEVER <= 128.0f;
+	switch (mode)
+	{
+	case Normal:       return &blend_row_const<normal>;
+	case Darken:       return &blend_row_const<darken>;
+	case Multiply:     return &blend_row_const<multiply>;
+	case ColorBurn:    return &blend_row_const<color_burn>;
+	case LinearBurn:   return &blend_row_const<linear_burn>;
+	case Lighten:      return &blend_row_const<lighten>;
+	case Screen:       return &blend_row_const<screen>;
+	case ColorDodge:   return &blend_row_const<color_dodge>;
+	case LinearDodge:  return &blend_row_const<linear_dodge>;
+	case Overlay:      return &blend_row_const<overlay>;
+	case SoftLight:    return lo ? &blend_row_const<one_side<soft_light_lo> > : &blend_row_const<one_side<soft_light_hi> >;
+	case HardLight:    return lo ? &blend_row_const<one_side<hard_light_lo> > : &blend_row_const<one_side<hard_light_hi> >;
+	case VividLight:   return lo ? &blend_row_const<vivid_light_side<vivid_light_lo> > : &blend_row_const<vivid_light_side<vivid_light_hi> >;
+	case LinearLight:  return &blend_row_const<linear_light>;
+	case PinLight:     return lo ? &blend_row_const<one_side<pin_light_lo> > : &blend_row_const<one_side<pin_light_hi> >;
+	case HardMix:      return &blend_row_const<hard_mix>;
+	case Diference:    return &blend_row_const<diference>;
+	case Exclusion:    return &blend_row_const<exclusion>;
+	default:           return NULL;
+	}
+}
+
+template <void (*Op)(const vfloat*, const vfloat*, vfloat*)>
+void blend_row_rgb_const(const float* const* a, const float* b, float* const* out, int n)
+{
+	vfloat vb[3] = { vset1(b[0]), vset1(b[1]), vset1(b[2]) };
+	int i = 0;
+	for (; i + kWidth <= n; i += kWidth) {
+		vfloat va[3] = { vloadu(a[0] + i), vloadu(a[1] + i), vloadu(a[2] + i) };
+		vfloat vr[3];
+		Op(va, vb, vr);
+		vstoreu(out[0] + i, vr[0]);
+		vstoreu(out[1] + i, vr[1]);
+		vstoreu(out[2] + i, vr[2]);
+	}
+	if (i < n) {
+		float ta[3][kWidth] = { { 0 } };
+		float to[3][kWidth];
+		for (int c = 0; c < 3; c++) {
+			for (int j = 0; j < n - i; j++)
+				ta[c][j] = a[c][i + j];
+		}
+		vfloat va[3] = { vloadu(ta[0]), vloadu(ta[1]), vloadu(ta[2]) };
+		vfloat vr[3];
+		Op(va, vb, vr);
+		for (int c = 0; c < 3; c++) {
+			vstoreu(to[c], vr[c]);
+			for (int j = 0; j < n - i; j++)
+				out[c][i + j] = to[c][j];
+		}
+	}
+}
+
+ConstColorRowKernel const_color_row_kernel(int mode)
+{
+	switch (mode)
+	{
+	case DarkerColor:  return &blend_row_rgb_const<darker_color>;
+	case LighterColor: return &blend_row_rgb_const<lighter_color>;
+	case Hue:          return &blend_row_rgb_const<hue>;
+	case Saturation:   return &blend_row_rgb_const<saturation>;
+	case Color:        return &blend_row_rgb_const<color>;
+	case Luminosity:   return &blend_row_rgb_const<luminosity>;
+	default:           return NULL;
+	}
+}
@@ -0,0 +1,62 @@
+// ========================================
+// 深度样本池的实现.
+// ========================================
+#include <algorithm>
+#include "psDeep.h"
+
+namespace photoshopMergeTool {
+	DeepSamples::DeepSamples() : stride_(0), pixels_(0), channels_(0)
+	{
+	}
+
+	void DeepSamples::shape(const uint32_t* counts, int pixels, int channels)
+	{
+		pixels_ = pixels;
+		channels_ = channels;
+		offsets_.resize((size_t)pixels + 1);
+		size_t total = 0;
+		for (int p = 0; p < pixels; p++) {
+			offsets_[p] = total;
+			total += counts[p];
+		}
+		offsets_[pixels] = total;
+		// 平面长度补到 16 个 float 的倍数, 每个平面起点的对齐与第一个平面相同
+		stride_ = (total + 15) & ~(size_t)15;
+		size_t need = stride_ * channels;
+		if (data_.size() < need)
+			data_.resize(need);
+	}
+
+	void DeepSamples::shape_like(const DeepSamples& other, int channels)
+	{
+		pixels_ = other.pixels_;
+		channels_ = channels;
+		offsets_ = other.offsets_;
+		stride_ = other.stride_;
+		size_t need = stride_ * channels;
+		if (data_.size() < need)
+			data_.resize(need);
+	}
+
+	void DeepSamples::spread(int c, const float* per_pixel)
+	{
+		float* dst = plane(c);
+		for (int p = 0; p < pixels_; p++)
+			std::fill(dst + offsets_[p], dst + offsets_[p + 1], per_pixel[p]);
+	}
+
+	void DeepSamples::trim(size_t keep_bytes)
+	{
+		if (capacity_bytes() <= keep_bytes)
+			return;
+		std::vector<float>().swap(data_);
+		std::vector<size_t>().swap(offsets_);
+		stride_ = 0;
+		pixels_ = channels_ = 0;
+	}
+
+	size_t DeepSamples::capacity_bytes() const
+	{
+		return data_.capacity() * sizeof(float) + offsets_.capacity() * sizeof(size_t);
+	}
+}
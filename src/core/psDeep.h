@@ -0,0 +1,52 @@
+// ========================================
+// 深度图的样本池: 一块区域里所有像素的样本按像素顺序连续存放 (CSR 格式).
+// offsets[p] .. offsets[p + 1] 是第 p 个像素的样本, 每个通道一个平面, 平面长度是样本总数.
+// 这样整块区域的一个通道是一段连续的 float, 行内核一次就能处理完, 不用按样本分配和调用.
+// 内存按线程复用: shape 只在样本变多时重新分配, trim 把用过的大块还给系统.
+//
+//   DeepSamples a;
+//   a.shape(counts, pixels, channels);            // counts[p] 是每个像素的样本数
+//   for (...) a.plane(c)[a.offset(p) + s] = ...;
+//   k.blend_row(&pa, &pb, &po, 1, (int)a.samples(), 0, 0, key);
+// ========================================
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <vector>
+
+namespace photoshopMergeTool {
+	class DeepSamples
+	{
+	public:
+		DeepSamples();
+
+		// 按每个像素的样本数排好位置, 平面的内容未定义. 容量够时不重新分配
+		void shape(const uint32_t* counts, int pixels, int channels);
+		// 与 other 相同的像素和样本数, channels 个平面
+		void shape_like(const DeepSamples& other, int channels);
+
+		int pixels() const { return pixels_; }
+		int channels() const { return channels_; }
+		size_t samples() const { return offsets_.empty() ? 0 : offsets_[pixels_]; }
+		size_t offset(int p) const { return offsets_[p]; }
+		int count(int p) const { return (int)(offsets_[p + 1] - offsets_[p]); }
+
+		float* plane(int c) { return data_.data() + stride_ * c; }
+		const float* plane(int c) const { return data_.data() + stride_ * c; }
+
+		// 每个像素一个值 -> 这个像素的所有样本都取它 (平面的 B、mask 展开到样本上)
+		void spread(int c, const float* per_pixel);
+
+		// 占用超过 keep_bytes 时释放, 处理过一块样本特别多的区域后不会一直占着那么多内存
+		void trim(size_t keep_bytes);
+		size_t capacity_bytes() const;
+
+	private:
+		std::vector<size_t> offsets_;  // pixels + 1 个
+		std::vector<float> data_;      // channels 个平面, 相隔 stride_ 个 float
+		size_t stride_;
+		int pixels_;
+		int channels_;
+	};
+}
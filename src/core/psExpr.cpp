@@ -0,0 +1,591 @@
+// ========================================
+// 自定义公式的解析、常量折叠和字节码生成.
+// 递归下降解析成语法树, 每建一个节点就尝试折叠 (子节点都是常数时直接算出结果),
+// 函数 / 幂在建树时展开成基本运算. 折叠用的运算与 psExpr.inl 的标量版本逐位相同,
+// 所以折不折叠结果都一样. 求值循环在 psExpr.inl.
+// ========================================
+#include <cmath>
+#include <cstdio>
+#include <cstring>
+#include "psExpr.h"
+
+namespace photoshopMergeTool {
+	namespace {
+		struct Node {
+			int code;       // ExprOpCode; 叶子是 ExprA / ExprB / ExprConst
+			float value;    // ExprConst 的值
+			int k;          // ExprPowi 的指数
+			int kid[3];
+			int height;     // 子树的层数, 叶子是 1
+		};
+
+		bool is_binary(int code) { return code >= ExprAdd && code <= ExprNe; }
+
+		float powi(float x, int n)
+		{
+			float r = 1.0f;
+			while (n) {
+				if (n & 1)
+					r = r * x;
+				n >>= 1;
+				if (n)
+					x = x * x;
+			}
+			return r;
+		}
+
+		// 与标量的 v* 基本运算相同
+		float fold(int code, float x, float y, float z, int k)
+		{
+			switch (code)
+			{
+			case ExprAdd:    return x + y;
+			case ExprSub:    return x - y;
+			case ExprMul:    return x * y;
+			case ExprDiv:    return x / y;
+			case ExprMin:    return x < y ? x : y;
+			case ExprMax:    return x > y ? x : y;
+			case ExprLt:     return x < y ? 1.0f : 0.0f;
+			case ExprLe:     return x <= y ? 1.0f : 0.0f;
+			case ExprGt:     return x > y ? 1.0f : 0.0f;
+			case ExprGe:     return x >= y ? 1.0f : 0.0f;
+			case ExprEq:     return x == y ? 1.0f : 0.0f;
+			case ExprNe:     return x == y ? 0.0f : 1.0f;
+			case ExprNeg:    return -1.0f * x;
+			case ExprAbs:    return std::fabs(x);
+			case ExprSqrt:   return std::sqrt(x);
+			case ExprPowi:   return powi(x, k);
+			case ExprSelect: return x == 0.0f ? z : y;
+			default:         return x;
+			}
+		}
+
+		class Parser
+		{
+		public:
+			Parser(const std::string& text) : s_(text), pos_(0), failed_(false), nesting_(0) {}
+
+			int parse()
+			{
+				int n = ternary();
+				skip();
+				if (!failed_ && pos_ < s_.size())
+					fail("unexpected '%c'", s_[pos_]);
+				return failed_ ? -1 : n;
+			}
+			const std::vector<Node>& nodes() const { return nodes_; }
+			const std::string& error() const { return error_; }
+
+		private:
+			// 递归的层数: 每个括号、函数参数、? : 的分支 (都经过 ternary)、一元运算符和 ^ 加一层
+			struct Nested {
+				Parser& p;
+				explicit Nested(Parser& parser) : p(parser)
+				{
+					if (++p.nesting_ > kMaxExprNesting)
+						p.fail("too deeply nested");
+				}
+				~Nested() { p.nesting_--; }
+			};
+
+			void fail(const char* fmt, char c = 0)
+			{
+				if (failed_)
+					return;
+				failed_ = true;
+				char msg[128];
+				snprintf(msg, sizeof(msg), fmt, c);
+				char where[32];
+				snprintf(where, sizeof(where), " at column %d", (int)pos_ + 1);
+				error_ = std::string(msg) + where;
+			}
+
+			void skip()
+			{
+				while (pos_ < s_.size() && (s_[pos_] == ' ' || s_[pos_] == '\t' || s_[pos_] == '\n' || s_[pos_] == '\r'))
+					pos_++;
+			}
+
+			bool eat(const char* tok)
+			{
+				skip();
+				size_t n = strlen(tok);
+				if (s_.compare(pos_, n, tok) != 0)
+					return false;
+				pos_ += n;
+				return true;
+			}
+
+			void expect(char c)
+			{
+				if (!eat(std::string(1, c).c_str()))
+					fail("expected '%c'", c);
+			}
+
+			bool is_const(int n) const { return n >= 0 && nodes_[n].code == ExprConst; }
+
+			// 所有节点都从这里加入, 顺便检查树高和节点数
+			int add(Node node)
+			{
+				if (failed_)
+					return -1;
+				node.height = 1;
+				for (int i = 0; i < 3; i++) {
+					if (node.kid[i] >= 0 && nodes_[node.kid[i]].height + 1 > node.height)
+						node.height = nodes_[node.kid[i]].height + 1;
+				}
+				if (node.height > kMaxExprHeight) {
+					fail("too deeply nested");
+					return -1;
+				}
+				if ((int)nodes_.size() >= kMaxExprNodes) {
+					fail("expression is too long");
+					return -1;
+				}
+				nodes_.push_back(node);
+				return (int)nodes_.size() - 1;
+			}
+
+			int constant(float v)
+			{
+				Node node = { ExprConst, v, 0, { -1, -1, -1 }, 1 };
+				return add(node);
+			}
+
+			// 建一个运算节点; 子节点都是常数时直接折叠成常数
+			int make(int code, int x, int y = -1, int z = -1, int k = 0)
+			{
+				if (failed_)
+					return -1;
+				if (is_const(x) && (y < 0 || is_const(y)) && (z < 0 || is_const(z)))
+					return constant(fold(code, nodes_[x].value, y < 0 ? 0.0f : nodes_[y].value, z < 0 ? 0.0f : nodes_[z].value, k));
+				Node node = { code, 0.0f, k, { x, y, z }, 1 };
+				return add(node);
+			}
+
+			// x ^ e: e 必须折叠成 0..16 的整数或 0.5
+			int power(int x, int e)
+			{
+				if (failed_)
+					return -1;
+				if (!is_const(e)) {
+					fail("exponent must be a constant");
+					return -1;
+				}
+				float v = nodes_[e].value;
+				if (v == 0.5f)
+					return make(ExprSqrt, x);
+				if (!(v >= 0.0f && v <= 16.0f) || v != std::floor(v)) {
+					fail("exponent must be an integer from 0 to 16, or 0.5");
+					return -1;
+				}
+				if (v == 1.0f)
+					return x;
+				return make(ExprPowi, x, -1, -1, (int)v);
+			}
+
+			int ternary()
+			{
+				Nested nested(*this);
+				if (failed_)
+					return -1;
+				int c = compare();
+				if (!eat("?"))
+					return c;
+				int x = ternary();
+				expect(':');
+				int y = ternary();
+				return make(ExprSelect, c, x, y);
+			}
+
+			int compare()
+			{
+				int x = additive();
+				for (;;) {
+					int code;
+					if (eat("<="))
+						code = ExprLe;
+					else if (eat(">="))
+						code = ExprGe;
+					else if (eat("=="))
+						code = ExprEq;
+					else if (eat("!="))
+						code = ExprNe;
+					else if (eat("<"))
+						code = ExprLt;
+					else if (eat(">"))
+						code = ExprGt;
+					else
+						return x;
+					x = make(code, x, additive());
+				}
+			}
+
+			int additive()
+			{
+				int x = term();
+				for (;;) {
+					if (eat("+"))
+						x = make(ExprAdd, x, term());
+					else if (eat("-"))
+						x = make(ExprSub, x, term());
+					else
+						return x;
+				}
+			}
+
+			int term()
+			{
+				int x = unary();
+				for (;;) {
+					if (eat("*"))
+						x = make(ExprMul, x, unary());
+					else if (eat("/"))
+						x = make(ExprDiv, x, unary());
+					else
+						return x;
+				}
+			}
+
+			int unary()
+			{
+				if (eat("-"))
+					return make(ExprNeg, nested_unary());
+				if (eat("+"))
+					return nested_unary();
+				int x = primary();
+				// 右结合, 比一元负号结合得紧: -a^2 = -(a^2)
+				if (eat("^"))
+					return power(x, nested_unary());
+				return x;
+			}
+
+			// 一元运算符和 ^ 右边的递归也各算一层
+			int nested_unary()
+			{
+				Nested nested(*this);
+				return failed_ ? -1 : unary();
+			}
+
+			int number()
+			{
+				// 自己解析, 不受 locale 的小数点影响
+				double v = 0.0;
+				int exp10 = 0;
+				bool digits = false;
+				while (pos_ < s_.size() && isdigit((unsigned char)s_[pos_])) {
+					v = v * 10.0 + (s_[pos_++] - '0');
+					digits = true;
+				}
+				if (pos_ < s_.size() && s_[pos_] == '.') {
+					pos_++;
+					while (pos_ < s_.size() && isdigit((unsigned char)s_[pos_])) {
+						v = v * 10.0 + (s_[pos_++] - '0');
+						exp10--;
+						digits = true;
+					}
+				}
+				if (!digits) {
+					fail("bad number");
+					return -1;
+				}
+				if (pos_ < s_.size() && (s_[pos_] == 'e' || s_[pos_] == 'E')) {
+					size_t p = pos_ + 1;
+					int sign = 1;
+					if (p < s_.size() && (s_[p] == '+' || s_[p] == '-'))
+						sign = s_[p++] == '-' ? -1 : 1;
+					if (p < s_.size() && isdigit((unsigned char)s_[p])) {
+						int e = 0;
+						while (p < s_.size() && isdigit((unsigned char)s_[p]))
+							e = e < 1000 ? e * 10 + (s_[p++] - '0') : e;
+						exp10 += sign * e;
+						pos_ = p;
+					}
+				}
+				return constant((float)(v * std::pow(10.0, exp10)));
+			}
+
+			// 逗号分隔的参数, 个数在 min_args..max_args 之间
+			int args(int* out, int min_args, int max_args)
+			{
+				expect('(');
+				int n = 0;
+				if (!eat(")")) {
+					do {
+						if (n == max_args) {
+							fail("too many arguments");
+							return 0;
+						}
+						out[n++] = ternary();
+					} while (eat(","));
+					expect(')');
+				}
+				if (n < min_args)
+					fail("too few arguments");
+				return n;
+			}
+
+			int call(const std::string& name)
+			{
+				int v[3] = { -1, -1, -1 };
+				if (name == "min" || name == "max") {
+					args(v, 2, 2);
+					return make(name == "min" ? ExprMin : ExprMax, v[0], v[1]);
+				}
+				if (name == "abs" || name == "sqrt") {
+					args(v, 1, 1);
+					return make(name == "abs" ? ExprAbs : ExprSqrt, v[0]);
+				}
+				if (name == "pow") {
+					args(v, 2, 2);
+					return power(v[0], v[1]);
+				}
+				if (name == "clamp") {
+					// max(lo, min(hi, x)), 与 clamp01 相同的顺序
+					int n = args(v, 1, 3);
+					if (n == 2)
+						fail("clamp takes 1 or 3 arguments");
+					int lo = n == 3 ? v[1] : constant(0.0f);
+					int hi = n == 3 ? v[2] : constant(1.0f);
+					return make(ExprMax, lo, make(ExprMin, hi, v[0]));
+				}
+				if (name == "lerp") {
+					// x + (y - x) t, x 在树里出现两次
+					args(v, 3, 3);
+					if (failed_)
+						return -1;
+					int x2 = copy(v[0]);
+					return make(ExprAdd, v[0], make(ExprMul, make(ExprSub, v[1], x2), v[2]));
+				}
+				fail("unknown function");
+				return -1;
+			}
+
+			int copy(int n)
+			{
+				if (n < 0 || failed_)
+					return -1;
+				Node node = nodes_[n];
+				for (int i = 0; i < 3; i++)
+					node.kid[i] = copy(node.kid[i]);
+				return add(node);
+			}
+
+			int primary()
+			{
+				skip();
+				if (failed_)
+					return -1;
+				if (pos_ >= s_.size()) {
+					fail("unexpected end");
+					return -1;
+				}
+				char c = s_[pos_];
+				if (c == '(') {
+					pos_++;
+					int x = ternary();
+					expect(')');
+					return x;
+				}
+				if (isdigit((unsigned char)c) || c == '.')
+					return number();
+				if (isalpha((unsigned char)c) || c == '_') {
+					size_t start = pos_;
+					while (pos_ < s_.size() && (isalnum((unsigned char)s_[pos_]) || s_[pos_] == '_'))
+						pos_++;
+					std::string name = s_.substr(start, pos_ - start);
+					if (name == "a" || name == "A" || name == "b" || name == "B") {
+						Node node = { name == "a" || name == "A" ? ExprA : ExprB, 0.0f, 0, { -1, -1, -1 }, 1 };
+						return add(node);
+					}
+					skip();
+					if (pos_ < s_.size() && s_[pos_] == '(')
+						return call(name);
+					pos_ = start;
+					fail("unknown name");
+					return -1;
+				}
+				fail("unexpected '%c'", c);
+				return -1;
+			}
+
+			const std::string& s_;
+			size_t pos_;
+			bool failed_;
+			int nesting_;
+			std::string error_;
+			std::vector<Node> nodes_;
+		};
+
+		// 后序遍历生成字节码. 一边是常数的二元运算把常数编进指令 (常数在左边时
+		// 交换、换成反向减除, 或把比较反过来), 不再占一个栈槽.
+		// 两边都不是常数时先算需要栈更深的一边 (Sethi-Ullman), 右边先算时同样换成反向的指令;
+		// min / max 在 NaN 上与参数顺序有关, 不换
+		class Emitter
+		{
+		public:
+			Emitter(const std::vector<Node>& nodes) : nodes_(nodes), depth_(0), max_depth_(0) {}
+
+			void emit(int n)
+			{
+				const Node& node = nodes_[n];
+				if (node.code == ExprA || node.code == ExprB) {
+					push(node.code, 0);
+					return;
+				}
+				if (node.code == ExprConst) {
+					push(ExprConst, konst(node.value));
+					return;
+				}
+				if (node.code == ExprSelect) {
+					emit(node.kid[0]);
+					emit(node.kid[1]);
+					emit(node.kid[2]);
+					op(ExprSelect, 0);
+					depth_ -= 2;
+					return;
+				}
+				if (!is_binary(node.code)) {
+					emit(node.kid[0]);
+					op(node.code, node.k);
+					return;
+				}
+				const Node& x = nodes_[node.kid[0]];
+				const Node& y = nodes_[node.kid[1]];
+				if (y.code == ExprConst) {
+					emit(node.kid[0]);
+					op(node.code, konst(y.value));
+				}
+				else if (x.code == ExprConst) {
+					emit(node.kid[1]);
+					op(swapped(node.code), konst(x.value));
+				}
+				else if (node.code != ExprMin && node.code != ExprMax && need(node.kid[1]) > need(node.kid[0])) {
+					emit(node.kid[1]);
+					emit(node.kid[0]);
+					op(swapped(node.code), -1);
+					depth_--;
+				}
+				else {
+					emit(node.kid[0]);
+					emit(node.kid[1]);
+					op(node.code, -1);
+					depth_--;
+				}
+			}
+
+			std::vector<ExprOp> code;
+			std::vector<float> consts;
+			int max_depth() const { return max_depth_; }
+
+		private:
+			// 按 emit 的顺序求值这棵子树需要的栈深
+			int need(int n) const
+			{
+				const Node& node = nodes_[n];
+				if (node.code == ExprA || node.code == ExprB || node.code == ExprConst)
+					return 1;
+				if (node.code == ExprSelect) {
+					int c = need(node.kid[0]), x = need(node.kid[1]) + 1, y = need(node.kid[2]) + 2;
+					return c > x ? (c > y ? c : y) : (x > y ? x : y);
+				}
+				if (!is_binary(node.code))
+					return need(node.kid[0]);
+				bool kx = nodes_[node.kid[0]].code == ExprConst, ky = nodes_[node.kid[1]].code == ExprConst;
+				if (kx || ky)
+					return need(node.kid[kx ? 1 : 0]);
+				int l = need(node.kid[0]), r = need(node.kid[1]);
+				if (node.code == ExprMin || node.code == ExprMax)
+					return l > r + 1 ? l : r + 1;
+				return l == r ? l + 1 : (l > r ? l : r);
+			}
+
+			static int swapped(int code)
+			{
+				switch (code)
+				{
+				case ExprSub: return ExprRSub;
+				case ExprDiv: return ExprRDiv;
+				case ExprLt:  return ExprGt;
+				case ExprLe:  return ExprGe;
+				case ExprGt:  return ExprLt;
+				case ExprGe:  return ExprLe;
+				default:      return code;
+				}
+			}
+
+			int konst(float v)
+			{
+				for (size_t i = 0; i < consts.size(); i++) {
+					if (memcmp(&consts[i], &v, sizeof(float)) == 0)
+						return (int)i;
+				}
+				consts.push_back(v);
+				return (int)consts.size() - 1;
+			}
+
+			void op(int c, int k)
+			{
+				ExprOp o = { c, k };
+				code.push_back(o);
+			}
+
+			void push(int c, int k)
+			{
+				op(c, k);
+				if (++depth_ > max_depth_)
+					max_depth_ = depth_;
+			}
+
+			const std::vector<Node>& nodes_;
+			int depth_;
+			int max_depth_;
+		};
+	}
+
+	BlendExpr::BlendExpr() : kernel_(expr_row_kernel())
+	{
+	}
+
+	bool BlendExpr::compile(const std::string& text, std::string* error)
+	{
+		Parser parser(text);
+		int root = parser.parse();
+		if (root < 0) {
+			if (error)
+				*error = parser.error();
+			return false;
+		}
+		Emitter emitter(parser.nodes());
+		emitter.emit(root);
+		if (emitter.max_depth() > kMaxExprStack) {
+			if (error)
+				*error = "expression is too deeply nested";
+			return false;
+		}
+		code_.swap(emitter.code);
+		consts_.swap(emitter.consts);
+		text_ = text;
+		return true;
+	}
+
+	void BlendExpr::run(const float* a, const float* b, float* out, int n) const
+	{
+		if (code_.empty()) {
+			if (out != b)
+				memmove(out, b, (size_t)n * sizeof(float));
+			return;
+		}
+		(*kernel_)(code_.data(), (int)code_.size(), consts_.data(), a, b, out, n);
+	}
+
+	void BlendExpr::run(const float* a, const float* b, float* out, int n, SimdLevel level) const
+	{
+		if (code_.empty()) {
+			if (out != b)
+				memmove(out, b, (size_t)n * sizeof(float));
+			return;
+		}
+		(*expr_row_kernel(level))(code_.data(), (int)code_.size(), consts_.data(), a, b, out, n);
+	}
+}
@@ -0,0 +1,87 @@
+// ========================================
+// 自定义混合公式 (Custom 模式): 用户用 A / B 写的表达式, 不用改代码重新编译插件.
+// 公式只在文字变了时解析一次: 语法树先做常量折叠, 再编成一段紧凑的栈式字节码.
+// 求值时每条指令一次处理一批 (kExprBatch 个) 像素, 指令分派的开销摊到整批上,
+// 每条指令内部是按指令集展开的向量循环 (psExpr.inl), 各指令集结果逐位相同.
+//
+//   BlendExpr e;
+//   std::string err;
+//   if (!e.compile("a <= 0.5 ? 2*a*b : 1 - 2*(1-a)*(1-b)", &err)) ...
+//   e.run(a, b, out, n);
+//
+// 语法:
+//   数字 (1, 0.5, 2e-3), 变量 a / b (A / B 也行, 是节点里 0..1 的原值), 括号
+//   + - * / 和一元 -, x ^ n (n 为 0..16 的整数常数, 或 0.5 即 sqrt)
+//   比较 < <= > >= == != (真为 1, 假为 0), 条件 c ? x : y (c 不为 0 时取 x, 两边都会算)
+//   min(x, y) max(x, y) abs(x) sqrt(x) pow(x, n) clamp(x) clamp(x, lo, hi) lerp(x, y, t)
+// 结果原样输出, 不受 math 影响; 需要截到 0..1 时在公式里写 clamp().
+// ========================================
+#pragma once
+
+#include <string>
+#include <vector>
+#include "psBlend.h"
+
+namespace photoshopMergeTool {
+	enum ExprOpCode {
+		// 压栈
+		ExprA, ExprB, ExprConst,
+		// 二元: 弹出两个压回一个; k >= 0 时右边是常数 consts[k], 只弹一个
+		ExprAdd, ExprSub, ExprMul, ExprDiv, ExprMin, ExprMax,
+		ExprLt, ExprLe, ExprGt, ExprGe, ExprEq, ExprNe,
+		// 反向的减法 / 除法: 栈顶减 / 除以它下面的一个; k >= 0 时是 k - x, k / x
+		ExprRSub, ExprRDiv,
+		// 一元; ExprPowi 的 k 是整数指数
+		ExprNeg, ExprAbs, ExprSqrt, ExprPowi,
+		// c ? x : y, 弹出三个
+		ExprSelect
+	};
+
+	struct ExprOp {
+		int code;
+		int k;
+	};
+
+	// 一批的像素数, 也是栈上每个槽的长度; 是所有向量宽度的倍数
+	static const int kExprBatch = 256;
+	// 栈最深的层数, 公式超过时编译失败
+	static const int kMaxExprStack = 16;
+	// 括号、一元运算符、^、? : 和函数参数最多套 kMaxExprNesting 层, 语法树最多 kMaxExprHeight 层高、
+	// kMaxExprNodes 个节点 (lerp 的第一个参数会复制一份). 超过时编译失败并给出字符位置,
+	// 解析和生成字节码的递归深度因此有界, 再长的公式也不会把栈用完
+	static const int kMaxExprNesting = 64;
+	static const int kMaxExprHeight = 256;
+	static const int kMaxExprNodes = 4096;
+
+	typedef void (*ExprRowKernel)(const ExprOp* code, int count, const float* consts,
+		const float* a, const float* b, float* out, int n);
+
+	// 按指令集取求值循环 (psBlendFloat.cpp), 不带 level 时使用 simd_level()
+	ExprRowKernel expr_row_kernel();
+	ExprRowKernel expr_row_kernel(SimdLevel level);
+
+	// 编好的公式. compile 之后只读, 可以在多个线程里同时 run
+	class BlendExpr
+	{
+	public:
+		BlendExpr();
+
+		// 失败时返回 false, error 里是带字符位置的说明, 原来的程序保持不变
+		bool compile(const std::string& text, std::string* error);
+		bool empty() const { return code_.empty(); }
+		// 上一次编译成功的文字
+		const std::string& text() const { return text_; }
+		// 字节码的指令数, 常量折叠之后
+		int size() const { return (int)code_.size(); }
+
+		// out[i] = f(a[i], b[i]), out 可以与 a 或 b 相同. 没有编译过时 out = b, 与正常模式相同
+		void run(const float* a, const float* b, float* out, int n) const;
+		void run(const float* a, const float* b, float* out, int n, SimdLevel level) const;
+
+	private:
+		std::vector<ExprOp> code_;
+		std::vector<float> consts_;
+		std::string text_;
+		ExprRowKernel kernel_;
+	};
+}
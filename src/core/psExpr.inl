@@ -0,0 +1,162 @@
+// ========================================
+// 自定义公式 (psExpr.h) 的字节码求值.
+// 由 psBlendFloat.cpp (标量) 和 psBlendSimd.cpp (每个指令集一次) 在各自的 expr 命名空间里包含,
+// 包含前需要定义 vfloat / vmask / kWidth / vloadu / vstoreu 和 v* 基本运算.
+// 每批 kExprBatch 个像素, 栈的每个槽就是一批; 每条指令对整批跑一个向量循环.
+// 满的一批 A / B 不复制, 指令直接从输入读. 最后不满的一批长度向上取到 kWidth 的倍数,
+// 复制到槽里, 补出来的位置装 0, 参与计算但不写回.
+// ========================================
+
+static inline vfloat truth(vmask m) { return vsel(m, vset1(1.0f), vset1(0.0f)); }
+static inline vfloat op_lt(vfloat x, vfloat y) { return truth(vlt(x, y)); }
+static inline vfloat op_le(vfloat x, vfloat y) { return truth(vle(x, y)); }
+static inline vfloat op_gt(vfloat x, vfloat y) { return truth(vgt(x, y)); }
+static inline vfloat op_ge(vfloat x, vfloat y) { return truth(vge(x, y)); }
+static inline vfloat op_eq(vfloat x, vfloat y) { return truth(veq(x, y)); }
+static inline vfloat op_ne(vfloat x, vfloat y) { return vsel(veq(x, y), vset1(0.0f), vset1(1.0f)); }
+static inline vfloat op_rsub(vfloat x, vfloat k) { return vsub(k, x); }
+static inline vfloat op_rdiv(vfloat x, vfloat k) { return vdiv(k, x); }
+// 常数总是放在前面, 与 clamp01 一样让 x 的 NaN 原样传递
+static inline vfloat op_kmin(vfloat x, vfloat k) { return vmin(k, x); }
+static inline vfloat op_kmax(vfloat x, vfloat k) { return vmax(k, x); }
+static inline vfloat op_neg(vfloat x) { return vmul(vset1(-1.0f), x); }
+
+// 与 psExpr.cpp 折叠常量时的乘法顺序相同
+static inline vfloat op_powi(vfloat x, int n)
+{
+	vfloat r = vset1(1.0f);
+	while (n) {
+		if (n & 1)
+			r = vmul(r, x);
+		n >>= 1;
+		if (n)
+			x = vmul(x, x);
+	}
+	return r;
+}
+
+typedef float ExprSlot[kExprBatch];
+
+// 不满一批时复制到槽里并补 0, 满一批直接读输入
+static inline const float* load(float* slot, const float* src, int m, int mw)
+{
+	if (m == mw)
+		return src;
+	memcpy(slot, src, (size_t)m * sizeof(float));
+	for (int i = m; i < mw; i++)
+		slot[i] = 0.0f;
+	return slot;
+}
+
+// 槽 sp 的当前数据是 in[sp], 结果总是写进槽自己的存储.
+// k >= 0 时右边是常数 consts[k], 栈深不变; 否则两个槽合成一个
+template <vfloat (*Op)(vfloat, vfloat), vfloat (*OpK)(vfloat, vfloat)>
+static inline int binary(ExprSlot* stack, const float** in, int sp, int k, const float* consts, int m)
+{
+	if (k >= 0) {
+		const float* x = in[sp];
+		float* r = stack[sp];
+		vfloat vk = vset1(consts[k]);
+		for (int i = 0; i < m; i += kWidth)
+			vstoreu(r + i, OpK(vloadu(x + i), vk));
+		in[sp] = r;
+		return sp;
+	}
+	const float* x = in[sp - 1];
+	const float* y = in[sp];
+	float* r = stack[sp - 1];
+	for (int i = 0; i < m; i += kWidth)
+		vstoreu(r + i, Op(vloadu(x + i), vloadu(y + i)));
+	in[sp - 1] = r;
+	return sp - 1;
+}
+
+template <vfloat (*Op)(vfloat)>
+static inline void unary(ExprSlot* stack, const float** in, int sp, int m)
+{
+	const float* x = in[sp];
+	float* r = stack[sp];
+	for (int i = 0; i < m; i += kWidth)
+		vstoreu(r + i, Op(vloadu(x + i)));
+	in[sp] = r;
+}
+
+void run(const ExprOp* code, int count, const float* consts, const float* a, const float* b, float* out, int n)
+{
+	ExprSlot stack[kMaxExprStack];
+	const float* in[kMaxExprStack];
+	for (int i0 = 0; i0 < n; i0 += kExprBatch) {
+		int m = n - i0 < kExprBatch ? n - i0 : kExprBatch;
+		int mw = (m + kWidth - 1) / kWidth * kWidth;
+		int sp = -1;
+		for (int pc = 0; pc < count; pc++) {
+			const ExprOp& op = code[pc];
+			switch (op.code)
+			{
+			case ExprA:
+				sp++;
+				in[sp] = load(stack[sp], a + i0, m, mw);
+				break;
+			case ExprB:
+				sp++;
+				in[sp] = load(stack[sp], b + i0, m, mw);
+				break;
+			case ExprConst: {
+				float* r = stack[++sp];
+				vfloat vk = vset1(consts[op.k]);
+				for (int i = 0; i < mw; i += kWidth)
+					vstoreu(r + i, vk);
+				in[sp] = r;
+				break;
+			}
+			case ExprAdd:  sp = binary<vadd, vadd>(stack, in, sp, op.k, consts, mw); break;
+			case ExprSub:  sp = binary<vsub, vsub>(stack, in, sp, op.k, consts, mw); break;
+			case ExprMul:  sp = binary<vmul, vmul>(stack, in, sp, op.k, consts, mw); break;
+			case ExprDiv:  sp = binary<vdiv, vdiv>(stack, in, sp, op.k, consts, mw); break;
+			case ExprMin:  sp = binary<vmin, op_kmin>(stack, in, sp, op.k, consts, mw); break;
+			case ExprMax:  sp = binary<vmax, op_kmax>(stack, in, sp, op.k, consts, mw); break;
+			case ExprLt:   sp = binary<op_lt, op_lt>(stack, in, sp, op.k, consts, mw); break;
+			case ExprLe:   sp = binary<op_le, op_le>(stack, in, sp, op.k, consts, mw); break;
+			case ExprGt:   sp = binary<op_gt, op_gt>(stack, in, sp, op.k, consts, mw); break;
+			case ExprGe:   sp = binary<op_ge, op_ge>(stack, in, sp, op.k, consts, mw); break;
+			case ExprEq:   sp = binary<op_eq, op_eq>(stack, in, sp, op.k, consts, mw); break;
+			case ExprNe:   sp = binary<op_ne, op_ne>(stack, in, sp, op.k, consts, mw); break;
+			case ExprRSub: sp = binary<op_rsub, op_rsub>(stack, in, sp, op.k, consts, mw); break;
+			case ExprRDiv: sp = binary<op_rdiv, op_rdiv>(stack, in, sp, op.k, consts, mw); break;
+			case ExprNeg:  unary<op_neg>(stack, in, sp, mw); break;
+			case ExprAbs:  unary<vabs>(stack, in, sp, mw); break;
+			case ExprSqrt: unary<vsqrt>(stack, in, sp, mw); break;
+			case ExprPowi: {
+				const float* x = in[sp];
+				float* r = stack[sp];
+				for (int i = 0; i < mw; i += kWidth)
+					vstoreu(r + i, op_powi(vloadu(x + i), op.k));
+				in[sp] = r;
+				break;
+			}
+			case ExprSelect: {
+				// c 不为 0 取 x, 为 0 取 y; NaN 也算不为 0
+				const float* c = in[sp - 2];
+				const float* x = in[sp - 1];
+				const float* y = in[sp];
+				float* r = stack[sp - 2];
+				for (int i = 0; i < mw; i += kWidth)
+					vstoreu(r + i, vsel(veq(vloadu(c + i), vset1(0.0f)), vloadu(y + i), vloadu(x + i)));
+				in[sp - 2] = r;
+				sp -= 2;
+				break;
+			}
+			default:
+				break;
+			}
+		}
+		// out 可以与 a / b 相同: 这一批已经读完, 之后的批只读后面的像素
+		const float* r = in[0];
+		float* o = out + i0;
+		int i = 0;
+		for (; i + kWidth <= m; i += kWidth)
+			vstoreu(o + i, vloadu(r + i));
+		for (; i < m; i++)
+			o[i] = r[i];
+	}
+}
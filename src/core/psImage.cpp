@@ -0,0 +1,275 @@
+// ========================================
+// 整张图混合和首次写入分配的实现.
+// ========================================
+#include <algorithm>
+#include <cstdlib>
+#include <cstring>
+#include "psImage.h"
+#include "psLut8.h"
+#include "psThreadPool.h"
+
+namespace photoshopMergeTool {
+	ConstImageView::ConstImageView() : width(0), height(0), channels(0), stride(0)
+	{
+		for (int c = 0; c < kMaxImageChannels; c++)
+			planes[c] = NULL;
+	}
+
+	ConstImageView::ConstImageView(const ImageView& v)
+		: width(v.width), height(v.height), channels(v.channels), stride(v.stride)
+	{
+		for (int c = 0; c < kMaxImageChannels; c++)
+			planes[c] = v.planes[c];
+	}
+
+	void ImageKernels::init(int m, bool p8, BlendMath mt, SoftLightPrecision sl)
+	{
+		mode = m;
+		parity8 = p8;
+		math = mt;
+		soft_light = sl;
+		kind = blend_mode_kind(m);
+		if (p8)
+			row = lut8_row_kernel(m);
+		else
+			row = m == SoftLight ? soft_light_row_kernel(mt, sl) : value_row_kernel(m, mt);
+		color = p8 ? lut8_color_row_kernel(m) : color_row_kernel(m, mt);
+		const_color = p8 ? NULL : const_color_row_kernel(m, mt);
+		dissolve = dissolve_row_kernel();
+		expr = NULL;
+	}
+
+	void ImageKernels::blend_row(const float* const* a, const float* const* b, float* const* out,
+		int channels, int n, int x, int y, const DissolveKey& key) const
+	{
+		if (mode == Custom && expr) {
+			for (int c = 0; c < channels; c++)
+				expr->run(a[c], b[c], out[c], n);
+			return;
+		}
+		if (kind == asValueBlend) {
+			for (int c = 0; c < channels; c++) {
+				if (span_is_uniform(b[c], n)) {
+					ConstRowKernel k;
+					if (parity8)
+						k = lut8_const_row_kernel(mode);
+					else if (mode == SoftLight)
+						k = soft_light_const_row_kernel(b[c][0], math, soft_light);
+					else
+						k = const_row_kernel(mode, b[c][0], math);
+					(*k)(a[c], b[c][0], out[c], n);
+				}
+				else
+					(*row)(a[c], b[c], out[c], n);
+			}
+			return;
+		}
+		if (kind == asDissolveBlend) {
+			for (int c = 0; c < channels; c++)
+				(*dissolve)(a[c], b[c], out[c], n, x, y, key);
+			return;
+		}
+		// 颜色模式: 前三个通道一起算, 其余照抄 A
+		for (int c = channels < 3 ? 0 : 3; c < channels; c++) {
+			if (out[c] != a[c])
+				memmove(out[c], a[c], (size_t)n * sizeof(float));
+		}
+		if (channels < 3)
+			return;
+		if (const_color && span_is_uniform(b[0], n) && span_is_uniform(b[1], n) && span_is_uniform(b[2], n)) {
+			float cb[3] = { b[0][0], b[1][0], b[2][0] };
+			(*const_color)(a, cb, out, n);
+		}
+		else
+			(*color)(a, b, out, n);
+	}
+
+	BlendImageOptions::BlendImageOptions() : tile_width(0), tile_height(0), parity8(false), math(MathLegacy),
+		soft_light(SoftLightExact), expr(NULL), pool(NULL)
+	{
+		dissolve.frame = 0;
+		dissolve.seed = 0;
+		dissolve.amount = 0.5f;
+	}
+
+	uint64_t kernels_fingerprint(const ImageKernels& k, const DissolveKey& key)
+	{
+		int32_t head[4] = { k.mode, k.parity8 ? 1 : 0, (int32_t)k.math, (int32_t)k.soft_light };
+		uint64_t h = hash_bytes(head, sizeof(head), 0);
+		if (k.mode == Custom && k.expr)
+			h = hash_bytes(k.expr->text().data(), k.expr->text().size(), h);
+		if (k.kind == asDissolveBlend) {
+			uint32_t d[3];
+			d[0] = (uint32_t)key.frame;
+			d[1] = key.seed;
+			memcpy(&d[2], &key.amount, sizeof(float));
+			h = hash_bytes(d, sizeof(d), h);
+		}
+		return h;
+	}
+
+	uint64_t hash_tile(const ConstImageView& v, int x, int y, int width, int height)
+	{
+		uint64_t h = 0;
+		for (int c = 0; c < v.channels; c++) {
+			for (int r = y; r < y + height; r++)
+				h = hash_bytes(v.row(c, r) + x, (size_t)width * sizeof(float), h);
+		}
+		return h;
+	}
+
+	TileKey make_tile_key(const ImageKernels& k, uint64_t params, uint64_t a, uint64_t b,
+		int x, int y, int width, int height, int channels)
+	{
+		bool positional = k.kind == asDissolveBlend;
+		TileKey key;
+		key.a = a;
+		key.b = b;
+		key.params = params;
+		key.x = positional ? x : 0;
+		key.y = positional ? y : 0;
+		key.width = width;
+		key.height = height;
+		key.channels = channels;
+		return key;
+	}
+
+	TileData copy_tile(const ConstImageView& v, int x, int y, int width, int height)
+	{
+		TileData data((size_t)width * height * v.channels);
+		float* p = data.data();
+		for (int c = 0; c < v.channels; c++) {
+			for (int r = y; r < y + height; r++, p += width)
+				memcpy(p, v.row(c, r) + x, (size_t)width * sizeof(float));
+		}
+		return data;
+	}
+
+	void paste_tile(const ImageView& v, int x, int y, int width, int height, const TileData& data)
+	{
+		const float* p = data.data();
+		for (int c = 0; c < v.channels; c++) {
+			for (int r = y; r < y + height; r++, p += width)
+				memcpy(v.row(c, r) + x, p, (size_t)width * sizeof(float));
+		}
+	}
+
+	static const int kMaxTileWidth = 1024;
+	static const size_t kTileBytes = 256 * 1024;
+
+	TileGrid tile_grid(int width, int height, int channels, const BlendImageOptions& opts)
+	{
+		TileGrid g;
+		g.tile_width = opts.tile_width > 0 ? opts.tile_width : std::min(std::max(width, 1), kMaxTileWidth);
+		if (opts.tile_height > 0)
+			g.tile_height = opts.tile_height;
+		else {
+			size_t row_bytes = (size_t)g.tile_width * std::max(channels, 1) * 3 * sizeof(float);
+			g.tile_height = (int)std::max<size_t>(1, kTileBytes / row_bytes);
+		}
+		g.cols = (width + g.tile_width - 1) / g.tile_width;
+		g.rows = (height + g.tile_height - 1) / g.tile_height;
+		return g;
+	}
+
+	static ThreadPool& pool_of(const BlendImageOptions& opts)
+	{
+		return opts.pool ? *opts.pool : ThreadPool::shared();
+	}
+
+	bool blend_image(const ImageView& dst, const ConstImageView& a, const ConstImageView& b,
+		int mode, const BlendImageOptions& opts)
+	{
+		if (a.width != dst.width || b.width != dst.width || a.height != dst.height || b.height != dst.height)
+			return false;
+		if (a.channels != dst.channels || b.channels != dst.channels || dst.channels > kMaxImageChannels)
+			return false;
+		if (dst.width <= 0 || dst.height <= 0 || dst.channels <= 0)
+			return true;
+
+		ImageKernels kernels;
+		kernels.init(mode, opts.parity8, opts.math, opts.soft_light);
+		kernels.expr = opts.expr;
+		TileGrid grid = tile_grid(dst.width, dst.height, dst.channels, opts);
+		int channels = dst.channels;
+		pool_of(opts).run(grid.count(), [&](int task, int) {
+			int x0 = (task % grid.cols) * grid.tile_width;
+			int y0 = (task / grid.cols) * grid.tile_height;
+			int n = std::min(grid.tile_width, dst.width - x0);
+			int y1 = std::min(y0 + grid.tile_height, dst.height);
+			const float* pa[kMaxImageChannels];
+			const float* pb[kMaxImageChannels];
+			float* po[kMaxImageChannels];
+			for (int y = y0; y < y1; y++) {
+				for (int c = 0; c < channels; c++) {
+					pa[c] = a.row(c, y) + x0;
+					pb[c] = b.row(c, y) + x0;
+					po[c] = dst.row(c, y) + x0;
+				}
+				kernels.blend_row(pa, pb, po, channels, n, x0, y, opts.dissolve);
+			}
+		});
+		return true;
+	}
+
+	ImageBuffer::ImageBuffer() : data_(NULL)
+	{
+		memset(&view_, 0, sizeof(view_));
+	}
+
+	ImageBuffer::~ImageBuffer()
+	{
+		release();
+	}
+
+	void ImageBuffer::release()
+	{
+#if defined(_WIN32)
+		_aligned_free(data_);
+#else
+		free(data_);
+#endif
+		data_ = NULL;
+		memset(&view_, 0, sizeof(view_));
+	}
+
+	bool ImageBuffer::allocate(int width, int height, int channels, const BlendImageOptions& opts)
+	{
+		release();
+		if (width <= 0 || height <= 0 || channels <= 0 || channels > kMaxImageChannels)
+			return false;
+		size_t stride = ((size_t)width + 15) & ~(size_t)15;
+		size_t bytes = stride * height * channels * sizeof(float);
+		// 大块内存由系统新映射, 在第一次写之前不占物理页
+#if defined(_WIN32)
+		data_ = (float*)_aligned_malloc(bytes, 64);
+#else
+		void* p = NULL;
+		data_ = posix_memalign(&p, 64, bytes) == 0 ? (float*)p : NULL;
+#endif
+		if (!data_)
+			return false;
+		view_.width = width;
+		view_.height = height;
+		view_.channels = channels;
+		view_.stride = stride;
+		for (int c = 0; c < channels; c++)
+			view_.planes[c] = data_ + stride * height * c;
+
+		// 首次写入: 与 blend_image 同样的 tile 和同样的初始分配
+		TileGrid grid = tile_grid(width, height, channels, opts);
+		const ImageView& v = view_;
+		pool_of(opts).run(grid.count(), [&](int task, int) {
+			int x0 = (task % grid.cols) * grid.tile_width;
+			int y0 = (task / grid.cols) * grid.tile_height;
+			// 最右一列的 tile 连行尾的对齐填充一起清掉
+			size_t n = x0 + grid.tile_width >= width ? stride - x0 : (size_t)grid.tile_width;
+			int y1 = std::min(y0 + grid.tile_height, height);
+			for (int c = 0; c < channels; c++) {
+				for (int y = y0; y < y1; y++)
+					memset(v.row(c, y) + x0, 0, n * sizeof(float));
+			}
+		});
+		return true;
+	}
+}
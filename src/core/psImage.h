@@ -0,0 +1,128 @@
+// ========================================
+// 整张图的混合: 把画面切成缓存大小的 tile, 交给任务窃取线程池并行处理.
+// 每个 tile 内部仍是一行一行地调用行内核, 结果与节点逐行计算完全相同.
+//
+//   ImageBuffer a, b, out;             // 用同一套 tile 划分首次写入, 页落在处理它的线程附近
+//   a.allocate(w, h, 3, opts); ...
+//   blend_image(out.view(), a.view(), b.view(), Multiply, opts);
+// ========================================
+#pragma once
+
+#include <cstddef>
+#include "psBlend.h"
+#include "psExpr.h"
+#include "psTileCache.h"
+
+namespace photoshopMergeTool {
+	class ThreadPool;
+
+	static const int kMaxImageChannels = 8;
+
+	// 平面格式的浮点图像: 每个通道一块, 同一通道相邻两行相隔 stride 个 float
+	struct ImageView {
+		int width;
+		int height;
+		int channels;
+		size_t stride;
+		float* planes[kMaxImageChannels];
+
+		float* row(int c, int y) const { return planes[c] + (size_t)y * stride; }
+	};
+
+	struct ConstImageView {
+		int width;
+		int height;
+		int channels;
+		size_t stride;
+		const float* planes[kMaxImageChannels];
+
+		ConstImageView();
+		ConstImageView(const ImageView& v);
+		const float* row(int c, int y) const { return planes[c] + (size_t)y * stride; }
+	};
+
+	// 一种模式用到的全部内核, 选一次之后按行混合多个通道:
+	// 可分离模式逐通道 (B 整段相同时用常数 B 内核), 颜色模式算前三个通道、其余照抄 A,
+	// 溶解按 (x, y, key) 取 A 或 B. parity8 时输入输出都是 8 位, math 和 soft_light 不起作用.
+	// Custom 模式由 expr 逐通道求值 (不受 parity8 / math 影响), expr 为 NULL 时与正常相同
+	struct ImageKernels {
+		int mode;
+		PsMode kind;
+		bool parity8;
+		BlendMath math;
+		SoftLightPrecision soft_light;
+		RowKernel row;
+		ColorRowKernel color;
+		ConstColorRowKernel const_color;
+		DissolveRowKernel dissolve;
+		const BlendExpr* expr;  // 不归这里所有, init 时清为 NULL
+
+		void init(int mode, bool parity8, BlendMath math = MathLegacy, SoftLightPrecision soft_light = SoftLightExact);
+		void blend_row(const float* const* a, const float* const* b, float* const* out,
+			int channels, int n, int x, int y, const DissolveKey& key) const;
+	};
+
+	struct BlendImageOptions {
+		int tile_width;       // <= 0 时自动选
+		int tile_height;
+		bool parity8;
+		BlendMath math;       // 默认 MathLegacy
+		SoftLightPrecision soft_light;  // 默认 SoftLightExact
+		const BlendExpr* expr;          // Custom 模式的公式, 默认 NULL
+		DissolveKey dissolve;
+		ThreadPool* pool;     // NULL 时用 ThreadPool::shared()
+
+		BlendImageOptions();
+	};
+
+	// tile 的划分, 按行优先编号
+	struct TileGrid {
+		int tile_width;
+		int tile_height;
+		int cols;
+		int rows;
+
+		int count() const { return cols * rows; }
+	};
+
+	// 自动大小: 宽度最多 1024, 高度让 A / B / 输出三份数据合起来约 256KB, 放得进 L2
+	TileGrid tile_grid(int width, int height, int channels, const BlendImageOptions& opts);
+
+	// 尺寸或通道数不一致时返回 false, 不做任何事. dst 可以和 a 是同一张图
+	bool blend_image(const ImageView& dst, const ConstImageView& a, const ConstImageView& b,
+		int mode, const BlendImageOptions& opts);
+
+	// 序列的 tile 结果缓存 (psTileCache.h) 用的几个小工具.
+	// 内存里的整张图不用它: 普通模式受内存带宽限制, 读两张输入算哈希再复制结果比重新混合还慢;
+	// 省得下来的是按帧读文件的场合 (psblend_batch --reuse), 命中时连 B 都不用读.
+
+	// 内核的指纹: 模式、parity8、数值域、柔光精度、公式的文字, 溶解时再加上帧号、种子和比例
+	uint64_t kernels_fingerprint(const ImageKernels& k, const DissolveKey& key);
+	// [x, x + width) x [y, y + height) 这一块所有通道的内容哈希
+	uint64_t hash_tile(const ConstImageView& v, int x, int y, int width, int height);
+	// x / y 是这一块在整张图里的位置. 只有溶解的结果与位置有关, 其它模式不同位置的相同内容共用一份
+	TileKey make_tile_key(const ImageKernels& k, uint64_t params, uint64_t a, uint64_t b,
+		int x, int y, int width, int height, int channels);
+	// 把一块复制成 TileData / 从 TileData 写回
+	TileData copy_tile(const ConstImageView& v, int x, int y, int width, int height);
+	void paste_tile(const ImageView& v, int x, int y, int width, int height, const TileData& data);
+
+	// 行对齐到 64 字节的平面图像. allocate 只申请地址空间, 由线程池按 tile_grid 的划分
+	// 和 blend_image 相同的分配方式写 0, 页就分配在之后处理这个 tile 的线程所在的节点上
+	class ImageBuffer
+	{
+	public:
+		ImageBuffer();
+		~ImageBuffer();
+		ImageBuffer(const ImageBuffer&) = delete;
+		ImageBuffer& operator=(const ImageBuffer&) = delete;
+
+		bool allocate(int width, int height, int channels, const BlendImageOptions& opts);
+		void release();
+		const ImageView& view() const { return view_; }
+
+	private:
+		float* data_;
+		ImageView view_;
+	};
+}
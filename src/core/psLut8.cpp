@@ -0,0 +1,232 @@
+// ========================================
+// 8 位对齐模式的查表实现.
+// 每张表对 256x256 种输入组合各算一次 Photoshop 的 8 位公式; 之后每个像素只剩两次量化和一次查表,
+// 柔光的 sqrt、颜色加深 / 亮光的除法都不再出现在热循环里.
+//
+// 公式是 Adobe 混合模式规范 (PDF 1.7, 11.3.5) 的可分离模式, 柔光用 Photoshop 自己的版本
+// (2ab + a^2 (1 - 2b) / 2a (1 - b) + sqrt(a) (2b - 1)), 实色混合是 A + B >= 255.
+// 在 0..1 上用 double 算, 最后乘 255 四舍五入一次; 乘法类的结果因此就是 round(A * B / 255).
+// legacy 公式 (psBlend.cpp) 里的 / 128 等近似不进表, 例如排除 255 与 255 在这里是 0.
+// ========================================
+#include <algorithm>
+#include <cmath>
+#include <cstddef>
+#include "psLut8.h"
+
+namespace photoshopMergeTool {
+	unsigned char quantize8(float v)
+	{
+		if (!(v > 0.0f))
+			return 0;
+		if (v >= 1.0f)
+			return 255;
+		return (unsigned char)(v * ARGB_LEVER + 0.5f);
+	}
+
+	// 0..255 -> 0..1, 与 convert_from_argb 的结果相同
+	struct Decode8 {
+		float v[256];
+		Decode8()
+		{
+			for (int i = 0; i < 256; i++)
+				v[i] = PhotoshopComput::convert_from_argb((argb)i);
+		}
+	};
+	static const Decode8 g_decode8;
+
+	static double color_burn8(double a, double b)
+	{
+		if (a >= 1.0)
+			return 1.0;
+		if (b <= 0.0)
+			return 0.0;
+		return 1.0 - std::min(1.0, (1.0 - a) / b);
+	}
+
+	static double color_dodge8(double a, double b)
+	{
+		if (a <= 0.0)
+			return 0.0;
+		if (b >= 1.0)
+			return 1.0;
+		return std::min(1.0, a / (1.0 - b));
+	}
+
+	// 8 位下 B 不会正好是 0.5 (127.5), 两段的分界没有歧义
+	static double photoshop8_value(int mode, double a, double b)
+	{
+		switch (mode)
+		{
+		case Darken:       return std::min(a, b);
+		case Multiply:     return a * b;
+		case ColorBurn:    return color_burn8(a, b);
+		case LinearBurn:   return std::max(0.0, a + b - 1.0);
+		case Lighten:      return std::max(a, b);
+		case Screen:       return 1.0 - (1.0 - a) * (1.0 - b);
+		case ColorDodge:   return color_dodge8(a, b);
+		case LinearDodge:  return std::min(1.0, a + b);
+		case Overlay:      return a < 0.5 ? 2.0 * a * b : 1.0 - 2.0 * (1.0 - a) * (1.0 - b);
+		case SoftLight:    return b < 0.5 ? 2.0 * a * b + a * a * (1.0 - 2.0 * b) : 2.0 * a * (1.0 - b) + std::sqrt(a) * (2.0 * b - 1.0);
+		case HardLight:    return b < 0.5 ? 2.0 * a * b : 1.0 - 2.0 * (1.0 - a) * (1.0 - b);
+		case VividLight:   return b < 0.5 ? color_burn8(a, 2.0 * b) : color_dodge8(a, 2.0 * b - 1.0);
+		case LinearLight:  return std::min(1.0, std::max(0.0, a + 2.0 * b - 1.0));
+		case PinLight:     return b < 0.5 ? std::min(a, 2.0 * b) : std::max(a, 2.0 * b - 1.0);
+		case HardMix:      return a + b >= 1.0 ? 1.0 : 0.0;
+		case Diference:    return std::fabs(a - b);
+		case Exclusion:    return a + b - 2.0 * a * b;
+		default:           return b;
+		}
+	}
+
+	unsigned char photoshop8(int mode, int a, int b)
+	{
+		double r = photoshop8_value(mode, a / 255.0, b / 255.0) * 255.0;
+		// 乘法类的结果离 .5 至少 1 / 510, 加一点余量, 避免 double 的误差把正好的整数舍到下面
+		int v = (int)std::floor(r + 0.5 + 1e-9);
+		return (unsigned char)(v < 0 ? 0 : (v > 255 ? 255 : v));
+	}
+
+	static const unsigned char* build_lut8(int mode)
+	{
+		unsigned char* table = new unsigned char[256 * 256];
+		for (int qa = 0; qa < 256; qa++) {
+			for (int qb = 0; qb < 256; qb++)
+				table[(qa << 8) | qb] = photoshop8(mode, qa, qb);
+		}
+		return table;
+	}
+
+	// 每种模式一个局部静态变量: 第一次调用时线程安全地建表, 之后只是一次判断
+	template <int Mode>
+	const unsigned char* lut8_of()
+	{
+		static const unsigned char* const table = build_lut8(Mode);
+		return table;
+	}
+
+	template <int Mode>
+	void lut8_row(const float* a, const float* b, float* out, int n)
+	{
+		const unsigned char* table = lut8_of<Mode>();
+		for (int i = 0; i < n; i++)
+			out[i] = g_decode8.v[table[(quantize8(a[i]) << 8) | quantize8(b[i])]];
+	}
+
+	template <int Mode>
+	void lut8_row_const(const float* a, float b, float* out, int n)
+	{
+		const unsigned char* table = lut8_of<Mode>() + quantize8(b);
+		float column[256];
+		for (int i = 0; i < 256; i++)
+			column[i] = g_decode8.v[table[i << 8]];
+		for (int i = 0; i < n; i++)
+			out[i] = column[quantize8(a[i])];
+	}
+
+	template <void (*Func)(const float*, const float*, float*)>
+	void lut8_row_rgb(const float* const* a, const float* const* b, float* const* out, int n)
+	{
+		for (int i = 0; i < n; i++) {
+			float pa[3], pb[3], pr[3];
+			for (int c = 0; c < 3; c++) {
+				pa[c] = g_decode8.v[quantize8(a[c][i])];
+				pb[c] = g_decode8.v[quantize8(b[c][i])];
+			}
+			Func(pa, pb, pr);
+			for (int c = 0; c < 3; c++)
+				out[c][i] = g_decode8.v[quantize8(pr[c])];
+		}
+	}
+
+	const unsigned char* lut8_table(int mode)
+	{
+		switch (mode)
+		{
+		case Normal:       return lut8_of<Normal>();
+		case Darken:       return lut8_of<Darken>();
+		case Multiply:     return lut8_of<Multiply>();
+		case ColorBurn:    return lut8_of<ColorBurn>();
+		case LinearBurn:   return lut8_of<LinearBurn>();
+		case Lighten:      return lut8_of<Lighten>();
+		case Screen:       return lut8_of<Screen>();
+		case ColorDodge:   return lut8_of<ColorDodge>();
+		case LinearDodge:  return lut8_of<LinearDodge>();
+		case Overlay:      return lut8_of<Overlay>();
+		case SoftLight:    return lut8_of<SoftLight>();
+		case HardLight:    return lut8_of<HardLight>();
+		case VividLight:   return lut8_of<VividLight>();
+		case LinearLight:  return lut8_of<LinearLight>();
+		case PinLight:     return lut8_of<PinLight>();
+		case HardMix:      return lut8_of<HardMix>();
+		case Diference:    return lut8_of<Diference>();
+		case Exclusion:    return lut8_of<Exclusion>();
+		default:           return NULL;
+		}
+	}
+
+	RowKernel lut8_row_kernel(int mode)
+	{
+		// 选内核的时候就把表建好, 渲染线程拿到的总是现成的表
+		lut8_table(mode);
+		switch (mode)
+		{
+		case Darken:       return &lut8_row<Darken>;
+		case Multiply:     return &lut8_row<Multiply>;
+		case ColorBurn:    return &lut8_row<ColorBurn>;
+		case LinearBurn:   return &lut8_row<LinearBurn>;
+		case Lighten:      return &lut8_row<Lighten>;
+		case Screen:       return &lut8_row<Screen>;
+		case ColorDodge:   return &lut8_row<ColorDodge>;
+		case LinearDodge:  return &lut8_row<LinearDodge>;
+		case Overlay:      return &lut8_row<Overlay>;
+		case SoftLight:    return &lut8_row<SoftLight>;
+		case HardLight:    return &lut8_row<HardLight>;
+		case VividLight:   return &lut8_row<VividLight>;
+		case LinearLight:  return &lut8_row<LinearLight>;
+		case PinLight:     return &lut8_row<PinLight>;
+		case HardMix:      return &lut8_row<HardMix>;
+		case Diference:    return &lut8_row<Diference>;
+		case Exclusion:    return &lut8_row<Exclusion>;
+		default:           lut8_table(Normal); return &lut8_row<Normal>;
+		}
+	}
+
+	ConstRowKernel lut8_const_row_kernel(int mode)
+	{
+		lut8_table(mode);
+		switch (mode)
+		{
+		case Darken:       return &lut8_row_const<Darken>;
+		case Multiply:     return &lut8_row_const<Multiply>;
+		case ColorBurn:    return &lut8_row_const<ColorBurn>;
+		case LinearBurn:   return &lut8_row_const<LinearBurn>;
+		case Lighten:      return &lut8_row_const<Lighten>;
+		case Screen:       return &lut8_row_const<Screen>;
+		case ColorDodge:   return &lut8_row_const<ColorDodge>;
+		case LinearDodge:  return &lut8_row_const<LinearDodge>;
+		case Overlay:      return &lut8_row_const<Overlay>;
+		case SoftLight:    return &lut8_row_const<SoftLight>;
+		case HardLight:    return &lut8_row_const<HardLight>;
+		case VividLight:   return &lut8_row_const<VividLight>;
+		case LinearLight:  return &lut8_row_const<LinearLight>;
+		case PinLight:     return &lut8_row_const<PinLight>;
+		case HardMix:      return &lut8_row_const<HardMix>;
+		case Diference:    return &lut8_row_const<Diference>;
+		case Exclusion:    return &lut8_row_const<Exclusion>;
+		default:           lut8_table(Normal); return &lut8_row_const<Normal>;
+		}
+	}
+
+	ColorRowKernel lut8_color_row_kernel(int mode)
+	{
+		switch (mode)
+		{
+		case DarkerColor:  return &lut8_row_rgb<PhotoshopComput::darker_color>;
+		case LighterColor: return &lut8_row_rgb<PhotoshopComput::lighter_color>;
+		case Saturation:   return &lut8_row_rgb<PhotoshopComput::saturation>;
+		case Color:        return &lut8_row_rgb<PhotoshopComput::color>;
+		case Luminosity:   return &lut8_row_rgb<PhotoshopComput::luminosity>;
+		default:           return &lut8_row_rgb<PhotoshopComput::hue>;
+		}
+	}
+}
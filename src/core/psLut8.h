@@ -0,0 +1,29 @@
+// ========================================
+// 8 位对齐模式: 输入先量化到 0..255, 结果直接查表.
+// 和 Photoshop 8 位文档一样, 每个通道只有 256 级, 输出也量化到 256 级.
+// 可分离模式的表按 Photoshop 的 8 位公式生成 (除以 255, 一次四舍五入, 见 psLut8.cpp),
+// 不是 legacy 公式 (除以 128 等) 的量化; 颜色模式只量化输入输出, 中间仍是原公式.
+// ========================================
+#pragma once
+
+#include "psBlend.h"
+
+namespace photoshopMergeTool {
+	// 0..1 浮点 -> 0..255 (四舍五入, 超出范围和 NaN 先截到两端)
+	unsigned char quantize8(float v);
+
+	// Photoshop 8 位公式的一个结果: A 是下层, B 是上层, 都是 0..255
+	unsigned char photoshop8(int mode, int a, int b);
+
+	// 可分离模式的 256x256 结果表, 下标 (A << 8) | B, 内容就是 photoshop8.
+	// 第一次用到时生成, 整个进程共用, 之后只读; 颜色模式返回 NULL
+	const unsigned char* lut8_table(int mode);
+
+	// 8 位对齐的行内核, 接口与 value_row_kernel / color_row_kernel 相同.
+	// 颜色模式三个通道一起查不了表, 只做输入输出量化, 中间仍按原公式计算
+	RowKernel lut8_row_kernel(int mode);
+	ColorRowKernel lut8_color_row_kernel(int mode);
+
+	// B 为常数时先取出 B 那一列 (256 个结果) 作为一维表, 每个像素只查 A
+	ConstRowKernel lut8_const_row_kernel(int mode);
+}
@@ -0,0 +1,69 @@
+// ========================================
+// 蒙版权重和分段的实现, 见 psMask.h.
+// ========================================
+#include "psMask.h"
+
+namespace photoshopMergeTool {
+	void mask_weights(float* w, int n, float mix)
+	{
+		for (int i = 0; i < n; i++) {
+			float v = w[i] * mix;
+			w[i] = v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f;
+		}
+	}
+
+	void trim_mask_span(const float* w, int* x0, int* x1)
+	{
+		int b = *x0, e = *x1;
+		while (b < e && w[b] <= 0.0f)
+			b++;
+		while (e > b && w[e - 1] <= 0.0f)
+			e--;
+		*x0 = b;
+		*x1 = e;
+	}
+
+	void next_mask_span(const float* w, int x, int x1, MaskSpan* span)
+	{
+		span->x0 = x;
+		int j = x;
+		while (j < x1 && w[j] <= 0.0f)
+			j++;
+		if (j - x >= kMinSkipRun || j == x1) {
+			span->x1 = j;
+			span->kind = MaskSpanCopyA;
+			return;
+		}
+		// 混合段一直延伸到下一个值得跳过的 0 段; 中间夹着短的 0 段或小于 1 的权重就要插值
+		int e = j;
+		bool full = j == x;
+		while (e < x1) {
+			if (w[e] > 0.0f) {
+				if (w[e] < 1.0f)
+					full = false;
+				e++;
+				continue;
+			}
+			int z0 = e;
+			while (e < x1 && w[e] <= 0.0f)
+				e++;
+			if (e - z0 >= kMinSkipRun || e == x1) {
+				e = z0;
+				break;
+			}
+			full = false;
+		}
+		span->x1 = e;
+		span->kind = full ? MaskSpanFull : MaskSpanBlend;
+	}
+
+	void mix_weighted(const float* a, float* o, int n, const float* w)
+	{
+		for (int i = 0; i < n; i++) {
+			if (w[i] <= 0.0f)
+				o[i] = a[i];
+			else if (w[i] < 1.0f)
+				o[i] = a[i] + (o[i] - a[i]) * w[i];
+		}
+	}
+}
@@ -0,0 +1,43 @@
+// ========================================
+// 蒙版 / 不透明度: 每个像素的权重 w = mask * opacity (截到 0..1), 结果 = A + (混合 - A) * w.
+// 一行按权重切成几段: 长的全 0 段照抄 A (不混合), 其余一次混合再插值, 全为 1 的段不用插值.
+// 结果与逐像素插值逐位相同, 只是少算. PhotoshopMerge (psMerge.cpp) 用它决定哪些像素要混合.
+//
+//   mask_weights(w + x0, x1 - x0, opacity);
+//   trim_mask_span(w, &x0, &x1);       // 两端的 0 不用取 B
+//   MaskSpan s;
+//   for (int i = x0; i < x1; i = s.x1) {
+//       next_mask_span(w, i, x1, &s);
+//       ...
+//   }
+// ========================================
+#pragma once
+
+namespace photoshopMergeTool {
+	// 比这短的 0 段跟着前后一起混合再插值回 A, 比多一次内核调用便宜
+	static const int kMinSkipRun = 16;
+
+	enum MaskSpanKind {
+		MaskSpanCopyA,  // 权重全为 0, 结果就是 A
+		MaskSpanBlend,  // 混合后按权重插值, 权重为 0 的像素回到 A
+		MaskSpanFull    // 权重全为 1, 直接用混合结果
+	};
+
+	struct MaskSpan {
+		int x0;
+		int x1;
+		MaskSpanKind kind;
+	};
+
+	// 原地把蒙版值换成权重 mask * mix, 截到 0..1, NaN 算 0
+	void mask_weights(float* w, int n, float mix);
+
+	// [*x0, *x1) 去掉两端权重为 0 的像素, 全为 0 时 *x0 == *x1. w 按绝对坐标取下标
+	void trim_mask_span(const float* w, int* x0, int* x1);
+
+	// 从 x 开始到 x1 为止的下一段, span->x1 是下一段的起点
+	void next_mask_span(const float* w, int x, int x1, MaskSpan* span);
+
+	// 混合好的 o 按权重插值回 a: w <= 0 取 a, w >= 1 不动
+	void mix_weighted(const float* a, float* o, int n, const float* w);
+}
@@ -0,0 +1,198 @@
+// ========================================
+// 运行统计的实现, 以及 PSMERGE_STATS 的退出汇总.
+// ========================================
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <vector>
+#include "psStats.h"
+
+namespace photoshopMergeTool {
+	StatTotals::StatTotals()
+	{
+		memset(counter, 0, sizeof(counter));
+		memset(mode_pixels, 0, sizeof(mode_pixels));
+		memset(mode_ns, 0, sizeof(mode_ns));
+	}
+
+	StatTotals& StatTotals::operator+=(const StatTotals& o)
+	{
+		for (int i = 0; i < StatCounterCount; i++)
+			counter[i] += o.counter[i];
+		for (int m = 0; m < kStatModes; m++) {
+			mode_pixels[m] += o.mode_pixels[m];
+			mode_ns[m] += o.mode_ns[m];
+		}
+		return *this;
+	}
+
+	// 退出汇总: 活着的实例 + 已经销毁的实例留下的计数
+	struct StatsRegistry {
+		std::mutex lock;
+		std::vector<const BlendStats*> live;
+		StatTotals retired;
+	};
+
+	static void dump_at_exit();
+
+	static StatsRegistry& registry()
+	{
+		// 先构造注册表再登记 atexit, 退出时汇总函数先于注册表析构运行
+		static StatsRegistry r;
+		static bool hooked = (atexit(dump_at_exit), true);
+		(void)hooked;
+		return r;
+	}
+
+	static void dump_at_exit()
+	{
+		StatsRegistry& r = registry();
+		std::lock_guard<std::mutex> guard(r.lock);
+		StatTotals all = r.retired;
+		for (const BlendStats* s : r.live)
+			all += s->totals();
+		std::string text = BlendStats::format("psblend stats, all instances", all);
+		const char* env = getenv("PSMERGE_STATS");
+		FILE* f = NULL;
+		if (env && strcmp(env, "1") != 0)
+			f = fopen(env, "a");
+		fputs(text.c_str(), f ? f : stderr);
+		if (f)
+			fclose(f);
+	}
+
+	static bool read_env()
+	{
+		const char* env = getenv("PSMERGE_STATS");
+		return env && *env && strcmp(env, "0") != 0;
+	}
+
+	bool BlendStats::env_enabled()
+	{
+		static const bool on = read_env();
+		return on;
+	}
+
+	uint64_t BlendStats::now_ns()
+	{
+		return (uint64_t)std::chrono::duration_cast<std::chrono::nanoseconds>(
+			std::chrono::steady_clock::now().time_since_epoch()).count();
+	}
+
+	BlendStats::BlendStats(const char* name) : name_(name), enabled_(false)
+	{
+		reset();
+		if (env_enabled()) {
+			StatsRegistry& r = registry();
+			std::lock_guard<std::mutex> guard(r.lock);
+			r.live.push_back(this);
+		}
+	}
+
+	BlendStats::~BlendStats()
+	{
+		if (env_enabled()) {
+			StatsRegistry& r = registry();
+			std::lock_guard<std::mutex> guard(r.lock);
+			r.retired += totals();
+			for (size_t i = 0; i < r.live.size(); i++) {
+				if (r.live[i] == this) {
+					r.live.erase(r.live.begin() + i);
+					break;
+				}
+			}
+		}
+	}
+
+	// 每个线程第一次用到时领一个编号, 之后固定用同一个槽
+	static std::atomic<unsigned int> g_next_thread(0);
+
+	BlendStats::Slot& BlendStats::slot()
+	{
+		static thread_local unsigned int index = g_next_thread.fetch_add(1, std::memory_order_relaxed);
+		return slots_[index % kSlots];
+	}
+
+	void BlendStats::add(StatCounter c, uint64_t v)
+	{
+		slot().counter[c].fetch_add(v, std::memory_order_relaxed);
+	}
+
+	void BlendStats::add_mode(int mode, uint64_t pixels, uint64_t ns)
+	{
+		if (mode < 0 || mode >= kStatModes)
+			return;
+		Slot& s = slot();
+		s.mode_pixels[mode].fetch_add(pixels, std::memory_order_relaxed);
+		s.mode_ns[mode].fetch_add(ns, std::memory_order_relaxed);
+	}
+
+	StatTotals BlendStats::totals() const
+	{
+		StatTotals t;
+		for (int i = 0; i < kSlots; i++) {
+			const Slot& s = slots_[i];
+			for (int c = 0; c < StatCounterCount; c++)
+				t.counter[c] += s.counter[c].load(std::memory_order_relaxed);
+			for (int m = 0; m < kStatModes; m++) {
+				t.mode_pixels[m] += s.mode_pixels[m].load(std::memory_order_relaxed);
+				t.mode_ns[m] += s.mode_ns[m].load(std::memory_order_relaxed);
+			}
+		}
+		return t;
+	}
+
+	void BlendStats::reset()
+	{
+		for (int i = 0; i < kSlots; i++) {
+			Slot& s = slots_[i];
+			for (int c = 0; c < StatCounterCount; c++)
+				s.counter[c].store(0, std::memory_order_relaxed);
+			for (int m = 0; m < kStatModes; m++) {
+				s.mode_pixels[m].store(0, std::memory_order_relaxed);
+				s.mode_ns[m].store(0, std::memory_order_relaxed);
+			}
+		}
+	}
+
+	std::string BlendStats::report() const
+	{
+		return format(name_, totals());
+	}
+
+	std::string BlendStats::format(const char* name, const StatTotals& t)
+	{
+		std::string out;
+		char line[160];
+		uint64_t blended = t.counter[StatPixelsBlended];
+		uint64_t skipped = t.counter[StatPixelsSkipped];
+		snprintf(line, sizeof(line), "%s\n", name);
+		out += line;
+		snprintf(line, sizeof(line), "rows %llu  blended %llu px  skipped %llu px\n",
+			(unsigned long long)t.counter[StatRows], (unsigned long long)blended, (unsigned long long)skipped);
+		out += line;
+		snprintf(line, sizeof(line), "fetch %.3f ms  blend %.3f ms\n",
+			t.counter[StatFetchNs] / 1e6, t.counter[StatBlendNs] / 1e6);
+		out += line;
+		for (int m = 0; m < kStatModes; m++) {
+			if (!t.mode_pixels[m])
+				continue;
+			snprintf(line, sizeof(line), "  %-14s %12llu px %9.3f ns/px\n", blendModeNames[m],
+				(unsigned long long)t.mode_pixels[m], (double)t.mode_ns[m] / (double)t.mode_pixels[m]);
+			out += line;
+		}
+		return out;
+	}
+
+	void StatsRow::commit()
+	{
+		stats_->add(StatRows, 1);
+		stats_->add(StatPixelsBlended, (uint64_t)blended_);
+		stats_->add(StatPixelsSkipped, (uint64_t)(pixels_ - blended_));
+		stats_->add(StatFetchNs, fetch_ns_);
+		stats_->add(StatBlendNs, blend_ns_);
+		stats_->add_mode(mode_, (uint64_t)blended_, blend_ns_);
+	}
+}
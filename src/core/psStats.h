@@ -0,0 +1,114 @@
+// ========================================
+// 运行统计: 行数, 混合 / 跳过的像素, 取数据和混合的耗时, 各模式的 ns/像素.
+// 每个节点实例一份, 计数按线程分槽 (relaxed 原子加), 读取时再合并.
+// 统计关闭时 StatsRow 只剩一次空指针判断, 不计时也不写计数.
+//
+// PSMERGE_STATS=1 打开所有实例的统计, 进程退出时把汇总写到 stderr;
+// PSMERGE_STATS=<文件> 则追加写到该文件.
+// ========================================
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <string>
+#include "psBlend.h"
+
+namespace photoshopMergeTool {
+	enum StatCounter {
+		StatRows, StatPixelsBlended, StatPixelsSkipped, StatFetchNs, StatBlendNs, StatCounterCount
+	};
+
+	static const int kStatModes = Custom + 1;
+
+	struct StatTotals {
+		uint64_t counter[StatCounterCount];
+		uint64_t mode_pixels[kStatModes];
+		uint64_t mode_ns[kStatModes];
+		StatTotals();
+		StatTotals& operator+=(const StatTotals& o);
+	};
+
+	class BlendStats
+	{
+	public:
+		explicit BlendStats(const char* name);
+		~BlendStats();
+		BlendStats(const BlendStats&) = delete;
+		BlendStats& operator=(const BlendStats&) = delete;
+
+		// 实例自己的开关 (节点上的 knob), 环境变量打开时总是开着
+		void set_enabled(bool on) { enabled_ = on; }
+		bool active() const { return enabled_ || env_enabled(); }
+
+		void add(StatCounter c, uint64_t v);
+		void add_mode(int mode, uint64_t pixels, uint64_t ns);
+		StatTotals totals() const;
+		void reset();
+		// 多行文字, 给只读 knob 显示
+		std::string report() const;
+
+		static bool env_enabled();
+		static uint64_t now_ns();
+		static std::string format(const char* name, const StatTotals& t);
+
+	private:
+		static const int kSlots = 16;
+		// 一个槽有好几个缓存行大, 不同线程的计数基本不会落在同一行
+		struct Slot {
+			std::atomic<uint64_t> counter[StatCounterCount];
+			std::atomic<uint64_t> mode_pixels[kStatModes];
+			std::atomic<uint64_t> mode_ns[kStatModes];
+		};
+		Slot& slot();
+
+		const char* name_;
+		bool enabled_;
+		Slot slots_[kSlots];
+	};
+
+	// 一行的统计: stats 为 NULL 时所有调用都是空操作.
+	// fetched / blended 把上一个标记到现在的时间记到对应计数上, 析构时一次提交
+	class StatsRow
+	{
+	public:
+		StatsRow(BlendStats* stats, int mode, int pixels)
+			: stats_(stats), mode_(mode), pixels_(pixels), blended_(0), fetch_ns_(0), blend_ns_(0)
+		{
+			mark_ = stats_ ? BlendStats::now_ns() : 0;
+		}
+		~StatsRow()
+		{
+			if (stats_)
+				commit();
+		}
+		void fetched()
+		{
+			if (stats_)
+				fetch_ns_ += lap();
+		}
+		void blended(int pixels)
+		{
+			if (stats_) {
+				blend_ns_ += lap();
+				blended_ += pixels;
+			}
+		}
+	private:
+		uint64_t lap()
+		{
+			uint64_t now = BlendStats::now_ns();
+			uint64_t d = now - mark_;
+			mark_ = now;
+			return d;
+		}
+		void commit();
+
+		BlendStats* stats_;
+		int mode_;
+		int pixels_;
+		int blended_;
+		uint64_t fetch_ns_;
+		uint64_t blend_ns_;
+		uint64_t mark_;
+	};
+}
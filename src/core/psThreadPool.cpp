@@ -0,0 +1,170 @@
+// ========================================
+// 任务窃取线程池的实现.
+// 任务都在某个还在干活的线程的区间里 (偷走的一半在放进自己的区间前只属于小偷),
+// 线程只在自己的区间空了并且一圈都偷不到时才退出这一批, 所以每个任务都会被执行.
+// ========================================
+#include <cstdlib>
+#include <cstring>
+#include "psThreadPool.h"
+
+#if defined(__linux__)
+#include <pthread.h>
+#include <sched.h>
+#endif
+
+namespace photoshopMergeTool {
+	// 当前线程是不是某个池的工作线程, 用来让嵌套的 run 顺序执行
+	static thread_local bool t_in_pool = false;
+
+	ThreadPool::ThreadPool(int threads, bool pin)
+		: pin_(pin), job_(NULL), generation_(0), busy_(0), quit_(false)
+	{
+		if (threads <= 0)
+			threads = (int)std::thread::hardware_concurrency();
+		if (threads <= 0)
+			threads = 1;
+		std::vector<Range> ranges(threads);
+		ranges_.swap(ranges);
+		for (Range& r : ranges_)
+			r.lo = r.hi = 0;
+		for (int i = 0; i < threads; i++)
+			workers_.emplace_back(&ThreadPool::worker_main, this, i);
+	}
+
+	ThreadPool::~ThreadPool()
+	{
+		{
+			std::lock_guard<std::mutex> guard(state_lock_);
+			quit_ = true;
+		}
+		wake_.notify_all();
+		for (std::thread& t : workers_)
+			t.join();
+	}
+
+	static int range_begin(int w, int n, int count)
+	{
+		return (int)((long long)count * w / n);
+	}
+
+	int ThreadPool::initial_worker(int task, int count) const
+	{
+		int n = size();
+		int w = (int)((long long)task * n / count);
+		while (w + 1 < n && range_begin(w + 1, n, count) <= task)
+			w++;
+		while (w > 0 && range_begin(w, n, count) > task)
+			w--;
+		return w;
+	}
+
+	void ThreadPool::run(int count, const std::function<void(int task, int worker)>& fn)
+	{
+		if (count <= 0)
+			return;
+		if (t_in_pool) {
+			for (int t = 0; t < count; t++)
+				fn(t, 0);
+			return;
+		}
+		std::lock_guard<std::mutex> run_guard(run_lock_);
+		int n = size();
+		for (int w = 0; w < n; w++) {
+			std::lock_guard<std::mutex> guard(ranges_[w].lock);
+			ranges_[w].lo = range_begin(w, n, count);
+			ranges_[w].hi = range_begin(w + 1, n, count);
+		}
+		std::unique_lock<std::mutex> state(state_lock_);
+		job_ = &fn;
+		busy_ = n;
+		generation_++;
+		wake_.notify_all();
+		done_.wait(state, [this]() { return busy_ == 0; });
+		job_ = NULL;
+	}
+
+	bool ThreadPool::take(int index, int* task)
+	{
+		Range& r = ranges_[index];
+		std::lock_guard<std::mutex> guard(r.lock);
+		if (r.lo >= r.hi)
+			return false;
+		*task = r.lo++;
+		return true;
+	}
+
+	// 从下一个线程开始找, 拿走对方剩下的后一半 (靠近它区间尾部的那些 tile 还没碰过)
+	bool ThreadPool::steal(int index)
+	{
+		int n = size();
+		for (int k = 1; k < n; k++) {
+			Range& v = ranges_[(index + k) % n];
+			int lo, hi;
+			{
+				std::lock_guard<std::mutex> guard(v.lock);
+				int left = v.hi - v.lo;
+				if (left <= 0)
+					continue;
+				hi = v.hi;
+				lo = hi - (left + 1) / 2;
+				v.hi = lo;
+			}
+			Range& own = ranges_[index];
+			std::lock_guard<std::mutex> guard(own.lock);
+			own.lo = lo;
+			own.hi = hi;
+			return true;
+		}
+		return false;
+	}
+
+	void ThreadPool::worker_main(int index)
+	{
+		t_in_pool = true;
+#if defined(__linux__)
+		if (pin_) {
+			int cpus = (int)std::thread::hardware_concurrency();
+			if (cpus > 0 && cpus <= CPU_SETSIZE) {
+				cpu_set_t set;
+				CPU_ZERO(&set);
+				CPU_SET(index % cpus, &set);
+				pthread_setaffinity_np(pthread_self(), sizeof(set), &set);
+			}
+		}
+#endif
+		unsigned long seen = 0;
+		for (;;) {
+			const std::function<void(int, int)>* job;
+			{
+				std::unique_lock<std::mutex> state(state_lock_);
+				wake_.wait(state, [&]() { return quit_ || generation_ != seen; });
+				if (quit_)
+					return;
+				seen = generation_;
+				job = job_;
+			}
+			int task;
+			for (;;) {
+				if (take(index, &task))
+					(*job)(task, index);
+				else if (!steal(index))
+					break;
+			}
+			std::lock_guard<std::mutex> state(state_lock_);
+			if (--busy_ == 0)
+				done_.notify_all();
+		}
+	}
+
+	static int env_int(const char* name, int fallback)
+	{
+		const char* v = getenv(name);
+		return v && *v ? atoi(v) : fallback;
+	}
+
+	ThreadPool& ThreadPool::shared()
+	{
+		static ThreadPool pool(env_int("PSBLEND_THREADS", 0), env_int("PSBLEND_PIN", 0) != 0);
+		return pool;
+	}
+}
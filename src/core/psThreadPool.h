@@ -0,0 +1,66 @@
+// ========================================
+// 给整张图用的线程池: 任务是 0..count-1 的编号 (一般是 tile), 开始时按连续的区间
+// 平均分给各个工作线程, 自己的区间做完了就从别的线程的区间尾部偷一半.
+// 颜色加深 / 亮光这类分支多的模式各 tile 耗时不均, 偷任务让线程不会闲着.
+//
+// 分配方式是确定的: 同样的任务数和线程数, 不被偷的任务总是落在同一个线程上,
+// 配合线程绑核, ImageBuffer 用同样的分配做首次写入 (first touch), 页就分在
+// 之后处理它的那个 NUMA 节点上.
+// ========================================
+#pragma once
+
+#include <condition_variable>
+#include <functional>
+#include <mutex>
+#include <thread>
+#include <vector>
+
+namespace photoshopMergeTool {
+	class ThreadPool
+	{
+	public:
+		// threads <= 0 时使用硬件线程数; pin 为 true 时工作线程 i 绑到第 i 个 CPU (只在 Linux 上生效)
+		explicit ThreadPool(int threads, bool pin = false);
+		~ThreadPool();
+		ThreadPool(const ThreadPool&) = delete;
+		ThreadPool& operator=(const ThreadPool&) = delete;
+
+		int size() const { return (int)workers_.size(); }
+
+		// 执行 fn(task, worker), task 取遍 0..count-1, 全部完成后返回.
+		// 同一时间只跑一批; 在工作线程里再调用 run 会直接在当前线程顺序执行
+		void run(int count, const std::function<void(int task, int worker)>& fn);
+
+		// 任务 task 开始时分给哪个线程, run 按这个规则分配
+		int initial_worker(int task, int count) const;
+
+		// 进程共用的池: PSBLEND_THREADS 指定线程数, PSBLEND_PIN=1 打开绑核
+		static ThreadPool& shared();
+
+	private:
+		// 每个线程的任务区间 [lo, hi); 补齐到一个缓存行, 避免相邻线程互相干扰
+		struct Range {
+			std::mutex lock;
+			int lo;
+			int hi;
+			char pad[64];
+		};
+
+		void worker_main(int index);
+		bool take(int index, int* task);
+		bool steal(int index);
+
+		std::vector<std::thread> workers_;
+		std::vector<Range> ranges_;
+		bool pin_;
+
+		std::mutex run_lock_;          // 一次只跑一批
+		std::mutex state_lock_;
+		std::condition_variable wake_;
+		std::condition_variable done_;
+		const std::function<void(int, int)>* job_;
+		unsigned long generation_;
+		int busy_;                     // 还在这一批里的工作线程数
+		bool quit_;
+	};
+}
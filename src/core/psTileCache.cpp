@@ -0,0 +1,231 @@
+// ========================================
+// tile 结果缓存的实现: 内容哈希和带字节上限的 LRU.
+// ========================================
+#include <cstring>
+#include "psTileCache.h"
+
+#if defined(__SSE2__) || defined(_M_X64) || defined(_M_AMD64)
+#include <emmintrin.h>
+#define PS_HASH_SSE2 1
+#endif
+
+namespace photoshopMergeTool {
+	static const uint64_t P1 = 0x9E3779B185EBCA87ull;
+	static const uint64_t P2 = 0xC2B2AE3D27D4EB4Full;
+	static const uint64_t P3 = 0x165667B19E3779F9ull;
+	static const uint64_t P4 = 0x85EBCA77C2B2AE63ull;
+	static const uint64_t P5 = 0x27D4EB2F165667C5ull;
+
+	static inline uint64_t rotl(uint64_t x, int r) { return (x << r) | (x >> (64 - r)); }
+
+	static inline uint64_t read64(const unsigned char* p)
+	{
+		uint64_t v;
+		memcpy(&v, p, 8);
+		return v;
+	}
+
+	static inline uint32_t read32(const unsigned char* p)
+	{
+		uint32_t v;
+		memcpy(&v, p, 4);
+		return v;
+	}
+
+	static inline uint64_t round(uint64_t acc, uint64_t w)
+	{
+		acc += w * P2;
+		acc = rotl(acc, 31);
+		return acc * P1;
+	}
+
+	static inline uint64_t merge(uint64_t h, uint64_t acc)
+	{
+		h ^= round(0, acc);
+		return h * P1 + P4;
+	}
+
+	// 大段数据用 XXH3 的累加方式: 8 个 64 位累加器, 每 8 字节只要一次 32 x 32 位乘法,
+	// 编译器能把它向量化; 每条 (64 字节) 用不同的密钥, 交换两条数据哈希会变, 每 1KB 打散一次累加器
+	static const uint64_t kSecret[24] = {
+		0x2CB0F69F4ABEA221ull, 0x9417034723148989ull, 0xDD555950609DFE03ull, 0xDBAFB150DEB12800ull,
+		0x7E789B2E6C442CB6ull, 0xF41E5636C7E4F8C4ull, 0x0959D150F8FBA7E4ull, 0xA97316F13CDB9EEAull,
+		0x74CD8258F9520068ull, 0x55C74A62E116868Bull, 0xD2F4C799A2023CBDull, 0xDF98CB79A37B51B9ull,
+		0x396F5885524F3905ull, 0xAF1D56386CA3B276ull, 0xA9FFBE6B5104E85Aull, 0x6BD0C51B9FD533B3ull,
+		0x980CE91C50AB4B56ull, 0x28AC395780FE62C5ull, 0x768912E3A6BCEDC7ull, 0x50B3E8C9332C7C88ull,
+		0xCE3BBFE520BD47DAull, 0xCBA6C8E8E0BB7C4Full, 0xBF194DB8434A346Dull, 0x7D8F2A7B60416D7Full,
+	};
+	static const int kStripeBytes = 64;
+	static const int kStripesPerBlock = 16;
+
+	static inline void accumulate(uint64_t* acc, const unsigned char* p, const uint64_t* key)
+	{
+		for (int i = 0; i < 8; i++) {
+			uint64_t d = read64(p + 8 * i);
+			uint64_t k = d ^ key[i];
+			acc[i ^ 1] += d;
+			acc[i] += (k & 0xFFFFFFFFu) * (k >> 32);
+		}
+	}
+
+	static inline void accumulate_block_scalar(uint64_t* acc, const unsigned char* p, int stripes)
+	{
+		for (int s = 0; s < stripes; s++)
+			accumulate(acc, p + s * kStripeBytes, kSecret + s);
+	}
+
+#if PS_HASH_SSE2
+	// 与 accumulate 相同, 一个寄存器放两个累加器: acc[i ^ 1] += d 就是寄存器内两半交换, 乘法是 pmuludq
+	static inline void accumulate_block_sse2(uint64_t* acc, const unsigned char* p, int stripes)
+	{
+		__m128i v[4];
+		for (int j = 0; j < 4; j++)
+			v[j] = _mm_loadu_si128((const __m128i*)(acc + 2 * j));
+		for (int s = 0; s < stripes; s++, p += kStripeBytes) {
+			for (int j = 0; j < 4; j++) {
+				__m128i d = _mm_loadu_si128((const __m128i*)(p + 16 * j));
+				__m128i k = _mm_xor_si128(d, _mm_loadu_si128((const __m128i*)(kSecret + s + 2 * j)));
+				__m128i prod = _mm_mul_epu32(k, _mm_srli_epi64(k, 32));
+				__m128i swap = _mm_shuffle_epi32(d, _MM_SHUFFLE(1, 0, 3, 2));
+				v[j] = _mm_add_epi64(v[j], _mm_add_epi64(prod, swap));
+			}
+		}
+		for (int j = 0; j < 4; j++)
+			_mm_storeu_si128((__m128i*)(acc + 2 * j), v[j]);
+	}
+#endif
+
+	// 标量版本总是编译, 两条路径的结果逐位相同
+	static inline void accumulate_block(uint64_t* acc, const unsigned char* p, int stripes, bool vector)
+	{
+#if PS_HASH_SSE2
+		if (vector) {
+			accumulate_block_sse2(acc, p, stripes);
+			return;
+		}
+#else
+		(void)vector;
+#endif
+		accumulate_block_scalar(acc, p, stripes);
+	}
+
+	static inline void scramble(uint64_t* acc)
+	{
+		for (int i = 0; i < 8; i++) {
+			uint64_t a = acc[i];
+			a ^= a >> 47;
+			a ^= kSecret[16 + i];
+			acc[i] = a * 0x9E3779B1u;
+		}
+	}
+
+	uint64_t hash_bytes(const void* data, size_t len, uint64_t seed)
+	{
+		return hash_bytes(data, len, seed, simd_level());
+	}
+
+	uint64_t hash_bytes(const void* data, size_t len, uint64_t seed, SimdLevel level)
+	{
+		const bool vector = level != SimdScalar;
+		const unsigned char* p = (const unsigned char*)data;
+		const unsigned char* end = p + len;
+		uint64_t h;
+		if (len >= (size_t)kStripeBytes) {
+			uint64_t acc[8];
+			for (int i = 0; i < 8; i++)
+				acc[i] = seed + kSecret[i];
+			const size_t block = (size_t)kStripeBytes * kStripesPerBlock;
+			for (; (size_t)(end - p) >= block; p += block) {
+				accumulate_block(acc, p, kStripesPerBlock, vector);
+				scramble(acc);
+			}
+			int stripes = (int)((end - p) / kStripeBytes);
+			accumulate_block(acc, p, stripes, vector);
+			p += (size_t)stripes * kStripeBytes;
+			h = seed + P5;
+			for (int i = 0; i < 8; i++)
+				h = merge(h, acc[i]);
+		}
+		else {
+			h = seed + P5;
+		}
+		h += (uint64_t)len;
+		for (; p + 8 <= end; p += 8)
+			h = rotl(h ^ round(0, read64(p)), 27) * P1 + P4;
+		if (p + 4 <= end) {
+			h = rotl(h ^ ((uint64_t)read32(p) * P1), 23) * P2 + P3;
+			p += 4;
+		}
+		for (; p < end; p++)
+			h = rotl(h ^ (*p * P5), 11) * P1;
+		// 收尾的雪崩, 让每个输入位影响所有输出位
+		h ^= h >> 33;
+		h *= P2;
+		h ^= h >> 29;
+		h *= P3;
+		h ^= h >> 32;
+		return h;
+	}
+
+	static size_t entry_bytes(const TileData& d) { return d.size() * sizeof(float); }
+
+	TileCache::TileCache(size_t max_bytes)
+		: max_bytes_(max_bytes), bytes_(0), hits_(0), misses_(0), evictions_(0)
+	{
+	}
+
+	std::shared_ptr<const TileData> TileCache::find(const TileKey& key)
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		auto it = index_.find(key);
+		if (it == index_.end()) {
+			misses_++;
+			return std::shared_ptr<const TileData>();
+		}
+		hits_++;
+		lru_.splice(lru_.begin(), lru_, it->second);
+		return it->second->data;
+	}
+
+	void TileCache::insert(const TileKey& key, TileData&& data)
+	{
+		size_t size = entry_bytes(data);
+		if (size > max_bytes_)
+			return;
+		// 在锁外分配, 持锁的时间只剩链表和索引的操作
+		std::shared_ptr<const TileData> shared = std::make_shared<const TileData>(std::move(data));
+		std::lock_guard<std::mutex> guard(lock_);
+		if (index_.count(key))
+			return;
+		while (bytes_ + size > max_bytes_ && !lru_.empty()) {
+			Entry& last = lru_.back();
+			bytes_ -= entry_bytes(*last.data);
+			index_.erase(last.key);
+			lru_.pop_back();
+			evictions_++;
+		}
+		lru_.push_front(Entry{ key, shared });
+		index_[key] = lru_.begin();
+		bytes_ += size;
+	}
+
+	void TileCache::clear()
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		index_.clear();
+		lru_.clear();
+		bytes_ = 0;
+	}
+
+	TileCacheStats TileCache::stats() const
+	{
+		std::lock_guard<std::mutex> guard(lock_);
+		TileCacheStats s;
+		s.hits = hits_;
+		s.misses = misses_;
+		s.evictions = evictions_;
+		s.bytes = bytes_;
+		s.tiles = lru_.size();
+		return s;
+	}
+}
@@ -0,0 +1,94 @@
+// ========================================
+// 序列的增量计算: 按内容记住已经混合过的 tile.
+// 每帧把 A / B 的每个 tile 各算一个 64 位哈希, 与 tile 的位置和内核的指纹 (模式、数值域、公式等)
+// 合成键; 键相同就说明输入完全相同, 直接复制上次的结果, 不再混合.
+// 静止的叠加层 (logo、纹理) 和长时间的定格, 每多一帧只剩读 A、算哈希和复制结果 (B 不变时哈希只算一次).
+//
+// 按内容而不是按帧号查, 所以与帧的处理顺序和线程数无关, 多个线程可以共用一个缓存.
+// 缓存按字节数设上限, 超出时淘汰最久没用到的 tile (LRU).
+// 不另外比较原始数据. 常见的情况是 B 不变, 键只靠 A 的 64 位哈希区分, 同一位置、同一内核下
+// 一个新的 A 与缓存里某个旧 tile 撞上的概率约为 (该位置缓存的 tile 数) x 2^-64; A、B 都变时才接近 2^-128.
+//
+//   TileCache cache(512 << 20);
+//   TileKey key = make_tile_key(k, params, hash_tile(a, ...), hash_tile(b, ...), ...);   // psImage.h
+//   if (std::shared_ptr<const TileData> hit = cache.find(key)) paste_tile(out, ..., *hit);
+//   else { ...混合...; cache.insert(key, copy_tile(out, ...)); }
+// ========================================
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <list>
+#include <memory>
+#include <mutex>
+#include <unordered_map>
+#include <vector>
+#include "psBlend.h"
+
+namespace photoshopMergeTool {
+	// 64 位内容哈希 (XXH3 式的累加, XXH64 式的收尾); seed 串起多段数据 (每行、每个通道接着算)
+	uint64_t hash_bytes(const void* data, size_t len, uint64_t seed);
+	// 同上, 指定累加的路径: SimdScalar 用标量, 其余用 SSE2 (没有时也退回标量); 结果与路径无关
+	uint64_t hash_bytes(const void* data, size_t len, uint64_t seed, SimdLevel level);
+
+	struct TileKey {
+		uint64_t a;       // A 的 tile 内容
+		uint64_t b;       // B 的 tile 内容
+		uint64_t params;  // 内核的指纹, 见 kernels_fingerprint (psImage.h)
+		int x, y, width, height, channels;
+
+		bool operator==(const TileKey& o) const
+		{
+			return a == o.a && b == o.b && params == o.params && x == o.x && y == o.y &&
+				width == o.width && height == o.height && channels == o.channels;
+		}
+	};
+
+	struct TileKeyHash {
+		size_t operator()(const TileKey& k) const { return (size_t)(k.a ^ (k.b * 0x9E3779B97F4A7C15ull) ^ k.params); }
+	};
+
+	// 一个 tile 的结果: channels 个平面, 每个 height 行 x width 个 float, 连续存放
+	typedef std::vector<float> TileData;
+
+	struct TileCacheStats {
+		uint64_t hits;
+		uint64_t misses;
+		uint64_t evictions;
+		size_t bytes;
+		size_t tiles;
+	};
+
+	class TileCache
+	{
+	public:
+		explicit TileCache(size_t max_bytes);
+		TileCache(const TileCache&) = delete;
+		TileCache& operator=(const TileCache&) = delete;
+
+		// 命中时返回结果并把它移到最近使用, 否则返回空. 返回的数据只读, 被淘汰后仍然有效
+		std::shared_ptr<const TileData> find(const TileKey& key);
+		// 已经有同一个键时保留旧的 (两个线程同时算了同一个 tile). 比上限还大的 tile 不存
+		void insert(const TileKey& key, TileData&& data);
+		void clear();
+
+		TileCacheStats stats() const;
+		size_t max_bytes() const { return max_bytes_; }
+
+	private:
+		struct Entry {
+			TileKey key;
+			std::shared_ptr<const TileData> data;
+		};
+		typedef std::list<Entry> Lru;  // 头部是最近使用的
+
+		mutable std::mutex lock_;
+		Lru lru_;
+		std::unordered_map<TileKey, Lru::iterator, TileKeyHash> index_;
+		size_t max_bytes_;
+		size_t bytes_;
+		uint64_t hits_;
+		uint64_t misses_;
+		uint64_t evictions_;
+	};
+}
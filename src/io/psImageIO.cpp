@@ -0,0 +1,396 @@
+// ========================================
+// 内存映射文件和 PFM / raw 平面图像的实现.
+// ========================================
+#include <algorithm>
+#include <cctype>
+#include <cerrno>
+#include <cstdint>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "psImageIO.h"
+
+#if defined(_WIN32)
+#define NOMINMAX
+#include <windows.h>
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+#endif
+
+namespace photoshopMergeTool {
+	static bool fail(std::string* err, const std::string& path, const char* what)
+	{
+		if (err)
+			*err = path + ": " + what;
+		return false;
+	}
+
+#if defined(_WIN32)
+	MappedFile::MappedFile() : data_(NULL), size_(0), file_(INVALID_HANDLE_VALUE), mapping_(NULL) {}
+
+	bool MappedFile::open_read(const std::string& path, std::string* err)
+	{
+		close();
+		HANDLE f = CreateFileA(path.c_str(), GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_FLAG_SEQUENTIAL_SCAN, NULL);
+		if (f == INVALID_HANDLE_VALUE)
+			return fail(err, path, "cannot open");
+		LARGE_INTEGER size;
+		if (!GetFileSizeEx(f, &size) || size.QuadPart == 0) {
+			CloseHandle(f);
+			return fail(err, path, "empty or unreadable file");
+		}
+		HANDLE m = CreateFileMappingA(f, NULL, PAGE_READONLY, 0, 0, NULL);
+		void* p = m ? MapViewOfFile(m, FILE_MAP_READ, 0, 0, 0) : NULL;
+		if (!p) {
+			if (m)
+				CloseHandle(m);
+			CloseHandle(f);
+			return fail(err, path, "cannot map");
+		}
+		file_ = f;
+		mapping_ = m;
+		data_ = (unsigned char*)p;
+		size_ = (size_t)size.QuadPart;
+		return true;
+	}
+
+	bool MappedFile::create(const std::string& path, size_t size, std::string* err)
+	{
+		close();
+		HANDLE f = CreateFileA(path.c_str(), GENERIC_READ | GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (f == INVALID_HANDLE_VALUE)
+			return fail(err, path, "cannot create");
+		unsigned long long s = size;
+		HANDLE m = CreateFileMappingA(f, NULL, PAGE_READWRITE, (DWORD)(s >> 32), (DWORD)s, NULL);
+		void* p = m ? MapViewOfFile(m, FILE_MAP_WRITE, 0, 0, size) : NULL;
+		if (!p) {
+			if (m)
+				CloseHandle(m);
+			CloseHandle(f);
+			return fail(err, path, "cannot map for writing");
+		}
+		file_ = f;
+		mapping_ = m;
+		data_ = (unsigned char*)p;
+		size_ = size;
+		return true;
+	}
+
+	void MappedFile::close()
+	{
+		if (data_)
+			UnmapViewOfFile(data_);
+		if (mapping_)
+			CloseHandle((HANDLE)mapping_);
+		if (file_ != INVALID_HANDLE_VALUE)
+			CloseHandle((HANDLE)file_);
+		data_ = NULL;
+		size_ = 0;
+		mapping_ = NULL;
+		file_ = INVALID_HANDLE_VALUE;
+	}
+
+	void MappedFile::advise_sequential() {}
+
+	void MappedFile::release(size_t offset, size_t len) const
+	{
+		SYSTEM_INFO info;
+		GetSystemInfo(&info);
+		size_t page = info.dwPageSize;
+		size_t b = (offset + page - 1) & ~(page - 1);
+		size_t e = std::min(offset + len, size_) & ~(page - 1);
+		// 没有锁定的页调用 VirtualUnlock 会把它们移出工作集
+		if (data_ && e > b)
+			VirtualUnlock(data_ + b, e - b);
+	}
+#else
+	MappedFile::MappedFile() : data_(NULL), size_(0), fd_(-1) {}
+
+	bool MappedFile::open_read(const std::string& path, std::string* err)
+	{
+		close();
+		int fd = ::open(path.c_str(), O_RDONLY);
+		if (fd < 0)
+			return fail(err, path, strerror(errno));
+		struct stat st;
+		if (fstat(fd, &st) != 0 || st.st_size == 0) {
+			::close(fd);
+			return fail(err, path, "empty or unreadable file");
+		}
+		void* p = mmap(NULL, (size_t)st.st_size, PROT_READ, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED) {
+			::close(fd);
+			return fail(err, path, strerror(errno));
+		}
+		fd_ = fd;
+		data_ = (unsigned char*)p;
+		size_ = (size_t)st.st_size;
+		return true;
+	}
+
+	bool MappedFile::create(const std::string& path, size_t size, std::string* err)
+	{
+		close();
+		int fd = ::open(path.c_str(), O_RDWR | O_CREAT | O_TRUNC, 0644);
+		if (fd < 0)
+			return fail(err, path, strerror(errno));
+		if (ftruncate(fd, (off_t)size) != 0) {
+			::close(fd);
+			return fail(err, path, strerror(errno));
+		}
+		void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+		if (p == MAP_FAILED) {
+			::close(fd);
+			return fail(err, path, strerror(errno));
+		}
+		fd_ = fd;
+		data_ = (unsigned char*)p;
+		size_ = size;
+		return true;
+	}
+
+	void MappedFile::close()
+	{
+		if (data_) {
+			// 写出的帧交给内核回写, 不在这里 msync 等盘
+			munmap(data_, size_);
+		}
+		if (fd_ >= 0)
+			::close(fd_);
+		data_ = NULL;
+		size_ = 0;
+		fd_ = -1;
+	}
+
+	void MappedFile::advise_sequential()
+	{
+		if (data_)
+			madvise(data_, size_, MADV_SEQUENTIAL);
+	}
+
+	void MappedFile::release(size_t offset, size_t len) const
+	{
+		static const size_t page = (size_t)sysconf(_SC_PAGESIZE);
+		size_t b = (offset + page - 1) & ~(page - 1);
+		size_t e = std::min(offset + len, size_) & ~(page - 1);
+		// 共享的文件映射: 脏页仍留在页缓存里照常回写, 这里只是解除映射
+		if (data_ && e > b)
+			madvise(data_ + b, e - b, MADV_DONTNEED);
+	}
+#endif
+
+	MappedFile::~MappedFile()
+	{
+		close();
+	}
+
+	ImageFormat format_from_path(const std::string& path)
+	{
+		size_t dot = path.rfind('.');
+		if (dot != std::string::npos) {
+			std::string ext = path.substr(dot + 1);
+			for (size_t i = 0; i < ext.size(); i++)
+				ext[i] = (char)tolower((unsigned char)ext[i]);
+			if (ext == "pfm")
+				return FormatPFM;
+		}
+		return FormatRaw;
+	}
+
+	static bool host_little_endian()
+	{
+		const unsigned int one = 1;
+		return *(const unsigned char*)&one == 1;
+	}
+
+	static float swap_float(const unsigned char* p)
+	{
+		unsigned char q[4] = { p[3], p[2], p[1], p[0] };
+		float v;
+		memcpy(&v, q, 4);
+		return v;
+	}
+
+	// PFM 文件头是三个以空白分隔的文本字段, 最后一个后面正好一个空白字符
+	static bool read_token(const unsigned char* data, size_t size, size_t& pos, std::string& token)
+	{
+		while (pos < size && isspace(data[pos]))
+			pos++;
+		token.clear();
+		while (pos < size && !isspace(data[pos]))
+			token += (char)data[pos++];
+		return !token.empty();
+	}
+
+	// 十进制正整数, 不超过 max; 带其它字符、为 0、负数或超出范围时返回 0
+	static int parse_size(const std::string& s, int max)
+	{
+		if (s.empty() || s.size() > 9)
+			return 0;
+		int v = 0;
+		for (char ch : s) {
+			if (ch < '0' || ch > '9')
+				return 0;
+			v = v * 10 + (ch - '0');
+		}
+		return v <= max ? v : 0;
+	}
+
+	// header + width * height * channels 个 float 的字节数, size_t 放不下时返回 false
+	static bool image_bytes(size_t header, int width, int height, int channels, size_t* bytes)
+	{
+		if (width <= 0 || height <= 0 || channels <= 0 || width > kMaxScanlineSide || height > kMaxScanlineSide ||
+			channels > kMaxScanlineChannels)
+			return false;
+		size_t n = (size_t)width * sizeof(float) * (size_t)channels;
+		if (n > (SIZE_MAX - header) / (size_t)height)
+			return false;
+		*bytes = header + n * (size_t)height;
+		return true;
+	}
+
+	ScanlineImage::ScanlineImage()
+		: format_(FormatRaw), width_(0), height_(0), channels_(0), header_(0), swap_(false) {}
+
+	bool ScanlineImage::open(const std::string& path, const RawSpec* spec, std::string* err)
+	{
+		if (!file_.open_read(path, err))
+			return false;
+		format_ = format_from_path(path);
+		const unsigned char* data = file_.data();
+		size_t size = file_.size();
+		if (format_ == FormatPFM) {
+			size_t pos = 0;
+			std::string magic, w, h, scale;
+			if (!read_token(data, size, pos, magic) || !read_token(data, size, pos, w) ||
+				!read_token(data, size, pos, h) || !read_token(data, size, pos, scale))
+				return fail(err, path, "truncated PFM header");
+			if (magic == "PF")
+				channels_ = 3;
+			else if (magic == "Pf")
+				channels_ = 1;
+			else
+				return fail(err, path, "not a PFM file");
+			width_ = parse_size(w, kMaxScanlineSide);
+			height_ = parse_size(h, kMaxScanlineSide);
+			bool little = atof(scale.c_str()) < 0.0;
+			swap_ = little != host_little_endian();
+			header_ = pos + 1;
+		} else {
+			if (!spec || spec->width <= 0 || spec->height <= 0 || spec->channels <= 0)
+				return fail(err, path, "raw input needs --raw WxHxC");
+			width_ = spec->width;
+			height_ = spec->height;
+			channels_ = spec->channels;
+			swap_ = !host_little_endian();
+			header_ = 0;
+		}
+		size_t need = 0;
+		if (!image_bytes(header_, width_, height_, channels_, &need))
+			return fail(err, path, "bad image size");
+		if (size < need)
+			return fail(err, path, "file is shorter than its image size");
+		file_.advise_sequential();
+		return true;
+	}
+
+	bool ScanlineImage::create(const std::string& path, ImageFormat format, int width, int height, int channels, std::string* err)
+	{
+		if (format == FormatPFM && channels != 1 && channels != 3)
+			return fail(err, path, "PFM only holds 1 or 3 channels");
+		char header[64] = "";
+		if (format == FormatPFM)
+			snprintf(header, sizeof(header), "%s\n%d %d\n-1.0\n", channels == 3 ? "PF" : "Pf", width, height);
+		size_t bytes = 0;
+		if (!image_bytes(strlen(header), width, height, channels, &bytes))
+			return fail(err, path, "bad image size");
+		format_ = format;
+		width_ = width;
+		height_ = height;
+		channels_ = channels;
+		header_ = strlen(header);
+		swap_ = !host_little_endian();
+		if (!file_.create(path, bytes, err))
+			return false;
+		memcpy(file_.data(), header, header_);
+		return true;
+	}
+
+	// raw: 通道 c 第 y 行的起点; PFM: 第 y 行 (已翻转) 的起点, 通道交错
+	const unsigned char* ScanlineImage::row_data(int y, int c) const
+	{
+		size_t row = (size_t)width_ * sizeof(float);
+		if (format_ == FormatPFM)
+			return file_.data() + header_ + (size_t)(height_ - 1 - y) * row * channels_;
+		return file_.data() + header_ + ((size_t)c * height_ + y) * row;
+	}
+
+	void ScanlineImage::read_row(int y, float* const* planes) const
+	{
+		if (format_ == FormatPFM && channels_ > 1) {
+			const unsigned char* p = row_data(y, 0);
+			for (int x = 0; x < width_; x++) {
+				for (int c = 0; c < channels_; c++, p += 4) {
+					if (swap_)
+						planes[c][x] = swap_float(p);
+					else
+						memcpy(&planes[c][x], p, 4);
+				}
+			}
+			return;
+		}
+		for (int c = 0; c < channels_; c++) {
+			const unsigned char* p = row_data(y, c);
+			if (!swap_) {
+				memcpy(planes[c], p, (size_t)width_ * sizeof(float));
+				continue;
+			}
+			for (int x = 0; x < width_; x++)
+				planes[c][x] = swap_float(p + 4 * x);
+		}
+	}
+
+	void ScanlineImage::write_row(int y, const float* const* planes)
+	{
+		if (format_ == FormatPFM && channels_ > 1) {
+			unsigned char* p = (unsigned char*)row_data(y, 0);
+			for (int x = 0; x < width_; x++) {
+				for (int c = 0; c < channels_; c++, p += 4) {
+					float v = planes[c][x];
+					if (swap_)
+						v = swap_float((const unsigned char*)&v);
+					memcpy(p, &v, 4);
+				}
+			}
+			return;
+		}
+		for (int c = 0; c < channels_; c++) {
+			unsigned char* p = (unsigned char*)row_data(y, c);
+			memcpy(p, planes[c], (size_t)width_ * sizeof(float));
+			if (swap_) {
+				for (int x = 0; x < width_; x++) {
+					float v = swap_float(p + 4 * x);
+					memcpy(p + 4 * x, &v, 4);
+				}
+			}
+		}
+	}
+
+	void ScanlineImage::release_rows(int y0, int y1)
+	{
+		if (y1 <= y0)
+			return;
+		size_t row = (size_t)width_ * sizeof(float);
+		if (format_ == FormatPFM) {
+			// PFM 从下往上存, [y0, y1) 在文件里是 [h - y1, h - y0)
+			size_t b = header_ + (size_t)(height_ - y1) * row * channels_;
+			file_.release(b, (size_t)(y1 - y0) * row * channels_);
+			return;
+		}
+		for (int c = 0; c < channels_; c++)
+			file_.release(header_ + ((size_t)c * height_ + y0) * row, (size_t)(y1 - y0) * row);
+	}
+}
@@ -0,0 +1,96 @@
+// ========================================
+// 离线工具用的图像读写: 内存映射文件 + 按扫描线访问的浮点图像.
+// 支持两种简单格式:
+//   PFM: "PF" (RGB 交错) / "Pf" (单通道), 行从下往上存, 比例为负表示小端
+//   raw: 没有文件头, 每个通道一整块 float32 (小端), 行从上往下, 尺寸由调用方给出
+// 整个文件映射进来, 只有读到的页才会真的进内存, 所以 4K 序列也不需要整帧载入.
+// ========================================
+#pragma once
+
+#include <cstddef>
+#include <string>
+
+namespace photoshopMergeTool {
+	class MappedFile
+	{
+	public:
+		MappedFile();
+		~MappedFile();
+		MappedFile(const MappedFile&) = delete;
+		MappedFile& operator=(const MappedFile&) = delete;
+
+		bool open_read(const std::string& path, std::string* err);
+		// 新建 (或截断) 文件到 size 字节并映射为可写
+		bool create(const std::string& path, size_t size, std::string* err);
+		void close();
+
+		unsigned char* data() const { return data_; }
+		size_t size() const { return size_; }
+		// 告诉系统按顺序读, 已处理的部分可以尽早换出
+		void advise_sequential();
+		// 这一段已经用完, 让它的页离开进程的工作集 (文件内容不受影响, 之后再读会重新载入).
+		// 只处理完全落在范围内的页
+		void release(size_t offset, size_t len) const;
+
+	private:
+		unsigned char* data_;
+		size_t size_;
+#if defined(_WIN32)
+		void* file_;
+		void* mapping_;
+#else
+		int fd_;
+#endif
+	};
+
+	enum ImageFormat {
+		FormatPFM, FormatRaw
+	};
+
+	// raw 格式没有文件头, 尺寸和通道数由命令行给出
+	struct RawSpec {
+		int width;
+		int height;
+		int channels;
+	};
+
+	// 一边最多 300000 像素 (与 PSB 的上限相同), 最多 64 个通道. 超出的尺寸只可能来自损坏的文件头
+	// 或写错的 --raw, open / create 在计算文件大小、分配行缓冲之前就拒绝
+	static const int kMaxScanlineSide = 300000;
+	static const int kMaxScanlineChannels = 64;
+
+	// 由扩展名判断: .pfm 为 PFM, 其它都按 raw 处理
+	ImageFormat format_from_path(const std::string& path);
+
+	class ScanlineImage
+	{
+	public:
+		ScanlineImage();
+
+		// raw 需要 spec, PFM 忽略它
+		bool open(const std::string& path, const RawSpec* spec, std::string* err);
+		bool create(const std::string& path, ImageFormat format, int width, int height, int channels, std::string* err);
+		void close() { file_.close(); }
+
+		int width() const { return width_; }
+		int height() const { return height_; }
+		int channels() const { return channels_; }
+
+		// 第 y 行 (0 为最上面一行), 每个通道一个平面
+		void read_row(int y, float* const* planes) const;
+		void write_row(int y, const float* const* planes);
+		// [y0, y1) 行已经读完 / 写完, 释放对应的页, 长序列和大图的常驻内存只有正在处理的几行
+		void release_rows(int y0, int y1);
+
+	private:
+		const unsigned char* row_data(int y, int c) const;
+
+		MappedFile file_;
+		ImageFormat format_;
+		int width_;
+		int height_;
+		int channels_;
+		size_t header_;
+		bool swap_;  // 大端 PFM
+	};
+}
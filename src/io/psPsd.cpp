@@ -0,0 +1,376 @@
+// ========================================
+// PSD / PSB 图层记录的解析和通道的按行解码.
+// 文件里所有整数都是大端; PSB 的若干长度字段是 8 字节.
+// ========================================
+#include <algorithm>
+#include <cstring>
+#include "psBlend.h"
+#include "psPsd.h"
+
+namespace photoshopMergeTool {
+	static bool fail(std::string* err, const char* what)
+	{
+		if (err)
+			*err = what;
+		return false;
+	}
+
+	// PSD 的画布和图层最大 30000 像素, PSB 最大 300000. 超出的尺寸只可能来自损坏的文件,
+	// 按它分配内存之前先拒绝
+	static int max_side(bool psb) { return psb ? 300000 : 30000; }
+
+	static bool side_ok(int64_t lo, int64_t hi, bool psb) { return hi >= lo && hi - lo <= max_side(psb); }
+
+	// 带边界检查的大端读取, 越界后 ok 变为 false, 之后读到的都是 0
+	struct BigEndianCursor {
+		const unsigned char* data;
+		size_t size;
+		size_t pos;
+		bool ok;
+
+		BigEndianCursor(const unsigned char* d, size_t s, size_t p) : data(d), size(s), pos(p), ok(p <= s) {}
+		bool has(size_t n) { ok = ok && pos + n <= size; return ok; }
+		uint64_t read(int bytes)
+		{
+			if (!has((size_t)bytes))
+				return 0;
+			uint64_t v = 0;
+			for (int i = 0; i < bytes; i++)
+				v = (v << 8) | data[pos++];
+			return v;
+		}
+		unsigned int u8() { return (unsigned int)read(1); }
+		unsigned int u16() { return (unsigned int)read(2); }
+		int i16() { return (int)(int16_t)read(2); }
+		unsigned int u32() { return (unsigned int)read(4); }
+		int i32() { return (int)(int32_t)read(4); }
+		void skip(uint64_t n)
+		{
+			if (ok && n <= size - pos)
+				pos += (size_t)n;
+			else
+				ok = false;
+		}
+		void four(char* out)
+		{
+			if (has(4))
+				memcpy(out, data + pos, 4);
+			else
+				memset(out, 0, 4);
+			pos += ok ? 4 : 0;
+		}
+	};
+
+	struct BlendKey {
+		const char* key;
+		int mode;
+	};
+
+	// 没有列出的 (pass / fsub / fdiv) 按 -1 处理
+	static const BlendKey kBlendKeys[] = {
+		{ "norm", Normal },      { "diss", Dissolve },    { "dark", Darken },       { "mul ", Multiply },
+		{ "idiv", ColorBurn },   { "lbrn", LinearBurn },  { "dkCl", DarkerColor },  { "lite", Lighten },
+		{ "scrn", Screen },      { "div ", ColorDodge },  { "lddg", LinearDodge },  { "lgCl", LighterColor },
+		{ "over", Overlay },     { "sLit", SoftLight },   { "hLit", HardLight },    { "vLit", VividLight },
+		{ "lLit", LinearLight }, { "pLit", PinLight },    { "hMix", HardMix },      { "diff", Diference },
+		{ "smud", Exclusion },   { "hue ", Hue },         { "sat ", Saturation },   { "colr", Color },
+		{ "lum ", Luminosity },
+	};
+
+	int psd_blend_mode(const char* key)
+	{
+		for (const BlendKey& k : kBlendKeys) {
+			if (memcmp(k.key, key, 4) == 0)
+				return k.mode;
+		}
+		return -1;
+	}
+
+	const PsdChannel* PsdLayerRecord::channel(int id) const
+	{
+		for (const PsdChannel& c : channels) {
+			if (c.id == id)
+				return &c;
+		}
+		return NULL;
+	}
+
+	// PSB 里这些附加信息块的长度是 8 字节
+	static bool long_block(const char* key)
+	{
+		static const char* const keys[] = { "LMsk", "Lr16", "Lr32", "Layr", "Mt16", "Mt32", "Mtrn", "Alph", "FMsk", "lnk2", "FEid", "FXid", "PxSD" };
+		for (const char* k : keys) {
+			if (memcmp(k, key, 4) == 0)
+				return true;
+		}
+		return false;
+	}
+
+	PsdDocument::PsdDocument() : version_(0), width_(0), height_(0), depth_(0) {}
+
+	bool PsdDocument::open(const std::string& path, std::string* err)
+	{
+		layers_.clear();
+		if (!file_.open_read(path, err))
+			return false;
+		BigEndianCursor c(file_.data(), file_.size(), 0);
+		char sig[4];
+		c.four(sig);
+		version_ = (int)c.u16();
+		if (memcmp(sig, "8BPS", 4) != 0 || (version_ != 1 && version_ != 2))
+			return fail(err, "not a PSD / PSB file");
+		c.skip(6);
+		c.u16();  // 合并图像的通道数
+		height_ = (int)c.u32();
+		width_ = (int)c.u32();
+		depth_ = (int)c.u16();
+		int color_mode = (int)c.u16();
+		if (!c.ok)
+			return fail(err, "truncated PSD header");
+		if (!side_ok(1, width_, is_psb()) || !side_ok(1, height_, is_psb()))
+			return fail(err, "bad document size");
+		if (color_mode != 3)
+			return fail(err, "only RGB documents are supported");
+		if (depth_ != 8 && depth_ != 16 && depth_ != 32)
+			return fail(err, "only 8, 16 and 32 bit documents are supported");
+
+		c.skip(c.u32());  // 颜色模式数据
+		c.skip(c.u32());  // 图像资源
+		uint64_t lmi_len = c.read(is_psb() ? 8 : 4);
+		if (!c.ok || lmi_len > file_.size() - c.pos)
+			return fail(err, "truncated layer section");
+		size_t lmi_end = c.pos + (size_t)lmi_len;
+		if (lmi_len == 0)
+			return true;
+
+		uint64_t info_len = c.read(is_psb() ? 8 : 4);
+		size_t info_start = c.pos;
+		if (info_len > lmi_end - std::min(info_start, lmi_end))
+			return fail(err, "truncated layer info");
+		if (info_len > 0)
+			return parse_layers(info_start, info_start + (size_t)info_len, err);
+
+		// 16 / 32 位文档把图层放在全局附加信息的 Lr16 / Lr32 块里
+		c.skip(c.u32());  // 全局图层蒙版
+		while (c.ok && c.pos + 12 <= lmi_end) {
+			char bsig[4], key[4];
+			c.four(bsig);
+			c.four(key);
+			if (memcmp(bsig, "8BIM", 4) != 0 && memcmp(bsig, "8B64", 4) != 0)
+				break;
+			uint64_t len = c.read(is_psb() && long_block(key) ? 8 : 4);
+			size_t start = c.pos;
+			if (len > lmi_end - std::min(start, lmi_end))
+				return fail(err, "truncated layer info");
+			if (memcmp(key, "Lr16", 4) == 0 || memcmp(key, "Lr32", 4) == 0 || memcmp(key, "Layr", 4) == 0)
+				return parse_layers(start, start + (size_t)len, err);
+			c.skip((len + 3) & ~(uint64_t)3);
+		}
+		return true;
+	}
+
+	bool PsdDocument::parse_layers(size_t pos, size_t end, std::string* err)
+	{
+		if (end > file_.size() || pos > end)
+			return fail(err, "truncated layer info");
+		BigEndianCursor c(file_.data(), end, pos);
+		int count = c.i16();
+		if (count < 0)
+			count = -count;  // 负数表示第一个 alpha 通道是合并图的透明度, 这里用不到
+		std::vector<uint64_t> lengths;
+		layers_.resize(count);
+		for (int i = 0; i < count && c.ok; i++) {
+			PsdLayerRecord& l = layers_[i];
+			l.top = c.i32();
+			l.left = c.i32();
+			l.bottom = c.i32();
+			l.right = c.i32();
+			if (!side_ok(l.left, l.right, is_psb()) || !side_ok(l.top, l.bottom, is_psb()))
+				return fail(err, "bad layer bounds");
+			int channels = (int)c.u16();
+			if (!c.has((size_t)channels * (is_psb() ? 10 : 6)))
+				break;
+			l.channels.resize(channels);
+			for (int ch = 0; ch < channels; ch++) {
+				l.channels[ch].id = c.i16();
+				lengths.push_back(c.read(is_psb() ? 8 : 4));
+			}
+			char sig[4];
+			c.four(sig);
+			c.four(l.key);
+			l.key[4] = 0;
+			l.mode = psd_blend_mode(l.key);
+			l.opacity = c.u8() / 255.0f;
+			l.clipped = c.u8() != 0;
+			unsigned int flags = c.u8();
+			l.visible = (flags & 0x02) == 0;
+			l.section = PsdNormalLayer;
+			c.u8();
+			if (memcmp(sig, "8BIM", 4) != 0)
+				return fail(err, "bad layer record signature");
+
+			size_t extra_len = c.u32();
+			if (!c.has(extra_len))
+				break;
+			size_t extra_end = c.pos + extra_len;
+			c.skip(c.u32());  // 图层蒙版
+			c.skip(c.u32());  // 混合颜色带
+			size_t name_start = c.pos;
+			unsigned int name_len = c.u8();
+			if (c.has(name_len))
+				l.name.assign((const char*)file_.data() + c.pos, name_len);
+			c.pos = name_start + ((name_len + 1 + 3) & ~3u);
+			while (c.ok && c.pos + 12 <= extra_end) {
+				char bsig[4], key[4];
+				c.four(bsig);
+				c.four(key);
+				uint64_t len = c.read(is_psb() && long_block(key) ? 8 : 4);
+				size_t start = c.pos;
+				if (memcmp(key, "lsct", 4) == 0 && len >= 4)
+					l.section = (int)c.u32();
+				c.pos = start;
+				c.skip(len);
+			}
+			c.pos = extra_end;
+		}
+		if (!c.ok)
+			return fail(err, "truncated layer records");
+
+		// 通道数据紧跟在所有图层记录之后, 按图层, 通道的顺序排列
+		size_t k = 0;
+		for (PsdLayerRecord& l : layers_) {
+			for (PsdChannel& ch : l.channels) {
+				uint64_t len = lengths[k++];
+				if (len < 2 || c.pos > end || len > end - c.pos)
+					return fail(err, "truncated channel data");
+				ch.compression = (int)c.u16();
+				ch.offset = c.pos;
+				ch.length = (size_t)len - 2;
+				c.pos += ch.length;
+			}
+		}
+
+		// 从上往下走一遍, 隐藏的组里的图层也不可见.
+		// 组在记录里是: 结束标记 (最下), 组内图层, 组本身 (最上)
+		std::vector<bool> hidden(1, false);
+		for (int i = count - 1; i >= 0; i--) {
+			PsdLayerRecord& l = layers_[i];
+			if (l.section == PsdOpenFolder || l.section == PsdClosedFolder)
+				hidden.push_back(hidden.back() || !l.visible);
+			else if (l.section == PsdDivider) {
+				if (hidden.size() > 1)
+					hidden.pop_back();
+			}
+			else
+				l.visible = l.visible && !hidden.back();
+		}
+		return true;
+	}
+
+	static const size_t kReleaseBytes = 64 << 10;
+
+	PsdChannelReader::PsdChannelReader()
+		: doc_(NULL), channel_(NULL), width_(0), height_(0), bytes_(1), row_(0), pos_(0), released_(0) {}
+
+	bool PsdChannelReader::reset(const PsdDocument& doc, const PsdLayerRecord& layer, const PsdChannel& channel)
+	{
+		doc_ = &doc;
+		channel_ = &channel;
+		width_ = layer.width();
+		height_ = layer.height();
+		bytes_ = doc.depth() / 8;
+		row_ = 0;
+		pos_ = channel.offset;
+		if (channel.compression == PsdRLE) {
+			// 每行的字节数表必须完整, skip_to / read_row 直接按行号查表
+			size_t table = (size_t)height_ * (doc.is_psb() ? 4 : 2);
+			if (channel.length < table)
+				return false;
+			pos_ += table;  // 跳过每行的字节数表
+		}
+		released_ = pos_;  // 行字节数表每行都要查, 不释放
+		scratch_.resize((size_t)width_ * bytes_);
+		return channel.compression == PsdRaw || channel.compression == PsdRLE;
+	}
+
+	// RLE 每行的压缩字节数在通道开头的表里
+	void PsdChannelReader::skip_to(int row)
+	{
+		int count_size = doc_->is_psb() ? 4 : 2;
+		const unsigned char* table = doc_->data() + channel_->offset;
+		for (; row_ < row; row_++) {
+			BigEndianCursor c(table, (size_t)height_ * count_size, (size_t)row_ * count_size);
+			pos_ += (size_t)c.read(count_size);
+		}
+	}
+
+	void PsdChannelReader::decode_rle(const unsigned char* src, size_t n, unsigned char* dst, size_t bytes)
+	{
+		size_t i = 0, o = 0;
+		while (i < n && o < bytes) {
+			int h = (int)(signed char)src[i++];
+			if (h >= 0) {
+				size_t run = std::min((size_t)h + 1, std::min(n - i, bytes - o));
+				memcpy(dst + o, src + i, run);
+				i += (size_t)h + 1;
+				o += run;
+			}
+			else if (h != -128 && i < n) {
+				size_t run = std::min((size_t)(1 - h), bytes - o);
+				memset(dst + o, src[i++], run);
+				o += run;
+			}
+		}
+		if (o < bytes)
+			memset(dst + o, 0, bytes - o);
+	}
+
+	void PsdChannelReader::read_row(int row, float* out)
+	{
+		size_t bytes = (size_t)width_ * bytes_;
+		size_t end = channel_->offset + channel_->length;
+		const unsigned char* src = NULL;
+		if (channel_->compression == PsdRaw) {
+			if ((size_t)row * bytes + bytes <= channel_->length)
+				src = doc_->data() + channel_->offset + (size_t)row * bytes;
+		}
+		else if (channel_->compression == PsdRLE && row >= row_) {
+			skip_to(row);
+			int count_size = doc_->is_psb() ? 4 : 2;
+			BigEndianCursor c(doc_->data() + channel_->offset, (size_t)height_ * count_size, (size_t)row * count_size);
+			size_t n = (size_t)c.read(count_size);
+			if (pos_ <= end && n <= end - pos_) {
+				decode_rle(doc_->data() + pos_, n, scratch_.data(), bytes);
+				src = scratch_.data();
+			}
+			pos_ += n;
+			row_ = row + 1;
+		}
+		// 读过的数据攒够一段就释放, 上百个图层的通道不会一直留在内存里
+		size_t consumed = channel_->compression == PsdRaw ? channel_->offset + (size_t)(row + 1) * bytes : pos_;
+		if (consumed > released_ + kReleaseBytes) {
+			doc_->release(released_, consumed - released_);
+			released_ = consumed;
+		}
+		if (!src) {
+			memset(out, 0, (size_t)width_ * sizeof(float));
+			return;
+		}
+		int n = width_;
+		if (bytes_ == 1) {
+			for (int x = 0; x < n; x++)
+				out[x] = src[x] * (1.0f / 255.0f);
+		}
+		else if (bytes_ == 2) {
+			for (int x = 0; x < n; x++)
+				out[x] = ((src[2 * x] << 8) | src[2 * x + 1]) * (1.0f / 65535.0f);
+		}
+		else {
+			for (int x = 0; x < n; x++) {
+				const unsigned char* p = src + 4 * x;
+				uint32_t u = ((uint32_t)p[0] << 24) | ((uint32_t)p[1] << 16) | ((uint32_t)p[2] << 8) | p[3];
+				memcpy(&out[x], &u, 4);
+			}
+		}
+	}
+}
@@ -0,0 +1,104 @@
+// ========================================
+// PSD / PSB 图层读取, 给离线拍平用.
+// 只解析文件头和图层记录, 像素数据留在内存映射里, 由 PsdChannelReader
+// 按行顺序解码 (raw / RLE), 所以内存只和一行的宽度有关, 与图层数无关.
+//
+// 支持: RGB 颜色模式, 8 / 16 / 32 位, 图层透明度通道, 图层不透明度, 隐藏的图层和组.
+// 不支持: ZIP 压缩的通道 (跳过并给出提示), 图层蒙版, 剪贴蒙版, 填充不透明度,
+// 组自己的不透明度和混合模式 (组一律按 "穿透" 处理).
+// ========================================
+#pragma once
+
+#include <cstdint>
+#include <string>
+#include <vector>
+#include "psImageIO.h"
+
+namespace photoshopMergeTool {
+	enum PsdCompression {
+		PsdRaw = 0, PsdRLE = 1, PsdZip = 2, PsdZipPredict = 3
+	};
+
+	// 组的开始 / 结束标记 (lsct), 它们本身没有像素
+	enum PsdSection {
+		PsdNormalLayer = 0, PsdOpenFolder = 1, PsdClosedFolder = 2, PsdDivider = 3
+	};
+
+	struct PsdChannel {
+		int id;           // 0 / 1 / 2 = R / G / B, -1 透明度, -2 / -3 蒙版
+		int compression;
+		size_t offset;    // 压缩方式之后的数据起点
+		size_t length;    // 不含压缩方式的两个字节
+	};
+
+	struct PsdLayerRecord {
+		std::string name;
+		int top, left, bottom, right;
+		char key[5];      // 混合模式的四字符代码, 如 "mul "
+		int mode;         // 对应的 PsBlend, 不认识的为 -1
+		float opacity;    // 0..1
+		bool visible;     // 自己和所在的组都可见
+		bool clipped;
+		int section;
+		std::vector<PsdChannel> channels;
+
+		int width() const { return right - left; }
+		int height() const { return bottom - top; }
+		const PsdChannel* channel(int id) const;
+	};
+
+	// Photoshop 混合模式代码 -> PsBlend, 没有对应的返回 -1
+	int psd_blend_mode(const char* key);
+
+	class PsdDocument
+	{
+	public:
+		PsdDocument();
+		bool open(const std::string& path, std::string* err);
+
+		int width() const { return width_; }
+		int height() const { return height_; }
+		int depth() const { return depth_; }
+		bool is_psb() const { return version_ == 2; }
+		// 从最下面一层开始
+		const std::vector<PsdLayerRecord>& layers() const { return layers_; }
+		const unsigned char* data() const { return file_.data(); }
+		size_t size() const { return file_.size(); }
+		void release(size_t offset, size_t len) const { file_.release(offset, len); }
+
+	private:
+		bool parse_layers(size_t pos, size_t end, std::string* err);
+
+		MappedFile file_;
+		int version_;
+		int width_;
+		int height_;
+		int depth_;
+		std::vector<PsdLayerRecord> layers_;
+	};
+
+	// 顺序读一个通道的行, 输出 0..1 (32 位为原值). 行号只能递增, 可以跳行
+	class PsdChannelReader
+	{
+	public:
+		PsdChannelReader();
+		// 不支持的压缩方式或不完整的 RLE 行字节数表返回 false
+		bool reset(const PsdDocument& doc, const PsdLayerRecord& layer, const PsdChannel& channel);
+		// row 是图层内的行号
+		void read_row(int row, float* out);
+
+	private:
+		void skip_to(int row);
+		void decode_rle(const unsigned char* src, size_t n, unsigned char* dst, size_t bytes);
+
+		const PsdDocument* doc_;
+		const PsdChannel* channel_;
+		int width_;
+		int height_;
+		int bytes_;        // 每个样本的字节数
+		int row_;          // 下一次 read_row 解码的行
+		size_t pos_;       // 下一行数据的位置
+		size_t released_;  // 这之前的数据已经读完并释放
+		std::vector<unsigned char> scratch_;
+	};
+}
@@ -0,0 +1,169 @@
+// ========================================
+// PSD 拍平的实现.
+// ========================================
+#include <algorithm>
+#include <cstring>
+#include "psPsdFlatten.h"
+
+namespace photoshopMergeTool {
+	static const int kChunk = 256;
+
+	// 一个参与合成的图层: 选好的内核, 四个通道的读取器和一行的像素
+	struct PsdFlattener::Layer {
+		const PsdLayerRecord* record;
+		int mode;
+		PsMode kind;
+		RowKernel row;
+		ColorRowKernel color;
+		PsdChannelReader reader[4];  // R, G, B, 透明度
+		bool has_alpha;
+		std::vector<float> pixels;   // 一行的 R, G, B, A 平面, 图层宽度
+	};
+
+	PsdFlattener::PsdFlattener(const PsdDocument& doc) : doc_(doc)
+	{
+		blended_.resize((size_t)doc.width() * 3);
+		alpha_.resize((size_t)doc.width());
+		for (const PsdLayerRecord& r : doc.layers()) {
+			if (r.section != PsdNormalLayer || !r.visible || r.opacity <= 0.0f)
+				continue;
+			if (r.width() <= 0 || r.height() <= 0 || r.right <= 0 || r.left >= doc.width() ||
+				r.bottom <= 0 || r.top >= doc.height())
+				continue;
+			const PsdChannel* ch[4] = { r.channel(0), r.channel(1), r.channel(2), r.channel(-1) };
+			if (!ch[0] || !ch[1] || !ch[2]) {
+				warnings_.push_back("layer '" + r.name + "': missing color channels, skipped");
+				continue;
+			}
+			std::unique_ptr<Layer> l(new Layer);
+			l->record = &r;
+			l->mode = r.mode;
+			if (l->mode < 0) {
+				warnings_.push_back("layer '" + r.name + "': blend mode '" + r.key + "' has no equivalent, using normal");
+				l->mode = Normal;
+			}
+			if (r.clipped)
+				warnings_.push_back("layer '" + r.name + "': clipping masks are not supported, composited unclipped");
+			if (r.channel(-2) || r.channel(-3))
+				warnings_.push_back("layer '" + r.name + "': layer mask ignored");
+			l->kind = blend_mode_kind(l->mode);
+			l->row = value_row_kernel(l->mode);
+			l->color = color_row_kernel(l->mode);
+			l->has_alpha = ch[3] != NULL;
+			bool ok = true, zip = false;
+			for (int c = 0; c < (l->has_alpha ? 4 : 3); c++) {
+				ok = l->reader[c].reset(doc, r, *ch[c]) && ok;
+				zip = zip || (ch[c]->compression != PsdRaw && ch[c]->compression != PsdRLE);
+			}
+			if (!ok) {
+				warnings_.push_back("layer '" + r.name + (zip ? "': ZIP compressed channels are not supported, skipped" :
+					"': truncated channel data, skipped"));
+				continue;
+			}
+			l->pixels.resize((size_t)r.width() * 4);
+			layers_.push_back(std::move(l));
+		}
+	}
+
+	PsdFlattener::~PsdFlattener() {}
+
+	void PsdFlattener::composite_band(int y0, int rows, float* const* out)
+	{
+		size_t w = (size_t)doc_.width();
+		for (int c = 0; c < 4; c++)
+			std::fill(out[c], out[c] + w * rows, 0.0f);
+		// 从下往上一层层叠; 每层在这条 band 里只读自己覆盖到的行
+		for (std::unique_ptr<Layer>& l : layers_) {
+			int top = std::max(l->record->top, y0);
+			int bottom = std::min(l->record->bottom, y0 + rows);
+			for (int y = top; y < bottom; y++) {
+				float* row[4];
+				for (int c = 0; c < 4; c++)
+					row[c] = out[c] + (y - y0) * w;
+				composite_row(*l, y, row);
+			}
+		}
+	}
+
+	void PsdFlattener::composite_row(Layer& l, int y, float* const* out)
+	{
+		const PsdLayerRecord& r = *l.record;
+		int lw = r.width();
+		int ly = y - r.top;
+		float* px[4];
+		for (int c = 0; c < 4; c++)
+			px[c] = l.pixels.data() + (size_t)lw * c;
+		for (int c = 0; c < (l.has_alpha ? 4 : 3); c++)
+			l.reader[c].read_row(ly, px[c]);
+		if (!l.has_alpha)
+			std::fill(px[3], px[3] + lw, 1.0f);
+
+		int x0 = std::max(r.left, 0);
+		int x1 = std::min(r.right, doc_.width());
+		if (x1 <= x0)
+			return;
+		int n = x1 - x0;
+		const float* cs[3];
+		float* cb[3];
+		float* bl[3];
+		for (int c = 0; c < 3; c++) {
+			cs[c] = px[c] + (x0 - r.left);
+			cb[c] = out[c] + x0;
+			bl[c] = blended_.data() + (size_t)doc_.width() * c;
+		}
+		const float* as = px[3] + (x0 - r.left);
+		float* ab = out[3] + x0;
+
+		// B(Cb, Cs), 背景在前 (A), 图层在后 (B), 与节点的输入顺序相同
+		DissolveKey key;
+		key.frame = 0;
+		key.seed = 0;
+		key.amount = 0.0f;
+		if (l.kind == asValueBlend) {
+			for (int c = 0; c < 3; c++)
+				(*l.row)(cb[c], cs[c], bl[c], n);
+		}
+		else if (l.kind == asColorBlend)
+			(*l.color)(cb, cs, bl, n);
+		else {
+			for (int c = 0; c < 3; c++)
+				memcpy(bl[c], cs[c], (size_t)n * sizeof(float));
+		}
+
+		float* alpha = alpha_.data();
+		for (int i = 0; i < n; i++)
+			alpha[i] = as[i] * r.opacity;
+		// 溶解: 透明度当作取图层像素的概率, 取到的像素完全不透明
+		if (l.kind == asDissolveBlend) {
+			for (int i = 0; i < n; i++) {
+				key.amount = alpha[i];
+				alpha[i] = dissolve_pick_b(x0 + i, y, key) ? 1.0f : 0.0f;
+			}
+		}
+
+		// 先算每个像素三项的权重 Co = ws * Cs + wb * B + wc * Cb, 再逐通道做乘加.
+		// 两段都是不分支的简单循环, 编译器可以向量化; 分成小块做, 权重一直在 L1 里.
+		// 透明度为 0 的像素 ws = wb = 0, wc = 1, 结果不变; 那时 ao 正好等于 ab
+		for (int i0 = 0; i0 < n; i0 += kChunk) {
+			int m = std::min(kChunk, n - i0);
+			float ws[kChunk], wb[kChunk], wc[kChunk];
+			for (int i = 0; i < m; i++) {
+				float a = alpha[i0 + i];
+				float b = ab[i0 + i];
+				float ao = a + b * (1.0f - a);
+				float inv = 1.0f / std::max(ao, 1e-30f);
+				ws[i] = a * (1.0f - b) * inv;
+				wb[i] = a * b * inv;
+				wc[i] = a > 0.0f ? (1.0f - a) * b * inv : 1.0f;
+				ab[i0 + i] = ao;
+			}
+			for (int c = 0; c < 3; c++) {
+				const float* s = cs[c] + i0;
+				const float* v = bl[c] + i0;
+				float* d = cb[c] + i0;
+				for (int i = 0; i < m; i++)
+					d[i] = ws[i] * s[i] + wb[i] * v[i] + wc[i] * d[i];
+			}
+		}
+	}
+}
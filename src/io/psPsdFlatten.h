@@ -0,0 +1,43 @@
+// ========================================
+// 把 PSD 的图层一条一条 (band) 地叠成一张图.
+// 每条只在内存里放 band 行的结果; 图层像素由 PsdChannelReader 从映射里按行解码,
+// 所以峰值内存是 band 大小加上每层一行, 不随 图层数 x 图像大小 增长.
+// 混合用的是节点同一套行内核, 再按图层透明度和不透明度做 Photoshop 的 alpha 合成:
+//   mix = (1 - ab) * Cs + ab * B(Cb, Cs)
+//   ao  = as + ab * (1 - as)
+//   Co  = (as * mix + (1 - as) * ab * Cb) / ao
+// 实现时展开成 Cs, B(Cb, Cs), Cb 三项的加权和.
+// ========================================
+#pragma once
+
+#include <memory>
+#include <string>
+#include <vector>
+#include "psBlend.h"
+#include "psPsd.h"
+
+namespace photoshopMergeTool {
+	class PsdFlattener
+	{
+	public:
+		explicit PsdFlattener(const PsdDocument& doc);
+		~PsdFlattener();
+
+		// 跳过或近似处理的图层, 每条一行说明
+		const std::vector<std::string>& warnings() const { return warnings_; }
+
+		// 合成 [y0, y0 + rows) 行, 结果是非预乘的 RGBA 平面,
+		// 行 y 的通道 c 在 out[c] + (y - y0) * width. band 必须从上往下依次调用
+		void composite_band(int y0, int rows, float* const* out);
+
+	private:
+		struct Layer;
+		void composite_row(Layer& l, int y, float* const* out);
+
+		const PsdDocument& doc_;
+		std::vector<std::unique_ptr<Layer>> layers_;
+		std::vector<std::string> warnings_;
+		std::vector<float> blended_;  // 一行 B(Cb, Cs), 三个平面
+		std::vector<float> alpha_;    // 一行图层的实际透明度 (含不透明度 / 溶解)
+	};
+}
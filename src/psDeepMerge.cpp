@@ -0,0 +1,377 @@
+// ========================================
+// PhotoshopDeepMerge: PhotoshopMerge 的深度版本, A 是深度图, B 和 mask 是普通的平面图.
+// 每个深度样本各自与所在像素的 B 混合, 样本数和深度通道不变, 之后照常做深度合成.
+// 一次 doDeepEngine 的所有样本放进按像素连续的样本池 (core/psDeep.h): A、展开到样本上的 B
+// 和结果各一组平面, 每个通道一次内核调用就处理完整块区域. 样本池按线程复用,
+// 处理完特别大的区域就释放, 大的深度渲染在农场上也不会一直占着内存.
+// 旋钮与 PhotoshopMerge 相同 (psMergeSettings.h).
+// ========================================
+#pragma warning(disable: 4996)
+#pragma execution_character_set("UTF-8")
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "DDImage/DeepFilterOp.h"
+#include "DDImage/DeepPlane.h"
+#include "DDImage/ImagePlane.h"
+#include "DDImage/Knobs.h"
+#include "core/psBlend.h"
+#include "core/psDeep.h"
+#include "psMergeSettings.h"
+
+using namespace DD;
+using namespace DD::Image;
+
+static const char* const HELP = "Photoshop layers merge for deep images. Every sample of the deep A input is "
+	"blended with the flat B input at its pixel, with the same knobs and modes as PhotoshopMerge. "
+	"Sample counts and depths are kept, so the result can still be deep merged and holdout.";
+
+// per-thread scratch reused by every doDeepEngine call: samples of the area packed per pixel, one plane per channel
+struct DeepScratch {
+	std::vector<uint32_t> counts;
+	std::vector<float> pixel;
+	photoshopMergeTool::DeepSamples a;
+	photoshopMergeTool::DeepSamples b;
+	photoshopMergeTool::DeepSamples out;
+	photoshopMergeTool::DeepSamples weight;
+
+	// keep up to this much between calls; one huge area does not pin its memory for the rest of the render
+	static const size_t kKeepBytes = 64u << 20;
+
+	void trim()
+	{
+		a.trim(kKeepBytes);
+		b.trim(kKeepBytes);
+		out.trim(kKeepBytes);
+		weight.trim(kKeepBytes);
+		if (counts.capacity() * sizeof(uint32_t) > kKeepBytes)
+			std::vector<uint32_t>().swap(counts);
+	}
+};
+
+// channel -> plane of a DeepSamples pool
+struct PlaneIndex {
+	std::vector<Channel> channels;
+
+	void set(const ChannelSet& set)
+	{
+		channels.clear();
+		foreach(z, set)
+			channels.push_back(z);
+	}
+	int size() const { return (int)channels.size(); }
+	int find(Channel z) const
+	{
+		for (size_t i = 0; i < channels.size(); i++) {
+			if (channels[i] == z)
+				return (int)i;
+		}
+		return -1;
+	}
+};
+
+class PhotoshopDeepMerge : public DeepFilterOp
+{
+	// knobs shared with PhotoshopMerge
+	MergeSettings settings;
+	photoshopMergeTool::ImageKernels kernels;
+	photoshopMergeTool::DissolveKey dissolve_key;
+	// input 1 data window: samples outside it are passed through untouched
+	Box b_bbox;
+	bool has_mask;
+
+	Iop* flat_input(int n) const { return dynamic_cast<Iop*>(Op::input(n)); }
+	void blend_span(const PlaneIndex& ia, const PlaneIndex& ib, const PlaneIndex& io, DeepScratch& s,
+		const ChannelSet& blend, const ChannelSet& layers, size_t first, int n, int x, int y, bool weighted) const;
+public:
+	PhotoshopDeepMerge(Node* node) : DeepFilterOp(node)
+	{
+		inputs(3);
+		has_mask = false;
+		kernels.init(settings.blend_mode, settings.parity8);
+		dissolve_key.frame = 0;
+		dissolve_key.seed = 0;
+		dissolve_key.amount = settings.dissolve_amount;
+	}
+	int minimum_inputs() const override { return 2; }
+	int maximum_inputs() const override { return 3; }
+	const char* input_label(int input, char* buffer) const override;
+	bool test_input(int n, Op* op) const override;
+	Op* default_input(int n) const override;
+	void knobs(Knob_Callback) override;
+	static const Op::Description d;
+	const char* Class() const override { return d.name; }
+	const char* node_help() const override { return HELP; }
+	void _validate(bool) override;
+	void append(Hash& hash) override;
+	void getDeepRequests(Box box, const ChannelSet& channels, int count, std::vector<RequestData>& requests) override;
+	bool doDeepEngine(Box box, const ChannelSet& channels, DeepOutputPlane& plane) override;
+};
+
+const char* PhotoshopDeepMerge::input_label(int input, char* buffer) const
+{
+	switch (input)
+	{
+	case 0: return "A";
+	case 1: return "B";
+	default: return "mask";
+	}
+}
+
+bool PhotoshopDeepMerge::test_input(int n, Op* op) const
+{
+	// A is deep, B and the mask are flat images
+	if (n == 0)
+		return DeepFilterOp::test_input(n, op);
+	return dynamic_cast<Iop*>(op) != NULL;
+}
+
+Op* PhotoshopDeepMerge::default_input(int n) const
+{
+	if (n == 0)
+		return DeepFilterOp::default_input(n);
+	return Iop::default_input(outputContext());
+}
+
+void PhotoshopDeepMerge::_validate(bool for_real)
+{
+	DeepFilterOp::_validate(for_real);
+	Iop* b = flat_input(1);
+	b->validate(for_real);
+	const Info& bi = b->info();
+	b_bbox.set(bi.x(), bi.y(), bi.r(), bi.t());
+	has_mask = node_input(2) != NULL && settings.mask_channel != Chan_Black;
+	if (has_mask)
+		flat_input(2)->validate(for_real);
+	std::string message;
+	if (!settings.prepare(&message)) {
+		error("%s", message.c_str());
+		return;
+	}
+	// mode layers are new channels on every sample
+	ChannelSet channels(_deepInfo.channels());
+	channels += settings.mode_channels;
+	_deepInfo = DeepInfo(_deepInfo.formats(), _deepInfo.box(), channels);
+	settings.select(&kernels, &dissolve_key, outputContext());
+}
+
+void PhotoshopDeepMerge::append(Hash& hash)
+{
+	if (settings.uses_frame())
+		hash.append((int)floor(outputContext().frame() + 0.5));
+}
+
+void PhotoshopDeepMerge::getDeepRequests(Box box, const ChannelSet& channels, int count, std::vector<RequestData>& requests)
+{
+	if (!input0())
+		return;
+	ChannelSet need_a(channels);
+	settings.in_channels(kernels.kind, 0, need_a);
+	requests.push_back(RequestData(input0(), box, need_a, count));
+	ChannelSet need_b(channels);
+	settings.in_channels(kernels.kind, 1, need_b);
+	Box area(box);
+	area.intersect(b_bbox);
+	if (settings.opacity <= 0.0f || !need_b.size() || area.r() <= area.x() || area.t() <= area.y())
+		return;
+	flat_input(1)->request(area.x(), area.y(), area.r(), area.t(), need_b, count);
+	if (has_mask)
+		flat_input(2)->request(area.x(), area.y(), area.r(), area.t(), ChannelSet(settings.mask_channel), count);
+}
+
+// blend samples [first, first + n) of the pools: main mode, mode layers, then the mix towards A.
+// x / y only matter to dissolve, which is called one sample at a time
+void PhotoshopDeepMerge::blend_span(const PlaneIndex& ia, const PlaneIndex& ib, const PlaneIndex& io, DeepScratch& s,
+	const ChannelSet& blend, const ChannelSet& layers, size_t first, int n, int x, int y, bool weighted) const
+{
+	auto a = [&](Channel z) { return (const float*)s.a.plane(ia.find(z)) + first; };
+	auto b = [&](Channel z) { return (const float*)s.b.plane(ib.find(z)) + first; };
+	auto o = [&](Channel z) { return s.out.plane(io.find(z)) + first; };
+	const float* wt = weighted ? s.weight.plane(0) + first : NULL;
+	float mix = settings.mix();
+
+	if (kernels.kind != photoshopMergeTool::asColorBlend) {
+		foreach(z, blend) {
+			const float* pa = a(z);
+			const float* pb = b(z);
+			float* po = o(z);
+			kernels.blend_row(&pa, &pb, &po, 1, n, x, y, dissolve_key);
+		}
+	}
+	else if (uses_rgb(blend)) {
+		// the kernel writes all of rgb, the pool always has the three planes
+		const float* pa[3] = { a(Chan_Red), a(Chan_Green), a(Chan_Blue) };
+		const float* pb[3] = { b(Chan_Red), b(Chan_Green), b(Chan_Blue) };
+		float* po[3] = { o(Chan_Red), o(Chan_Green), o(Chan_Blue) };
+		kernels.blend_row(pa, pb, po, 3, n, x, y, dissolve_key);
+	}
+	if (layers.size())
+		settings.blend_mode_layers(layers, a, b, o, n, x, y, wt, mix, dissolve_key);
+	foreach(z, blend) {
+		if (kernels.kind == photoshopMergeTool::asColorBlend && (z < Chan_Red || z > Chan_Blue))
+			continue;
+		MergeSettings::mix_span(a(z), o(z), n, wt, mix);
+	}
+}
+
+bool PhotoshopDeepMerge::doDeepEngine(Box box, const ChannelSet& channels, DeepOutputPlane& plane)
+{
+	plane = DeepOutputPlane(channels, box);
+	if (!input0())
+		return true;
+	ChannelSet need_a(channels);
+	settings.in_channels(kernels.kind, 0, need_a);
+	DeepPlane in;
+	if (!input0()->deepEngine(box, need_a, in))
+		return false;
+
+	ChannelSet blend(channels);
+	blend &= settings.blend_channels;
+	ChannelSet layers(channels);
+	layers &= settings.mode_channels;
+	ChannelSet need_b(channels);
+	settings.in_channels(kernels.kind, 1, need_b);
+	Box area(box);
+	area.intersect(b_bbox);
+	bool active = (blend.size() || layers.size()) && need_b.size() && settings.opacity > 0.0f &&
+		area.r() > area.x() && area.t() > area.y();
+
+	// pools: A for everything a kernel or the mix reads, B spread over the samples, and the results.
+	// a color mode blends rgb as a whole, so rgb is in all three as soon as one of it is blended
+	ChannelSet pool_a(need_b);
+	pool_a += blend;
+	foreach(z, layers)
+		pool_a += settings.source_of(z);
+	// what the output takes from the results; other blend channels of a color mode are A
+	ChannelSet written(blend);
+	if (kernels.kind == photoshopMergeTool::asColorBlend)
+		written &= Mask_RGB;
+	written += layers;
+	ChannelSet pool_out(written);
+	if (kernels.kind == photoshopMergeTool::asColorBlend && uses_rgb(blend))
+		pool_out += Mask_RGB;
+	PlaneIndex ia, ib, io;
+	ia.set(pool_a);
+	ib.set(need_b);
+	io.set(pool_out);
+
+	static thread_local DeepScratch scratch;
+	DeepScratch& s = scratch;
+	int w = box.w();
+	auto inside = [&](int x, int y) { return x >= area.x() && x < area.r() && y >= area.y() && y < area.t(); };
+	int pixels = box.w() * box.h();
+	s.counts.resize((size_t)pixels);
+	for (int y = box.y(), p = 0; y < box.t(); y++) {
+		for (int x = box.x(); x < box.r(); x++, p++)
+			s.counts[p] = (uint32_t)in.getPixel(y, x).getSampleCount();
+	}
+	s.a.shape(s.counts.data(), pixels, active ? ia.size() : 0);
+
+	if (active) {
+		// gather A, then B and the weights, one value per pixel spread over its samples
+		for (int y = box.y(), p = 0; y < box.t(); y++) {
+			for (int x = box.x(); x < box.r(); x++, p++) {
+				DeepPixel px = in.getPixel(y, x);
+				size_t base = s.a.offset(p);
+				for (int c = 0; c < ia.size(); c++) {
+					float* dst = s.a.plane(c) + base;
+					for (int i = 0; i < (int)s.counts[p]; i++)
+						dst[i] = px.getUnorderedSample(i, ia.channels[c]);
+				}
+			}
+		}
+		ImagePlane bp(area, false, need_b, need_b.size());
+		flat_input(1)->fetchPlane(bp);
+		s.b.shape_like(s.a, ib.size());
+		s.pixel.resize((size_t)pixels);
+		for (int c = 0; c < ib.size(); c++) {
+			int z = bp.chanNo(ib.channels[c]);
+			for (int y = box.y(), p = 0; y < box.t(); y++) {
+				for (int x = box.x(); x < box.r(); x++, p++)
+					s.pixel[p] = inside(x, y) ? bp.at(x, y, z) : 0.0f;
+			}
+			s.b.spread(c, s.pixel.data());
+		}
+
+		// weight = mask * opacity clamped to 0..1, and 0 outside input 1 so those samples stay A
+		bool weighted = has_mask || area.x() != box.x() || area.y() != box.y() || area.r() != box.r() || area.t() != box.t();
+		float mix = settings.mix();
+		if (weighted) {
+			ImagePlane mp;
+			if (has_mask) {
+				mp = ImagePlane(area, false, ChannelSet(settings.mask_channel), 1);
+				flat_input(2)->fetchPlane(mp);
+			}
+			for (int y = box.y(), p = 0; y < box.t(); y++) {
+				for (int x = box.x(); x < box.r(); x++, p++) {
+					float v = 0.0f;
+					if (inside(x, y)) {
+						v = has_mask ? mp.at(x, y, 0) * mix : mix;
+						v = v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f;
+					}
+					s.pixel[p] = v;
+				}
+			}
+			s.weight.shape_like(s.a, 1);
+			s.weight.spread(0, s.pixel.data());
+		}
+
+		// one span over every sample of the area, or one sample at a time for dissolve,
+		// where all samples of a pixel get the pixel's pattern
+		s.out.shape_like(s.a, io.size());
+		bool per_sample = kernels.kind == photoshopMergeTool::asDissolveBlend ||
+			settings.layers_use(photoshopMergeTool::asDissolveBlend);
+		if (!per_sample)
+			blend_span(ia, ib, io, s, blend, layers, 0, (int)s.a.samples(), 0, 0, weighted);
+		else {
+			for (int p = 0; p < pixels; p++) {
+				for (int i = 0; i < (int)s.counts[p]; i++)
+					blend_span(ia, ib, io, s, blend, layers, s.a.offset(p) + i, 1, box.x() + p % w, box.y() + p / w, weighted);
+			}
+		}
+		if (aborted())
+			return false;
+	}
+
+	// write out pixel by pixel: results from the pool, everything else (depth, untouched channels) from A
+	std::vector<int> from_pool;
+	std::vector<Channel> from_a;
+	foreach(z, channels) {
+		from_pool.push_back(active && written.contains(z) ? io.find(z) : -1);
+		from_a.push_back(settings.source_of(z));
+	}
+	DeepOutPixel out;
+	for (int y = box.y(), p = 0; y < box.t(); y++) {
+		for (int x = box.x(); x < box.r(); x++, p++) {
+			int n = (int)s.counts[p];
+			if (!n) {
+				plane.addHole();
+				continue;
+			}
+			DeepPixel px = in.getPixel(y, x);
+			size_t base = s.a.offset(p);
+			out.clear();
+			out.reserve((size_t)n * from_a.size());
+			for (int i = 0; i < n; i++) {
+				for (size_t c = 0; c < from_a.size(); c++) {
+					if (from_pool[c] >= 0)
+						out.push_back(s.out.plane(from_pool[c])[base + i]);
+					else
+						out.push_back(px.getUnorderedSample(i, from_a[c]));
+				}
+			}
+			plane.addPixel(out);
+		}
+	}
+	s.trim();
+	return true;
+}
+
+void PhotoshopDeepMerge::knobs(Knob_Callback f)
+{
+	settings.knobs(f);
+}
+
+static Op* build(Node* node) { return new PhotoshopDeepMerge(node); }
+
+const Op::Description PhotoshopDeepMerge::d("PhotoshopDeepMerge", "PhotoshopDeepMerge", build);
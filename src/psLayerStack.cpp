@@ -0,0 +1,380 @@
+// ========================================
+// PhotoshopLayerStack: 一个节点里按 Photoshop 图层顺序叠多层.
+// input 0 是背景, 之后每个输入是一层 (从下往上), 每层有自己的
+// 混合模式 / 不透明度 / 开关. 每行按小段处理, 一段数据在缓存里
+// 依次经过所有图层, 不再像串联多个 PhotoshopMerge 那样每层都来回读写整行.
+// ========================================
+#pragma warning(disable: 4996)
+#pragma execution_character_set("UTF-8")
+#include <cmath>
+#include <cstdio>
+#include <memory>
+#include <string>
+#include <vector>
+#include "DDImage/PixelIop.h"
+#include "DDImage/Row.h"
+#include "DDImage/Knobs.h"
+#include "core/psBlend.h"
+#include "core/psExpr.h"
+#include "core/psLut8.h"
+#include "psNukeCommon.h"
+
+using namespace DD;
+using namespace DD::Image;
+
+static const char* const HELP = "Photoshop layer stack: blends inputs 1..N over the background (input 0) "
+	"bottom-to-top in a single pass, each layer with its own blend mode, opacity and enable switch.";
+
+static const int kMaxLayers = 64;
+// pixels per chunk: one chunk of every blended channel stays in L1 across all layers
+static const int kChunk = 256;
+
+// knob names have to outlive the knobs, build them once
+struct LayerKnobNames {
+	char group[kMaxLayers][16];
+	char mode[kMaxLayers][16];
+	char opacity[kMaxLayers][16];
+	char enable[kMaxLayers][16];
+	LayerKnobNames()
+	{
+		for (int i = 0; i < kMaxLayers; i++) {
+			snprintf(group[i], sizeof(group[i]), "layer%d", i + 1);
+			snprintf(mode[i], sizeof(mode[i]), "mode%d", i + 1);
+			snprintf(opacity[i], sizeof(opacity[i]), "opacity%d", i + 1);
+			snprintf(enable[i], sizeof(enable[i]), "enable%d", i + 1);
+		}
+	}
+};
+static const LayerKnobNames layerKnobNames;
+
+// layer rows reused by every pixel_engine call on a thread, so a row costs no allocations.
+// get() on an input can render an upstream PhotoshopLayerStack on the same thread,
+// so every nesting level has its own set
+struct ThreadRows {
+	std::vector<std::unique_ptr<Row> > rows;
+
+	Row* at(size_t i, int x, int r)
+	{
+		if (rows.size() <= i)
+			rows.resize(i + 1);
+		if (!rows[i])
+			rows[i].reset(new Row(x, r));
+		else
+			rows[i]->range(x, r);
+		return rows[i].get();
+	}
+};
+
+static thread_local std::vector<std::unique_ptr<ThreadRows> > t_row_levels;
+static thread_local size_t t_row_depth = 0;
+
+class RowLease
+{
+	size_t level;
+public:
+	RowLease() : level(t_row_depth++)
+	{
+		if (t_row_levels.size() <= level)
+			t_row_levels.emplace_back(new ThreadRows);
+	}
+	~RowLease() { t_row_depth--; }
+	RowLease(const RowLease&) = delete;
+	RowLease& operator=(const RowLease&) = delete;
+	ThreadRows& rows() { return *t_row_levels[level]; }
+};
+
+class PhotoshopLayerStack : public PixelIop
+{
+	int layer_mode[kMaxLayers];
+	float layer_opacity[kMaxLayers];
+	bool layer_enable[kMaxLayers];
+	ChannelSet blend_channels;
+	bool parity8;
+	// photoshopMergeTool::BlendMath, shared by every layer
+	int math;
+	// photoshopMergeTool::SoftLightPrecision for soft light layers
+	int soft_light;
+	// formula for custom layers, shared by all of them
+	std::string expression;
+	photoshopMergeTool::BlendExpr expr;
+	int dissolve_seed;
+	photoshopMergeTool::DissolveRowKernel dissolve_kernel;
+
+	// active layers bottom-to-top, filled in _validate
+	struct Layer {
+		int input;
+		float opacity;
+		photoshopMergeTool::PsMode kind;
+		photoshopMergeTool::RowKernel row_kernel;
+		photoshopMergeTool::ColorRowKernel color_kernel;
+		// custom layers evaluate this instead of row_kernel
+		const photoshopMergeTool::BlendExpr* expr;
+		// dissolve layers use the opacity as the dissolve amount, like Photoshop
+		photoshopMergeTool::DissolveKey dissolve;
+		Box bbox;
+	};
+	std::vector<Layer> layers;
+	bool any_color;
+
+	void blend_chunk(const Layer& layer, const Row& src, const ChannelSet& blend, int cx, int n, int y, Row& out) const;
+public:
+	PhotoshopLayerStack(Node* node) : PixelIop(node)
+	{
+		inputs(2);
+		for (int i = 0; i < kMaxLayers; i++) {
+			layer_mode[i] = photoshopMergeTool::Normal;
+			layer_opacity[i] = 1.0f;
+			layer_enable[i] = true;
+		}
+		blend_channels = Mask_RGBA;
+		parity8 = false;
+		math = photoshopMergeTool::MathLegacy;
+		soft_light = photoshopMergeTool::SoftLightExact;
+		expression = "b";
+		dissolve_seed = 0;
+		dissolve_kernel = photoshopMergeTool::dissolve_row_kernel();
+		any_color = false;
+	}
+	int minimum_inputs() const override { return 2; }
+	int maximum_inputs() const override { return kMaxLayers + 1; }
+	const char* input_label(int input, char* buffer) const override;
+	bool pass_transform() const override { return true; }
+	void in_channels(int input, ChannelSet& mask) const override;
+	void pixel_engine(const Row &in, int y, int x, int r, ChannelMask, Row & out) override;
+	void knobs(Knob_Callback) override;
+	static const Iop::Description d;
+	const char* Class() const override { return d.name; }
+	const char* node_help() const override { return HELP; }
+	void _validate(bool) override;
+	void _request(int x, int y, int r, int t, ChannelMask channels, int count) override;
+	void append(Hash& hash) override;
+};
+
+const char* PhotoshopLayerStack::input_label(int input, char* buffer) const
+{
+	if (input == 0)
+		return "bg";
+	snprintf(buffer, 16, "%d", input);
+	return buffer;
+}
+
+void PhotoshopLayerStack::_validate(bool for_real)
+{
+	copy_info();
+	layers.clear();
+	any_color = false;
+	int frame = (int)floor(outputContext().frame() + 0.5);
+	for (int i = 1; i < inputs() && i <= kMaxLayers; i++) {
+		// unconnected inputs and disabled / fully transparent layers cost nothing
+		if (!node_input(i) || !layer_enable[i - 1] || layer_opacity[i - 1] <= 0.0f)
+			continue;
+		Iop* iop = input(i);
+		iop->validate(for_real);
+		const Info& li = iop->info();
+		if (li.r() <= li.x() || li.t() <= li.y())
+			continue;
+		merge_info(i);
+		Layer layer;
+		int mode = layer_mode[i - 1];
+		layer.input = i;
+		layer.expr = NULL;
+		if (mode == photoshopMergeTool::Custom) {
+			// parsed again only when the text changed
+			std::string message;
+			if ((expr.empty() || expr.text() != expression) && !expr.compile(expression, &message)) {
+				error("expression: %s", message.c_str());
+				return;
+			}
+			layer.expr = &expr;
+		}
+		layer.opacity = layer_opacity[i - 1] > 1.0f ? 1.0f : layer_opacity[i - 1];
+		layer.kind = photoshopMergeTool::blend_mode_kind(mode);
+		if (parity8) {
+			layer.row_kernel = photoshopMergeTool::lut8_row_kernel(mode);
+			layer.color_kernel = photoshopMergeTool::lut8_color_row_kernel(mode);
+		}
+		else {
+			photoshopMergeTool::BlendMath m = (photoshopMergeTool::BlendMath)math;
+			if (mode == photoshopMergeTool::SoftLight)
+				layer.row_kernel = photoshopMergeTool::soft_light_row_kernel(m, (photoshopMergeTool::SoftLightPrecision)soft_light);
+			else
+				layer.row_kernel = photoshopMergeTool::value_row_kernel(mode, m);
+			layer.color_kernel = photoshopMergeTool::color_row_kernel(mode, m);
+		}
+		// every layer gets its own pattern
+		layer.dissolve.frame = frame;
+		layer.dissolve.seed = (unsigned int)dissolve_seed + (unsigned int)i * 0x9E3779B9u;
+		layer.dissolve.amount = layer.opacity;
+		layer.bbox.set(li.x(), li.y(), li.r(), li.t());
+		layers.push_back(layer);
+		if (layer.kind == photoshopMergeTool::asColorBlend)
+			any_color = true;
+	}
+	set_out_channels(layers.empty() ? ChannelSet(Mask_None) : blend_channels);
+	PixelIop::_validate(for_real);
+}
+
+void PhotoshopLayerStack::append(Hash& hash)
+{
+	// dissolve layers change with the frame even when no knob is animated
+	for (int i = 0; i < kMaxLayers; i++) {
+		if (layer_mode[i] == photoshopMergeTool::Dissolve) {
+			hash.append((int)floor(outputContext().frame() + 0.5));
+			return;
+		}
+	}
+}
+
+void PhotoshopLayerStack::_request(int x, int y, int r, int t, ChannelMask channels, int count)
+{
+	ChannelSet need_bg(channels);
+	in_channels(0, need_bg);
+	input0().request(x, y, r, t, need_bg, count);
+	ChannelSet need_layer(channels);
+	in_channels(1, need_layer);
+	if (!need_layer.size())
+		return;
+	for (size_t i = 0; i < layers.size(); i++) {
+		Box area(x, y, r, t);
+		area.intersect(layers[i].bbox);
+		if (area.r() > area.x() && area.t() > area.y())
+			input(layers[i].input)->request(area.x(), area.y(), area.r(), area.t(), need_layer, count);
+	}
+}
+
+void PhotoshopLayerStack::in_channels(int input, ChannelSet& mask) const
+{
+	// same rules as PhotoshopMerge: layers only deliver blend channels,
+	// and a color mode anywhere in the stack needs the full rgb triple
+	ChannelSet blend(mask);
+	blend &= blend_channels;
+	if (input != 0)
+		mask = blend;
+	if (any_color && uses_rgb(blend))
+		mask += Mask_RGB;
+}
+
+void PhotoshopLayerStack::blend_chunk(const Layer& layer, const Row& src, const ChannelSet& blend,
+	int cx, int n, int y, Row& out) const
+{
+	// out already holds everything below this layer for [cx, cx + n)
+	float tmp[3][kChunk];
+	float o = layer.opacity;
+	if (layer.kind == photoshopMergeTool::asValueBlend) {
+		foreach(z, blend) {
+			float* acc = out.writable(z) + cx;
+			float* dst = o >= 1.0f ? acc : tmp[0];
+			if (layer.expr)
+				layer.expr->run(acc, src[z] + cx, dst, n);
+			else
+				(*layer.row_kernel)(acc, src[z] + cx, dst, n);
+			if (o >= 1.0f)
+				continue;
+			for (int i = 0; i < n; i++)
+				acc[i] += (tmp[0][i] - acc[i]) * o;
+		}
+	}
+	else if (layer.kind == photoshopMergeTool::asDissolveBlend) {
+		foreach(z, blend) {
+			float* acc = out.writable(z) + cx;
+			(*dissolve_kernel)(acc, src[z] + cx, acc, n, cx, y, layer.dissolve);
+		}
+	}
+	else if (uses_rgb(blend)) {
+		float* acc[3] = { out.writable(Chan_Red) + cx, out.writable(Chan_Green) + cx, out.writable(Chan_Blue) + cx };
+		const float* pb[3] = { src[Chan_Red] + cx, src[Chan_Green] + cx, src[Chan_Blue] + cx };
+		// blend_channels may leave some of rgb out, those keep the value below
+		bool keep[3] = { !blend.contains(Chan_Red), !blend.contains(Chan_Green), !blend.contains(Chan_Blue) };
+		float* po[3] = { tmp[0], tmp[1], tmp[2] };
+		(*layer.color_kernel)(acc, pb, po, n);
+		for (int c = 0; c < 3; c++) {
+			if (keep[c])
+				continue;
+			for (int i = 0; i < n; i++)
+				acc[c][i] += (tmp[c][i] - acc[c][i]) * o;
+		}
+	}
+}
+
+void PhotoshopLayerStack::pixel_engine(const Row& in, int y, int x, int r,
+	ChannelMask channels, Row& out)
+{
+	// start from the background, non-blend channels are done after this
+	out.copy(in, channels, x, r);
+	ChannelSet blend(channels);
+	blend &= blend_channels;
+	if (!blend.size() || layers.empty())
+		return;
+	if (any_color && uses_rgb(blend))
+		out.copy(in, Mask_RGB, x, r);
+
+	ChannelSet layer_channels(channels);
+	in_channels(1, layer_channels);
+
+	// fetch every layer that touches this row once, only over its bbox
+	RowLease lease;
+	Row* rows[kMaxLayers];
+	int lx[kMaxLayers], lr[kMaxLayers];
+	for (size_t i = 0; i < layers.size(); i++) {
+		const Box& bb = layers[i].bbox;
+		lx[i] = x > bb.x() ? x : bb.x();
+		lr[i] = r < bb.r() ? r : bb.r();
+		rows[i] = NULL;
+		if (y < bb.y() || y >= bb.t() || lx[i] >= lr[i])
+			continue;
+		rows[i] = lease.rows().at(i, lx[i], lr[i]);
+		input(layers[i].input)->get(y, lx[i], lr[i], layer_channels, *rows[i]);
+	}
+
+	// then walk the row in chunks, each chunk goes through the whole stack bottom-to-top
+	for (int cx = x; cx < r; cx += kChunk) {
+		int cr = cx + kChunk < r ? cx + kChunk : r;
+		for (size_t i = 0; i < layers.size(); i++) {
+			if (!rows[i])
+				continue;
+			int sx = cx > lx[i] ? cx : lx[i];
+			int sr = cr < lr[i] ? cr : lr[i];
+			if (sx < sr)
+				blend_chunk(layers[i], *rows[i], blend, sx, sr - sx, y, out);
+		}
+		if (aborted())
+			return;
+	}
+}
+
+void PhotoshopLayerStack::knobs(Knob_Callback f)
+{
+	Input_ChannelSet_knob(f, &blend_channels, 0, "blendChannels", "blend channels");
+	Tooltip(f, "Channels the layers are blended into. All other channels come from the background.");
+	Int_knob(f, &dissolve_seed, "seed");
+	Tooltip(f, "Pattern seed for dissolve layers. A dissolve layer uses its opacity as the fraction of pixels it covers.");
+	Enumeration_knob(f, &math, &photoshopMergeTool::blendMathNames[0], "math");
+	Tooltip(f, "legacy: the original 0..255 formulas. clamped: computed directly on 0..1 and clamped. "
+		"hdr: computed on 0..1 without clamping, highlights above 1 are kept through every layer. "
+		"Ignored with 8-bit parity.");
+	Enumeration_knob(f, &soft_light, &photoshopMergeTool::softLightPrecisionNames[0], "softLight", "soft light");
+	Tooltip(f, "Soft light layers only. exact: the reference formula. accurate: differs only by rounding and is about "
+		"twice as fast with legacy math.");
+	String_knob(f, &expression, "expression");
+	Tooltip(f, "Formula used by every custom layer, in a (everything below the layer) and b (the layer), per channel "
+		"on 0..1 values. Same syntax as PhotoshopMerge, e.g. a <= 0.5 ? 2*a*b : 1 - 2*(1-a)*(1-b). "
+		"Not clamped, and not affected by math or 8-bit parity.");
+	Bool_knob(f, &parity8, "parity8", "8-bit parity");
+	Tooltip(f, "Every layer quantizes to 8 bits and looks up Photoshop's 8-bit blend formulas in precomputed 256x256 tables, "
+		"as in PhotoshopMerge. Checked against the published formulas, not against Photoshop renders.");
+	for (int i = 0; i < kMaxLayers; i++) {
+		BeginClosedGroup(f, layerKnobNames.group[i]);
+		Bool_knob(f, &layer_enable[i], layerKnobNames.enable[i], "enable");
+		CascadingEnumeration_knob(f, &layer_mode[i], &photoshopMergeTool::blendModeNames[0], layerKnobNames.mode[i], "blendMode");
+		Float_knob(f, &layer_opacity[i], IRange(0, 1), layerKnobNames.opacity[i], "opacity");
+		EndGroup(f);
+	}
+}
+
+#include "DDImage/NukeWrapper.h"
+
+// blendChannels already picks the channels, the wrapper's selector would be a second one.
+// the wrapper's mask and mix stay: the stack has only per-layer opacities, nothing that masks or mixes the whole result
+static Iop* build(Node* node) { return (new NukeWrapper(new PhotoshopLayerStack(node)))->noChannels(); }
+
+const Iop::Description PhotoshopLayerStack::d("PhotoshopLayerStack", "PhotoshopLayerStack", build);
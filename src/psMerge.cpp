@@ -5,538 +5,77 @@
 // ========================================
 #pragma warning(disable: 4996)
 #pragma execution_character_set("UTF-8")
-#include <iostream>
 #include <cmath>
-#include <vector>
 #include "DDImage/PixelIop.h"
 #include "DDImage/Row.h"
 #include "DDImage/Knobs.h"
-
-#define ARGB_LEVER 255.0f
-typedef float argb;
-#define max(a,b)  (((a) > (b)) ? (a) : (b))
-#define min(a,b)  (((a) < (b)) ? (a) : (b))
+#include "core/psBlend.h"
+#include "core/psImage.h"
+#include "core/psMask.h"
+#include "core/psStats.h"
+#include "psMergeSettings.h"
 
 using namespace DD;
 using namespace DD::Image;
 
-namespace photoshopMergeTool {
-	enum PsBlend {
-		Normal, Darken, Multiply, ColorBurn, LinearBurn, DarkerColor, Lighten, Screen, ColorDodge, LinearDodge, LighterColor,
-		Overlay, SoftLight, HardLight, VividLight, LinearLight, PinLight, HardMix, Diference, Exclusion,
-		Hue, Saturation, Color, Luminosity, Dissolve
-	};
-
-	enum PsMode {
-		asValueBlend, asColorBlend
-	};
-
-	class PhotoshopComput
-	{
-	public:
-		PhotoshopComput() = default;
-		~PhotoshopComput() = default;
-		static float clump_to_ps_argb(float);
-		static float convert_from_argb(argb);
-		static argb inverted(argb);  // 
-		static float normal(float, float);  // 
-		static float darken(float, float);    // 䰵
-		static float multiply(float, float);  // Ƭ
-		static float color_burn(float, float); // ɫ
-		static float linear_burn(float, float); // Լ
-		static std::vector <float> PhotoshopComput::darker_color(std::vector <float> a, std::vector <float> b); // ɫ
-		static float lighten(float, float);    // 
-		static float screen(float, float); // ɫ
-		static float color_dodge(float, float); // ɫ
-		static float linear_dodge(float, float); // Լ
-		static std::vector <float> PhotoshopComput::lighter_color(std::vector <float> a, std::vector <float> b); // ǳɫ
-		static float overlay(float, float); // 
-		static float soft_light(float, float); // 
-		static float hard_light(float, float); // ǿ
-		static float vivid_light(float, float); // 
-		static float linear_light(float, float); // Թ
-		static float pin_light(float, float); // 
-		static float hard_mix(float, float); // ʵɫ
-		static float diference(float, float); // ų
-		static float exclusion(float, float); // ֵ
-		static std::vector <float> PhotoshopComput::hue(std::vector <float> a, std::vector <float> b); // ɫ
-	};
-
-	float PhotoshopComput::clump_to_ps_argb(float a)
-	{
-		argb r = (argb)(a * ARGB_LEVER);
-		return r;
-	}
-
-	float PhotoshopComput::convert_from_argb(argb a)
-	{
-		float r = float(a) / ARGB_LEVER;
-		return r;
-	}
-
-	argb PhotoshopComput::inverted(argb a)
-	{
-		argb r = (argb)(ARGB_LEVER - a);
-		return r;
-	}
-
-	float PhotoshopComput::normal(float a, float b)
-	{
-		// 
-		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
-		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
-		float r = PhotoshopComput::convert_from_argb(r_b);
-		return b;
-	}
-
-	float PhotoshopComput::darken(float a, float b)
-	{
-		// 䰵   B<=A  C=B B>=A  C=A
-		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
-		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
-		argb r_1 = 0;
-		if (r_a >= r_b)
-			r_1 = r_b;
-		else
-			r_1 = r_a;
-		float r = PhotoshopComput::convert_from_argb(r_1);
-		return r;
-	}
-
-	float PhotoshopComput::multiply(float a, float b)
-	{
-		// Ƭ    C = (A*B)/255
-		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
-		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
-		argb r_1 = r_a * r_b / ARGB_LEVER;
-		if (r_1 > ARGB_LEVER)
-			r_1 = ARGB_LEVER;
-		if (r_1 < 0)
-			r_1 = 0;
-		float r = PhotoshopComput::convert_from_argb(r_1);
-		return r;
-	}
-
-	float PhotoshopComput::color_burn(float a, float b)
-	{
-		// ɫ    C = A - ( (255 - A) * (255 - B) ) / B
-		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
-		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
-		if (r_b == 0)
-			return 0.0;
-		argb r_1 = r_a - PhotoshopComput::inverted(r_a) * PhotoshopComput::inverted(r_b) / r_b;
-		if (r_1 > ARGB_LEVER)
-			r_1 = ARGB_LEVER;
-		if (r_1 < 0)
-			r_1 = 0;
-		float r = PhotoshopComput::convert_from_argb(r_1);
-		return r;
-	}
-
-	float PhotoshopComput::linear_burn(float a, float b)
-	{
-		// Լ   C=A+B-255
-		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
-		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
-		argb r_1 = r_a + r_b - ARGB_LEVER;
-		if (r_1 > ARGB_LEVER)
-			r_1 = ARGB_LEVER;
-		if (r_1 < 0)
-			r_1 = 0;
-		float r = PhotoshopComput::convert_from_argb(r_1);
-		return r;
-	}
-
-	float PhotoshopComput::lighten(float a, float b)
-	{
-		//  B<=A  C=A B>A  C=B
-		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
-		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
-		argb r_1 = 0;
-		if (r_a >= r_b)
-			r_1 = r_a;
-		else
-			r_1 = r_b;
-		float r = PhotoshopComput::convert_from_argb(r_1);
-		return r;
-	}
-
-	float PhotoshopComput::screen(float a, float b)
-	{
-		// ɫ C = 255 - ( (255 - A) * (255 - B) ) / 255
-		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
-		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
-		argb r_1 = 0;
-		r_1 = ARGB_LEVER - PhotoshopComput::inverted(r_a) * PhotoshopComput::inverted(r_b) / ARGB_LEVER;
-		if (r_1 > ARGB_LEVER)
-			r_1 = ARGB_LEVER;
-		if (r_1 < 0)
-			r_1 = 0;
-		float r = PhotoshopComput::convert_from_argb(r_1);
-		return r;
-	}
-
-	float PhotoshopComput::color_dodge(float a, float b)
-	{
-		// ɫ   C = A + (A * B) / (255 - B)
-		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
-		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
-		if (PhotoshopComput::inverted(r_b) == 0)
-			return 1.0;
-		argb r_1 = r_a + r_a * r_b / PhotoshopComput::inverted(r_b);
-		if (r_1 > ARGB_LEVER)
-			r_1 = ARGB_LEVER;
-		if (r_1 < 0)
-			r_1 = 0;
-		float r = PhotoshopComput::convert_from_argb(r_1);
-		return r;
-	}
-
-	float PhotoshopComput::linear_dodge(float a, float b)
-	{
-		// Լӣ   C=A+B
-		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
-		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
-		argb r_1 = r_a + r_b;
-		if (r_1 > ARGB_LEVER)
-			r_1 = ARGB_LEVER;
-		if (r_1 < 0)
-			r_1 = 0;
-		float r = PhotoshopComput::convert_from_argb(r_1);
-		return r;
-	}
-
-	float PhotoshopComput::overlay(float a, float b)
-	{
-		//   if A <= 128  C = ( A  B ) / 255, if A > 128  C = 255 - ( (255 - A) * (255 - B)) / 128
-		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
-		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
-		argb r_1 = 0;
-		if (r_a <= 128)
-			r_1 = r_a * r_b / 128;
-		else
-			r_1 = 255 - PhotoshopComput::inverted(r_a) * PhotoshopComput::inverted(r_b) / 128;
-		if (r_1 > ARGB_LEVER)
-			r_1 = ARGB_LEVER;
-		if (r_1 < 0)
-			r_1 = 0;
-		float r = PhotoshopComput::convert_from_argb(r_1);
-		return r;
-	}
-
-	float PhotoshopComput::soft_light(float a, float b)
-	{
-		//     if B <= 128  C= (A * B) / 128 + (A / 255) ^ 2(255 - 2B) , if B>128  C = ( A * ( 255 - _B ) ) / 128 + sqrt(A / 255) * (2B - 255)
-		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
-		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
-		argb r_1 = 0;
-		if (r_b <= 128)
-			r_1 = r_a * r_b / 128 + (argb)(pow((r_a / 255), 2)) * (255 - 2 * r_b);
-		else
-			r_1 = r_a * PhotoshopComput::inverted(r_b) / 128 + (argb)(sqrt((r_a / 255))) * (2 * r_b - 255);
-		if (r_1 > ARGB_LEVER)
-			r_1 = ARGB_LEVER;
-		if (r_1 < 0)
-			r_1 = 0;
-		float r = PhotoshopComput::convert_from_argb(r_1);
-		return r;
-	}
-
-	float PhotoshopComput::hard_light(float a, float b)
-	{
-		// ǿ  if B<=128  C=(A * B)/128 , if B>128  C = 255 - ( (255 - A) * (255 - B) ) / 128
-		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
-		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
-		argb r_1 = 0;
-		if (r_b <= 128)
-			r_1 = r_a * r_b / 128;
-		else
-			r_1 = 255 - PhotoshopComput::inverted(r_a) * PhotoshopComput::inverted(r_b) / 128;
-		if (r_1 > ARGB_LEVER)
-			r_1 = ARGB_LEVER;
-		if (r_1 < 0)
-			r_1 = 0;
-		float r = PhotoshopComput::convert_from_argb(r_1);
-		return r;
-	}
-
-	float PhotoshopComput::vivid_light(float a, float b)
-	{
-		//    if B <= 128  C = A - (255 - A) * (255-2B) / (2B), if  B>128  C = A + A * (2B - 255) / (2 * (255 - B) )
-		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
-		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
-		argb r_1 = 0;
-		if (r_b == 0)
-			return 0.0;
-		if (PhotoshopComput::inverted(r_b) == 0)
-			return 0.0;
-		if (r_b <= 128)
-			r_1 = r_a - PhotoshopComput::inverted(r_a) * (255 - 2 * r_b) / (2 * r_b);
-		else
-			r_1 = r_a + r_a * (2 * r_b - 255) / (2 * PhotoshopComput::inverted(r_b));
-		if (r_1 > ARGB_LEVER)
-			r_1 = ARGB_LEVER;
-		if (r_1 < 0)
-			r_1 = 0;
-		float r = PhotoshopComput::convert_from_argb(r_1);
-		return r;
-	}
-
-	float PhotoshopComput::linear_light(float a, float b)
-	{
-		// Թ  C = A + 2 * B - 255
-		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
-		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
-		argb r_1 = 0;
-		r_1 = r_a + 2 * r_b - 255;
-		if (r_1 > ARGB_LEVER)
-			r_1 = ARGB_LEVER;
-		if (r_1 < 0)
-			r_1 = 0;
-		float r = PhotoshopComput::convert_from_argb(r_1);
-		return r;
-	}
-
-	float PhotoshopComput::pin_light(float a, float b)
-	{
-		//   if B <= 128  C = Min(A, 2B),  if B>128  C = MAX(A, 2B - 255)
-		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
-		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
-		argb r_1 = 0;
-		if (r_b <= 128)
-			r_1 = min(r_a, 2 * r_b);
-		else
-			r_1 = max(r_a, 2 * r_b - 255);
-		if (r_1 > ARGB_LEVER)
-			r_1 = ARGB_LEVER;
-		if (r_1 < 0)
-			r_1 = 0;
-		float r = PhotoshopComput::convert_from_argb(r_1);
-		return r;
-	}
-
-	float PhotoshopComput::hard_mix(float a, float b)
-	{
-		// ʵɫ   A + B >= 255  C=255, else C = A + B
-		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
-		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
-		argb r_1 = 0;
-		if (r_a + r_b > ARGB_LEVER)
-			r_1 = ARGB_LEVER;
-		else
-			r_1 = 0;
-		if (r_1 > ARGB_LEVER)
-			r_1 = ARGB_LEVER;
-		if (r_1 < 0)
-			r_1 = 0;
-		float r = PhotoshopComput::convert_from_argb(r_1);
-		return r;
-	}
-
-	float PhotoshopComput::diference(float a, float b)
-	{
-		// ֵ   C = | A - B |
-		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
-		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
-		argb r_1 = 0;
-		r_1 = abs(r_a - r_b);
-		if (r_1 > ARGB_LEVER)
-			r_1 = ARGB_LEVER;
-		if (r_1 < 0)
-			r_1 = 0;
-		float r = PhotoshopComput::convert_from_argb(r_1);
-		return r;
-	}
-
-	float PhotoshopComput::exclusion(float a, float b)
-	{
-		// ų   C = A + B - (A * B) / 128
-		argb r_a = PhotoshopComput::clump_to_ps_argb(a);
-		argb r_b = PhotoshopComput::clump_to_ps_argb(b);
-		argb r_1 = 0;
-		r_1 = r_a + r_b - r_a * r_b / 128;
-		if (r_1 > ARGB_LEVER)
-			r_1 = ARGB_LEVER;
-		if (r_1 < 0)
-			r_1 = 0;
-		float r = PhotoshopComput::convert_from_argb(r_1);
-		return r;
-	}
-
-	// ɫģʽ
-	std::vector <float> PhotoshopComput::darker_color(std::vector <float> a, std::vector <float> b)
-	{
-		// ɫ   Br+Bg+Bb >= Ar+Ag+Ab  C=A
-		argb r_a_r = PhotoshopComput::clump_to_ps_argb(a[0]);
-		argb r_a_g = PhotoshopComput::clump_to_ps_argb(a[1]);
-		argb r_a_b = PhotoshopComput::clump_to_ps_argb(a[2]);
-		argb r_b_r = PhotoshopComput::clump_to_ps_argb(b[0]);
-		argb r_b_g = PhotoshopComput::clump_to_ps_argb(b[1]);
-		argb r_b_b = PhotoshopComput::clump_to_ps_argb(b[2]);
-		argb r_1_r = 0; argb r_1_g = 0; argb r_1_b = 0;
-		argb aline = r_a_r + r_a_g + r_a_b;
-		argb bline = r_b_r + r_b_g + r_b_b;
-		if (bline >= aline) {
-			r_1_r = r_a_r;
-			r_1_g = r_a_g;
-			r_1_b = r_a_b;
-		}
-		else {
-			r_1_r = r_b_r;
-			r_1_g = r_b_g;
-			r_1_b = r_b_b;
-		}
-		if (r_1_r > ARGB_LEVER)
-			r_1_r = ARGB_LEVER;
-		if (r_1_g > ARGB_LEVER)
-			r_1_g = ARGB_LEVER;
-		if (r_1_b > ARGB_LEVER)
-			r_1_b = ARGB_LEVER;
-		if (r_1_r < 0)
-			r_1_r = 0;
-		if (r_1_g < 0)
-			r_1_g = 0;
-		if (r_1_b < 0)
-			r_1_b = 0;
-		float rR = PhotoshopComput::convert_from_argb(r_1_r);
-		float rG = PhotoshopComput::convert_from_argb(r_1_g);
-		float rB = PhotoshopComput::convert_from_argb(r_1_b);
-		std::vector <float> r = { rR, rG, rB };
-		return r;
-	}
-
-	std::vector <float> PhotoshopComput::lighter_color(std::vector <float> a, std::vector <float> b)
-	{
-		// ǳɫ  Br+Bg+Bb >= Ar+Ag+Ab  C=B
-		argb r_a_r = PhotoshopComput::clump_to_ps_argb(a[0]);
-		argb r_a_g = PhotoshopComput::clump_to_ps_argb(a[1]);
-		argb r_a_b = PhotoshopComput::clump_to_ps_argb(a[2]);
-		argb r_b_r = PhotoshopComput::clump_to_ps_argb(b[0]);
-		argb r_b_g = PhotoshopComput::clump_to_ps_argb(b[1]);
-		argb r_b_b = PhotoshopComput::clump_to_ps_argb(b[2]);
-		argb r_1_r = 0; argb r_1_g = 0; argb r_1_b = 0;
-		argb aline = r_a_r + r_a_g + r_a_b;
-		argb bline = r_b_r + r_b_g + r_b_b;
-		if (bline >= aline) {
-			r_1_r = r_b_r;
-			r_1_g = r_b_g;
-			r_1_b = r_b_b;
-		}
-		else {
-			r_1_r = r_a_r;
-			r_1_g = r_a_g;
-			r_1_b = r_a_b;
-		}
-		if (r_1_r > ARGB_LEVER)
-			r_1_r = ARGB_LEVER;
-		if (r_1_g > ARGB_LEVER)
-			r_1_g = ARGB_LEVER;
-		if (r_1_b > ARGB_LEVER)
-			r_1_b = ARGB_LEVER;
-		if (r_1_r < 0)
-			r_1_r = 0;
-		if (r_1_g < 0)
-			r_1_g = 0;
-		if (r_1_b < 0)
-			r_1_b = 0;
-		float rR = PhotoshopComput::convert_from_argb(r_1_r);
-		float rG = PhotoshopComput::convert_from_argb(r_1_g);
-		float rB = PhotoshopComput::convert_from_argb(r_1_b);
-		std::vector <float> r = { rR, rG, rB };
-		return r;
-	}
-
-	std::vector <float> PhotoshopComput::hue(std::vector <float> a, std::vector <float> b)
-	{
-		// ɫ
-		argb r_a_r = PhotoshopComput::clump_to_ps_argb(a[0]);
-		argb r_a_g = PhotoshopComput::clump_to_ps_argb(a[1]);
-		argb r_a_b = PhotoshopComput::clump_to_ps_argb(a[2]);
-		argb r_b_r = PhotoshopComput::clump_to_ps_argb(b[0]);
-		argb r_b_g = PhotoshopComput::clump_to_ps_argb(b[1]);
-		argb r_b_b = PhotoshopComput::clump_to_ps_argb(b[2]);
-		argb r_1_r = 0; argb r_1_g = 0; argb r_1_b = 0;
-		r_1_r = 0.5f;
-		if (r_1_r > ARGB_LEVER)
-			r_1_r = ARGB_LEVER;
-		if (r_1_g > ARGB_LEVER)
-			r_1_g = ARGB_LEVER;
-		if (r_1_b > ARGB_LEVER)
-			r_1_b = ARGB_LEVER;
-		if (r_1_r < 0)
-			r_1_r = 0;
-		if (r_1_g < 0)
-			r_1_g = 0;
-		if (r_1_b < 0)
-			r_1_b = 0;
-		float rR = PhotoshopComput::convert_from_argb(r_1_r);
-		float rG = PhotoshopComput::convert_from_argb(r_1_g);
-		float rB = PhotoshopComput::convert_from_argb(r_1_b);
-		std::vector <float> r = { rR, rG, rB };
-		return r;
-	}
-}
-
 static const char* const HELP = "Photoshop layers merge. by wuxiaomeng.";
 
 class PhotoshopMerge : public PixelIop
 {
-	int layer_index;
-	static const char* const enumLayerNames[];
+	// knobs shared with PhotoshopMergePlanar
+	MergeSettings settings;
+	// selected once in _validate, used by every pixel_engine call.
+	// solid-color B rows (Constant inputs, tint layers) skip reading B per pixel
+	photoshopMergeTool::ImageKernels kernels;
+	photoshopMergeTool::DissolveKey dissolve_key;
+	// input 1 data window: outside it A is passed through untouched
+	Box b_bbox;
+	bool has_mask;
+	// opt-in counters, see core/psStats.h. PSMERGE_STATS turns them on for every instance
+	bool collect_stats;
+	photoshopMergeTool::BlendStats stats;
+	const char* stats_text;
+
+	void blend_run(const Row& in, const Row& inB, int y, int x0, int x1,
+		const ChannelSet& blend, const ChannelSet& pass, Row& out) const;
+	void copy_a(const Row& in, const ChannelSet& blend, const ChannelSet& layers, int x0, int x1, Row& out) const;
 public:
 	void in_channels(int input, ChannelSet& mask) const override;
-	PhotoshopMerge(Node* node) : PixelIop(node)
+	PhotoshopMerge(Node* node) : PixelIop(node), stats("PhotoshopMerge")
 	{
-		inputs(2);
-		layer_index = 0;
+		inputs(3);
+		has_mask = false;
+		collect_stats = false;
+		stats_text = "";
+		kernels.init(settings.blend_mode, settings.parity8);
+		dissolve_key.frame = 0;
+		dissolve_key.seed = 0;
+		dissolve_key.amount = settings.dissolve_amount;
 	}
+	int minimum_inputs() const override { return 2; }
+	int maximum_inputs() const override { return 3; }
+	const char* input_label(int input, char* buffer) const override;
 	bool pass_transform() const override { return true; }
 	void pixel_engine(const Row &in, int y, int x, int r, ChannelMask, Row & out) override;
 	void knobs(Knob_Callback) override;
+	int knob_changed(Knob* k) override;
 	static const Iop::Description d;
 	const char* Class() const override { return d.name; }
 	const char* node_help() const override { return HELP; }
 	void _validate(bool) override;
 	void _request(int x, int y, int r, int t, ChannelMask channels, int count);
+	void append(Hash& hash) override;
 };
 
-/*
-      Normal
-# ܽ     Dissolve
--------------------------
-䰵       Darken
-Ƭ   Multiply
-ɫ   ColorBurn
-Լ    LinearBurn
-ɫ       DarkerColor
------------------------------
-      Lighten
-ɫ       Screen
-ɫ    ColorDodge
-Լ    LinearDodge
-ǳɫ       LighterColor
-----------------------------
-      Overlay
-     SoftLight
-ǿ    HardLight
-    VividLight
-Թ   LinearLight
-    PinLight
-ʵɫ  HardMix
-----------------------------
-ֵ     Diference
-ų     Exclusion
----------------------------
-ɫ     Hue
-# Ͷ    Saturation
-# ɫ      Color
-#       Luminosity
-*/
-
-const char* const PhotoshopMerge::enumLayerNames[] = { "normal", "darken", "multiply",
-"colorBurn", "linearBurn", "darkerColor", "lighten", "screen", "colorDodge", "linearDodge", "lighterColor",
-"overlay", "softLight", "hardLight", "vividLight", "linearLight", "pinLight", "hardMix",
-"diference", "exclusion", "hue", NULL};
+const char* PhotoshopMerge::input_label(int input, char* buffer) const
+{
+	switch (input)
+	{
+	case 0: return "A";
+	case 1: return "B";
+	default: return "mask";
+	}
+}
 
 void PhotoshopMerge::_validate(bool for_real)
 {
@@ -544,185 +83,224 @@ void PhotoshopMerge::_validate(bool for_real)
 	input1().validate(for_real);
 	copy_info();
 	merge_info(1);
-	set_out_channels(Mask_All);
+	const Info& bi = input1().info();
+	b_bbox.set(bi.x(), bi.y(), bi.r(), bi.t());
+	has_mask = node_input(2) != NULL && settings.mask_channel != Chan_Black;
+	if (has_mask)
+		input(2)->validate(for_real);
+	stats.set_enabled(collect_stats);
+	std::string message;
+	if (!settings.prepare(&message)) {
+		error("%s", message.c_str());
+		return;
+	}
+	// zero opacity leaves A untouched, nothing is fetched from B; mode layers are new channels and always written
+	info_.turn_on(settings.mode_channels);
+	ChannelSet written(settings.mode_channels);
+	if (settings.opacity > 0.0f)
+		written += settings.blend_channels;
+	set_out_channels(written);
+	settings.select(&kernels, &dissolve_key, outputContext());
 	PixelIop::_validate(for_real);
 }
 
+void PhotoshopMerge::append(Hash& hash)
+{
+	if (settings.uses_frame())
+		hash.append((int)floor(outputContext().frame() + 0.5));
+}
+
 void PhotoshopMerge::_request(int x, int y, int r, int t, ChannelMask channels, int count)
 {
-	// request from input 0 and input 1
-	input0().request(x, y, r, t, channels, count);
-	input1().request(x, y, r, t, channels, count);
+	// request from input 0, and from input 1 only where it overlaps its bbox
+	ChannelSet need_a(channels);
+	in_channels(0, need_a);
+	input0().request(x, y, r, t, need_a, count);
+	ChannelSet need_b(channels);
+	in_channels(1, need_b);
+	Box area(x, y, r, t);
+	area.intersect(b_bbox);
+	if (settings.opacity <= 0.0f || !need_b.size() || area.r() <= area.x() || area.t() <= area.y())
+		return;
+	input1().request(area.x(), area.y(), area.r(), area.t(), need_b, count);
+	if (has_mask)
+		input(2)->request(area.x(), area.y(), area.r(), area.t(), ChannelSet(settings.mask_channel), count);
 }
 
 void PhotoshopMerge::in_channels(int input, ChannelSet& mask) const
 {
-	// mask is unchanged
+	settings.in_channels(kernels.kind, input, mask);
 }
 
-void PhotoshopMerge::pixel_engine(const Row& in, int y, int x, int r,
-	ChannelMask channels, Row& out)
+// blend [x0, x1) into out, without mask or opacity
+void PhotoshopMerge::blend_run(const Row& in, const Row& inB, int y, int x0, int x1,
+	const ChannelSet& blend, const ChannelSet& pass, Row& out) const
 {
-	// input 0 row
-	Row inA(x, r);
-	input0().get(y, x, r, channels, inA);
+	if (kernels.kind != photoshopMergeTool::asColorBlend) {
+		// one channel at a time; a uniform B channel turns the blend into a function of A alone
+		foreach(z, blend) {
+			const float* pa = in[z] + x0;
+			const float* pb = inB[z] + x0;
+			float* po = out.writable(z) + x0;
+			kernels.blend_row(&pa, &pb, &po, 1, x1 - x0, x0, y, dissolve_key);
+		}
+		return;
+	}
 
-	// input 1 row
-	Row inB(x, r);
-	input1().get(y, x, r, channels, inB);
+	// color modes work on rgb, anything else passes A through
+	ChannelSet rest(blend);
+	rest -= Mask_RGB;
+	if (rest.size())
+		out.copy(in, rest, x0, x1);
+	if (!uses_rgb(blend))
+		return;
+	const float* pa[3] = { in[Chan_Red] + x0, in[Chan_Green] + x0, in[Chan_Blue] + x0 };
+	const float* pb[3] = { inB[Chan_Red] + x0, inB[Chan_Green] + x0, inB[Chan_Blue] + x0 };
+	float* po[3] = { out.writable(Chan_Red) + x0, out.writable(Chan_Green) + x0, out.writable(Chan_Blue) + x0 };
+	kernels.blend_row(pa, pb, po, 3, x1 - x0, x0, y, dissolve_key);
+	// the kernel writes all of rgb, restore the ones that are passed through
+	ChannelSet rgb_pass(pass);
+	rgb_pass &= Mask_RGB;
+	if (rgb_pass.size())
+		out.copy(in, rgb_pass, x0, x1);
+}
 
-	float (*func)(float, float);
-	std::vector <float> (*funcColor)(std::vector <float>, std::vector <float>);
-	func = &photoshopMergeTool::PhotoshopComput::normal;
-	funcColor = &photoshopMergeTool::PhotoshopComput::hue;
-	photoshopMergeTool::PsMode mode = photoshopMergeTool::asValueBlend;
+// A into the blend channels and the mode layer channels over [x0, x1)
+void PhotoshopMerge::copy_a(const Row& in, const ChannelSet& blend, const ChannelSet& layers, int x0, int x1, Row& out) const
+{
+	out.copy(in, blend, x0, x1);
+	if (layers.size())
+		settings.copy_mode_layers(layers, [&](Channel z) { return in[z] + x0; },
+			[&](Channel z) { return out.writable(z) + x0; }, x1 - x0);
+}
 
-	switch (layer_index)
-	{
-	case photoshopMergeTool::Normal:
-		func = &photoshopMergeTool::PhotoshopComput::normal;
-		mode = photoshopMergeTool::asValueBlend;
-		break;
-	case photoshopMergeTool::Darken:
-		func = &photoshopMergeTool::PhotoshopComput::darken;
-		mode = photoshopMergeTool::asValueBlend;
-		break;
-	case photoshopMergeTool::Multiply:
-		func = &photoshopMergeTool::PhotoshopComput::multiply;
-		mode = photoshopMergeTool::asValueBlend;
-		break;
-	case photoshopMergeTool::ColorBurn:
-		func = &photoshopMergeTool::PhotoshopComput::color_burn;
-		mode = photoshopMergeTool::asValueBlend;
-		break;
-	case photoshopMergeTool::LinearBurn:
-		func = &photoshopMergeTool::PhotoshopComput::linear_burn;
-		mode = photoshopMergeTool::asValueBlend;
-		break;
-	case photoshopMergeTool::DarkerColor:
-		funcColor = &photoshopMergeTool::PhotoshopComput::darker_color;
-		mode = photoshopMergeTool::asColorBlend;
-		break;
-	case photoshopMergeTool::Lighten:
-		func = &photoshopMergeTool::PhotoshopComput::lighten;
-		mode = photoshopMergeTool::asValueBlend;
-		break;
-	case photoshopMergeTool::Screen:
-		func = &photoshopMergeTool::PhotoshopComput::screen;
-		mode = photoshopMergeTool::asValueBlend;
-		break;
-	case photoshopMergeTool::ColorDodge:
-		func = &photoshopMergeTool::PhotoshopComput::color_dodge;
-		mode = photoshopMergeTool::asValueBlend;
-		break;
-	case photoshopMergeTool::LinearDodge:
-		func = &photoshopMergeTool::PhotoshopComput::linear_dodge;
-		mode = photoshopMergeTool::asValueBlend;
-		break;
-	case photoshopMergeTool::LighterColor:
-		funcColor = &photoshopMergeTool::PhotoshopComput::lighter_color;
-		mode = photoshopMergeTool::asColorBlend;
-		break;
-	case photoshopMergeTool::Overlay:
-		func = &photoshopMergeTool::PhotoshopComput::overlay;
-		mode = photoshopMergeTool::asValueBlend;
-		break;
-	case photoshopMergeTool::SoftLight:
-		func = &photoshopMergeTool::PhotoshopComput::soft_light;
-		mode = photoshopMergeTool::asValueBlend;
-		break;
-	case photoshopMergeTool::HardLight:
-		func = &photoshopMergeTool::PhotoshopComput::hard_light;
-		mode = photoshopMergeTool::asValueBlend;
-		break;
-	case photoshopMergeTool::VividLight:
-		func = &photoshopMergeTool::PhotoshopComput::vivid_light;
-		mode = photoshopMergeTool::asValueBlend;
-		break;
-	case photoshopMergeTool::LinearLight:
-		func = &photoshopMergeTool::PhotoshopComput::linear_light;
-		mode = photoshopMergeTool::asValueBlend;
-		break;
-	case photoshopMergeTool::PinLight:
-		func = &photoshopMergeTool::PhotoshopComput::pin_light;
-		mode = photoshopMergeTool::asValueBlend;
-		break;
-	case photoshopMergeTool::HardMix:
-		func = &photoshopMergeTool::PhotoshopComput::hard_mix;
-		mode = photoshopMergeTool::asValueBlend;
-		break;
-	case photoshopMergeTool::Diference:
-		func = &photoshopMergeTool::PhotoshopComput::diference;
-		mode = photoshopMergeTool::asValueBlend;
-		break;
-	case photoshopMergeTool::Exclusion:
-		func = &photoshopMergeTool::PhotoshopComput::exclusion;
-		mode = photoshopMergeTool::asValueBlend;
-		break;
-	case photoshopMergeTool::Hue:
-		funcColor = &photoshopMergeTool::PhotoshopComput::hue;
-		mode = photoshopMergeTool::asColorBlend;
-		break;
-	default:
-		func = &photoshopMergeTool::PhotoshopComput::normal;
-		mode = photoshopMergeTool::asValueBlend;
+void PhotoshopMerge::pixel_engine(const Row& in, int y, int x, int r,
+	ChannelMask channels, Row& out)
+{
+	// channels outside the blend set are a straight copy of A,
+	// mode layer channels are blended from the blend channel they are named after
+	ChannelSet blend(channels);
+	blend &= settings.blend_channels;
+	ChannelSet layers(channels);
+	layers &= settings.mode_channels;
+	ChannelSet pass(channels);
+	pass -= settings.blend_channels;
+	pass -= settings.mode_channels;
+	if (pass.size())
+		out.copy(in, pass, x, r);
+	if (!blend.size() && !layers.size())
+		return;
+	photoshopMergeTool::StatsRow row_stats(stats.active() ? &stats : NULL, settings.blend_mode, r - x);
+
+	// span of this row covered by input 1, A is copied through everywhere else
+	int bx = x > b_bbox.x() ? x : b_bbox.x();
+	int br = r < b_bbox.r() ? r : b_bbox.r();
+	if (settings.opacity <= 0.0f || y < b_bbox.y() || y >= b_bbox.t() || bx >= br) {
+		copy_a(in, blend, layers, x, r, out);
+		return;
 	}
 
-	if (mode == photoshopMergeTool::asValueBlend) {
-		foreach(z, channels) {
-			const float* inptr = inA[z] + x;
-			const float* inptrA = inB[z] + x;
-			const float* END = inptr + (r - x);
-			float* outptr = out.writable(z) + x;
-			while (inptr < END)
-				*outptr++ = (*func)((*inptr++), (*inptrA++));
-		}
+	// weight = mask * opacity clamped to 0..1, computed in place in the mask row.
+	// the span shrinks to the pixels with weight, so fully masked rows never fetch input 1
+	float mix = settings.mix();
+	const float* w = NULL;
+	Row maskRow(bx, br);
+	if (has_mask) {
+		input(2)->get(y, bx, br, ChannelSet(settings.mask_channel), maskRow);
+		row_stats.fetched();
+		float* wm = maskRow.writable(settings.mask_channel);
+		photoshopMergeTool::mask_weights(wm + bx, br - bx, mix);
+		photoshopMergeTool::trim_mask_span(wm, &bx, &br);
+		w = wm;
+	}
+	if (bx >= br) {
+		copy_a(in, blend, layers, x, r, out);
+		return;
+	}
+	if (bx > x)
+		copy_a(in, blend, layers, x, bx, out);
+	if (br < r)
+		copy_a(in, blend, layers, br, r, out);
+
+	// input 1 row, only the channels the blend reads ("in" already holds input 0)
+	ChannelSet b_channels(channels);
+	in_channels(1, b_channels);
+	Row inB(bx, br);
+	input1().get(y, bx, br, b_channels, inB);
+	row_stats.fetched();
+
+	// every mode layer runs over the same span of A and B while it is still in cache
+	if (layers.size()) {
+		settings.blend_mode_layers(layers, [&](Channel z) { return in[z] + bx; }, [&](Channel z) { return inB[z] + bx; },
+			[&](Channel z) { return out.writable(z) + bx; }, br - bx, bx, y, w ? w + bx : NULL, mix, dissolve_key);
 	}
 
-	if (mode == photoshopMergeTool::asColorBlend) {
-		if (channels.size() >= 3) {
-			std::vector <Channel> uchannels;
-			int ci = 1;
-			foreach(z, channels) {
-				uchannels.push_back(z);
+	if (!w) {
+		blend_run(in, inB, y, bx, br, blend, pass, out);
+		if (mix < 1.0f) {
+			foreach(z, blend) {
+				const float* a = in[z];
+				float* o = out.writable(z);
+				for (int i = bx; i < br; i++)
+					o[i] = a[i] + (o[i] - a[i]) * mix;
 			}
-			const float* inptrR = inA[uchannels[0]] + x;
-			const float* inptrG = inA[uchannels[1]] + x;
-			const float* inptrB = inA[uchannels[2]] + x;
-			const float* inptrAR = inB[uchannels[0]] + x;
-			const float* inptrAG = inB[uchannels[1]] + x;
-			const float* inptrAB = inB[uchannels[2]] + x;
-			const float* ENDR = inptrR + (r - x);
-			float* outptr_r = out.writable(uchannels[0]) + x;
-			float* outptr_g = out.writable(uchannels[1]) + x;
-			float* outptr_b = out.writable(uchannels[2]) + x;
+		}
+		row_stats.blended(br - bx);
+		return;
+	}
 
-			while (inptrR < ENDR) {
-				std::vector <float> inD = { *inptrR, *inptrG, *inptrB };
-				std::vector <float> inDA = { *inptrAR, *inptrAG, *inptrAB };
-				std::vector <float> result = (*funcColor)(inD, inDA);
-				*outptr_r++ = result[0];
-				inptrR++;
-				inptrAR++;
-				*outptr_g++ = result[1];
-				inptrG++;
-				inptrAG++;
-				*outptr_b++ = result[2]; 
-				inptrB++;
-				inptrAB++;
-			}
+	// masked: long zero runs are copied from A, everything else is blended,
+	// and the lerp only runs on stretches that are not fully on (core/psMask.h)
+	photoshopMergeTool::MaskSpan s;
+	for (int i = bx; i < br; i = s.x1) {
+		photoshopMergeTool::next_mask_span(w, i, br, &s);
+		if (s.kind == photoshopMergeTool::MaskSpanCopyA) {
+			out.copy(in, blend, s.x0, s.x1);
+			continue;
+		}
+		blend_run(in, inB, y, s.x0, s.x1, blend, pass, out);
+		if (s.kind == photoshopMergeTool::MaskSpanBlend) {
+			foreach(z, blend)
+				photoshopMergeTool::mix_weighted(in[z] + s.x0, out.writable(z) + s.x0, s.x1 - s.x0, w + s.x0);
 		}
+		row_stats.blended(s.x1 - s.x0);
 	}
 }
 
 void PhotoshopMerge::knobs(Knob_Callback f)
 {
-	CascadingEnumeration_knob(f, &layer_index, &enumLayerNames[0], "blendMode");
+	settings.knobs(f);
+	Bool_knob(f, &collect_stats, "stats", "collect stats");
+	SetFlags(f, Knob::NO_RERENDER);
+	Tooltip(f, "Count rows, blended / skipped pixels and fetch / blend time for this node. "
+		"Off costs nothing. PSMERGE_STATS=1 turns it on everywhere and prints a summary on exit.");
+	Button(f, "statsRefresh", "refresh");
+	Button(f, "statsReset", "reset");
+	Multiline_String_knob(f, &stats_text, "statsText", "stats", 6);
+	SetFlags(f, Knob::READ_ONLY | Knob::DO_NOT_WRITE | Knob::NO_RERENDER);
+}
+
+int PhotoshopMerge::knob_changed(Knob* k)
+{
+	if (k->is("stats")) {
+		stats.set_enabled(collect_stats);
+		return 1;
+	}
+	if (k->is("statsReset"))
+		stats.reset();
+	if (k->is("statsRefresh") || k->is("statsReset")) {
+		std::string text = stats.report();
+		knob("statsText")->set_text(text.c_str());
+		return 1;
+	}
+	return PixelIop::knob_changed(k);
 }
 
 #include "DDImage/NukeWrapper.h"
 
-static Iop* build(Node* node) { return new NukeWrapper(new PhotoshopMerge(node)); }
+// the node has its own mask input, opacity and blendChannels; the wrapper's would be a second set
+// (two mask inputs, two mixes multiplied together) and the result would differ from PhotoshopMergePlanar
+static Iop* build(Node* node) { return (new NukeWrapper(new PhotoshopMerge(node)))->noChannels()->noMask()->noMix(); }
 
 const Iop::Description PhotoshopMerge::d("PhotoshopMerge", "PhotoshopMerge", build);
 
@@ -0,0 +1,277 @@
+// ========================================
+// PhotoshopMergePlanar: PhotoshopMerge 的 PlanarIop 版本.
+// 一次处理一条 stripe (整个宽度 x stripeHeight 行) 的平面数据, A / B / mask 各取一次,
+// 不再每行构造 Row. 平面里同一通道的像素是连续的, B 覆盖整个宽度又没有 mask 时,
+// 可分离模式和颜色模式一次内核调用就处理完整条 stripe.
+// 旋钮和结果都与 PhotoshopMerge 相同 (psMergeSettings.h), 换节点类就能对比两种引擎.
+// ========================================
+#pragma warning(disable: 4996)
+#pragma execution_character_set("UTF-8")
+#include <cmath>
+#include <cstring>
+#include <vector>
+#include "DDImage/PlanarIop.h"
+#include "DDImage/ImagePlane.h"
+#include "DDImage/Knobs.h"
+#include "core/psBlend.h"
+#include "core/psImage.h"
+#include "psMergeSettings.h"
+
+using namespace DD;
+using namespace DD::Image;
+
+static const char* const HELP = "Photoshop layers merge, planar engine. Same knobs and results as "
+	"PhotoshopMerge, but renders whole stripes of planar data instead of one row at a time.";
+
+// start of row y of channel z at column x, planes are unpacked so the row is contiguous
+static inline const float* readable_row(const ImagePlane& p, Channel z, int x, int y)
+{
+	return &p.at(x, y, p.chanNo(z));
+}
+
+static inline float* writable_row(ImagePlane& p, Channel z, int x, int y)
+{
+	return &p.writableAt(x, y, p.chanNo(z));
+}
+
+class PhotoshopMergePlanar : public PlanarIop
+{
+	// knobs shared with PhotoshopMerge
+	MergeSettings settings;
+	photoshopMergeTool::ImageKernels kernels;
+	photoshopMergeTool::DissolveKey dissolve_key;
+	// input 1 data window: outside it A is passed through untouched
+	Box b_bbox;
+	bool has_mask;
+	int stripe_rows;
+
+	void render(ImagePlane& out);
+public:
+	PhotoshopMergePlanar(Node* node) : PlanarIop(node)
+	{
+		inputs(3);
+		has_mask = false;
+		stripe_rows = 64;
+		kernels.init(settings.blend_mode, settings.parity8);
+		dissolve_key.frame = 0;
+		dissolve_key.seed = 0;
+		dissolve_key.amount = settings.dissolve_amount;
+	}
+	int minimum_inputs() const override { return 2; }
+	int maximum_inputs() const override { return 3; }
+	const char* input_label(int input, char* buffer) const override;
+	bool useStripes() const override { return true; }
+	size_t stripeHeight() const override { return (size_t)(stripe_rows > 0 ? stripe_rows : 1); }
+	PlanarI::PackedPreference packedPreference() const override { return PlanarI::ePackedPreferenceUnpacked; }
+	void getRequests(const Box& box, const ChannelSet& channels, int count, RequestOutput& reqData) const override;
+	void renderStripe(ImagePlane& plane) override;
+	void knobs(Knob_Callback) override;
+	static const Iop::Description d;
+	const char* Class() const override { return d.name; }
+	const char* node_help() const override { return HELP; }
+	void _validate(bool) override;
+	void append(Hash& hash) override;
+};
+
+const char* PhotoshopMergePlanar::input_label(int input, char* buffer) const
+{
+	switch (input)
+	{
+	case 0: return "A";
+	case 1: return "B";
+	default: return "mask";
+	}
+}
+
+void PhotoshopMergePlanar::_validate(bool for_real)
+{
+	input0().validate(for_real);
+	input1().validate(for_real);
+	copy_info();
+	merge_info(1);
+	const Info& bi = input1().info();
+	b_bbox.set(bi.x(), bi.y(), bi.r(), bi.t());
+	has_mask = node_input(2) != NULL && settings.mask_channel != Chan_Black;
+	if (has_mask)
+		input(2)->validate(for_real);
+	std::string message;
+	if (!settings.prepare(&message)) {
+		error("%s", message.c_str());
+		return;
+	}
+	info_.turn_on(settings.mode_channels);
+	ChannelSet written(settings.mode_channels);
+	if (settings.opacity > 0.0f)
+		written += settings.blend_channels;
+	set_out_channels(written);
+	settings.select(&kernels, &dissolve_key, outputContext());
+}
+
+void PhotoshopMergePlanar::append(Hash& hash)
+{
+	if (settings.uses_frame())
+		hash.append((int)floor(outputContext().frame() + 0.5));
+}
+
+void PhotoshopMergePlanar::getRequests(const Box& box, const ChannelSet& channels, int count, RequestOutput& reqData) const
+{
+	ChannelSet need_a(channels);
+	settings.in_channels(kernels.kind, 0, need_a);
+	reqData.request(&input0(), box, need_a, count);
+	ChannelSet need_b(channels);
+	settings.in_channels(kernels.kind, 1, need_b);
+	Box area(box);
+	area.intersect(b_bbox);
+	if (settings.opacity <= 0.0f || !need_b.size() || area.r() <= area.x() || area.t() <= area.y())
+		return;
+	reqData.request(&input1(), area, need_b, count);
+	if (has_mask)
+		reqData.request(input(2), area, ChannelSet(settings.mask_channel), count);
+}
+
+void PhotoshopMergePlanar::renderStripe(ImagePlane& plane)
+{
+	// asked for unpacked planes; if the caller still hands over a packed one, go through a copy
+	if (!plane.packed()) {
+		render(plane);
+		return;
+	}
+	ImagePlane tmp(plane.bounds(), false, plane.channels(), plane.nComps());
+	render(tmp);
+	plane.copyIntersectionFrom(tmp);
+}
+
+void PhotoshopMergePlanar::render(ImagePlane& out)
+{
+	const Box& box = out.bounds();
+	const ChannelSet& channels = out.channels();
+	out.makeWritable();
+
+	ChannelSet need_a(channels);
+	settings.in_channels(kernels.kind, 0, need_a);
+	ImagePlane a(box, false, need_a, need_a.size());
+	input0().fetchPlane(a);
+
+	// everything starts as A (mode layers as A of their blend channel), the blend overwrites the part input 1 covers
+	foreach(z, channels) {
+		Channel src = settings.source_of(z);
+		for (int y = box.y(); y < box.t(); y++)
+			memcpy(writable_row(out, z, box.x(), y), readable_row(a, src, box.x(), y), (size_t)box.w() * sizeof(float));
+	}
+	ChannelSet blend(channels);
+	blend &= settings.blend_channels;
+	ChannelSet layers(channels);
+	layers &= settings.mode_channels;
+	Box area(box);
+	area.intersect(b_bbox);
+	if ((!blend.size() && !layers.size()) || settings.opacity <= 0.0f || area.r() <= area.x() || area.t() <= area.y() || aborted())
+		return;
+
+	ChannelSet need_b(channels);
+	settings.in_channels(kernels.kind, 1, need_b);
+	// color modes with none of rgb blended read nothing from B and leave A as is
+	if (!need_b.size())
+		return;
+	ImagePlane b(area, false, need_b, need_b.size());
+	input1().fetchPlane(b);
+	ImagePlane m;
+	if (has_mask) {
+		m = ImagePlane(area, false, ChannelSet(settings.mask_channel), 1);
+		input(2)->fetchPlane(m);
+	}
+
+	// without a mask, a full-width area is one contiguous span per channel.
+	// dissolve hashes (x, y), so it always goes row by row
+	int w = area.w();
+	bool whole = !has_mask && kernels.kind != photoshopMergeTool::asDissolveBlend &&
+		!settings.layers_use(photoshopMergeTool::asDissolveBlend) && area.x() == box.x() &&
+		area.r() == box.r() && a.rowStride() == w && b.rowStride() == w && out.rowStride() == w;
+	int spans = whole ? 1 : area.h();
+	int n = whole ? w * area.h() : w;
+
+	bool color = kernels.kind == photoshopMergeTool::asColorBlend;
+	std::vector<float> rgb(color ? (size_t)n * 3 : 0);
+	std::vector<float> weight(has_mask ? (size_t)w : 0);
+	float mix = settings.mix();
+
+	for (int s = 0; s < spans; s++) {
+		int y = area.y() + s;
+		// weight = mask * opacity clamped to 0..1; fully masked rows stay A and are not blended
+		const float* wt = NULL;
+		if (has_mask) {
+			const float* mr = readable_row(m, settings.mask_channel, area.x(), y);
+			bool any = false;
+			for (int i = 0; i < w; i++) {
+				float v = mr[i] * mix;
+				weight[i] = v > 0.0f ? (v < 1.0f ? v : 1.0f) : 0.0f;
+				any = any || weight[i] > 0.0f;
+			}
+			if (!any)
+				continue;
+			wt = weight.data();
+		}
+
+		if (!color) {
+			foreach(z, blend) {
+				const float* pa = readable_row(a, z, area.x(), y);
+				const float* pb = readable_row(b, z, area.x(), y);
+				float* po = writable_row(out, z, area.x(), y);
+				kernels.blend_row(&pa, &pb, &po, 1, n, area.x(), y, dissolve_key);
+			}
+		}
+		else if (uses_rgb(blend)) {
+			// the kernel writes all of rgb, only the blended ones are copied out
+			const float* pa[3] = { readable_row(a, Chan_Red, area.x(), y), readable_row(a, Chan_Green, area.x(), y),
+				readable_row(a, Chan_Blue, area.x(), y) };
+			const float* pb[3] = { readable_row(b, Chan_Red, area.x(), y), readable_row(b, Chan_Green, area.x(), y),
+				readable_row(b, Chan_Blue, area.x(), y) };
+			float* po[3] = { &rgb[0], &rgb[(size_t)n], &rgb[(size_t)n * 2] };
+			kernels.blend_row(pa, pb, po, 3, n, area.x(), y, dissolve_key);
+			foreach(z, blend) {
+				if (z >= Chan_Red && z <= Chan_Blue)
+					memcpy(writable_row(out, z, area.x(), y), po[z - Chan_Red], (size_t)n * sizeof(float));
+			}
+		}
+
+		// mode layers, back to back on the same stripe data
+		if (layers.size()) {
+			int x0 = area.x();
+			settings.blend_mode_layers(layers, [&](Channel z) { return readable_row(a, z, x0, y); },
+				[&](Channel z) { return readable_row(b, z, x0, y); }, [&](Channel z) { return writable_row(out, z, x0, y); },
+				n, x0, y, wt, mix, dissolve_key);
+		}
+
+		// mix back towards A, same formula as PhotoshopMerge
+		if (!wt && mix >= 1.0f)
+			continue;
+		foreach(z, blend) {
+			const float* pa = readable_row(a, z, area.x(), y);
+			float* po = writable_row(out, z, area.x(), y);
+			if (!wt) {
+				for (int i = 0; i < n; i++)
+					po[i] = pa[i] + (po[i] - pa[i]) * mix;
+				continue;
+			}
+			for (int i = 0; i < n; i++) {
+				if (wt[i] <= 0.0f)
+					po[i] = pa[i];
+				else if (wt[i] < 1.0f)
+					po[i] = pa[i] + (po[i] - pa[i]) * wt[i];
+			}
+		}
+		if (aborted())
+			return;
+	}
+}
+
+void PhotoshopMergePlanar::knobs(Knob_Callback f)
+{
+	settings.knobs(f);
+	Int_knob(f, &stripe_rows, "stripeHeight", "stripe height");
+	Tooltip(f, "Rows rendered per stripe. Taller stripes mean fewer, larger fetches and longer kernel runs, "
+		"at the cost of more memory per thread.");
+}
+
+static Iop* build(Node* node) { return new PhotoshopMergePlanar(node); }
+
+const Iop::Description PhotoshopMergePlanar::d("PhotoshopMergePlanar", "PhotoshopMergePlanar", build);
@@ -0,0 +1,353 @@
+// ========================================
+// PhotoshopMerge (按行, PixelIop) 和 PhotoshopMergePlanar (按 tile, PlanarIop) 共用的
+// 参数、旋钮和内核选择. 两个节点的旋钮名字和顺序完全相同, 脚本里换一下节点类
+// 就能在两种引擎之间做对比, 结果逐位相同. PhotoshopDeepMerge (深度图, 按样本) 也用同一套.
+// modeLayers 里列出的模式用同一次取到的 A / B 各算一遍, 写进各自的 ps_<mode> 层,
+// 对比外观时不必为每种模式再接一个节点、重新取一遍输入.
+// ========================================
+#pragma once
+#include <cmath>
+#include <cstring>
+#include <string>
+#include <vector>
+#include "DDImage/Iop.h"
+#include "DDImage/Knobs.h"
+#include "core/psBlend.h"
+#include "core/psExpr.h"
+#include "core/psImage.h"
+#include "core/psMask.h"
+#include "psNukeCommon.h"
+
+struct MergeSettings {
+	int blend_mode;
+	// channels the blend applies to, the rest are copied from A
+	DD::Image::ChannelSet blend_channels;
+	DD::Image::Channel mask_channel;
+	// mix: result = A + (blend - A) * mask * opacity
+	float opacity;
+	// dissolve: per-pixel hash of (x, y, frame, seed), same result for any row or tile order
+	float dissolve_amount;
+	int dissolve_seed;
+	// quantize to 8 bits and look up Photoshop's 8-bit formulas in the shared tables (core/psLut8.h)
+	bool parity8;
+	// photoshopMergeTool::BlendMath: legacy 0..255 formulas, or native 0..1 clamped / hdr
+	int math;
+	// photoshopMergeTool::SoftLightPrecision, only used by soft light
+	int soft_light;
+	// custom mode: formula in a and b, and its bytecode compiled in _validate
+	std::string expression;
+	photoshopMergeTool::BlendExpr expr;
+	// extra modes, each blended into its own layer (rgba.red -> ps_screen.red) from the same A / B data
+	std::string mode_layer_text;
+	struct ModeLayer {
+		int mode;
+		photoshopMergeTool::PsMode kind;
+		photoshopMergeTool::ImageKernels kernels;
+		// blend channel -> the same channel in this layer, in blend channel order
+		std::vector<DD::Image::Channel> src;
+		std::vector<DD::Image::Channel> dst;
+	};
+	std::vector<ModeLayer> mode_layers;
+	// every channel of every mode layer
+	DD::Image::ChannelSet mode_channels;
+
+	MergeSettings()
+		: blend_mode(photoshopMergeTool::Normal), blend_channels(DD::Image::Mask_RGBA),
+		mask_channel(DD::Image::Chan_Alpha), opacity(1.0f), dissolve_amount(0.5f), dissolve_seed(0),
+		parity8(false), math(photoshopMergeTool::MathLegacy),
+		soft_light(photoshopMergeTool::SoftLightExact), expression("b")
+	{
+	}
+
+	// opacity as a 0..1 weight
+	float mix() const { return opacity < 1.0f ? opacity : 1.0f; }
+
+	// once per _validate, before select: build the mode layers and parse the expression when custom mode
+	// is used and its text changed since the last successful compile.
+	// false with a message on an unknown mode or a syntax error, the old program is kept
+	bool prepare(std::string* error)
+	{
+		if (!parse_mode_layers(error))
+			return false;
+		bool custom = blend_mode == photoshopMergeTool::Custom;
+		for (size_t i = 0; i < mode_layers.size(); i++)
+			custom = custom || mode_layers[i].mode == photoshopMergeTool::Custom;
+		if (!custom || (!expr.empty() && expr.text() == expression))
+			return true;
+		std::string message;
+		if (expr.compile(expression, &message))
+			return true;
+		*error = "expression: " + message;
+		return false;
+	}
+
+	bool parse_mode_layers(std::string* error)
+	{
+		using namespace DD::Image;
+		mode_layers.clear();
+		mode_channels.clear();
+		const char* sep = " \t\n,;";
+		size_t pos = mode_layer_text.find_first_not_of(sep);
+		while (pos != std::string::npos) {
+			size_t end = mode_layer_text.find_first_of(sep, pos);
+			std::string name = mode_layer_text.substr(pos, end == std::string::npos ? std::string::npos : end - pos);
+			pos = mode_layer_text.find_first_not_of(sep, end);
+			int mode = -1;
+			for (int m = 0; photoshopMergeTool::blendModeNames[m]; m++) {
+				if (name == photoshopMergeTool::blendModeNames[m])
+					mode = m;
+			}
+			if (mode < 0) {
+				*error = "modeLayers: unknown blend mode '" + name + "'";
+				return false;
+			}
+			bool listed = false;
+			for (size_t i = 0; i < mode_layers.size(); i++)
+				listed = listed || mode_layers[i].mode == mode;
+			if (listed)
+				continue;
+			ModeLayer layer;
+			layer.mode = mode;
+			layer.kind = photoshopMergeTool::blend_mode_kind(mode);
+			foreach(z, blend_channels) {
+				// rgba.red -> ps_<mode>.red, other layers keep their channel name too
+				const char* full = getName(z);
+				const char* dot = strrchr(full, '.');
+				std::string channel = std::string("ps_") + photoshopMergeTool::blendModeNames[mode] + "." + (dot ? dot + 1 : full);
+				Channel d = getChannel(channel.c_str());
+				layer.src.push_back(z);
+				layer.dst.push_back(d);
+				mode_channels += d;
+			}
+			mode_layers.push_back(layer);
+		}
+		return true;
+	}
+
+	// the blend channel a mode layer channel is made from, z itself for any other channel
+	DD::Image::Channel source_of(DD::Image::Channel z) const
+	{
+		for (size_t i = 0; i < mode_layers.size(); i++) {
+			for (size_t c = 0; c < mode_layers[i].dst.size(); c++) {
+				if (mode_layers[i].dst[c] == z)
+					return mode_layers[i].src[c];
+			}
+		}
+		return z;
+	}
+
+	// dissolve changes with the frame even when no knob is animated, in the main mode or as a mode layer.
+	// reads the knob text: append runs before _validate has rebuilt mode_layers
+	bool uses_frame() const
+	{
+		if (blend_mode == photoshopMergeTool::Dissolve)
+			return true;
+		const char* sep = " \t\n,;";
+		const char* dissolve = photoshopMergeTool::blendModeNames[photoshopMergeTool::Dissolve];
+		size_t pos = mode_layer_text.find_first_not_of(sep);
+		while (pos != std::string::npos) {
+			size_t end = mode_layer_text.find_first_of(sep, pos);
+			if (mode_layer_text.compare(pos, end == std::string::npos ? std::string::npos : end - pos, dissolve) == 0)
+				return true;
+			pos = mode_layer_text.find_first_not_of(sep, end);
+		}
+		return false;
+	}
+
+	bool layers_use(photoshopMergeTool::PsMode kind) const
+	{
+		for (size_t i = 0; i < mode_layers.size(); i++) {
+			if (mode_layers[i].kind == kind)
+				return true;
+		}
+		return false;
+	}
+
+	// pick the kernels for the current knobs, once per _validate
+	void select(photoshopMergeTool::ImageKernels* kernels, photoshopMergeTool::DissolveKey* key,
+		const DD::Image::OutputContext& context)
+	{
+		kernels->init(blend_mode, parity8, (photoshopMergeTool::BlendMath)math,
+			(photoshopMergeTool::SoftLightPrecision)soft_light);
+		kernels->expr = blend_mode == photoshopMergeTool::Custom ? &expr : NULL;
+		for (size_t i = 0; i < mode_layers.size(); i++) {
+			photoshopMergeTool::ImageKernels& k = mode_layers[i].kernels;
+			k.init(mode_layers[i].mode, parity8, (photoshopMergeTool::BlendMath)math,
+				(photoshopMergeTool::SoftLightPrecision)soft_light);
+			k.expr = mode_layers[i].mode == photoshopMergeTool::Custom ? &expr : NULL;
+		}
+		key->frame = (int)floor(context.frame() + 0.5);
+		key->seed = (unsigned int)dissolve_seed;
+		key->amount = dissolve_amount;
+	}
+
+	// value modes read the same channel from A and B, and only blend channels from B.
+	// color modes need the whole rgb triple as soon as one of it is blended,
+	// and read nothing else from B
+	static DD::Image::ChannelSet reads(photoshopMergeTool::PsMode kind, int input, const DD::Image::ChannelSet& blend)
+	{
+		if (kind != photoshopMergeTool::asColorBlend)
+			return blend;
+		bool rgb = uses_rgb(blend);
+		if (input == 1)
+			return rgb ? DD::Image::ChannelSet(DD::Image::Mask_RGB) : DD::Image::ChannelSet(DD::Image::Mask_None);
+		DD::Image::ChannelSet r(blend);
+		if (rgb)
+			r += DD::Image::Mask_RGB;
+		return r;
+	}
+
+	// what the main mode and the wanted mode layer channels read from input 0 / 1
+	void in_channels(photoshopMergeTool::PsMode kind, int input, DD::Image::ChannelSet& mask) const
+	{
+		DD::Image::ChannelSet blend(mask);
+		blend &= blend_channels;
+		DD::Image::ChannelSet need = reads(kind, input, blend);
+		for (size_t i = 0; i < mode_layers.size(); i++) {
+			const ModeLayer& layer = mode_layers[i];
+			DD::Image::ChannelSet src;
+			for (size_t c = 0; c < layer.dst.size(); c++) {
+				if (mask.contains(layer.dst[c]))
+					src += layer.src[c];
+			}
+			if (src.size())
+				need += reads(layer.kind, input, src);
+		}
+		if (input == 1) {
+			mask = need;
+			return;
+		}
+		mask -= mode_channels;
+		mask += need;
+	}
+
+	// lerp a blended span back towards A: by mix, or by the per-pixel weight w when there is one
+	static void mix_span(const float* a, float* o, int n, const float* w, float mix)
+	{
+		if (!w) {
+			if (mix < 1.0f) {
+				for (int i = 0; i < n; i++)
+					o[i] = a[i] + (o[i] - a[i]) * mix;
+			}
+			return;
+		}
+		photoshopMergeTool::mix_weighted(a, o, n, w);
+	}
+
+	// mode layer channels in 'wanted' over a span of n pixels that input 1 does not cover: a copy of A.
+	// a(z) is the A data of blend channel z at the start of the span, o(z) the output of layer channel z
+	template <class InA, class Out>
+	void copy_mode_layers(const DD::Image::ChannelSet& wanted, InA a, Out o, int n) const
+	{
+		for (size_t i = 0; i < mode_layers.size(); i++) {
+			const ModeLayer& layer = mode_layers[i];
+			for (size_t c = 0; c < layer.dst.size(); c++) {
+				if (wanted.contains(layer.dst[c]))
+					memcpy(o(layer.dst[c]), a(layer.src[c]), (size_t)n * sizeof(float));
+			}
+		}
+	}
+
+	// blend the mode layer channels in 'wanted' over one span [x, x + n) of row y, mode after mode on the same
+	// A / B data, then mix like the main result. b(z) is the B data of blend channel z, w the weights from x or NULL
+	template <class InA, class InB, class Out>
+	void blend_mode_layers(const DD::Image::ChannelSet& wanted, InA a, InB b, Out o, int n, int x, int y,
+		const float* w, float mix, const photoshopMergeTool::DissolveKey& key) const
+	{
+		std::vector<float> unused;
+		for (size_t i = 0; i < mode_layers.size(); i++) {
+			const ModeLayer& layer = mode_layers[i];
+			if (layer.kind != photoshopMergeTool::asColorBlend) {
+				for (size_t c = 0; c < layer.dst.size(); c++) {
+					if (!wanted.contains(layer.dst[c]))
+						continue;
+					const float* pa = a(layer.src[c]);
+					const float* pb = b(layer.src[c]);
+					float* po = o(layer.dst[c]);
+					layer.kernels.blend_row(&pa, &pb, &po, 1, n, x, y, key);
+					mix_span(pa, po, n, w, mix);
+				}
+				continue;
+			}
+			// color modes: rgb together, written where the layer has the channel and it is wanted.
+			// anything else in the layer is A, like the main result
+			float* po[3] = { NULL, NULL, NULL };
+			bool out[3] = { false, false, false };
+			bool any = false;
+			for (size_t c = 0; c < layer.dst.size(); c++) {
+				if (!wanted.contains(layer.dst[c]))
+					continue;
+				DD::Image::Channel z = layer.src[c];
+				if (z >= DD::Image::Chan_Red && z <= DD::Image::Chan_Blue) {
+					po[z - DD::Image::Chan_Red] = o(layer.dst[c]);
+					out[z - DD::Image::Chan_Red] = true;
+					any = true;
+				}
+				else
+					memcpy(o(layer.dst[c]), a(z), (size_t)n * sizeof(float));
+			}
+			if (!any)
+				continue;
+			for (int c = 0; c < 3; c++) {
+				if (!po[c]) {
+					unused.resize((size_t)n);
+					po[c] = unused.data();
+				}
+			}
+			const float* pa[3] = { a(DD::Image::Chan_Red), a(DD::Image::Chan_Green), a(DD::Image::Chan_Blue) };
+			const float* pb[3] = { b(DD::Image::Chan_Red), b(DD::Image::Chan_Green), b(DD::Image::Chan_Blue) };
+			layer.kernels.blend_row(pa, pb, po, 3, n, x, y, key);
+			for (int c = 0; c < 3; c++) {
+				if (out[c])
+					mix_span(pa[c], po[c], n, w, mix);
+			}
+		}
+	}
+
+	void knobs(DD::Image::Knob_Callback f)
+	{
+		using namespace DD::Image;
+		CascadingEnumeration_knob(f, &blend_mode, &photoshopMergeTool::blendModeNames[0], "blendMode");
+		Input_ChannelSet_knob(f, &blend_channels, 0, "blendChannels", "blend channels");
+		Tooltip(f, "Channels the blend mode is applied to. All other channels are copied from A "
+			"without fetching B. Color modes always blend red, green and blue together.");
+		Input_Channel_knob(f, &mask_channel, 1, 2, "maskChannel", "mask");
+		Tooltip(f, "Channel of the mask input that scales the blend. Pixels where it is 0 are A, "
+			"and rows that are fully masked off never fetch B.");
+		Float_knob(f, &opacity, IRange(0, 1), "opacity");
+		Tooltip(f, "Mix between A (0) and the blended result (1).");
+		String_knob(f, &expression, "expression");
+		Tooltip(f, "Custom mode: the result as a formula of a (input A) and b (input B), per channel on 0..1 values. "
+			"Operators + - * / ^ < <= > >= == != and c ? x : y, functions min, max, abs, sqrt, pow, "
+			"clamp(x), clamp(x, lo, hi) and lerp(x, y, t). Exponents must be constant integers up to 16, or 0.5. "
+			"Example, overlay: a <= 0.5 ? 2*a*b : 1 - 2*(1-a)*(1-b)\n"
+			"The result is not clamped and ignores math and 8-bit parity; wrap it in clamp() when needed.");
+		Float_knob(f, &dissolve_amount, IRange(0, 1), "dissolve");
+		Tooltip(f, "Dissolve mode: fraction of pixels taken from B.");
+		Int_knob(f, &dissolve_seed, "seed");
+		Tooltip(f, "Dissolve mode: pattern seed. The pattern only depends on the pixel position, "
+			"frame and seed, so re-renders are identical.");
+		Enumeration_knob(f, &math, &photoshopMergeTool::blendMathNames[0], "math");
+		Tooltip(f, "legacy: the original formulas on a 0..255 scale, clamped (default, matches older scripts).\n"
+			"clamped: the same modes computed directly on 0..1 and clamped to 0..1, like Photoshop.\n"
+			"hdr: computed on 0..1 without clamping, so scene-linear highlights above 1 survive the merge. "
+			"Values outside 0..1 follow well-defined extensions of each mode instead of being cut off.\n"
+			"Ignored with 8-bit parity.");
+		Enumeration_knob(f, &soft_light, &photoshopMergeTool::softLightPrecisionNames[0], "softLight", "soft light");
+		Tooltip(f, "Soft light only.\n"
+			"exact: the same formula as the other modes.\n"
+			"accurate: divisions by constants become multiplications; differs from exact only by rounding "
+			"(under 1e-6) and is about twice as fast with legacy math.\n"
+			"Ignored with 8-bit parity.");
+		String_knob(f, &mode_layer_text, "modeLayers", "mode layers");
+		Tooltip(f, "Extra blend modes to output at the same time, e.g. \"multiply screen overlay\". Each one is blended "
+			"from the same A and B data into its own layer named ps_<mode> (ps_multiply.red, ...), with the same "
+			"blend channels, mask, opacity and settings as the main result. Use it to compare looks or build "
+			"contact sheets without one node, and one fetch of the inputs, per mode.");
+		Bool_knob(f, &parity8, "parity8", "8-bit parity");
+		Tooltip(f, "Quantize A and B to 8 bits and look the result up in precomputed 256x256 tables built from "
+			"Photoshop's 8-bit blend formulas (divide by 255, rounded once) instead of the legacy ones. "
+			"The result is quantized too. Color modes only quantize their inputs and output. "
+			"Checked against the published formulas, not against Photoshop renders.");
+	}
+};
@@ -0,0 +1,12 @@
+// ========================================
+// PhotoshopMerge / PhotoshopMergePlanar / PhotoshopLayerStack 共用的 DDImage 小工具.
+// ========================================
+#pragma once
+#include "DDImage/ChannelSet.h"
+
+// color modes blend red, green and blue together
+inline bool uses_rgb(const DD::Image::ChannelSet& channels)
+{
+	return channels.contains(DD::Image::Chan_Red) || channels.contains(DD::Image::Chan_Green)
+		|| channels.contains(DD::Image::Chan_Blue);
+}
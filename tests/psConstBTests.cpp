@@ -0,0 +1,90 @@
+// ========================================
+// 常数 B (纯色层) 的内核与普通内核逐位相同: 每种模式 x 数值域 x 指令集,
+// B 取 0 / 1 这些公式分段的边界和 0..1 以外的值. ImageKernels 遇到整行相同的 B 时也要一致.
+// ========================================
+#include "psTest.h"
+#include "psImage.h"
+
+namespace {
+	void test_kernels(const Planes& p)
+	{
+		static const float consts[] = { 0.0f, 0.25f, 0.5f, 0.75f, 1.0f, 1.2f, -0.2f };
+		std::vector<float> bb[3], ref[3], out[3];
+		for (int c = 0; c < 3; c++) {
+			bb[c].resize(kWidth);
+			ref[c].resize(kWidth);
+			out[c].resize(kWidth);
+		}
+		const float* a[3] = { p.a[0].data(), p.a[1].data(), p.a[2].data() };
+		const float* b[3] = { bb[0].data(), bb[1].data(), bb[2].data() };
+		float* r[3] = { ref[0].data(), ref[1].data(), ref[2].data() };
+		float* o[3] = { out[0].data(), out[1].data(), out[2].data() };
+		std::vector<SimdLevel> levels = vector_levels();
+		levels.insert(levels.begin(), SimdScalar);
+		for (float k : consts) {
+			float color[3] = { k, 1.0f - k, k * 0.5f };
+			for (int c = 0; c < 3; c++)
+				std::fill(bb[c].begin(), bb[c].end(), color[c]);
+			for (int mode = Normal; mode < Dissolve; mode++) {
+				PsMode kind = blend_mode_kind(mode);
+				for (int math = MathLegacy; math <= MathHdr; math++) {
+					if (kind == asColorBlend)
+						color_row_kernel(mode, (BlendMath)math, SimdScalar)(a, b, r, kWidth);
+					else
+						value_row_kernel(mode, (BlendMath)math, SimdScalar)(a[0], b[0], r[0], kWidth);
+					for (SimdLevel level : levels) {
+						if (kind == asColorBlend)
+							const_color_row_kernel(mode, (BlendMath)math, level)(a, color, o, kWidth);
+						else
+							const_row_kernel(mode, k, (BlendMath)math, level)(a[0], k, o[0], kWidth);
+						for (int c = 0; c < (kind == asColorBlend ? 3 : 1); c++) {
+							int i = first_diff(r[c], o[c], kWidth);
+							expect(i < 0, format("%s / %s / %s: constant B %g differs at %d", blendModeNames[mode],
+								blendMathNames[math], simd_level_name(level), k, i));
+						}
+					}
+				}
+			}
+		}
+	}
+
+	// ImageKernels::blend_row 发现 B 整行相同时换成常数 B 内核, 结果不变
+	void test_image_kernels(const Planes& p)
+	{
+		std::vector<float> bb[3];
+		OutPlanes ref, out;
+		const float color[3] = { 0.3f, 0.9f, 1.0f };
+		for (int c = 0; c < 3; c++)
+			bb[c].assign(kWidth, color[c]);
+		const float* a[3] = { p.a[0].data(), p.a[1].data(), p.a[2].data() };
+		const float* b[3] = { bb[0].data(), bb[1].data(), bb[2].data() };
+		DissolveKey key = { 0, 0, 0.5f };
+		for (int mode = Normal; mode < Dissolve; mode++) {
+			bool color_mode = blend_mode_kind(mode) == asColorBlend;
+			for (int math = MathLegacy; math <= MathHdr; math++) {
+				if (color_mode) {
+					color_row_kernel(mode, (BlendMath)math)(a, b, ref.p, kWidth);
+				} else {
+					for (int c = 0; c < 3; c++)
+						value_row_kernel(mode, (BlendMath)math)(a[c], b[c], ref.p[c], kWidth);
+				}
+				ImageKernels k;
+				k.init(mode, false, (BlendMath)math);
+				k.blend_row(a, b, out.p, 3, kWidth, 0, 0, key);
+				for (int c = 0; c < 3; c++) {
+					int i = first_diff(ref.p[c], out.p[c], kWidth);
+					expect(i < 0, format("%s / %s: blend_row with a uniform B differs in channel %d at %d",
+						blendModeNames[mode], blendMathNames[math], c, i));
+				}
+			}
+		}
+	}
+}
+
+int main()
+{
+	Planes p;
+	test_kernels(p);
+	test_image_kernels(p);
+	return test_result("psConstBTests");
+}
@@ -0,0 +1,151 @@
+// ========================================
+// 深度样本池 (psDeep.h): 按样本数排好的位置、平面互不重叠、按像素展开, 以及内存的复用和释放.
+// ========================================
+#include "psTest.h"
+#include "psDeep.h"
+
+namespace {
+	// 位置和每个像素的样本数与 counts 一致
+	bool check_layout(const DeepSamples& d, const std::vector<uint32_t>& counts, int channels, std::string* why)
+	{
+		if (d.pixels() != (int)counts.size() || d.channels() != channels) {
+			*why = format("%d pixels, %d channels", d.pixels(), d.channels());
+			return false;
+		}
+		size_t total = 0;
+		for (int p = 0; p < (int)counts.size(); p++) {
+			if (d.offset(p) != total || d.count(p) != (int)counts[p]) {
+				*why = format("pixel %d: offset %d, count %d, expected %d, %d", p, (int)d.offset(p), d.count(p), (int)total, (int)counts[p]);
+				return false;
+			}
+			total += counts[p];
+		}
+		if (d.samples() != total) {
+			*why = format("%d samples, expected %d", (int)d.samples(), (int)total);
+			return false;
+		}
+		return true;
+	}
+
+	// 每个平面写满不同的值再读回: 平面之间不重叠, 起点对齐到 16 个 float
+	bool check_planes(DeepSamples& d, std::string* why)
+	{
+		for (int c = 0; c < d.channels(); c++) {
+			if ((d.plane(c) - d.plane(0)) % 16) {
+				*why = format("plane %d starts %d floats after plane 0", c, (int)(d.plane(c) - d.plane(0)));
+				return false;
+			}
+			for (size_t s = 0; s < d.samples(); s++)
+				d.plane(c)[s] = (float)(c * 100000 + (int)s);
+		}
+		for (int c = 0; c < d.channels(); c++) {
+			for (size_t s = 0; s < d.samples(); s++) {
+				if (d.plane(c)[s] != (float)(c * 100000 + (int)s)) {
+					*why = format("plane %d sample %d was overwritten", c, (int)s);
+					return false;
+				}
+			}
+		}
+		return true;
+	}
+
+	void test_shape()
+	{
+		// 含没有样本的像素, 开头和结尾也有
+		std::vector<uint32_t> counts = { 0, 3, 1, 0, 0, 17, 2, 0 };
+		DeepSamples d;
+		expect(d.samples() == 0 && d.pixels() == 0, "an empty pool has no samples");
+		d.shape(counts.data(), (int)counts.size(), 4);
+		std::string why;
+		bool ok = check_layout(d, counts, 4, &why);
+		expect(ok, format("shape: %s", why.c_str()));
+		ok = check_planes(d, &why);
+		expect(ok, format("shape planes: %s", why.c_str()));
+
+		// 随机的样本数, 包括很多个全空的像素
+		std::mt19937 rng(7);
+		for (int round = 0; round < 20; round++) {
+			int pixels = (int)(rng() % 300);
+			std::vector<uint32_t> c(pixels);
+			for (int p = 0; p < pixels; p++)
+				c[p] = rng() % 3 ? rng() % 40 : 0;
+			int channels = 1 + (int)(rng() % 5);
+			d.shape(c.data(), pixels, channels);
+			ok = check_layout(d, c, channels, &why);
+			expect(ok, format("random shape %d: %s", round, why.c_str()));
+			ok = check_planes(d, &why);
+			expect(ok, format("random shape %d planes: %s", round, why.c_str()));
+		}
+
+		d.shape(counts.data(), 0, 2);
+		expect(d.pixels() == 0 && d.samples() == 0, format("zero pixels: %d samples", (int)d.samples()));
+	}
+
+	void test_reuse_and_trim()
+	{
+		std::vector<uint32_t> big(100, 50);
+		std::vector<uint32_t> small(10, 2);
+		DeepSamples d;
+		d.shape(big.data(), (int)big.size(), 4);
+		const float* data = d.plane(0);
+		size_t bytes = d.capacity_bytes();
+		expect(bytes >= 100 * 50 * 4 * sizeof(float), format("capacity %d bytes is below the samples", (int)bytes));
+
+		// 样本变少时不重新分配
+		d.shape(small.data(), (int)small.size(), 4);
+		std::string why;
+		bool ok = check_layout(d, small, 4, &why);
+		expect(ok, format("smaller shape: %s", why.c_str()));
+		expect(d.plane(0) == data && d.capacity_bytes() == bytes, "a smaller shape reallocated");
+
+		// 占用没超过时 trim 不动
+		d.trim(bytes);
+		expect(d.plane(0) == data && d.samples() == small.size() * 2, "trim below the limit released the pool");
+		d.trim(bytes - 1);
+		expect(d.capacity_bytes() == 0 && d.samples() == 0 && d.pixels() == 0,
+			format("trim: %d bytes, %d samples left", (int)d.capacity_bytes(), (int)d.samples()));
+
+		// trim 之后还能接着用
+		d.shape(small.data(), (int)small.size(), 3);
+		ok = check_layout(d, small, 3, &why) && check_planes(d, &why);
+		expect(ok, format("shape after trim: %s", why.c_str()));
+	}
+
+	void test_shape_like_and_spread()
+	{
+		std::vector<uint32_t> counts = { 2, 0, 5, 1, 0, 3 };
+		DeepSamples a;
+		a.shape(counts.data(), (int)counts.size(), 4);
+		DeepSamples b;
+		b.shape_like(a, 2);
+		std::string why;
+		bool ok = check_layout(b, counts, 2, &why);
+		expect(ok, format("shape_like: %s", why.c_str()));
+		ok = check_planes(b, &why);
+		expect(ok, format("shape_like planes: %s", why.c_str()));
+
+		// 每个像素的值展开到它所有的样本上, 其余通道不变
+		const float per_pixel[] = { 0.5f, 9.0f, -1.0f, 2.0f, 9.0f, 0.25f };
+		for (size_t s = 0; s < b.samples(); s++)
+			b.plane(0)[s] = 7.0f;
+		b.spread(1, per_pixel);
+		for (int p = 0; p < b.pixels(); p++) {
+			for (int s = 0; s < b.count(p); s++) {
+				float v = b.plane(1)[b.offset(p) + s];
+				expect(v == per_pixel[p], format("spread: pixel %d sample %d is %g, expected %g", p, s, v, per_pixel[p]));
+			}
+		}
+		bool untouched = true;
+		for (size_t s = 0; s < b.samples(); s++)
+			untouched = untouched && b.plane(0)[s] == 7.0f;
+		expect(untouched, "spread wrote another plane");
+	}
+}
+
+int main()
+{
+	test_shape();
+	test_reuse_and_trim();
+	test_shape_like_and_spread();
+	return test_result("psDeepTests");
+}
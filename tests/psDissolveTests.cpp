@@ -0,0 +1,83 @@
+// ========================================
+// 溶解: 各指令集与标量相同, 取 B 的像素与 dissolve_pick_b 一致;
+// 取 B 的比例接近 amount, 结果只由 (x, y, frame, seed) 决定.
+// ========================================
+#include "psTest.h"
+
+namespace {
+	void test_kernels(const Planes& p)
+	{
+		std::vector<float> ref(kWidth), out(kWidth);
+		const float* a = p.a[0].data();
+		const float* b = p.b[0].data();
+		DissolveKey key;
+		key.frame = 12;
+		key.seed = 7;
+		key.amount = 0.4f;
+		for (int y = 0; y < 3; y++) {
+			dissolve_row_kernel(SimdScalar)(a, b, ref.data(), kWidth, -5, y, key);
+			bool agree = true;
+			for (int i = 0; i < kWidth; i++)
+				agree = agree && same(ref[i], dissolve_pick_b(i - 5, y, key) ? b[i] : a[i]);
+			expect(agree, format("dissolve row %d: scalar kernel disagrees with dissolve_pick_b", y));
+			for (SimdLevel level : vector_levels()) {
+				dissolve_row_kernel(level)(a, b, out.data(), kWidth, -5, y, key);
+				int i = first_diff(ref.data(), out.data(), kWidth);
+				expect(i < 0, format("dissolve / %s: row %d differs from scalar at %d", simd_level_name(level), y, i));
+			}
+		}
+	}
+
+	// 256 x 256 个像素里取 B 的比例; amount 为 0 / 1 时一个都不取 / 全取
+	void test_amount()
+	{
+		const float amounts[] = { 0.0f, 0.1f, 0.5f, 0.9f, 1.0f };
+		for (float amount : amounts) {
+			DissolveKey key;
+			key.frame = 3;
+			key.seed = 99;
+			key.amount = amount;
+			int picked = 0;
+			for (int y = 0; y < 256; y++) {
+				for (int x = 0; x < 256; x++)
+					picked += dissolve_pick_b(x, y, key) ? 1 : 0;
+			}
+			double rate = picked / 65536.0;
+			bool ok = amount == 0.0f ? picked == 0 : amount == 1.0f ? picked == 65536 : std::fabs(rate - amount) < 0.01;
+			expect(ok, format("dissolve amount %g: picked B for %.4f of the pixels", amount, rate));
+		}
+	}
+
+	// 换一帧或换一个种子, 图案不同; 同样的参数总是同样的图案
+	void test_key()
+	{
+		DissolveKey k0, k1, k2;
+		k0.frame = 1;
+		k0.seed = 5;
+		k0.amount = 0.5f;
+		k1 = k0;
+		k1.frame = 2;
+		k2 = k0;
+		k2.seed = 6;
+		int same_frame = 0, same_seed = 0;
+		bool repeat = true;
+		for (int x = 0; x < 4096; x++) {
+			bool p0 = dissolve_pick_b(x, 17, k0);
+			same_frame += p0 == dissolve_pick_b(x, 17, k1) ? 1 : 0;
+			same_seed += p0 == dissolve_pick_b(x, 17, k2) ? 1 : 0;
+			repeat = repeat && p0 == dissolve_pick_b(x, 17, k0);
+		}
+		expect(repeat, "dissolve: the same key gave a different pattern");
+		// 两个独立的图案大约一半相同
+		expect(same_frame < 2400 && same_seed < 2400, format("dissolve: frame / seed change kept %d / %d of 4096 pixels", same_frame, same_seed));
+	}
+}
+
+int main()
+{
+	Planes p;
+	test_kernels(p);
+	test_amount();
+	test_key();
+	return test_result("psDissolveTests");
+}
@@ -0,0 +1,152 @@
+// ========================================
+// 自定义公式 (psExpr.h): 编译、求值 (各指令集逐位相同, 与直接计算接近)、报错;
+// 套得很深或很长的公式编译失败并给出位置, 不会把栈用完.
+// ========================================
+#include "psTest.h"
+#include "psExpr.h"
+
+namespace {
+	struct ExprCase {
+		const char* text;
+		float (*f)(float a, float b);
+	};
+
+	void test_expressions(const Planes& p)
+	{
+		static const ExprCase cases[] = {
+			{ "b", [](float, float b) { return b; } },
+			{ "a * b", [](float a, float b) { return a * b; } },
+			{ "A + B / 2", [](float a, float b) { return a + b / 2; } },
+			{ "1 - (1 - a) * (1 - b)", [](float a, float b) { return 1 - (1 - a) * (1 - b); } },
+			{ "a <= 0.5 ? 2*a*b : 1 - 2*(1-a)*(1-b)", [](float a, float b) { return a <= 0.5f ? 2 * a * b : 1 - 2 * (1 - a) * (1 - b); } },
+			{ "clamp(a + b)", [](float a, float b) { float v = a + b; return v < 0 ? 0.0f : (v > 1 ? 1.0f : v); } },
+			{ "clamp(a - b, -0.25, 0.5)", [](float a, float b) { float v = a - b; return v < -0.25f ? -0.25f : (v > 0.5f ? 0.5f : v); } },
+			{ "min(a, b) + max(a, b) * 0.5", [](float a, float b) { return std::min(a, b) + std::max(a, b) * 0.5f; } },
+			{ "abs(a - b)", [](float a, float b) { return std::fabs(a - b); } },
+			{ "lerp(a, b, 0.25)", [](float a, float b) { return a + (b - a) * 0.25f; } },
+			{ "a ^ 3 - pow(b, 2)", [](float a, float b) { return a * a * a - b * b; } },
+			{ "sqrt(abs(a)) + abs(b) ^ 0.5", [](float a, float b) { return std::sqrt(std::fabs(a)) + std::sqrt(std::fabs(b)); } },
+			{ "-a + (a > b) - (a == b)", [](float a, float b) { return -a + (a > b ? 1.0f : 0.0f) - (a == b ? 1.0f : 0.0f); } },
+			{ "2 + 3 * 4", [](float, float) { return 14.0f; } },
+		};
+		std::vector<float> ref(kWidth), out(kWidth);
+		const float* a = p.a[0].data();
+		const float* b = p.b[0].data();
+		for (const ExprCase& t : cases) {
+			BlendExpr e;
+			std::string err;
+			bool ok = e.compile(t.text, &err);
+			expect(ok, format("expression '%s' does not compile: %s", t.text, err.c_str()));
+			if (!ok)
+				continue;
+			e.run(a, b, ref.data(), kWidth, SimdScalar);
+			int bad = -1;
+			for (int i = 0; i < kWidth && bad < 0; i++) {
+				float want = t.f(a[i], b[i]);
+				if (!(std::fabs(ref[i] - want) <= 1e-5f * (1.0f + std::fabs(want))))
+					bad = i;
+			}
+			expect(bad < 0, format("expression '%s': %g at a=%g b=%g", t.text, bad < 0 ? 0.0 : ref[bad],
+				bad < 0 ? 0.0 : a[bad], bad < 0 ? 0.0 : b[bad]));
+			for (SimdLevel level : vector_levels()) {
+				e.run(a, b, out.data(), kWidth, level);
+				int i = first_diff(ref.data(), out.data(), kWidth);
+				expect(i < 0, format("expression '%s' / %s: differs from scalar at %d", t.text, simd_level_name(level), i));
+			}
+		}
+
+		// 常量折叠成一条指令
+		BlendExpr folded;
+		expect(folded.compile("2 + 3 * 4", NULL) && folded.size() == 1, "constant expression is not folded to one instruction");
+
+		// 没有编译过时与正常模式相同
+		BlendExpr none;
+		none.run(a, b, out.data(), kWidth);
+		expect(first_diff(b, out.data(), kWidth) < 0, "an empty expression does not return b");
+
+		// 出错时给出说明, 原来的程序不变
+		static const char* const errors[] = {
+			"", "a +", "(a * b", "a * b)", "c", "foo(a)", "min(a)", "a ^ 1.5", "a ? b", "1 2", "a $ b",
+		};
+		BlendExpr e;
+		e.compile("a * b", NULL);
+		for (const char* text : errors) {
+			std::string err;
+			bool ok = e.compile(text, &err);
+			expect(!ok, format("expression '%s' compiles, expected an error", text));
+			expect(ok || !err.empty(), format("expression '%s': no error message", text));
+		}
+		expect(e.text() == "a * b", "a failed compile replaced the previous expression");
+		e.run(a, b, out.data(), kWidth);
+		bool kept = true;
+		for (int i = 0; i < kWidth; i++)
+			kept = kept && same(out[i], a[i] * b[i]);
+		expect(kept, "a failed compile changed the previous program");
+
+		// 栈超过 kMaxExprStack 层的公式编译失败. min 的两边不交换顺序, 每套一层栈深一层
+		std::string deep = "b";
+		for (int i = 0; i < kMaxExprStack + 2; i++)
+			deep = "min(a, " + deep + ")";
+		std::string err;
+		BlendExpr d;
+		expect(!d.compile(deep, &err) && !err.empty(), "a too deeply nested expression compiles");
+	}
+
+	bool fails_with(const std::string& text, const char* what, std::string* err)
+	{
+		BlendExpr e;
+		return !e.compile(text, err) && err->find(what) != std::string::npos;
+	}
+
+	// 解析和生成字节码都是递归的: 括号、一元运算符、^、? : 和长的左结合链都有上限
+	void test_nesting()
+	{
+		for (int n : { 5000, 200000 }) {
+			std::string err;
+			std::string parens(n, '(');
+			expect(fails_with(parens + "a" + std::string(n, ')'), "too deeply nested", &err),
+				format("%d nested parentheses: '%s'", n, err.c_str()));
+			// 第 64 个括号之后超过 kMaxExprNesting
+			expect(err.find("at column 65") != std::string::npos, format("%d nested parentheses: error at the wrong place: '%s'", n, err.c_str()));
+			expect(fails_with(std::string(n, '-') + "a", "too deeply nested", &err), format("%d unary minus: '%s'", n, err.c_str()));
+			expect(fails_with(parens, "too deeply nested", &err), format("%d unclosed parentheses: '%s'", n, err.c_str()));
+
+			std::string ternary, chain = "a", power = "a", calls;
+			for (int i = 0; i < n; i++) {
+				ternary += "a ? b : ";
+				chain += "+a";
+				power += "^1";
+				calls += "abs(";
+			}
+			expect(fails_with(ternary + "a", "too deeply nested", &err), format("%d nested ? : : '%s'", n, err.c_str()));
+			expect(fails_with(power, "too deeply nested", &err), format("%d chained ^: '%s'", n, err.c_str()));
+			expect(fails_with(calls + "a" + std::string(n, ')'), "too deeply nested", &err), format("%d nested calls: '%s'", n, err.c_str()));
+			// 左结合的 a+a+...+a 解析时不递归, 但树一样高
+			expect(fails_with(chain, "too deeply nested", &err), format("%d-term sum: '%s'", n, err.c_str()));
+		}
+
+		// lerp 复制第一个参数, 套 20 层就有 2^20 个节点
+		std::string lerp = "a";
+		for (int i = 0; i < 20; i++)
+			lerp = "lerp(" + lerp + ", b, 0.5)";
+		std::string err;
+		expect(fails_with(lerp, "too long", &err), format("nested lerp: '%s'", err.c_str()));
+
+		// 上限以内的正常公式不受影响
+		BlendExpr e;
+		std::string ok = std::string(60, '(') + "a * b" + std::string(60, ')');
+		expect(e.compile(ok, &err), "60 nested parentheses: " + err);
+		std::string sum = "a";
+		for (int i = 0; i < 200; i++)
+			sum += i % 2 ? "+a" : "-b";
+		expect(e.compile(sum, &err), "200-term sum: " + err);
+	}
+}
+
+int main()
+{
+	Planes p;
+	test_expressions(p);
+	test_nesting();
+	return test_result("psExprTests");
+}
@@ -0,0 +1,109 @@
+// ========================================
+// 0..1 浮点公式 (MathClamped / MathHdr, psBlendFloat.inl): 超出范围的输入得到有限的结果;
+// clamped 的结果在 0..1 内; 输入和结果都在 0..1 内时 hdr 与 clamped 逐位相同;
+// hdr 让超过 1 的值穿过混合.
+// ========================================
+#include "psTest.h"
+
+namespace {
+
+	// 每种模式 x 数值域: 超出 0..1 的输入得到有限的结果
+	void test_finite(const Planes& p)
+	{
+		OutPlanes ref;
+		const float* a[3] = { p.a[0].data(), p.a[1].data(), p.a[2].data() };
+		const float* b[3] = { p.b[0].data(), p.b[1].data(), p.b[2].data() };
+		for (int mode = Normal; mode < Dissolve; mode++) {
+			bool color = blend_mode_kind(mode) == asColorBlend;
+			for (int math = MathLegacy; math <= MathHdr; math++) {
+				if (color)
+					color_row_kernel(mode, (BlendMath)math, SimdScalar)(a, b, ref.p, kWidth);
+				else
+					value_row_kernel(mode, (BlendMath)math, SimdScalar)(a[0], b[0], ref.p[0], kWidth);
+				for (int c = 0; c < (color ? 3 : 1); c++) {
+					int i = first_non_finite(ref.p[c], kWidth);
+					expect(i < 0, format("%s / %s: scalar result %g at a=%g b=%g is not finite", blendModeNames[mode],
+						blendMathNames[math], i < 0 ? 0.0 : ref.p[c][i], i < 0 ? 0.0 : a[c][i], i < 0 ? 0.0 : b[c][i]));
+				}
+			}
+		}
+	}
+
+	// clamped 的结果截在 0..1 内, 包括超出范围的输入. 正常模式与 legacy 一样原样取 B, 不截断
+	void test_clamped_range(const Planes& p)
+	{
+		OutPlanes out;
+		const float* a[3] = { p.a[0].data(), p.a[1].data(), p.a[2].data() };
+		const float* b[3] = { p.b[0].data(), p.b[1].data(), p.b[2].data() };
+		for (int mode = Darken; mode < Dissolve; mode++) {
+			bool color = blend_mode_kind(mode) == asColorBlend;
+			if (color)
+				color_row_kernel(mode, MathClamped)(a, b, out.p, kWidth);
+			else
+				value_row_kernel(mode, MathClamped)(a[0], b[0], out.p[0], kWidth);
+			for (int c = 0; c < (color ? 3 : 1); c++) {
+				int bad = -1;
+				for (int i = 0; i < kWidth && bad < 0; i++) {
+					if (!(out.p[c][i] >= 0.0f && out.p[c][i] <= 1.0f))
+						bad = i;
+				}
+				expect(bad < 0, format("%s / clamped: %g at %d is outside 0..1", blendModeNames[mode], bad < 0 ? 0.0 : out.p[c][bad], bad));
+			}
+		}
+	}
+
+	// 这些模式在 0..1 的输入上结果也在 0..1 内, hdr 不截断也应与 clamped 逐位相同
+	void test_hdr_matches_clamped()
+	{
+		const int modes[] = { Normal, Darken, Multiply, Lighten, Screen, Overlay, SoftLight, HardLight, Diference, Exclusion };
+		std::mt19937 rng(99);
+		std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+		std::vector<float> a(kWidth), b(kWidth), clamped(kWidth), hdr(kWidth);
+		for (int i = 0; i < kWidth; i++) {
+			a[i] = dist(rng);
+			b[i] = dist(rng);
+		}
+		for (int mode : modes) {
+			value_row_kernel(mode, MathClamped)(a.data(), b.data(), clamped.data(), kWidth);
+			value_row_kernel(mode, MathHdr)(a.data(), b.data(), hdr.data(), kWidth);
+			int i = first_diff(clamped.data(), hdr.data(), kWidth);
+			expect(i < 0, format("%s: hdr differs from clamped on 0..1 inputs at %d", blendModeNames[mode], i));
+		}
+	}
+
+	// 超过 1 的高光穿过 hdr 的混合, clamped 把它截到 1 (正常模式除外)
+	void test_hdr_highlights()
+	{
+		struct Case {
+			int mode;
+			float a, b;
+			float hdr;
+			float clamped;
+		};
+		const Case cases[] = {
+			{ Normal, 0.3f, 4.0f, 4.0f, 4.0f },
+			{ Multiply, 2.0f, 3.0f, 6.0f, 1.0f },
+			{ Darken, 2.0f, 3.0f, 2.0f, 1.0f },
+			{ Lighten, 0.5f, 2.0f, 2.0f, 1.0f },
+			{ LinearDodge, 1.5f, 1.0f, 2.5f, 1.0f },
+			{ Diference, 3.0f, 1.0f, 2.0f, 1.0f },
+		};
+		for (const Case& k : cases) {
+			float r = 0.0f, c = 0.0f;
+			value_row_kernel(k.mode, MathHdr)(&k.a, &k.b, &r, 1);
+			value_row_kernel(k.mode, MathClamped)(&k.a, &k.b, &c, 1);
+			expect(r == k.hdr, format("%s / hdr (%g, %g) = %g, expected %g", blendModeNames[k.mode], k.a, k.b, r, k.hdr));
+			expect(c == k.clamped, format("%s / clamped (%g, %g) = %g, expected %g", blendModeNames[k.mode], k.a, k.b, c, k.clamped));
+		}
+	}
+}
+
+int main()
+{
+	Planes p;
+	test_finite(p);
+	test_clamped_range(p);
+	test_hdr_matches_clamped();
+	test_hdr_highlights();
+	return test_result("psFloatMathTests");
+}
@@ -0,0 +1,206 @@
+// ========================================
+// 色相 / 饱和度 / 颜色 / 亮度: 与按 PDF 1.7 (11.3.5.3) 的 Lum / Sat / ClipColor 写的双精度参考对比,
+// 再核对几个手算的值. A 是下层, B 是上层.
+// ========================================
+#include "psTest.h"
+
+namespace {
+	double lum(const double* c)
+	{
+		return 0.3 * c[0] + 0.59 * c[1] + 0.11 * c[2];
+	}
+
+	double sat(const double* c)
+	{
+		return std::max(std::max(c[0], c[1]), c[2]) - std::min(std::min(c[0], c[1]), c[2]);
+	}
+
+	void clip_color(double* c)
+	{
+		double l = lum(c);
+		double n = std::min(std::min(c[0], c[1]), c[2]);
+		double x = std::max(std::max(c[0], c[1]), c[2]);
+		for (int i = 0; i < 3; i++) {
+			if (n < 0)
+				c[i] = l + (c[i] - l) * l / (l - n);
+		}
+		for (int i = 0; i < 3; i++) {
+			if (x > 1)
+				c[i] = l + (c[i] - l) * (1 - l) / (x - l);
+		}
+	}
+
+	void set_lum(double* c, double l)
+	{
+		double d = l - lum(c);
+		for (int i = 0; i < 3; i++)
+			c[i] += d;
+		clip_color(c);
+	}
+
+	void set_sat(double* c, double s)
+	{
+		double n = std::min(std::min(c[0], c[1]), c[2]);
+		double x = std::max(std::max(c[0], c[1]), c[2]);
+		for (int i = 0; i < 3; i++)
+			c[i] = x > n ? (c[i] - n) * s / (x - n) : 0;
+	}
+
+	// 规范里 Cb 是下层 (A), Cs 是上层 (B)
+	void reference(int mode, const double* a, const double* b, double* r)
+	{
+		switch (mode) {
+		case Hue:
+			std::copy(b, b + 3, r);
+			set_sat(r, sat(a));
+			set_lum(r, lum(a));
+			break;
+		case Saturation:
+			std::copy(a, a + 3, r);
+			set_sat(r, sat(b));
+			set_lum(r, lum(a));
+			break;
+		case Color:
+			std::copy(b, b + 3, r);
+			set_lum(r, lum(a));
+			break;
+		default:
+			std::copy(a, a + 3, r);
+			set_lum(r, lum(b));
+			break;
+		}
+	}
+
+	const int hsl_modes[] = { Hue, Saturation, Color, Luminosity };
+
+	std::vector<SimdLevel> all_levels()
+	{
+		std::vector<SimdLevel> levels = vector_levels();
+		levels.insert(levels.begin(), SimdScalar);
+		return levels;
+	}
+
+	// 0..1 内的随机颜色和参考值比较. legacy 在 0..255 上算, 误差放宽一些
+	void test_reference()
+	{
+		std::mt19937 rng(77);
+		std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+		std::vector<float> a[3], b[3];
+		OutPlanes out;
+		for (int c = 0; c < 3; c++) {
+			a[c].resize(kWidth);
+			b[c].resize(kWidth);
+			for (int i = 0; i < kWidth; i++) {
+				a[c][i] = dist(rng);
+				b[c][i] = dist(rng);
+			}
+		}
+		const float* pa[3] = { a[0].data(), a[1].data(), a[2].data() };
+		const float* pb[3] = { b[0].data(), b[1].data(), b[2].data() };
+		const BlendMath maths[] = { MathClamped, MathLegacy };
+		const double tolerance[] = { 1e-5, 1e-4 };
+		for (int m = 0; m < 2; m++) {
+			for (SimdLevel level : all_levels()) {
+				for (int mode : hsl_modes) {
+					color_row_kernel(mode, maths[m], level)(pa, pb, out.p, kWidth);
+					double worst = 0;
+					int at = 0;
+					for (int i = 0; i < kWidth; i++) {
+						double da[3] = { a[0][i], a[1][i], a[2][i] };
+						double db[3] = { b[0][i], b[1][i], b[2][i] };
+						double r[3];
+						reference(mode, da, db, r);
+						for (int c = 0; c < 3; c++) {
+							double e = std::fabs(out.v[c][i] - std::min(std::max(r[c], 0.0), 1.0));
+							if (!(e <= worst)) {
+								worst = e;
+								at = i;
+							}
+						}
+					}
+					expect(worst <= tolerance[m], format("%s %s %s: off the reference by %g at %d", blendModeNames[mode],
+						blendMathNames[maths[m]], simd_level_name(level), worst, at));
+				}
+			}
+		}
+	}
+
+	struct Known {
+		int mode;
+		float a[3], b[3];
+		float r[3];
+	};
+
+	// 手算的值 (亮度系数 0.3 / 0.59 / 0.11)
+	const Known known[] = {
+		// 灰色 0.5 的亮度放到红色上: (1.2, 0.2, 0.2) 超过 1, 沿亮度拉回
+		{ Color, { 0.5f, 0.5f, 0.5f }, { 1.0f, 0.0f, 0.0f }, { 1.0f, 0.285714f, 0.285714f } },
+		{ Luminosity, { 1.0f, 0.0f, 0.0f }, { 0.5f, 0.5f, 0.5f }, { 1.0f, 0.285714f, 0.285714f } },
+		// 灰色没有饱和度, 结果是 A 亮度的灰色: 0.24 + 0.236 + 0.022
+		{ Saturation, { 0.8f, 0.4f, 0.2f }, { 0.5f, 0.5f, 0.5f }, { 0.498f, 0.498f, 0.498f } },
+		// 蓝色配 A 的饱和度 0.6 是 (0, 0, 0.6), 平移到亮度 0.498 后 B 超过 1 再拉回
+		{ Hue, { 0.8f, 0.4f, 0.2f }, { 0.0f, 0.0f, 1.0f }, { 0.435955f, 0.435955f, 1.0f } },
+		// 同一颜色: 结果不变
+		{ Hue, { 0.8f, 0.4f, 0.2f }, { 0.8f, 0.4f, 0.2f }, { 0.8f, 0.4f, 0.2f } },
+	};
+
+	void test_known()
+	{
+		for (const Known& k : known) {
+			const float* pa[3] = { &k.a[0], &k.a[1], &k.a[2] };
+			const float* pb[3] = { &k.b[0], &k.b[1], &k.b[2] };
+			for (int math = MathLegacy; math <= MathClamped; math++) {
+				float r[3];
+				float* pr[3] = { &r[0], &r[1], &r[2] };
+				color_row_kernel(k.mode, (BlendMath)math)(pa, pb, pr, 1);
+				bool ok = true;
+				for (int c = 0; c < 3; c++)
+					ok = ok && std::fabs(r[c] - k.r[c]) <= 1e-4f;
+				expect(ok, format("%s %s: (%g, %g, %g), expected (%g, %g, %g)", blendModeNames[k.mode], blendMathNames[math],
+					r[0], r[1], r[2], k.r[0], k.r[1], k.r[2]));
+			}
+		}
+	}
+
+	// hdr 不把超过 1 的分量拉回: 灰色 0.5 的亮度放到红色上就是平移后的 (1.2, 0.2, 0.2)
+	void test_hdr()
+	{
+		float a[3] = { 0.5f, 0.5f, 0.5f }, b[3] = { 1.0f, 0.0f, 0.0f }, r[3];
+		const float* pa[3] = { &a[0], &a[1], &a[2] };
+		const float* pb[3] = { &b[0], &b[1], &b[2] };
+		float* pr[3] = { &r[0], &r[1], &r[2] };
+		color_row_kernel(Color, MathHdr)(pa, pb, pr, 1);
+		expect(std::fabs(r[0] - 1.2f) <= 1e-6f && std::fabs(r[1] - 0.2f) <= 1e-6f && std::fabs(r[2] - 0.2f) <= 1e-6f,
+			format("color hdr: (%g, %g, %g), expected (1.2, 0.2, 0.2)", r[0], r[1], r[2]));
+	}
+
+	// 超出 0..1 的输入 (含超出范围的灰色) 不产生 NaN / Inf
+	void test_finite()
+	{
+		Planes in;
+		OutPlanes out;
+		const float* pa[3] = { in.a[0].data(), in.a[1].data(), in.a[2].data() };
+		const float* pb[3] = { in.b[0].data(), in.b[1].data(), in.b[2].data() };
+		for (int math = MathLegacy; math <= MathHdr; math++) {
+			for (SimdLevel level : all_levels()) {
+				for (int mode : hsl_modes) {
+					color_row_kernel(mode, (BlendMath)math, level)(pa, pb, out.p, kWidth);
+					for (int c = 0; c < 3; c++) {
+						int i = first_non_finite(out.p[c], kWidth);
+						expect(i < 0, format("%s %s %s: channel %d not finite at %d", blendModeNames[mode], blendMathNames[math],
+							simd_level_name(level), c, i));
+					}
+				}
+			}
+		}
+	}
+}
+
+int main()
+{
+	test_reference();
+	test_known();
+	test_hdr();
+	test_finite();
+	return test_result("psHslTests");
+}
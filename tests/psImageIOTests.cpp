@@ -0,0 +1,122 @@
+// ========================================
+// PFM / raw 的读写 (io/psImageIO.h): 文件头里的尺寸为负、为 0、超出上限、带其它字符或乘起来溢出时
+// open 拒绝, 不去分配行缓冲; 正常的文件写出再读回, 内容不变.
+// ========================================
+#include "psTest.h"
+#include "io/psImageIO.h"
+
+namespace {
+	// 写一个文件头 + payload 个字节的 PFM, 再用 ScanlineImage 打开
+	bool open_pfm(const std::string& header, size_t payload, const char* name, ScanlineImage* img, std::string* err)
+	{
+		std::string path = std::string("psblend_tests_") + name + ".pfm";
+		FILE* f = fopen(path.c_str(), "wb");
+		if (!f) {
+			expect(false, "cannot write " + path);
+			return false;
+		}
+		fwrite(header.data(), 1, header.size(), f);
+		std::vector<unsigned char> zeros(payload);
+		fwrite(zeros.data(), 1, zeros.size(), f);
+		fclose(f);
+		bool ok = img->open(path, NULL, err);
+		img->close();
+		remove(path.c_str());
+		return ok;
+	}
+
+	void test_bad_headers()
+	{
+		struct Bad {
+			const char* name;
+			const char* header;
+		};
+		const Bad bad[] = {
+			{ "negative", "PF\n-4 4\n-1.0\n" },
+			{ "zero", "PF\n0 4\n-1.0\n" },
+			{ "over_limit", "PF\n300001 1\n-1.0\n" },
+			{ "int_overflow", "PF\n4294967300 1\n-1.0\n" },
+			{ "product", "PF\n300000 300000\n-1.0\n" },
+			{ "junk", "PF\n4x 4\n-1.0\n" },
+			{ "no_size", "PF\n4\n" },
+			{ "magic", "P6\n4 4\n255\n" },
+			{ "short", "PF\n4 4\n-1.0\n" },
+		};
+		for (const Bad& b : bad) {
+			ScanlineImage img;
+			std::string err;
+			// 够 4 x 4 的数据, 但比文件头说的尺寸少
+			bool ok = open_pfm(b.header, strcmp(b.name, "short") == 0 ? 100 : 4 * 4 * 3 * 4, b.name, &img, &err);
+			expect(!ok && !err.empty(), format("PFM %s: opened (%s)", b.name, err.c_str()));
+		}
+
+		// raw 的尺寸由调用方给出, 同样检查
+		RawSpec spec = { kMaxScanlineSide + 1, 1, 1 };
+		ScanlineImage img;
+		std::string err;
+		std::string path = "psblend_tests_raw.raw";
+		FILE* f = fopen(path.c_str(), "wb");
+		if (f) {
+			fputs("0123", f);
+			fclose(f);
+		}
+		expect(!img.open(path, &spec, &err), "raw wider than the limit opened");
+		spec.width = 1;
+		spec.channels = kMaxScanlineChannels + 1;
+		expect(!img.open(path, &spec, &err), "raw with too many channels opened");
+		img.close();
+		remove(path.c_str());
+
+		expect(!img.create("psblend_tests_big.pfm", FormatPFM, kMaxScanlineSide + 1, 1, 3, &err), "create over the limit");
+		remove("psblend_tests_big.pfm");
+	}
+
+	// 小端 RGB 写出再读回
+	void test_round_trip()
+	{
+		const int w = 5, h = 3;
+		std::vector<float> src[3], back[3];
+		for (int c = 0; c < 3; c++) {
+			src[c].resize(w * h);
+			back[c].resize(w * h);
+			for (int i = 0; i < w * h; i++)
+				src[c][i] = c * 100.0f + i * 0.25f - 1.0f;
+		}
+		std::string err;
+		const char* path = "psblend_tests_round_trip.pfm";
+		{
+			ScanlineImage out;
+			bool ok = out.create(path, FormatPFM, w, h, 3, &err);
+			expect(ok, "create: " + err);
+			if (!ok)
+				return;
+			for (int y = 0; y < h; y++) {
+				const float* rows[3] = { &src[0][y * w], &src[1][y * w], &src[2][y * w] };
+				out.write_row(y, rows);
+			}
+			out.close();
+		}
+		ScanlineImage in;
+		bool ok = in.open(path, NULL, &err);
+		expect(ok && in.width() == w && in.height() == h && in.channels() == 3, "reopen: " + err);
+		if (ok) {
+			for (int y = 0; y < h; y++) {
+				float* rows[3] = { &back[0][y * w], &back[1][y * w], &back[2][y * w] };
+				in.read_row(y, rows);
+			}
+			for (int c = 0; c < 3; c++) {
+				int i = first_diff(src[c].data(), back[c].data(), w * h);
+				expect(i < 0, format("round trip: channel %d differs at %d", c, i));
+			}
+		}
+		in.close();
+		remove(path);
+	}
+}
+
+int main()
+{
+	test_bad_headers();
+	test_round_trip();
+	return test_result("psImageIOTests");
+}
@@ -0,0 +1,173 @@
+// ========================================
+// 整张图的混合 (psImage.h) 和线程池 (psThreadPool.h): 每个任务正好执行一次;
+// 不同的 tile 大小和线程数下 blend_image 的结果与逐行调用内核逐位相同.
+// ========================================
+#include <atomic>
+#include <memory>
+#include "psTest.h"
+#include "psImage.h"
+#include "psThreadPool.h"
+
+namespace {
+	void test_pool()
+	{
+		for (int threads : { 1, 2, 4, 7 }) {
+			ThreadPool pool(threads);
+			expect(pool.size() == threads, format("pool of %d has %d threads", threads, pool.size()));
+			for (int count : { 0, 1, 3, 100, 1000 }) {
+				// 同一个池连跑几批, 上一批的状态不能漏到下一批
+				for (int batch = 0; batch < 5; batch++) {
+					std::unique_ptr<std::atomic<int>[]> runs(new std::atomic<int>[count > 0 ? count : 1]);
+					for (int i = 0; i < count; i++)
+						runs[i] = 0;
+					std::atomic<int> bad_worker(0);
+					pool.run(count, [&](int task, int worker) {
+						runs[task]++;
+						if (worker < 0 || worker >= threads)
+							bad_worker++;
+					});
+					int wrong = -1;
+					for (int i = 0; i < count && wrong < 0; i++) {
+						if (runs[i] != 1)
+							wrong = i;
+					}
+					expect(wrong < 0, format("pool %d, %d tasks: task %d ran %d times", threads, count, wrong,
+						wrong < 0 ? 1 : runs[wrong].load()));
+					expect(bad_worker == 0, format("pool %d: worker index out of range", threads));
+				}
+				// 初始分配是连续的区间, 编号不减
+				int prev = 0;
+				bool ok = true;
+				for (int i = 0; i < count; i++) {
+					int w = pool.initial_worker(i, count);
+					ok = ok && w >= prev && w < threads;
+					prev = w;
+				}
+				expect(ok, format("pool %d, %d tasks: initial workers are not contiguous ranges", threads, count));
+			}
+		}
+
+		// 在工作线程里再调用 run: 在当前线程顺序执行完, 不会死锁
+		ThreadPool pool(3);
+		std::atomic<int> inner(0);
+		pool.run(6, [&](int, int) {
+			pool.run(10, [&](int, int) { inner++; });
+		});
+		expect(inner == 60, format("nested run executed %d of 60 inner tasks", inner.load()));
+	}
+
+	// 一张奇数尺寸的三通道图
+	struct Image {
+		int width;
+		int height;
+		std::vector<float> data;
+		ImageView view;
+
+		Image(int w, int h, unsigned int seed) : width(w), height(h), data((size_t)w * h * 3)
+		{
+			std::mt19937 rng(seed);
+			std::uniform_real_distribution<float> dist(-0.25f, 1.25f);
+			for (float& v : data)
+				v = dist(rng);
+			view.width = w;
+			view.height = h;
+			view.channels = 3;
+			view.stride = w;
+			for (int c = 0; c < 3; c++)
+				view.planes[c] = data.data() + (size_t)w * h * c;
+		}
+	};
+
+	// 逐行调用内核, 整行一次
+	void blend_by_rows(const Image& dst, const Image& a, const Image& b, int mode, const BlendImageOptions& opts)
+	{
+		ImageKernels k;
+		k.init(mode, opts.parity8, opts.math, opts.soft_light);
+		for (int y = 0; y < dst.height; y++) {
+			const float* pa[3];
+			const float* pb[3];
+			float* po[3];
+			for (int c = 0; c < 3; c++) {
+				pa[c] = a.view.row(c, y);
+				pb[c] = b.view.row(c, y);
+				po[c] = dst.view.row(c, y);
+			}
+			k.blend_row(pa, pb, po, 3, dst.width, 0, y, opts.dissolve);
+		}
+	}
+
+	void test_blend_image()
+	{
+		const int w = 301, h = 77;
+		Image a(w, h, 1), b(w, h, 2), ref(w, h, 3), out(w, h, 4);
+		const int modes[] = { Multiply, ColorBurn, SoftLight, VividLight, Hue, Luminosity, Dissolve };
+		const int tiles[][2] = { { 0, 0 }, { 1, 1 }, { 7, 5 }, { 64, 16 }, { 1000, 1000 } };
+		for (int threads : { 1, 3 }) {
+			ThreadPool pool(threads);
+			for (int mode : modes) {
+				for (int parity8 = 0; parity8 < 2; parity8++) {
+					BlendImageOptions opts;
+					opts.pool = &pool;
+					opts.parity8 = parity8 != 0;
+					opts.math = MathClamped;
+					opts.dissolve.seed = 11;
+					blend_by_rows(ref, a, b, mode, opts);
+					for (const int* t : tiles) {
+						opts.tile_width = t[0];
+						opts.tile_height = t[1];
+						bool ok = blend_image(out.view, a.view, b.view, mode, opts);
+						int diff = -1;
+						for (int c = 0; c < 3 && diff < 0; c++)
+							diff = first_diff(ref.view.planes[c], out.view.planes[c], w * h);
+						expect(ok && diff < 0, format("%s%s, %d threads, %dx%d tiles: differs from per-row blending at %d",
+							blendModeNames[mode], parity8 ? " (8-bit)" : "", threads, t[0], t[1], diff));
+					}
+				}
+			}
+		}
+
+		// 输出和 A 是同一张图
+		BlendImageOptions opts;
+		Image in_place(w, h, 1);
+		blend_by_rows(ref, a, b, Overlay, opts);
+		blend_image(in_place.view, in_place.view, b.view, Overlay, opts);
+		int diff = first_diff(ref.data.data(), in_place.data.data(), (int)ref.data.size());
+		expect(diff < 0, format("in-place blend_image differs at %d", diff));
+
+		// 尺寸不一致: 返回 false, 不写输出
+		Image small(w - 1, h, 5);
+		std::vector<float> before = small.data;
+		expect(!blend_image(small.view, a.view, b.view, Multiply, opts), "blend_image accepted mismatched sizes");
+		expect(before == small.data, "blend_image wrote into a mismatched output");
+	}
+
+	void test_image_buffer()
+	{
+		ImageBuffer buf;
+		BlendImageOptions opts;
+		opts.tile_width = 40;
+		opts.tile_height = 7;
+		bool ok = buf.allocate(301, 77, 3, opts);
+		expect(ok, "ImageBuffer::allocate failed");
+		if (!ok)
+			return;
+		const ImageView& v = buf.view();
+		bool zero = v.stride >= 301 && v.stride % 16 == 0;
+		for (int c = 0; c < 3 && zero; c++) {
+			for (int y = 0; y < 77 && zero; y++) {
+				for (size_t x = 0; x < v.stride && zero; x++)
+					zero = v.row(c, y)[x] == 0.0f;
+			}
+		}
+		expect(zero, "ImageBuffer is not zero-filled up to the row stride");
+		expect(!buf.allocate(4, 4, kMaxImageChannels + 1, opts), "ImageBuffer accepted too many channels");
+	}
+}
+
+int main()
+{
+	test_pool();
+	test_blend_image();
+	test_image_buffer();
+	return test_result("psImageTests");
+}
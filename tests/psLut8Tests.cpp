@@ -0,0 +1,135 @@
+// ========================================
+// 8 位对齐模式 (psLut8.h): 表的内容是 Photoshop 的 8 位公式, 用手算的值和恒等式核对;
+// 行内核、常数 B 内核与直接查表的结果相同.
+// ========================================
+#include "psTest.h"
+#include "psLut8.h"
+
+namespace {
+	struct Known {
+		int mode;
+		int a, b;
+		int r;
+	};
+
+	// A 是下层, B 是上层; 右边的值按 round(公式 x 255) 手算
+	const Known known[] = {
+		{ Normal, 10, 200, 200 },
+		{ Multiply, 128, 128, 64 },        // 128 * 128 / 255 = 64.25
+		{ Multiply, 255, 77, 77 },
+		{ Screen, 128, 128, 192 },         // 255 - 127 * 127 / 255 = 191.75
+		{ Screen, 0, 77, 77 },
+		{ Darken, 30, 200, 30 },
+		{ Lighten, 30, 200, 200 },
+		{ ColorBurn, 255, 0, 255 },
+		{ ColorBurn, 100, 0, 0 },
+		{ ColorBurn, 100, 200, 57 },       // 255 - 155 * 255 / 200 = 57.375
+		{ LinearBurn, 100, 100, 0 },
+		{ LinearBurn, 200, 100, 45 },
+		{ ColorDodge, 0, 255, 0 },
+		{ ColorDodge, 100, 255, 255 },
+		{ ColorDodge, 100, 100, 165 },     // 100 * 255 / 155 = 164.52
+		{ LinearDodge, 200, 100, 255 },
+		{ LinearDodge, 20, 100, 120 },
+		{ Overlay, 64, 200, 100 },         // 2 * 64 * 200 / 255 = 100.39
+		{ Overlay, 200, 64, 173 },         // 255 - 2 * 55 * 191 / 255 = 172.61
+		{ HardLight, 64, 200, 173 },       // 255 - 2 * 191 * 55 / 255 = 172.61
+		{ HardLight, 200, 64, 100 },
+		{ SoftLight, 128, 255, 181 },      // sqrt(128 / 255) * 255 = 180.66
+		{ SoftLight, 128, 0, 64 },         // a^2 = 64.25
+		{ VividLight, 100, 255, 255 },
+		{ VividLight, 100, 0, 0 },
+		{ LinearLight, 100, 100, 45 },     // 100 + 200 - 255
+		{ LinearLight, 200, 200, 255 },
+		{ PinLight, 100, 30, 60 },
+		{ PinLight, 100, 200, 145 },
+		{ HardMix, 128, 127, 255 },        // A + B >= 255
+		{ HardMix, 128, 126, 0 },
+		{ Diference, 200, 50, 150 },
+		{ Exclusion, 255, 255, 0 },        // legacy 的 / 128 在这里是 2
+		{ Exclusion, 255, 0, 255 },
+		{ Exclusion, 128, 128, 127 },      // 2 * 128 * 127 / 255 = 127.498
+	};
+}
+
+int main()
+{
+	for (const Known& k : known) {
+		int r = photoshop8(k.mode, k.a, k.b);
+		expect(r == k.r, format("%s(%d, %d) = %d, expected %d", blendModeNames[k.mode], k.a, k.b, r, k.r));
+	}
+
+	// 恒等式, 对每个 8 位值
+	for (int x = 0; x < 256; x++) {
+		expect(photoshop8(Multiply, x, 255) == x && photoshop8(Multiply, x, 0) == 0, format("multiply identity at %d", x));
+		expect(photoshop8(Screen, x, 0) == x && photoshop8(Screen, x, 255) == 255, format("screen identity at %d", x));
+		expect(photoshop8(Diference, x, x) == 0, format("difference of %d with itself", x));
+		expect(photoshop8(Exclusion, x, 0) == x && photoshop8(Exclusion, x, 255) == 255 - x, format("exclusion identity at %d", x));
+		expect(photoshop8(Overlay, x, 128) == photoshop8(HardLight, 128, x), format("overlay is hard light swapped at %d", x));
+		for (int y = 0; y < 256; y++) {
+			if (photoshop8(HardMix, x, y) != (x + y >= 255 ? 255 : 0)) {
+				expect(false, format("hard mix(%d, %d)", x, y));
+				break;
+			}
+		}
+	}
+
+	// 表、行内核、常数 B 内核与 photoshop8 一致
+	std::vector<float> a(256), b(256), out(256);
+	for (int mode = Normal; mode < Dissolve; mode++) {
+		if (blend_mode_kind(mode) != asValueBlend)
+			continue;
+		const unsigned char* table = lut8_table(mode);
+		bool ok = table != NULL;
+		for (int qa = 0; qa < 256 && ok; qa++) {
+			for (int qb = 0; qb < 256 && ok; qb++)
+				ok = table[(qa << 8) | qb] == photoshop8(mode, qa, qb);
+		}
+		expect(ok, format("%s: table differs from photoshop8", blendModeNames[mode]));
+
+		RowKernel row = lut8_row_kernel(mode);
+		ConstRowKernel konst = lut8_const_row_kernel(mode);
+		for (int qb = 0; qb < 256; qb += 17) {
+			for (int i = 0; i < 256; i++) {
+				a[i] = i / 255.0f;
+				b[i] = qb / 255.0f;
+			}
+			row(a.data(), b.data(), out.data(), 256);
+			int bad = -1;
+			for (int i = 0; i < 256 && bad < 0; i++) {
+				if (!same(out[i], photoshop8(mode, i, qb) / 255.0f))
+					bad = i;
+			}
+			expect(bad < 0, format("%s: row kernel at a=%d b=%d", blendModeNames[mode], bad, qb));
+			std::vector<float> c(256);
+			konst(a.data(), b[0], c.data(), 256);
+			int i = first_diff(out.data(), c.data(), 256);
+			expect(i < 0, format("%s: constant B %d differs from the row kernel at %d", blendModeNames[mode], qb, i));
+		}
+	}
+
+	// 颜色模式只量化输入输出: 结果都落在 256 级上
+	Planes in;
+	OutPlanes o;
+	const float* pa[3] = { in.a[0].data(), in.a[1].data(), in.a[2].data() };
+	const float* pb[3] = { in.b[0].data(), in.b[1].data(), in.b[2].data() };
+	for (int mode = Normal; mode < Dissolve; mode++) {
+		if (blend_mode_kind(mode) != asColorBlend)
+			continue;
+		expect(lut8_table(mode) == NULL, format("%s: color mode has a table", blendModeNames[mode]));
+		lut8_color_row_kernel(mode)(pa, pb, o.p, kWidth);
+		int bad = -1;
+		for (int c = 0; c < 3 && bad < 0; c++) {
+			for (int i = 0; i < kWidth && bad < 0; i++) {
+				if (!same(o.v[c][i], quantize8(o.v[c][i]) / 255.0f))
+					bad = i;
+			}
+		}
+		expect(bad < 0, format("%s: output not on the 8-bit grid at %d", blendModeNames[mode], bad));
+	}
+
+	// 量化: 四舍五入, 超出范围和 NaN 截到两端
+	expect(quantize8(0.5f) == 128 && quantize8(-1.0f) == 0 && quantize8(2.0f) == 255 && quantize8(NAN) == 0,
+		"quantize8 edges");
+	return test_result("psLut8Tests");
+}
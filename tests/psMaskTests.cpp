@@ -0,0 +1,145 @@
+// ========================================
+// 蒙版 / 不透明度的分段 (psMask.h): 各段首尾相接地覆盖整行, 照抄 A 的段权重全为 0 且够长,
+// 不插值的段权重全为 1; 按分段算出的结果与逐像素插值逐位相同.
+// ========================================
+#include "psTest.h"
+#include "psMask.h"
+
+namespace {
+	// 混合结果用 B 代替, 按分段处理一行, 返回混合过的像素数
+	int apply_spans(const float* w, const float* a, const float* b, float* o, int x0, int x1)
+	{
+		int blended = 0;
+		MaskSpan s;
+		for (int i = x0; i < x1; i = s.x1) {
+			next_mask_span(w, i, x1, &s);
+			if (s.kind == MaskSpanCopyA) {
+				std::copy(a + s.x0, a + s.x1, o + s.x0);
+				continue;
+			}
+			std::copy(b + s.x0, b + s.x1, o + s.x0);
+			if (s.kind == MaskSpanBlend)
+				mix_weighted(a + s.x0, o + s.x0, s.x1 - s.x0, w + s.x0);
+			blended += s.x1 - s.x0;
+		}
+		return blended;
+	}
+
+	// 每段的性质
+	bool check_spans(const float* w, int x0, int x1, std::string* why)
+	{
+		MaskSpan s;
+		for (int i = x0; i < x1; i = s.x1) {
+			next_mask_span(w, i, x1, &s);
+			if (s.x0 != i || s.x1 <= s.x0 || s.x1 > x1) {
+				*why = format("span [%d, %d) after %d", s.x0, s.x1, i);
+				return false;
+			}
+			int zeros = 0, longest = 0;
+			bool all_one = true;
+			for (int k = s.x0; k < s.x1; k++) {
+				zeros = w[k] <= 0.0f ? zeros + 1 : 0;
+				longest = std::max(longest, zeros);
+				all_one = all_one && w[k] == 1.0f;
+			}
+			if (s.kind == MaskSpanCopyA && (longest != s.x1 - s.x0 || (longest < kMinSkipRun && s.x1 != x1))) {
+				*why = format("copy span [%d, %d) is not a long zero run", s.x0, s.x1);
+				return false;
+			}
+			if (s.kind != MaskSpanCopyA && (longest >= kMinSkipRun || w[s.x1 - 1] <= 0.0f)) {
+				*why = format("blend span [%d, %d) holds a zero run of %d", s.x0, s.x1, longest);
+				return false;
+			}
+			if (s.kind == MaskSpanFull && !all_one) {
+				*why = format("full span [%d, %d) has weights below 1", s.x0, s.x1);
+				return false;
+			}
+		}
+		return true;
+	}
+
+	// 随机的权重行: 长短不一的 0 段、1 段和小数段
+	std::vector<float> random_weights(std::mt19937& rng, int n)
+	{
+		std::vector<float> w(n);
+		std::uniform_int_distribution<int> len(1, 40);
+		std::uniform_int_distribution<int> kind(0, 2);
+		std::uniform_real_distribution<float> frac(0.0f, 1.0f);
+		int i = 0;
+		while (i < n) {
+			int k = kind(rng);
+			for (int e = std::min(n, i + len(rng)); i < e; i++)
+				w[i] = k == 0 ? 0.0f : k == 1 ? 1.0f : frac(rng);
+		}
+		return w;
+	}
+
+	void test_random_rows()
+	{
+		std::mt19937 rng(4321);
+		std::uniform_real_distribution<float> dist(-0.5f, 1.5f);
+		std::vector<float> a(kWidth), b(kWidth), o(kWidth), ref(kWidth);
+		for (int i = 0; i < kWidth; i++) {
+			a[i] = dist(rng);
+			b[i] = dist(rng);
+		}
+		for (int row = 0; row < 200; row++) {
+			std::vector<float> w = random_weights(rng, kWidth);
+			int x0 = row % 7, x1 = kWidth - row % 5;
+			std::string why;
+			bool ok = check_spans(w.data(), x0, x1, &why);
+			expect(ok, format("row %d: %s", row, why.c_str()));
+
+			// 逐像素插值
+			for (int i = x0; i < x1; i++)
+				ref[i] = w[i] <= 0.0f ? a[i] : w[i] < 1.0f ? a[i] + (b[i] - a[i]) * w[i] : b[i];
+			apply_spans(w.data(), a.data(), b.data(), o.data(), x0, x1);
+			int i = first_diff(ref.data() + x0, o.data() + x0, x1 - x0);
+			expect(i < 0, format("row %d: differs from per-pixel lerp at %d", row, i < 0 ? i : i + x0));
+		}
+	}
+
+	// 长的 0 段不混合, 短的跟着混合; 全 1 的段不插值
+	void test_layout()
+	{
+		std::vector<float> w(300, 1.0f);
+		std::fill(w.begin() + 100, w.begin() + 200, 0.0f);
+		std::fill(w.begin() + 250, w.begin() + 250 + kMinSkipRun - 1, 0.0f);
+		MaskSpan s[4];
+		int count = 0;
+		for (int i = 0; i < 300 && count < 4; i = s[count++].x1)
+			next_mask_span(w.data(), i, 300, &s[count]);
+		expect(count == 3 && s[0].kind == MaskSpanFull && s[0].x1 == 100 && s[1].kind == MaskSpanCopyA && s[1].x1 == 200
+			&& s[2].kind == MaskSpanBlend && s[2].x1 == 300, format("layout: %d spans, ends %d %d %d", count, s[0].x1, s[1].x1, s[2].x1));
+
+		std::vector<float> a(300, 0.25f), b(300, 0.75f), o(300);
+		int blended = apply_spans(w.data(), a.data(), b.data(), o.data(), 0, 300);
+		expect(blended == 200, format("layout: blended %d pixels, expected 200", blended));
+	}
+
+	void test_weights_and_trim()
+	{
+		float w[] = { 2.0f, -1.0f, NAN, 0.5f, 0.1f, 4.0f };
+		mask_weights(w, 6, 0.5f);
+		expect(w[0] == 1.0f && w[1] == 0.0f && w[2] == 0.0f && w[3] == 0.25f && w[4] == 0.05f && w[5] == 1.0f,
+			format("mask_weights: %g %g %g %g %g %g", w[0], w[1], w[2], w[3], w[4], w[5]));
+
+		float t[] = { 0.0f, 0.0f, 0.5f, 0.0f, 1.0f, 0.0f, 0.0f };
+		int x0 = 0, x1 = 7;
+		trim_mask_span(t, &x0, &x1);
+		expect(x0 == 2 && x1 == 5, format("trim: [%d, %d), expected [2, 5)", x0, x1));
+		float z[] = { 0.0f, 0.0f, 0.0f };
+		x0 = 0;
+		x1 = 3;
+		trim_mask_span(z, &x0, &x1);
+		expect(x0 == x1, format("trim of an all-zero row: [%d, %d)", x0, x1));
+	}
+}
+
+int main()
+{
+	test_random_rows();
+	test_layout();
+	test_weights_and_trim();
+	return test_result("psMaskTests");
+}
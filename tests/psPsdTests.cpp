@@ -0,0 +1,171 @@
+// ========================================
+// PSD 读取 (io/psPsd.h) 和拍平: 正常的文档读出正确的像素; 截断、尺寸过大或颠倒、
+// 通道长度回绕的文件在打开时拒绝; RLE 行字节数表不够的图层跳过并给出警告, 不越界读取.
+// ========================================
+#include "psTest.h"
+#include "io/psPsd.h"
+#include "io/psPsdFlatten.h"
+
+namespace {
+	// 在内存里拼出一个 4 x 4 的 8 位 RGB 文档, 一个图层, 三个通道, 写到临时文件再读
+	struct PsdBuilder {
+		std::vector<unsigned char> bytes;
+
+		void u8(unsigned int v) { bytes.push_back((unsigned char)v); }
+		void u16(unsigned int v) { u8(v >> 8); u8(v); }
+		void u32(uint32_t v) { u16(v >> 16); u16(v & 0xFFFF); }
+		void raw(const void* p, size_t n) { bytes.insert(bytes.end(), (const unsigned char*)p, (const unsigned char*)p + n); }
+	};
+
+	// 每个通道: 压缩方式 + payload; channel_len 是记录里写的长度 (含压缩方式的两个字节)
+	std::vector<unsigned char> make_psd(int top, int bottom, uint32_t channel_len, const std::vector<unsigned char>& payload)
+	{
+		const int w = 4, h = 4;
+		PsdBuilder info;
+		info.u16(1);  // 一个图层
+		info.u32(top);
+		info.u32(0);
+		info.u32(bottom);
+		info.u32(w);
+		info.u16(3);
+		for (int c = 0; c < 3; c++) {
+			info.u16(c);
+			info.u32(channel_len);
+		}
+		info.raw("8BIMnorm", 8);
+		info.u8(255);  // 不透明度
+		info.u8(0);
+		info.u8(0);
+		info.u8(0);
+		info.u32(12);  // 附加数据: 蒙版、混合颜色带、空的名字
+		info.u32(0);
+		info.u32(0);
+		info.u32(0);
+		for (int c = 0; c < 3; c++) {
+			info.u16(1);  // RLE
+			std::vector<unsigned char> data(payload);
+			data.resize(channel_len >= 2 && channel_len < 4096 ? channel_len - 2 : payload.size());
+			info.raw(data.data(), data.size());
+		}
+
+		PsdBuilder f;
+		f.raw("8BPS", 4);
+		f.u16(1);
+		f.raw("\0\0\0\0\0\0", 6);
+		f.u16(3);
+		f.u32(h);
+		f.u32(w);
+		f.u16(8);
+		f.u16(3);  // RGB
+		f.u32(0);  // 颜色模式数据
+		f.u32(0);  // 图像资源
+		f.u32((uint32_t)info.bytes.size() + 4);
+		f.u32((uint32_t)info.bytes.size());
+		f.raw(info.bytes.data(), info.bytes.size());
+		return f.bytes;
+	}
+
+	// 每行 4 个字节 10 20 30 40 (一个 literal 段), 前面是 4 行的字节数表
+	std::vector<unsigned char> rle_payload()
+	{
+		PsdBuilder p;
+		for (int y = 0; y < 4; y++)
+			p.u16(5);
+		for (int y = 0; y < 4; y++) {
+			static const unsigned char row[5] = { 3, 10, 20, 30, 40 };
+			p.raw(row, 5);
+		}
+		return p.bytes;
+	}
+
+	bool open_psd(const std::vector<unsigned char>& bytes, const char* name, PsdDocument* doc, std::string* err)
+	{
+		std::string path = std::string("psblend_tests_") + name + ".psd";
+		FILE* f = fopen(path.c_str(), "wb");
+		if (!f) {
+			expect(false, "cannot write " + path);
+			return false;
+		}
+		fwrite(bytes.data(), 1, bytes.size(), f);
+		fclose(f);
+		bool ok = doc->open(path, err);
+		remove(path.c_str());
+		return ok;
+	}
+
+	void test_psd()
+	{
+		std::vector<unsigned char> payload = rle_payload();
+		uint32_t len = (uint32_t)payload.size() + 2;
+
+		// 正常的文档能读出像素
+		{
+			PsdDocument doc;
+			std::string err;
+			bool ok = open_psd(make_psd(0, 4, len, payload), "valid", &doc, &err);
+			expect(ok, "valid PSD rejected: " + err);
+			if (ok) {
+				PsdFlattener flat(doc);
+				expect(flat.warnings().empty(), "valid PSD produced warnings");
+				std::vector<float> planes[4];
+				float* out[4];
+				for (int c = 0; c < 4; c++) {
+					planes[c].assign(16, -1.0f);
+					out[c] = planes[c].data();
+				}
+				flat.composite_band(0, 4, out);
+				expect(same(planes[0][0], 10 / 255.0f) && same(planes[1][3], 40 / 255.0f) && planes[3][15] == 1.0f,
+					format("valid PSD: got %g %g %g", planes[0][0], planes[1][3], planes[3][15]));
+			}
+		}
+		// 截断的文件
+		{
+			std::vector<unsigned char> bytes = make_psd(0, 4, len, payload);
+			for (size_t cut : { (size_t)10, (size_t)30, bytes.size() / 2, bytes.size() - 25, bytes.size() - 1 }) {
+				PsdDocument doc;
+				std::string err;
+				std::vector<unsigned char> part(bytes.begin(), bytes.begin() + cut);
+				expect(!open_psd(part, "truncated", &doc, &err), format("PSD truncated to %d bytes accepted", (int)cut));
+			}
+		}
+		// 很小的文件里 2,000,000 行的图层: 在分配和读行字节数表之前拒绝
+		{
+			PsdDocument doc;
+			std::string err;
+			expect(!open_psd(make_psd(0, 2000000, 4, payload), "huge", &doc, &err), "PSD with a 2,000,000-row layer accepted");
+			expect(!open_psd(make_psd(100, 0, 4, payload), "inverted", &doc, &err), "PSD with bottom < top accepted");
+		}
+		// 通道长度接近 4GB: 位置加长度会回绕
+		{
+			PsdDocument doc;
+			std::string err;
+			expect(!open_psd(make_psd(0, 4, 0xFFFFFFF0u, payload), "wrap", &doc, &err), "PSD with a wrapping channel length accepted");
+		}
+		// RLE 的行字节数表比图层的行数短: 图层跳过, 不读表外的数据
+		{
+			PsdDocument doc;
+			std::string err;
+			std::vector<unsigned char> short_table(payload.begin(), payload.begin() + 4);
+			bool ok = open_psd(make_psd(0, 4, 6, short_table), "short_rle", &doc, &err);
+			expect(ok, "PSD with a short RLE table rejected at open: " + err);
+			if (ok) {
+				PsdFlattener flat(doc);
+				expect(flat.warnings().size() == 1, "short RLE table: layer not skipped with a warning");
+				std::vector<float> planes[4];
+				float* out[4];
+				for (int c = 0; c < 4; c++) {
+					planes[c].assign(16, -1.0f);
+					out[c] = planes[c].data();
+				}
+				flat.composite_band(0, 4, out);
+				expect(planes[3][0] == 0.0f, "short RLE table: skipped layer still composited");
+			}
+		}
+	}
+}
+
+int main()
+{
+	test_psd();
+	return test_result("psPsdTests");
+}
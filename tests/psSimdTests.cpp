@@ -0,0 +1,35 @@
+// ========================================
+// 各指令集的行内核与标量版本逐位相同: 每种模式 (可分离和颜色模式) x 每种数值域.
+// 输入里有 0..1 以外的值和超出范围的灰色, 这些情况下也必须一致. 只测本机支持的指令集.
+// ========================================
+#include "psTest.h"
+
+int main()
+{
+	Planes p;
+	OutPlanes ref, out;
+	const float* a[3] = { p.a[0].data(), p.a[1].data(), p.a[2].data() };
+	const float* b[3] = { p.b[0].data(), p.b[1].data(), p.b[2].data() };
+	for (int mode = Normal; mode < Dissolve; mode++) {
+		bool color = blend_mode_kind(mode) == asColorBlend;
+		for (int math = MathLegacy; math <= MathHdr; math++) {
+			if (color)
+				color_row_kernel(mode, (BlendMath)math, SimdScalar)(a, b, ref.p, kWidth);
+			else
+				value_row_kernel(mode, (BlendMath)math, SimdScalar)(a[0], b[0], ref.p[0], kWidth);
+			for (SimdLevel level : vector_levels()) {
+				if (color)
+					color_row_kernel(mode, (BlendMath)math, level)(a, b, out.p, kWidth);
+				else
+					value_row_kernel(mode, (BlendMath)math, level)(a[0], b[0], out.p[0], kWidth);
+				for (int c = 0; c < (color ? 3 : 1); c++) {
+					int i = first_diff(ref.p[c], out.p[c], kWidth);
+					expect(i < 0, format("%s / %s / %s: channel %d differs from scalar at %d (%g vs %g)",
+						blendModeNames[mode], blendMathNames[math], simd_level_name(level), c, i,
+						i < 0 ? 0.0 : ref.p[c][i], i < 0 ? 0.0 : out.p[c][i]));
+				}
+			}
+		}
+	}
+	return test_result("psSimdTests");
+}
@@ -0,0 +1,65 @@
+// ========================================
+// 柔光的 accurate 版本 (psSoftLight.inl): 各指令集与标量逐位相同, 结果有限;
+// 0..1 的输入上与精确版本只差舍入 (头注释写的上限约 7e-7).
+// ========================================
+#include "psTest.h"
+
+namespace {
+	// 各指令集与标量相同, 结果有限, 常数 B 的内核与普通内核相同
+	void test_kernels(const Planes& p)
+	{
+		std::vector<float> ref(kWidth), out(kWidth), bb(kWidth);
+		const float* a = p.a[0].data();
+		const float* b = p.b[0].data();
+		for (int math = MathLegacy; math <= MathHdr; math++) {
+			for (int precision = SoftLightExact; precision <= SoftLightAccurate; precision++) {
+				const char* what = softLightPrecisionNames[precision];
+				soft_light_row_kernel((BlendMath)math, (SoftLightPrecision)precision, SimdScalar)(a, b, ref.data(), kWidth);
+				int i = first_non_finite(ref.data(), kWidth);
+				expect(i < 0, format("soft light %s / %s: %g at a=%g b=%g is not finite", what, blendMathNames[math],
+					i < 0 ? 0.0 : ref[i], i < 0 ? 0.0 : a[i], i < 0 ? 0.0 : b[i]));
+				for (SimdLevel level : vector_levels()) {
+					soft_light_row_kernel((BlendMath)math, (SoftLightPrecision)precision, level)(a, b, out.data(), kWidth);
+					i = first_diff(ref.data(), out.data(), kWidth);
+					expect(i < 0, format("soft light %s / %s / %s: differs from scalar at %d", what,
+						blendMathNames[math], simd_level_name(level), i));
+				}
+				// 常数 B, 两段各一个
+				for (float k : { 0.3f, 0.9f }) {
+					std::fill(bb.begin(), bb.end(), k);
+					soft_light_row_kernel((BlendMath)math, (SoftLightPrecision)precision, SimdScalar)(a, bb.data(), ref.data(), kWidth);
+					soft_light_const_row_kernel(k, (BlendMath)math, (SoftLightPrecision)precision)(a, k, out.data(), kWidth);
+					i = first_diff(ref.data(), out.data(), kWidth);
+					expect(i < 0, format("soft light %s / %s: constant B %g differs at %d", what, blendMathNames[math], k, i));
+				}
+			}
+		}
+	}
+
+	void test_accuracy()
+	{
+		std::mt19937 rng(5);
+		std::uniform_real_distribution<float> dist(0.0f, 1.0f);
+		std::vector<float> a(kWidth), b(kWidth), exact(kWidth), accurate(kWidth);
+		for (int i = 0; i < kWidth; i++) {
+			a[i] = dist(rng);
+			b[i] = dist(rng);
+		}
+		for (int math = MathLegacy; math <= MathHdr; math++) {
+			soft_light_row_kernel((BlendMath)math, SoftLightExact)(a.data(), b.data(), exact.data(), kWidth);
+			soft_light_row_kernel((BlendMath)math, SoftLightAccurate)(a.data(), b.data(), accurate.data(), kWidth);
+			float worst = 0.0f;
+			for (int i = 0; i < kWidth; i++)
+				worst = std::max(worst, std::fabs(exact[i] - accurate[i]));
+			expect(worst <= 1e-6f, format("soft light accurate / %s: %g off exact", blendMathNames[math], worst));
+		}
+	}
+}
+
+int main()
+{
+	Planes p;
+	test_kernels(p);
+	test_accuracy();
+	return test_result("psSoftLightTests");
+}
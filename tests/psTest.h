@@ -0,0 +1,150 @@
+// ========================================
+// 回归测试共用的小工具: 失败计数、逐位比较、随机的输入平面.
+// 每个 tests/*.cpp 是一个独立的可执行文件, 由 ctest 运行 (CMakeLists.txt 的 psblend_add_test).
+// 每条不符的情况打印一行, test_result 在有失败时返回 1.
+//
+//   int main()
+//   {
+//       expect(x == 1, format("x is %d", x));
+//       return test_result("psExprTests");
+//   }
+// ========================================
+#pragma once
+
+#include <algorithm>
+#include <cmath>
+#include <cstdarg>
+#include <cstdint>
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <string>
+#include <vector>
+#include "psBlend.h"
+
+namespace {
+	using namespace photoshopMergeTool;
+
+	int& failure_count()
+	{
+		static int n = 0;
+		return n;
+	}
+
+	void expect(bool ok, const std::string& what)
+	{
+		if (ok)
+			return;
+		if (++failure_count() <= 50)
+			fprintf(stderr, "FAIL: %s\n", what.c_str());
+	}
+
+	std::string format(const char* fmt, ...)
+	{
+		char buf[256];
+		va_list args;
+		va_start(args, fmt);
+		vsnprintf(buf, sizeof(buf), fmt, args);
+		va_end(args);
+		return buf;
+	}
+
+	int test_result(const char* name)
+	{
+		if (failure_count()) {
+			printf("%s: %d failures\n", name, failure_count());
+			return 1;
+		}
+		printf("%s: all passed (%s)\n", name, simd_level_name(simd_level()));
+		return 0;
+	}
+
+	// 逐位相同, 两边都是 NaN 也算相同
+	bool same(float x, float y)
+	{
+		return memcmp(&x, &y, sizeof(float)) == 0 || (std::isnan(x) && std::isnan(y));
+	}
+
+	// 第一个不相同的位置, 都相同时返回 -1
+	int first_diff(const float* x, const float* y, int n)
+	{
+		for (int i = 0; i < n; i++) {
+			if (!same(x[i], y[i]))
+				return i;
+		}
+		return -1;
+	}
+
+	int first_non_finite(const float* x, int n)
+	{
+		for (int i = 0; i < n; i++) {
+			if (!std::isfinite(x[i]))
+				return i;
+		}
+		return -1;
+	}
+
+	// 本机支持的向量指令集, 不含标量
+	std::vector<SimdLevel> vector_levels()
+	{
+		std::vector<SimdLevel> levels;
+		for (int l = SimdSSE41; l <= simd_level(); l++)
+			levels.push_back((SimdLevel)l);
+		return levels;
+	}
+
+	// 行宽不是任何向量宽度的倍数, 尾部的标量处理也会测到
+	const int kWidth = 1037;
+
+	// 0..1 内外的随机值, 开头放一段边界值; 颜色通道每 5 个像素有一个灰色, 超出范围的灰色是 HSL 模式的特殊情况
+	struct Planes {
+		std::vector<float> a[3];
+		std::vector<float> b[3];
+
+		Planes()
+		{
+			static const float edges[] = { 0.0f, 1.0f, 0.5f, -0.0f, 1e-30f, -1.0f, 2.0f, 10.0f, -0.1f, 1.5f, 0.25f, 0.75f };
+			const int ne = (int)(sizeof(edges) / sizeof(edges[0]));
+			std::mt19937 rng(1234);
+			std::uniform_real_distribution<float> dist(-0.5f, 1.5f);
+			for (int c = 0; c < 3; c++) {
+				a[c].resize(kWidth);
+				b[c].resize(kWidth);
+				for (int i = 0; i < kWidth; i++) {
+					a[c][i] = dist(rng);
+					b[c][i] = dist(rng);
+				}
+				// 每对边界值都出现一次
+				for (int i = 0; i < ne * ne; i++) {
+					a[c][i] = edges[i / ne];
+					b[c][i] = edges[i % ne];
+				}
+			}
+			for (int i = ne * ne; i + 2 < kWidth; i += 5) {
+				a[1][i] = a[2][i] = a[0][i];
+				b[1][i + 2] = b[2][i + 2] = b[0][i + 2];
+			}
+			// 超出范围的灰色 A 配灰色 B
+			for (int c = 0; c < 3; c++) {
+				a[c][ne * ne] = 2.0f;
+				b[c][ne * ne] = 0.5f;
+				a[c][ne * ne + 1] = -1.0f;
+				b[c][ne * ne + 1] = 0.5f;
+			}
+		}
+	};
+
+	// 三个通道的输出平面
+	struct OutPlanes {
+		std::vector<float> v[3];
+		float* p[3];
+
+		OutPlanes()
+		{
+			for (int c = 0; c < 3; c++) {
+				v[c].resize(kWidth);
+				p[c] = v[c].data();
+			}
+		}
+	};
+}
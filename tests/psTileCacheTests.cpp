@@ -0,0 +1,167 @@
+// ========================================
+// tile 结果缓存 (psTileCache.h): 内容哈希的标量与 SSE2 路径逐位相同, LRU 的淘汰顺序、字节上限和统计.
+// ========================================
+#include "psTest.h"
+#include "psTileCache.h"
+
+namespace {
+	TileKey key_at(int x)
+	{
+		TileKey k;
+		k.a = 1;
+		k.b = 2;
+		k.params = 3;
+		k.x = x;
+		k.y = 0;
+		k.width = 4;
+		k.height = 4;
+		k.channels = 1;
+		return k;
+	}
+
+	// n 个 float, 都是 value
+	TileData tile(size_t n, float value)
+	{
+		return TileData(n, value);
+	}
+
+	bool cached(TileCache& cache, int x)
+	{
+		return (bool)cache.find(key_at(x));
+	}
+
+	// 长度跨过条 (64 字节) 和块 (1KB) 的边界, 起点不对齐; 两条路径都与长度、偏移、seed 一起变化
+	void test_hash_paths()
+	{
+		std::vector<unsigned char> data(4096 + 16);
+		std::mt19937 rng(99);
+		for (size_t i = 0; i < data.size(); i++)
+			data[i] = (unsigned char)rng();
+		static const uint64_t seeds[] = { 0, 1, 0x9E3779B97F4A7C15ull, ~0ull };
+		static const size_t longs[] = { 1023, 1024, 1025, 2047, 2048, 2111, 3000, 4096 };
+		std::vector<size_t> lens;
+		for (size_t n = 0; n <= 320; n++)
+			lens.push_back(n);
+		lens.insert(lens.end(), longs, longs + sizeof(longs) / sizeof(longs[0]));
+		for (uint64_t seed : seeds) {
+			for (size_t n : lens) {
+				for (int off = 0; off < 8; off++) {
+					const unsigned char* p = data.data() + off;
+					uint64_t scalar = hash_bytes(p, n, seed, SimdScalar);
+					uint64_t vector = hash_bytes(p, n, seed, SimdSSE41);
+					uint64_t dflt = hash_bytes(p, n, seed);
+					expect(scalar == vector && scalar == dflt,
+						format("hash of %d bytes at +%d, seed %llx: scalar %llx, sse2 %llx, default %llx", (int)n, off,
+							(unsigned long long)seed, (unsigned long long)scalar, (unsigned long long)vector, (unsigned long long)dflt));
+				}
+			}
+		}
+	}
+
+	// 改一个字节、交换两条数据、换 seed 或长度, 哈希都要变
+	void test_hash_sensitivity()
+	{
+		std::vector<unsigned char> data(2500);
+		for (size_t i = 0; i < data.size(); i++)
+			data[i] = (unsigned char)(i * 7 + 3);
+		for (int level = SimdScalar; level <= SimdSSE41; level++) {
+			SimdLevel l = (SimdLevel)level;
+			uint64_t h = hash_bytes(data.data(), data.size(), 0, l);
+			expect(h != hash_bytes(data.data(), data.size(), 1, l), format("%s: seed does not change the hash", simd_level_name(l)));
+			expect(h != hash_bytes(data.data(), data.size() - 1, 0, l), format("%s: length does not change the hash", simd_level_name(l)));
+			static const size_t flips[] = { 0, 63, 64, 1023, 1024, 2047, 2400, 2499 };
+			for (size_t i : flips) {
+				std::vector<unsigned char> d = data;
+				d[i] ^= 1;
+				expect(h != hash_bytes(d.data(), d.size(), 0, l), format("%s: flipping byte %d does not change the hash", simd_level_name(l), (int)i));
+			}
+			std::vector<unsigned char> swapped = data;
+			std::swap_ranges(swapped.begin(), swapped.begin() + 64, swapped.begin() + 64);
+			expect(h != hash_bytes(swapped.data(), swapped.size(), 0, l), format("%s: swapping two stripes does not change the hash", simd_level_name(l)));
+		}
+	}
+
+	void test_lru()
+	{
+		// 每个 tile 16 个 float = 64 字节, 上限放得下 3 个
+		TileCache cache(3 * 64);
+		cache.insert(key_at(0), tile(16, 0.0f));
+		cache.insert(key_at(1), tile(16, 1.0f));
+		cache.insert(key_at(2), tile(16, 2.0f));
+		// 用到 0, 最久没用的变成 1
+		expect(cached(cache, 0), "lru: tile 0 missing");
+		cache.insert(key_at(3), tile(16, 3.0f));
+		expect(!cached(cache, 1), "lru: tile 1 was not evicted");
+		expect(cached(cache, 0) && cached(cache, 2) && cached(cache, 3), "lru: a recently used tile was evicted");
+
+		TileCacheStats s = cache.stats();
+		expect(s.tiles == 3 && s.bytes == 3 * 64 && s.evictions == 1,
+			format("lru stats: %d tiles, %d bytes, %d evictions", (int)s.tiles, (int)s.bytes, (int)s.evictions));
+		expect(s.hits == 4 && s.misses == 1, format("lru stats: %d hits, %d misses", (int)s.hits, (int)s.misses));
+
+		// 一个大 tile 挤掉最久没用的两个 (0, 2 之后用过 3)
+		cache.find(key_at(3));
+		cache.insert(key_at(4), tile(32, 4.0f));
+		s = cache.stats();
+		expect(s.tiles == 2 && s.bytes == 3 * 64 && s.evictions == 3,
+			format("big insert: %d tiles, %d bytes, %d evictions", (int)s.tiles, (int)s.bytes, (int)s.evictions));
+		expect(cached(cache, 3) && cached(cache, 4) && !cached(cache, 0) && !cached(cache, 2), "big insert: wrong tiles evicted");
+
+		std::shared_ptr<const TileData> hit = cache.find(key_at(4));
+		expect(hit && hit->size() == 32 && (*hit)[31] == 4.0f, "find returns the inserted data");
+		// 被淘汰后返回的数据仍然有效
+		cache.insert(key_at(5), tile(48, 5.0f));
+		expect(!cached(cache, 4) && hit->size() == 32 && (*hit)[0] == 4.0f, "data outlives its eviction");
+	}
+
+	void test_limits()
+	{
+		TileCache cache(256);
+		expect(cache.max_bytes() == 256, "max_bytes");
+
+		// 比上限还大的 tile 不存, 也不挤掉已有的
+		cache.insert(key_at(0), tile(16, 0.0f));
+		cache.insert(key_at(1), tile(65, 1.0f));
+		TileCacheStats s = cache.stats();
+		expect(!cached(cache, 1) && cached(cache, 0) && s.tiles == 1 && s.bytes == 64 && s.evictions == 0,
+			format("too big: %d tiles, %d bytes, %d evictions", (int)s.tiles, (int)s.bytes, (int)s.evictions));
+		// 正好等于上限的可以存
+		cache.insert(key_at(2), tile(64, 2.0f));
+		s = cache.stats();
+		expect(cached(cache, 2) && !cached(cache, 0) && s.bytes == 256, format("exactly the cap: %d bytes", (int)s.bytes));
+
+		// 同一个键保留旧的
+		cache.insert(key_at(2), tile(16, 9.0f));
+		std::shared_ptr<const TileData> hit = cache.find(key_at(2));
+		expect(hit && hit->size() == 64 && (*hit)[0] == 2.0f, "insert replaced an existing entry");
+		s = cache.stats();
+		expect(s.tiles == 1 && s.bytes == 256, format("duplicate insert: %d tiles, %d bytes", (int)s.tiles, (int)s.bytes));
+
+		// 键的每个字段都参与比较
+		TileKey k = key_at(2);
+		k.channels = 2;
+		expect(!cache.find(k), "a key with different channels hits");
+		k = key_at(2);
+		k.params = 4;
+		expect(!cache.find(k), "a key with different params hits");
+
+		cache.clear();
+		s = cache.stats();
+		expect(s.tiles == 0 && s.bytes == 0 && !cached(cache, 2), format("clear: %d tiles, %d bytes", (int)s.tiles, (int)s.bytes));
+		cache.insert(key_at(3), tile(64, 3.0f));
+		expect(cached(cache, 3), "insert after clear");
+
+		TileCache none(0);
+		none.insert(key_at(0), tile(1, 0.0f));
+		expect(!cached(none, 0) && none.stats().tiles == 0, "a zero-byte cache stores nothing");
+	}
+}
+
+int main()
+{
+	test_hash_paths();
+	test_hash_sensitivity();
+	test_lru();
+	test_limits();
+	return test_result("psTileCacheTests");
+}
@@ -0,0 +1,525 @@
+// ========================================
+// psblend_batch: 不开 Nuke, 批量把两组浮点图像按一种模式叠起来.
+// 输入输出都是内存映射的 PFM 或 raw 平面文件, 一行一行地读, 混合, 写回,
+// 每帧只占几行的缓冲, 几千帧 4K 序列也不会整帧 / 整段载入内存.
+// 多个线程各自领帧处理, 帧之间互不相干.
+//
+//   psblend_batch --mode multiply --a a.%04d.pfm --b b.%04d.pfm --out out.%04d.pfm
+//                 [--frames 1-1000] [--threads N] [--raw WxHxC]
+//                 [--math legacy|clamped|hdr] [--soft-light exact|accurate] [--expr <formula>]
+//                 [--parity8] [--dissolve 0.5] [--seed 0] [--reuse] [--cache-mb 512] [--quiet]
+// 文件名里的 %04d 或 #### 换成帧号; B 没有帧号时每帧都用同一张.
+// .pfm 以外的文件都按 raw 处理, 读 raw 需要 --raw 给出尺寸, 输出格式跟着输出文件名走.
+// 颜色模式只混合前三个通道, 其它通道照抄 A (与节点一致).
+// 场景线性的序列用 --math hdr, 大于 1 的高光不会被截掉.
+// --soft-light accurate 让柔光快一倍左右, 只差舍入.
+// --mode custom 用 --expr 给的公式 (语法见 psExpr.h), 启动时编译一次, 所有帧共用.
+// --reuse 按 256 x 16 的 tile 记住混合过的结果 (psTileCache.h), A / B 的内容与之前某帧相同的 tile
+// 直接复制, 不再混合; 所有线程共用一个最多 --cache-mb 兆的缓存. B 没有帧号时它的哈希只算一次,
+// 之后的帧只在有 tile 没命中时才读 B. 静止的叠加层和定格基本只剩读 A 和写输出.
+// 溶解的结果每帧都不同, 不走缓存.
+// ========================================
+#include <algorithm>
+#include <atomic>
+#include <cctype>
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <mutex>
+#include <string>
+#include <thread>
+#include <vector>
+#include "psBlend.h"
+#include "psExpr.h"
+#include "psImage.h"
+#include "psTileCache.h"
+#include "io/psImageIO.h"
+
+using namespace photoshopMergeTool;
+
+namespace {
+
+	struct Options {
+		int mode;
+		std::string a;
+		std::string b;
+		std::string out;
+		int first;
+		int last;
+		int threads;
+		bool has_raw;
+		RawSpec raw;
+		BlendMath math;
+		SoftLightPrecision soft_light;
+		std::string expr;
+		bool parity8;
+		float dissolve;
+		unsigned int seed;
+		bool reuse;
+		size_t cache_mb;
+		bool quiet;
+	};
+
+	void usage()
+	{
+		fprintf(stderr,
+			"usage: psblend_batch --mode <mode> --a <A> --b <B> --out <OUT>\n"
+			"                     [--frames first-last] [--threads N] [--raw WxHxC]\n"
+			"                     [--math legacy|clamped|hdr] [--soft-light exact|accurate]\n"
+			"                     [--expr <formula>] [--parity8] [--dissolve 0.5] [--seed 0]\n"
+			"                     [--reuse] [--cache-mb 512] [--quiet]\n"
+			"  A / B / OUT: .pfm or raw planar float32, %%04d or #### is replaced by the frame\n");
+	}
+
+	int mode_from_name(const std::string& name)
+	{
+		for (int m = 0; blendModeNames[m]; m++) {
+			if (name == blendModeNames[m])
+				return m;
+		}
+		return -1;
+	}
+
+	int math_from_name(const std::string& name)
+	{
+		for (int m = 0; blendMathNames[m]; m++) {
+			if (name == blendMathNames[m])
+				return m;
+		}
+		return -1;
+	}
+
+	int soft_light_from_name(const std::string& name)
+	{
+		for (int p = 0; softLightPrecisionNames[p]; p++) {
+			if (name == softLightPrecisionNames[p])
+				return p;
+		}
+		return -1;
+	}
+
+	// 帧号的位置: %d、%0Nd 或一串 #, 得到起点、长度和补零的位数. 其它的 % 都当普通字符,
+	// 文件名不会被当成 printf 的格式
+	bool find_frame(const std::string& pattern, size_t* pos, size_t* len, int* digits)
+	{
+		for (size_t p = 0; p < pattern.size(); p++) {
+			if (pattern[p] == '#') {
+				size_t e = pattern.find_first_not_of('#', p);
+				if (e == std::string::npos)
+					e = pattern.size();
+				*pos = p;
+				*len = e - p;
+				*digits = (int)(e - p);
+				return true;
+			}
+			if (pattern[p] != '%')
+				continue;
+			size_t e = p + 1;
+			int n = 0;
+			if (e < pattern.size() && pattern[e] == '0') {
+				for (e++; e < pattern.size() && isdigit((unsigned char)pattern[e]) && n < 100; e++)
+					n = n * 10 + (pattern[e] - '0');
+				if (n == 0)
+					continue;
+			}
+			if (e < pattern.size() && pattern[e] == 'd' && n <= 16) {
+				*pos = p;
+				*len = e + 1 - p;
+				*digits = n;
+				return true;
+			}
+		}
+		return false;
+	}
+
+	bool has_frame(const std::string& pattern)
+	{
+		size_t pos, len;
+		int digits;
+		return find_frame(pattern, &pos, &len, &digits);
+	}
+
+	// a.%04d.pfm / a.####.pfm -> a.0012.pfm
+	std::string frame_path(const std::string& pattern, int frame)
+	{
+		size_t pos, len;
+		int digits;
+		if (!find_frame(pattern, &pos, &len, &digits))
+			return pattern;
+		char num[32];
+		snprintf(num, sizeof(num), "%0*d", digits, frame);
+		return pattern.substr(0, pos) + num + pattern.substr(pos + len);
+	}
+
+	bool parse_args(int argc, char** argv, Options* opt)
+	{
+		opt->mode = -1;
+		opt->first = opt->last = 0;
+		opt->threads = std::max(1, (int)std::thread::hardware_concurrency());
+		opt->has_raw = false;
+		opt->raw.width = opt->raw.height = opt->raw.channels = 0;
+		opt->math = MathLegacy;
+		opt->soft_light = SoftLightExact;
+		opt->parity8 = false;
+		opt->dissolve = 0.5f;
+		opt->seed = 0;
+		opt->reuse = false;
+		opt->cache_mb = 512;
+		opt->quiet = false;
+		bool frames = false;
+
+		for (int i = 1; i < argc; i++) {
+			std::string arg = argv[i];
+			if (arg == "--parity8") {
+				opt->parity8 = true;
+				continue;
+			}
+			if (arg == "--reuse") {
+				opt->reuse = true;
+				continue;
+			}
+			if (arg == "--quiet") {
+				opt->quiet = true;
+				continue;
+			}
+			if (i + 1 >= argc) {
+				usage();
+				return false;
+			}
+			const char* val = argv[++i];
+			if (arg == "--mode") {
+				opt->mode = mode_from_name(val);
+				if (opt->mode < 0) {
+					fprintf(stderr, "unknown mode '%s'\n", val);
+					return false;
+				}
+			}
+			else if (arg == "--math") {
+				int m = math_from_name(val);
+				if (m < 0) {
+					fprintf(stderr, "unknown math '%s'\n", val);
+					return false;
+				}
+				opt->math = (BlendMath)m;
+			}
+			else if (arg == "--soft-light") {
+				int p = soft_light_from_name(val);
+				if (p < 0) {
+					fprintf(stderr, "unknown soft light precision '%s'\n", val);
+					return false;
+				}
+				opt->soft_light = (SoftLightPrecision)p;
+			}
+			else if (arg == "--expr")
+				opt->expr = val;
+			else if (arg == "--a")
+				opt->a = val;
+			else if (arg == "--b")
+				opt->b = val;
+			else if (arg == "--out")
+				opt->out = val;
+			else if (arg == "--frames") {
+				frames = true;
+				if (sscanf(val, "%d-%d", &opt->first, &opt->last) != 2)
+					opt->last = opt->first = atoi(val);
+			}
+			else if (arg == "--threads")
+				opt->threads = std::max(1, atoi(val));
+			else if (arg == "--raw") {
+				opt->has_raw = sscanf(val, "%dx%dx%d", &opt->raw.width, &opt->raw.height, &opt->raw.channels) == 3;
+				if (!opt->has_raw) {
+					fprintf(stderr, "--raw expects WxHxC, got '%s'\n", val);
+					return false;
+				}
+			}
+			else if (arg == "--dissolve")
+				opt->dissolve = (float)atof(val);
+			else if (arg == "--seed")
+				opt->seed = (unsigned int)strtoul(val, NULL, 10);
+			else if (arg == "--cache-mb")
+				opt->cache_mb = (size_t)strtoul(val, NULL, 10);
+			else {
+				usage();
+				return false;
+			}
+		}
+		if (opt->mode < 0 || opt->a.empty() || opt->b.empty() || opt->out.empty()) {
+			usage();
+			return false;
+		}
+		if (opt->mode == Custom && opt->expr.empty()) {
+			fprintf(stderr, "--mode custom needs --expr\n");
+			return false;
+		}
+		if (opt->first > opt->last)
+			std::swap(opt->first, opt->last);
+		if (!frames && (has_frame(opt->a) || has_frame(opt->out))) {
+			fprintf(stderr, "frame patterns need --frames\n");
+			return false;
+		}
+		if (opt->last > opt->first && !has_frame(opt->out)) {
+			fprintf(stderr, "--out needs a frame pattern for more than one frame\n");
+			return false;
+		}
+		return true;
+	}
+
+	const int kReleaseRows = 64;
+
+	// 每个线程一份: A / B / 输出各 channels 个平面, 各一行宽
+	struct RowBuffers {
+		std::vector<float> storage;
+		std::vector<float*> a, b, out;
+
+		void resize(int width, int channels)
+		{
+			storage.resize((size_t)width * channels * 3);
+			a.resize(channels);
+			b.resize(channels);
+			out.resize(channels);
+			for (int c = 0; c < channels; c++) {
+				a[c] = storage.data() + (size_t)width * c;
+				b[c] = storage.data() + (size_t)width * (channels + c);
+				out[c] = storage.data() + (size_t)width * (2 * channels + c);
+			}
+		}
+	};
+
+	const int kReuseTileWidth = 256;
+	const int kReuseTileRows = 16;
+
+	// --reuse 时每个线程一份: 一段 kReuseTileRows 行的 A / B / 输出平面,
+	// 以及 B 没有帧号时各 tile 的哈希 (第一帧算好, 之后的帧共用)
+	struct BandBuffers {
+		std::vector<float> storage;
+		ImageView a, b, out;
+		std::vector<uint64_t> b_hash;
+		std::vector<char> b_known;
+
+		void resize(int width, int channels)
+		{
+			storage.resize((size_t)width * kReuseTileRows * channels * 3);
+			ImageView* views[3] = { &a, &b, &out };
+			for (int i = 0; i < 3; i++) {
+				ImageView& v = *views[i];
+				v.width = width;
+				v.height = kReuseTileRows;
+				v.channels = channels;
+				v.stride = width;
+				for (int c = 0; c < channels; c++)
+					v.planes[c] = storage.data() + (size_t)width * kReuseTileRows * (i * channels + c);
+			}
+		}
+	};
+
+	void read_band(const ScanlineImage& img, const ImageView& v, int y0, int rows)
+	{
+		float* planes[kMaxImageChannels];
+		for (int r = 0; r < rows; r++) {
+			for (int c = 0; c < v.channels; c++)
+				planes[c] = v.row(c, r);
+			img.read_row(y0 + r, planes);
+		}
+	}
+
+	bool process_frame(const Options& opt, const ImageKernels& k, RowBuffers& rb, int frame, std::string* err)
+	{
+		const RawSpec* spec = opt.has_raw ? &opt.raw : NULL;
+		ScanlineImage a, b, out;
+		std::string out_path = frame_path(opt.out, frame);
+		if (!a.open(frame_path(opt.a, frame), spec, err) || !b.open(frame_path(opt.b, frame), spec, err))
+			return false;
+		if (a.width() != b.width() || a.height() != b.height() || a.channels() != b.channels()) {
+			*err = out_path + ": A and B differ in size or channel count";
+			return false;
+		}
+		int width = a.width();
+		int channels = a.channels();
+		if (!out.create(out_path, format_from_path(out_path), width, a.height(), channels, err))
+			return false;
+		rb.resize(width, channels);
+		DissolveKey key;
+		key.frame = frame;
+		key.seed = opt.seed;
+		key.amount = opt.dissolve;
+		for (int y = 0; y < a.height(); y++) {
+			a.read_row(y, rb.a.data());
+			b.read_row(y, rb.b.data());
+			k.blend_row(rb.a.data(), rb.b.data(), rb.out.data(), channels, width, 0, y, key);
+			out.write_row(y, rb.out.data());
+			// 每处理完一段就释放, 常驻内存不随帧大小和线程数成倍增长
+			if ((y + 1) % kReleaseRows == 0 || y + 1 == a.height()) {
+				int y0 = y + 1 - ((y % kReleaseRows) + 1);
+				a.release_rows(y0, y + 1);
+				b.release_rows(y0, y + 1);
+				out.release_rows(y0, y + 1);
+			}
+		}
+		return true;
+	}
+
+	// --reuse: 按段读入, 每个 tile 先查缓存, 没命中才混合. 结果与 process_frame 逐位相同
+	bool process_frame_reuse(const Options& opt, const ImageKernels& k, TileCache& cache, BandBuffers& bb,
+		int frame, std::string* err)
+	{
+		const RawSpec* spec = opt.has_raw ? &opt.raw : NULL;
+		ScanlineImage a, b, out;
+		std::string out_path = frame_path(opt.out, frame);
+		if (!a.open(frame_path(opt.a, frame), spec, err) || !b.open(frame_path(opt.b, frame), spec, err))
+			return false;
+		if (a.width() != b.width() || a.height() != b.height() || a.channels() != b.channels()) {
+			*err = out_path + ": A and B differ in size or channel count";
+			return false;
+		}
+		int width = a.width();
+		int height = a.height();
+		int channels = a.channels();
+		if (channels > kMaxImageChannels) {
+			*err = out_path + ": --reuse supports at most 8 channels";
+			return false;
+		}
+		if (!out.create(out_path, format_from_path(out_path), width, height, channels, err))
+			return false;
+		bb.resize(width, channels);
+		DissolveKey key;
+		key.frame = frame;
+		key.seed = opt.seed;
+		key.amount = opt.dissolve;
+		uint64_t params = kernels_fingerprint(k, key);
+
+		int cols = (width + kReuseTileWidth - 1) / kReuseTileWidth;
+		int bands = (height + kReuseTileRows - 1) / kReuseTileRows;
+		bool static_b = !has_frame(opt.b);
+		if (static_b && bb.b_hash.size() != (size_t)cols * bands) {
+			bb.b_hash.assign((size_t)cols * bands, 0);
+			bb.b_known.assign((size_t)cols * bands, 0);
+		}
+		const float* pa[kMaxImageChannels];
+		const float* pb[kMaxImageChannels];
+		float* po[kMaxImageChannels];
+		for (int band = 0; band < bands; band++) {
+			int y0 = band * kReuseTileRows;
+			int rows = std::min(kReuseTileRows, height - y0);
+			read_band(a, bb.a, y0, rows);
+			bool b_loaded = false;
+			for (int col = 0; col < cols; col++) {
+				int x0 = col * kReuseTileWidth;
+				int n = std::min(kReuseTileWidth, width - x0);
+				size_t t = (size_t)band * cols + col;
+				uint64_t hb;
+				if (static_b && bb.b_known[t])
+					hb = bb.b_hash[t];
+				else {
+					if (!b_loaded)
+						read_band(b, bb.b, y0, rows);
+					b_loaded = true;
+					hb = hash_tile(bb.b, x0, 0, n, rows);
+					if (static_b) {
+						bb.b_hash[t] = hb;
+						bb.b_known[t] = 1;
+					}
+				}
+				TileKey tk = make_tile_key(k, params, hash_tile(bb.a, x0, 0, n, rows), hb, x0, y0, n, rows, channels);
+				std::shared_ptr<const TileData> hit = cache.find(tk);
+				if (hit) {
+					paste_tile(bb.out, x0, 0, n, rows, *hit);
+					continue;
+				}
+				if (!b_loaded)
+					read_band(b, bb.b, y0, rows);
+				b_loaded = true;
+				for (int r = 0; r < rows; r++) {
+					for (int c = 0; c < channels; c++) {
+						pa[c] = bb.a.row(c, r) + x0;
+						pb[c] = bb.b.row(c, r) + x0;
+						po[c] = bb.out.row(c, r) + x0;
+					}
+					k.blend_row(pa, pb, po, channels, n, x0, y0 + r, key);
+				}
+				cache.insert(tk, copy_tile(bb.out, x0, 0, n, rows));
+			}
+			for (int r = 0; r < rows; r++) {
+				for (int c = 0; c < channels; c++)
+					po[c] = bb.out.row(c, r);
+				out.write_row(y0 + r, po);
+			}
+			int y1 = y0 + rows;
+			if (y1 % kReleaseRows == 0 || y1 == height) {
+				int r0 = (y1 - 1) / kReleaseRows * kReleaseRows;
+				a.release_rows(r0, y1);
+				b.release_rows(r0, y1);
+				out.release_rows(r0, y1);
+			}
+		}
+		return true;
+	}
+}
+
+int main(int argc, char** argv)
+{
+	Options opt;
+	if (!parse_args(argc, argv, &opt))
+		return 2;
+
+	BlendExpr expr;
+	if (opt.mode == Custom) {
+		std::string err;
+		if (!expr.compile(opt.expr, &err)) {
+			fprintf(stderr, "--expr: %s\n", err.c_str());
+			return 2;
+		}
+	}
+	ImageKernels k;
+	k.init(opt.mode, opt.parity8, opt.math, opt.soft_light);
+	k.expr = opt.mode == Custom ? &expr : NULL;
+
+	TileCache cache(opt.cache_mb << 20);
+	bool reuse = opt.reuse && blend_mode_kind(opt.mode) != asDissolveBlend;
+
+	int count = opt.last - opt.first + 1;
+	int threads = std::min(opt.threads, count);
+	std::atomic<int> next(opt.first);
+	std::atomic<int> failed(0);
+	std::mutex print_lock;
+	auto start = std::chrono::steady_clock::now();
+
+	auto worker = [&]() {
+		RowBuffers rb;
+		BandBuffers bb;
+		for (;;) {
+			int frame = next.fetch_add(1);
+			if (frame > opt.last)
+				break;
+			std::string err;
+			bool ok = reuse ? process_frame_reuse(opt, k, cache, bb, frame, &err)
+				: process_frame(opt, k, rb, frame, &err);
+			std::lock_guard<std::mutex> guard(print_lock);
+			if (!ok) {
+				failed++;
+				fprintf(stderr, "frame %d: %s\n", frame, err.c_str());
+			}
+			else if (!opt.quiet)
+				printf("frame %d done\n", frame);
+		}
+	};
+	std::vector<std::thread> pool;
+	for (int t = 1; t < threads; t++)
+		pool.emplace_back(worker);
+	worker();
+	for (std::thread& t : pool)
+		t.join();
+
+	double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+	if (!opt.quiet)
+		printf("%d frames, %d failed, %s, %d threads, %.2f s\n",
+			count, failed.load(), simd_level_name(simd_level()), threads, seconds);
+	if (reuse && !opt.quiet) {
+		TileCacheStats st = cache.stats();
+		uint64_t total = st.hits + st.misses;
+		printf("reuse: %llu of %llu tiles (%.1f%%), %llu evicted, %.1f MB cached\n",
+			(unsigned long long)st.hits, (unsigned long long)total, total ? 100.0 * st.hits / total : 0.0,
+			(unsigned long long)st.evictions, st.bytes / 1048576.0);
+	}
+	return failed ? 1 : 0;
+}